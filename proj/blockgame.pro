@@ -1,8 +1,8 @@
 QT      -= core gui
 CONFIG  -= c++11
 
-QMAKE_CXXFLAGS += -std=c++17 -pedantic -Wall
-QMAKE_LFLAGS   += -std=c++17
+QMAKE_CXXFLAGS += -std=c++17 -pedantic -Wall -pthread
+QMAKE_LFLAGS   += -std=c++17 -pthread
 LIBS           += -lsfml-graphics -lsfml-window -lsfml-system -lksg -lcommon \
                   -lX11 \ # -ldiscord_game_sdk \
                   -L/usr/lib/x86_64-linux-gnu -L$$PWD/../lib/cul -L$$PWD/../lib/ksg
@@ -31,6 +31,10 @@ SOURCES += \
     ../src/Graphics.cpp \
     ../src/main.cpp \
     ../src/BlockAlgorithm.cpp \
+    ../src/BlockBitBoard.cpp \
+    ../src/BlockGroups.cpp \
+    ../src/ChainResolver.cpp \
+    ../src/PackedBlockGrid.cpp \
     ../src/EffectsFull.cpp \
     ../src/Defs.cpp \
     ../src/FallingPiece.cpp \
@@ -48,6 +52,20 @@ SOURCES += \
     ../src/PlayControl.cpp \
     ../src/WakefullnessUpdater.cpp \
     ../src/PuyoAiScript.cpp \
+    ../src/WorkStealingPool.cpp \
+    ../src/ZobristHash.cpp \
+    ../src/TranspositionTable.cpp \
+    ../src/TetrisAi.cpp \
+    ../src/SameGameSolver.cpp \
+    ../src/PuyoTournament.cpp \
+    ../src/PuyoAiTuner.cpp \
+    ../src/ColumnsPiece.cpp \
+    ../src/GameEngines.cpp \
+    ../src/Random.cpp \
+    ../src/Replay.cpp \
+    ../src/MappedFile.cpp \
+    ../src/PacketLink.cpp \
+    ../src/PuyoNetplay.cpp \
     ../src/ControlConfigurationDialog.cpp \
     ../unit-tests/test-driver.cpp \
     \ ##############################################################
@@ -70,6 +88,10 @@ HEADERS += \
     ../src/Graphics.hpp \
     ../src/Defs.hpp \
     ../src/BlockAlgorithm.hpp \
+    ../src/BlockBitBoard.hpp \
+    ../src/BlockGroups.hpp \
+    ../src/ChainResolver.hpp \
+    ../src/PackedBlockGrid.hpp \
     ../src/EffectsFull.hpp \
     ../src/FallingPiece.hpp \
     ../src/Polyomino.hpp \
@@ -86,7 +108,21 @@ HEADERS += \
     ../src/WakefullnessUpdater.hpp \
     ../src/PlayControl.hpp \
     ../src/ControlConfigurationDialog.hpp \
-    ../src/PuyoAiScript.hpp
+    ../src/PuyoAiScript.hpp \
+    ../src/WorkStealingPool.hpp \
+    ../src/ZobristHash.hpp \
+    ../src/TranspositionTable.hpp \
+    ../src/TetrisAi.hpp \
+    ../src/SameGameSolver.hpp \
+    ../src/PuyoTournament.hpp \
+    ../src/PuyoAiTuner.hpp \
+    ../src/ColumnsPiece.hpp \
+    ../src/GameEngines.hpp \
+    ../src/Random.hpp \
+    ../src/Replay.hpp \
+    ../src/MappedFile.hpp \
+    ../src/PacketLink.hpp \
+    ../src/PuyoNetplay.hpp
 
 INCLUDEPATH += \
     ../lib/cul/inc \
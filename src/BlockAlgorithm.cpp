@@ -20,34 +20,26 @@
 #include "BlockAlgorithm.hpp"
 
 #include <array>
+#include <stdexcept>
+#include <string>
+
+#ifdef __BMI2__
+#   include <immintrin.h>
+#endif
 
 #include <cassert>
 
 namespace {
 
+using namespace block_algorithm_detail;
+
 std::array<VectorI, 4> get_neighbor_positions_for(VectorI);
 
-void pop_special_neighbors(BlockGrid &, VectorI location, PopEffects &);
+// fills runs of "kind" containing any of "seeds" up and down the column
+ColumnMask fill_column(ColumnMask seeds, ColumnMask kind);
 
-Grid<bool> get_columns_popped_blocks(const BlockGrid &, int pop_requirement);
-
-[[nodiscard]] inline auto make_finisher(PopEffects & pop_effects) {
-    struct FinisherRaii {
-        FinisherRaii(PopEffects & effects_): effects(effects_) {}
-        ~FinisherRaii() { effects.finish(); }
-        PopEffects & effects;
-    };
-    return FinisherRaii(pop_effects);
-}
-
-[[nodiscard]] inline auto make_finisher(FallBlockEffects & pop_effects) {
-    struct FinisherRaii {
-        FinisherRaii(FallBlockEffects & effects_): effects(effects_) {}
-        ~FinisherRaii() { effects.finish(); }
-        FallBlockEffects & effects;
-    };
-    return FinisherRaii(pop_effects);
-}
+// gathers the bits of "value" selected by "mask" into the low bits
+ColumnMask extract_bits(ColumnMask value, ColumnMask mask);
 
 } // end of <anonymous> namespace
 
@@ -62,72 +54,114 @@ Grid<bool> get_columns_popped_blocks(const BlockGrid &, int pop_requirement);
     return inst;
 }
 
+void FallBlockEffects::post_block_falls(const BlockFall * beg, const BlockFall * end) {
+    for (auto itr = beg; itr != end; ++itr) {
+        post_block_fall(itr->from, itr->to, itr->color);
+    }
+}
+
 FallBlockEffects::~FallBlockEffects() {}
 
 void make_blocks_fall(BlockSubGrid grid, FallBlockEffects & effects) {
-    effects.start();
-    auto finisher = make_finisher(effects);
-
-    for (int x = 0                ; x != grid.width(); ++x) {
-    for (int y = grid.height() - 1; y != -1          ;    ) {
-        if (grid(x, y) != k_empty_block) {
-            effects.post_stationary_block(VectorI(x, y), grid(x, y));
-            --y;
-            continue;
-        }
-        bool swap_occured = false;
-        for (int yi = y; yi != -1 && !swap_occured; --yi) {
-            if (grid(x, yi) == k_empty_block) continue;
-            std::swap(grid(x, y), grid(x, yi));
-            effects.post_block_fall(VectorI(x, yi), VectorI(x, y), grid(x, y));
-            // only one step
-            --y;
-            swap_occured = true;
-        }
-        if (!swap_occured) {
-            // skip rest of column
-            break;
-        }
-    }}
+    make_blocks_fall<FallBlockEffects>(grid, effects);
 }
 
-void make_tetris_rows_fall(BlockSubGrid blocks, FallBlockEffects & effects) {
-    effects.start();
-    auto finisher = make_finisher(effects);
+void make_blocks_fall(BlockSubGrid grid, std::vector<BlockFall> & falls) {
+    falls.clear();
+    for (int x = 0; x != grid.width(); ++x) {
+        compact_column(grid, x, [](VectorI, BlockId) {},
+            [&falls](VectorI from, VectorI to, BlockId bid)
+                { falls.push_back(BlockFall { from, to, bid }); });
+    }
+}
 
-    int cleared_rows = 0;
-    for (int y = blocks.height() - 1; y != -1; --y) {
-        bool row_is_clear = [&blocks, y]() {
-            for (int x = 0; x != blocks.width(); ++x) {
-                if (blocks(x, y) != k_empty_block) return false;
-            }
-            return true;
-        }();
-        if (row_is_clear) {
-            ++cleared_rows;
-        } else if (cleared_rows > 0) {
-            for (int x = 0; x != blocks.width(); ++x) {
-                if (!is_block_color(blocks(x, y))) continue;
-                effects.post_block_fall(VectorI(x, y), VectorI(x, y + cleared_rows), blocks(x, y));
-                std::swap(blocks(x, y), blocks(x, y + cleared_rows));
-            }
-        } else {
-            for (int x = 0; x != blocks.width(); ++x) {
-                if (!is_block_color(blocks(x, y))) continue;
-                effects.post_stationary_block(VectorI(x, y), blocks(x, y));
-            }
+bool make_blocks_fall(BlockBitBoard & board) {
+    bool any_moved = false;
+    const auto full = board.full_column();
+    for (int x = 0; x != board.width(); ++x) {
+        auto occupied = board.occupied_column(x);
+        if (occupied == 0) continue;
+        // the bottom is the high end of the column, so a settled column is a
+        // run of bits up against the board's height
+        int count = __builtin_popcount(occupied);
+        int shift = board.height() - count;
+        auto settled = full & ~((ColumnMask(1) << shift) - 1);
+        if (occupied == settled) continue;
+        any_moved = true;
+        for (auto kind : k_all_block_kinds) {
+            auto & col = board.masks_for(kind)[x];
+            if (col == 0) continue;
+            col = extract_bits(col, occupied) << shift;
         }
     }
+    return any_moved;
+}
+
+void make_tetris_rows_fall(BlockSubGrid blocks, FallBlockEffects & effects) {
+    make_tetris_rows_fall<FallBlockEffects>(blocks, effects);
 }
 
 void make_all_blocks_fall_out(BlockSubGrid blocks, FallBlockEffects & effects) {
     effects.start();
-    auto finisher = make_finisher(effects);
+    EffectsFinisher<FallBlockEffects> finisher(effects);
+    FallBatch<FallBlockEffects> falls(effects);
     for (VectorI r; r != blocks.end_position(); r = blocks.next(r)) {
         if (blocks(r) == k_empty_block) continue;
-        effects.post_block_fall(r, VectorI(r.x, blocks.height()), blocks(r));
+        falls.post(r, VectorI(r.x, blocks.height()), blocks(r));
         blocks(r) = k_empty_block;
     }
+    falls.flush();
+}
+
+void make_blocks_fall_in
+    (BlockGrid & blocks, const BlockGrid & fall_ins, FallBlockEffects & effects)
+{
+    if (blocks.width() != fall_ins.width() || blocks.height() != fall_ins.height()) {
+        throw std::invalid_argument("make_blocks_fall_in: board and fall ins must be the same size.");
+    }
+    if (blocks.height() == 0 || blocks.width() == 0)
+        { return; }
+
+    effects.start();
+    EffectsFinisher<FallBlockEffects> finisher(effects);
+    // all fall-ins are posted as one batch
+    FallBatch<FallBlockEffects> falls(effects);
+    for (VectorI r; r != blocks.end_position(); r = blocks.next(r)) {
+        if (blocks(r) != k_empty_block) {
+            effects.post_stationary_block(r, blocks(r));
+        }
+    }
+    for (int x = 0; x != blocks.width(); ++x) {
+        // find the lowest empty space
+        // (assumes all blocks have fallen)
+        int lowest_empty = blocks.height() - 1;
+        for (int y = 0; y != blocks.height(); ++y) {
+            if (blocks(x, y) == k_empty_block) continue;
+            lowest_empty = y - 1;
+            break;
+        }
+        // no space available for fallins
+        if (lowest_empty == -1) continue;
+        // start from the bottom of the fallins grid
+        int fallins_y = fall_ins.height() - 1;
+        // iterate empty blocks
+        for (int y = lowest_empty; y != -1; --y) {
+            // find first fallin block
+            for ( ;fallins_y != -1; --fallins_y) {
+                if (fall_ins(x, fallins_y) != k_empty_block) { break; }
+            }
+            // breaks once we're out of fallins
+            if (fallins_y == -1) { break; }
+            assert(fall_ins(x, fallins_y) != k_empty_block);
+            assert(blocks(x, y) == k_empty_block);
+
+            auto fallins_block = fall_ins(x, fallins_y);
+            blocks(x, y) = fallins_block;
+            falls.post(VectorI(x, y - lowest_empty - 1), VectorI(x, y), fallins_block);
+            --fallins_y;
+        }
+    }
+    falls.flush();
 }
 
 // ----------------------------------------------------------------------------
@@ -143,6 +177,12 @@ void make_all_blocks_fall_out(BlockSubGrid blocks, FallBlockEffects & effects) {
     return inst;
 }
 
+void PopEffects::post_pop_effects(const BlockPop * beg, const BlockPop * end) {
+    for (auto itr = beg; itr != end; ++itr) {
+        post_pop_effect(itr->at, itr->color);
+    }
+}
+
 PopEffects::~PopEffects() {}
 
 std::vector<VectorI> select_connected_blocks(const BlockGrid & grid, VectorI r) {
@@ -184,85 +224,183 @@ void select_connected_blocks
 
 bool pop_connected_blocks
     (BlockGrid & grid, int amount_required, PopEffects & effects)
-{
-    effects.start();
-    auto finisher = make_finisher(effects);
+{ return pop_connected_blocks<PopEffects>(grid, amount_required, effects); }
 
-    bool any_popped = false;
-    Grid<bool> explored;
-    std::vector<VectorI> selections;
-    explored.set_size(grid.width(), grid.height());
+bool pop_connected_blocks
+    (BlockBitBoard & board, int amount_required, PopEffects & effects)
+{ return pop_connected_blocks<PopEffects>(board, amount_required, effects); }
+
+bool pop_connected_blocks
+    (BlockGrid & grid, int amount_required, ConnectedGroups & groups,
+     PopEffects & effects)
+{ return pop_connected_blocks<PopEffects>(grid, amount_required, groups, effects); }
+
+bool pop_connected_blocks
+    (BlockGrid & grid, int amount_required,
+     const std::vector<VectorI> & dirty_cells, GroupSearch & search,
+     PopEffects & effects)
+{
+    return pop_connected_blocks<PopEffects>
+        (grid, amount_required, dirty_cells, search, effects);
+}
 
-    for (VectorI r; r != grid.end_position(); r = grid.next(r)) {
-        if (grid(r) == k_empty_block) continue;
-        selections.clear();
-        selections.push_back(r);
-        select_connected_blocks(grid, selections, explored);
-        if (int(selections.size()) < amount_required) continue;
-
-        any_popped = true;
-        for (auto u : selections) {
-            pop_special_neighbors(grid, u, effects);
-            effects.post_pop_effect(u, grid(u));
-            grid(u) = k_empty_block;
+void flood_fill(const ColumnMasks & kind, ColumnMasks & region, int width) {
+    // only columns next to the region found so far may change
+    int first = width, last = -1;
+    for (int x = 0; x != width; ++x) {
+        if (!region[x]) continue;
+        region[x] = fill_column(region[x], kind[x]);
+        first = std::min(first, x);
+        last  = x;
+    }
+    if (last == -1) return;
+
+    auto spread_into = [&kind, &region, width](int x) {
+        ColumnMask from_sides = 0;
+        if (x != 0        ) from_sides |= region[x - 1];
+        if (x != width - 1) from_sides |= region[x + 1];
+        auto grown = fill_column(region[x] | from_sides, kind[x]);
+        if (grown == region[x]) return false;
+        region[x] = grown;
+        return true;
+    };
+    // sweeping both ways per pass, means that most groups are finished
+    // on their first pass
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int x = std::max(first - 1, 0); x != std::min(last + 2, width); ++x) {
+            if (!spread_into(x)) continue;
+            changed = true;
+            first = std::min(first, x);
+            last  = std::max(last , x);
+        }
+        for (int x = std::min(last + 1, width - 1); x != std::max(first - 2, -1); --x) {
+            if (!spread_into(x)) continue;
+            changed = true;
+            first = std::min(first, x);
+            last  = std::max(last , x);
         }
-        effects.post_group(selections);
     }
-    return any_popped;
 }
 
-bool pop_columns_blocks(BlockGrid & blocks, int pop_requirement, PopEffects & effects) {
-    effects.start();
-    auto finisher = make_finisher(effects);
-    auto popped_blocks = get_columns_popped_blocks(blocks, pop_requirement);
-    assert(popped_blocks.size() == blocks.size());
-    for (VectorI i; i != blocks.end_position(); i = blocks.next(i)) {
-        if (!popped_blocks(i)) continue;
-        effects.post_pop_effect(i, blocks(i));
-        blocks(i) = k_empty_block;
+int count_cells(const ColumnMasks & masks, int width) {
+    int rv = 0;
+    for (int x = 0; x != width; ++x) {
+        rv += __builtin_popcount(masks[x]);
     }
-    return std::any_of(popped_blocks.begin(), popped_blocks.end(), [](bool b) { return b; });
+    return rv;
 }
 
-int clear_tetris_rows(BlockGrid & blocks, PopEffects & effects) {
-    effects.start();
-    auto finisher = make_finisher(effects);
+bool pop_columns_blocks(BlockGrid & blocks, int pop_requirement, PopEffects & effects)
+    { return pop_columns_blocks<PopEffects>(blocks, pop_requirement, effects); }
 
-    int rv = 0;
-    for (int y = 0; y != blocks.height(); ++y) {
-        bool is_filled = true;
-        for (int x = 0; x != blocks.width(); ++x) {
-            if (blocks(x, y) == k_empty_block) is_filled = false;
+bool pop_columns_blocks(BlockBitBoard & board, int pop_requirement, PopEffects & effects)
+    { return pop_columns_blocks<PopEffects>(board, pop_requirement, effects); }
+
+bool find_columns_matches
+    (const ColumnMasks & kind, int width, int height, int pop_requirement,
+     ColumnMasks & matched)
+{
+    std::fill(matched.begin(), matched.begin() + width, 0);
+    const int run = std::max(pop_requirement, 1);
+    // a run that long cannot fit in any direction
+    if (run > std::max(width, height)) return false;
+
+    ColumnMask any_matched = 0;
+    // the shifts give, for each direction, how far one step moves a cell's
+    // row (as a bit shift toward higher rows)
+    auto mark_runs = [&](int x, int x_step, int row_step) {
+        // bits where a run of "run" blocks begins at column x
+        ColumnMask starts = kind[x];
+        for (int i = 1; i != run && starts; ++i) {
+            auto other = kind[x + i*x_step];
+            starts &= row_step > 0 ? (other >> (i*row_step)) : (other << (i*-row_step));
         }
-        if (is_filled) {
-            ++rv;
-            for (int x = 0; x != blocks.width(); ++x) {
-                effects.post_pop_effect(VectorI(x, y), blocks(x, y));
-                blocks(x, y) = k_empty_block;
-            }
+        if (!starts) return;
+        any_matched |= starts;
+        for (int i = 0; i != run; ++i) {
+            matched[x + i*x_step] |= row_step > 0 ? (starts << (i*row_step))
+                                                  : (starts >> (i*-row_step));
         }
+    };
+    for (int x = 0; x != width; ++x) {
+        if (!kind[x]) continue;
+        if (run <= height) mark_runs(x, 0, 1); // vertical
+        if (x + run > width) continue;
+        mark_runs(x, 1,  0); // horizontal
+        mark_runs(x, 1,  1); // diagonal, down and to the right
+        mark_runs(x, 1, -1); // diagonal, up and to the right
     }
-    return rv;
+    return any_matched != 0;
 }
 
-namespace {
+int clear_tetris_rows(BlockGrid & blocks, PopEffects & effects)
+    { return clear_tetris_rows<PopEffects>(blocks, effects); }
 
-std::array<VectorI, 4> get_neighbor_positions_for(VectorI v) {
-    return { VectorI(1, 0) + v, VectorI(-1, 0) + v,
-             VectorI(0, 1) + v, VectorI(0, -1) + v };
+void count_row_fills(const BlockGrid & blocks, std::vector<int> & row_fill_counts) {
+    row_fill_counts.clear();
+    row_fill_counts.resize(std::size_t(blocks.height()), 0);
+    for (VectorI r; r != blocks.end_position(); r = blocks.next(r)) {
+        if (blocks(r) != k_empty_block) ++row_fill_counts[std::size_t(r.y)];
+    }
 }
 
-void pop_special_neighbors(BlockGrid & grid, VectorI location, PopEffects & effects) {
-    for (auto n : get_neighbor_positions_for(location)) {
-        if (!grid.has_position(n)) continue;
-        switch (grid(n)) {
-        case BlockId::hard_glass: case BlockId::glass:
-            effects.post_pop_effect(n, grid(n));
-            grid(n) = decay_block(grid(n));
-            break;
-        default: break;
-        }
-    }
+int clear_tetris_rows
+    (BlockGrid & blocks, std::vector<int> & row_fill_counts,
+     int first_row, int last_row, PopEffects & effects)
+{
+    return clear_tetris_rows<PopEffects>
+        (blocks, row_fill_counts, first_row, last_row, effects);
+}
+
+void make_tetris_rows_fall
+    (BlockGrid & blocks, std::vector<int> & row_fill_counts,
+     FallBlockEffects & effects)
+{ make_tetris_rows_fall<FallBlockEffects>(blocks, row_fill_counts, effects); }
+
+namespace block_algorithm_detail {
+
+ColumnMask with_neighbors_of_kind(const ColumnMasks & kind, int x, int width) {
+    ColumnMask neighbors = (kind[x] << 1) | (kind[x] >> 1);
+    if (x != 0        ) neighbors |= kind[x - 1];
+    if (x != width - 1) neighbors |= kind[x + 1];
+    return kind[x] & neighbors;
+}
+
+GlassDecay decay_glass_in_column
+    (BlockBitBoard & board, const ColumnMasks & popped, int x)
+{
+    // each popped block decays each of its special neighbors once, so a
+    // neighbor of two or more popped blocks may decay twice
+    auto & glass      = board.masks_for(BlockId::glass     );
+    auto & hard_glass = board.masks_for(BlockId::hard_glass);
+    const int width = board.width();
+    ColumnMask below = popped[x] << 1;
+    ColumnMask above = popped[x] >> 1;
+    ColumnMask left  = x != 0         ? popped[x - 1] : 0;
+    ColumnMask right = x != width - 1 ? popped[x + 1] : 0;
+    ColumnMask at_least_once  = below | above | left | right;
+    ColumnMask at_least_twice =   (below & above) | (left & right)
+                                | ((below | above) & (left | right));
+
+    GlassDecay rv;
+    rv.glass_hits = glass[x] & at_least_once;
+    rv.hard_once  = hard_glass[x] & at_least_once & ~at_least_twice;
+    rv.hard_twice = hard_glass[x] & at_least_twice;
+
+    glass     [x] = (glass[x] & ~rv.glass_hits) | rv.hard_once;
+    hard_glass[x] &= ~at_least_once;
+    return rv;
+}
+
+void verify_row_fill_counts
+    (const char * caller, const BlockGrid & blocks,
+     const std::vector<int> & row_fill_counts)
+{
+    if (int(row_fill_counts.size()) == blocks.height()) return;
+    throw std::invalid_argument(std::string(caller) + ": there must be exactly "
+                                "one fill count for each row of the grid.");
 }
 
 Grid<bool> get_columns_popped_blocks(const BlockGrid & blocks, int pop_requirement) {
@@ -313,4 +451,38 @@ Grid<bool> get_columns_popped_blocks(const BlockGrid & blocks, int pop_requireme
     return rv;
 }
 
+} // end of block_algorithm_detail namespace
+
+namespace {
+
+std::array<VectorI, 4> get_neighbor_positions_for(VectorI v) {
+    return { VectorI(1, 0) + v, VectorI(-1, 0) + v,
+             VectorI(0, 1) + v, VectorI(0, -1) + v };
+}
+
+ColumnMask fill_column(ColumnMask seeds, ColumnMask kind) {
+    // Kogge-Stone style fill, doubling the distance covered on each step
+    ColumnMask up   = seeds & kind, up_path   = kind;
+    ColumnMask down = seeds & kind, down_path = kind;
+    for (int shift = 1; shift != int(sizeof(ColumnMask)*8); shift *= 2) {
+        up   |= up_path   & (up   << shift);
+        down |= down_path & (down >> shift);
+        up_path   &= (up_path   << shift);
+        down_path &= (down_path >> shift);
+    }
+    return up | down;
+}
+
+ColumnMask extract_bits(ColumnMask value, ColumnMask mask) {
+#   ifdef __BMI2__
+    return _pext_u32(value, mask);
+#   else
+    ColumnMask rv = 0;
+    for (ColumnMask out_bit = 1; mask; mask &= mask - 1, out_bit <<= 1) {
+        if (value & mask & -mask) rv |= out_bit;
+    }
+    return rv;
+#   endif
+}
+
 } // end of <anonymous> namespace
@@ -20,6 +20,14 @@
 #pragma once
 
 #include "Defs.hpp"
+#include "BlockBitBoard.hpp"
+#include "BlockGroups.hpp"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include <cassert>
 #if 0
 #include <common/SubGrid.hpp>
 
@@ -27,6 +35,17 @@ using BlockSubGrid      = SubGrid     <BlockId>;
 using ConstBlockSubGrid = ConstSubGrid<BlockId>;
 #endif
 
+struct BlockFall {
+    VectorI from;
+    VectorI to;
+    BlockId color = k_empty_block;
+};
+
+struct BlockPop {
+    VectorI at;
+    BlockId color = k_empty_block;
+};
+
 class FallBlockEffects {
 public:
     static FallBlockEffects & default_instance();
@@ -34,20 +53,18 @@ public:
     virtual void start() = 0;
     virtual void post_stationary_block(VectorI at, BlockId) = 0;
     virtual void post_block_fall(VectorI from, VectorI to, BlockId) = 0;
+
+    /** Algorithms post falls in batches (a column or a wave at a time) here.
+     *  By default each fall is posted by itself with post_block_fall.
+     */
+    virtual void post_block_falls(const BlockFall * beg, const BlockFall * end);
+
     virtual void finish() = 0;
 protected:
     FallBlockEffects() {}
     virtual ~FallBlockEffects();
 };
 
-void make_blocks_fall
-    (BlockSubGrid, FallBlockEffects & = FallBlockEffects::default_instance());
-
-void make_tetris_rows_fall
-    (BlockSubGrid, FallBlockEffects & = FallBlockEffects::default_instance());
-
-void make_all_blocks_fall_out(BlockSubGrid, FallBlockEffects &);
-
 class PopEffects {
 public:
     static PopEffects & default_instance();
@@ -55,12 +72,95 @@ public:
     virtual void start() = 0;
     virtual void finish() = 0;
     virtual void post_pop_effect(VectorI at, BlockId) = 0;
+
+    /** Algorithms post pops in batches (a group or a wave at a time) here,
+     *  always before the post_group call for those pops. By default each pop
+     *  is posted by itself with post_pop_effect.
+     */
+    virtual void post_pop_effects(const BlockPop * beg, const BlockPop * end);
+
     virtual void post_group(const std::vector<VectorI> & group_locations) = 0;
 protected:
     PopEffects() {}
     virtual ~PopEffects();
 };
 
+// ----------------------------------------------------------------------------
+
+/** Each algorithm below taking effects has a templated overload, which takes
+ *  any "sink" type with the same member functions as FallBlockEffects (or
+ *  PopEffects), without them needing to be virtual. Types deriving from the
+ *  effects interfaces still go through the virtual entry points, which are
+ *  thin wrappers around the templates. The batch member functions
+ *  (post_block_falls, post_pop_effects) are optional for sinks, without
+ *  them every record is posted by itself.
+ *
+ *  Leaving effects out uses the null sinks, which compile away entirely.
+ */
+template <typename Base, typename Sink>
+using EnableForEffectsSink = std::enable_if_t<
+    std::is_same_v<Base, Sink> || !std::is_base_of_v<Base, Sink>>;
+
+struct NullFallEffects {
+    void start() {}
+    void post_stationary_block(VectorI, BlockId) {}
+    void post_block_fall(VectorI, VectorI, BlockId) {}
+    void finish() {}
+};
+
+struct NullPopEffects {
+    void start() {}
+    void finish() {}
+    void post_pop_effect(VectorI, BlockId) {}
+    void post_group(const std::vector<VectorI> &) {}
+};
+
+// ----------------------------------------------------------------------------
+
+void make_blocks_fall(BlockSubGrid, FallBlockEffects &);
+
+template <typename FallSink, typename = EnableForEffectsSink<FallBlockEffects, FallSink>>
+void make_blocks_fall(BlockSubGrid, FallSink &);
+
+inline void make_blocks_fall(BlockSubGrid);
+
+/** Same gravity as above, but every moved block is appended to "falls"
+ *  (stationary blocks are not recorded), in the order effects would have
+ *  been posted. The list is cleared first.
+ */
+void make_blocks_fall(BlockSubGrid, std::vector<BlockFall> & falls);
+
+/** Compacts every column of the bit board toward the bottom.
+ *  @returns true if any block moved
+ */
+bool make_blocks_fall(BlockBitBoard &);
+
+void make_tetris_rows_fall(BlockSubGrid, FallBlockEffects &);
+
+template <typename FallSink, typename = EnableForEffectsSink<FallBlockEffects, FallSink>>
+void make_tetris_rows_fall(BlockSubGrid, FallSink &);
+
+inline void make_tetris_rows_fall(BlockSubGrid);
+
+/** Copies source into dest with rows and columns swapped (dest is resized),
+ *  so that row algorithms can work on columns. SameGame sweeps its empty
+ *  columns this way, with make_tetris_rows_fall on the flipped board.
+ */
+template <typename T>
+void flip_along_trace(const Grid<T> & source, Grid<T> & dest);
+
+void make_all_blocks_fall_out(BlockSubGrid, FallBlockEffects &);
+
+/** Drops the blocks of "fall_ins" onto the board, each column of them onto
+ *  the same column of the board (gaps between them closed), as refuge blocks
+ *  fall in. The board is assumed to have settled already, and blocks that do
+ *  not fit are lost.
+ *  @throws if the grids are not the same size
+ */
+void make_blocks_fall_in(BlockGrid &, const BlockGrid & fall_ins, FallBlockEffects &);
+
+inline void make_blocks_fall_in(BlockGrid &, const BlockGrid & fall_ins);
+
 // this is a pretty intense algorithm
 // so solid and numerous test cases are necessary
 void select_connected_blocks
@@ -68,9 +168,722 @@ void select_connected_blocks
 
 std::vector<VectorI> select_connected_blocks(const BlockGrid &, VectorI);
 
-bool pop_connected_blocks(BlockGrid &, int amount_required, PopEffects & = PopEffects::default_instance());
+bool pop_connected_blocks(BlockGrid &, int amount_required, PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+bool pop_connected_blocks(BlockGrid &, int amount_required, PopSink &);
+
+inline bool pop_connected_blocks(BlockGrid &, int amount_required);
+
+bool pop_connected_blocks(BlockBitBoard &, int amount_required, PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+bool pop_connected_blocks(BlockBitBoard &, int amount_required, PopSink &);
+
+inline bool pop_connected_blocks(BlockBitBoard &, int amount_required);
+
+/** Pops using union-find labels rather than the bit board, which works for
+ *  boards of any size. "groups" is relabeled from the grid first, and is
+ *  left labeling the board as it was before popping.
+ */
+bool pop_connected_blocks(BlockGrid &, int amount_required, ConnectedGroups & groups,
+                          PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+bool pop_connected_blocks(BlockGrid &, int amount_required, ConnectedGroups & groups,
+                          PopSink &);
+
+inline bool pop_connected_blocks(BlockGrid &, int amount_required, ConnectedGroups & groups);
+
+/** Pops only the groups which include at least one of "dirty_cells", all
+ *  other groups are assumed to be under the requirement already (which is
+ *  true if every cell that has changed since the last pop is dirty). Costs
+ *  time in proportion to those groups, rather than the board's area.
+ */
+bool pop_connected_blocks(BlockGrid &, int amount_required,
+                          const std::vector<VectorI> & dirty_cells, GroupSearch &,
+                          PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+bool pop_connected_blocks(BlockGrid &, int amount_required,
+                          const std::vector<VectorI> & dirty_cells, GroupSearch &,
+                          PopSink &);
+
+inline bool pop_connected_blocks(BlockGrid &, int amount_required,
+                                 const std::vector<VectorI> & dirty_cells, GroupSearch &);
+
+/** Grows "region" to include every block in "kind" that is four-way
+ *  connected to it. Bits in region which are not in kind are dropped.
+ */
+void flood_fill(const BlockBitBoard::ColumnMasks & kind,
+                BlockBitBoard::ColumnMasks & region, int width);
+
+int count_cells(const BlockBitBoard::ColumnMasks &, int width);
 
 // wip
-bool pop_columns_blocks(BlockGrid &, int pop_requirement, PopEffects & = PopEffects::default_instance());
+bool pop_columns_blocks(BlockGrid &, int pop_requirement, PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+bool pop_columns_blocks(BlockGrid &, int pop_requirement, PopSink &);
+
+inline bool pop_columns_blocks(BlockGrid &, int pop_requirement);
+
+bool pop_columns_blocks(BlockBitBoard &, int pop_requirement, PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+bool pop_columns_blocks(BlockBitBoard &, int pop_requirement, PopSink &);
+
+inline bool pop_columns_blocks(BlockBitBoard &, int pop_requirement);
+
+/** Marks, in "matched", every block of "kind" which is part of a straight
+ *  line of at least pop_requirement blocks: horizontal, vertical or along
+ *  either diagonal. Nothing is allocated.
+ *  @returns true if any block was matched
+ */
+bool find_columns_matches(const BlockBitBoard::ColumnMasks & kind, int width,
+                          int height, int pop_requirement,
+                          BlockBitBoard::ColumnMasks & matched);
+
+int clear_tetris_rows(BlockGrid &, PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+int clear_tetris_rows(BlockGrid &, PopSink &);
+
+inline int clear_tetris_rows(BlockGrid &);
+
+/** Sets "row_fill_counts" to the number of blocks in each row of the grid. */
+void count_row_fills(const BlockGrid &, std::vector<int> & row_fill_counts);
+
+/** Same as above, but only checks rows from first_row to last_row
+ *  (inclusive, clamped to the grid) using each row's fill count, which is
+ *  kept up to date.
+ */
+int clear_tetris_rows(BlockGrid &, std::vector<int> & row_fill_counts,
+                      int first_row, int last_row, PopEffects &);
+
+template <typename PopSink, typename = EnableForEffectsSink<PopEffects, PopSink>>
+int clear_tetris_rows(BlockGrid &, std::vector<int> & row_fill_counts,
+                      int first_row, int last_row, PopSink &);
+
+inline int clear_tetris_rows(BlockGrid &, std::vector<int> & row_fill_counts,
+                             int first_row, int last_row);
+
+/** Same as make_tetris_rows_fall above, but uses fill counts to find empty
+ *  rows. Each row is copied whole to where it lands, and the counts are
+ *  moved with them. As above, only color blocks fall.
+ */
+void make_tetris_rows_fall
+    (BlockGrid &, std::vector<int> & row_fill_counts, FallBlockEffects &);
+
+template <typename FallSink, typename = EnableForEffectsSink<FallBlockEffects, FallSink>>
+void make_tetris_rows_fall
+    (BlockGrid &, std::vector<int> & row_fill_counts, FallSink &);
+
+inline void make_tetris_rows_fall(BlockGrid &, std::vector<int> & row_fill_counts);
+
+// ----------------------------------------------------------------------------
+
+// helpers for the templates, not meant for use anywhere else
+namespace block_algorithm_detail {
+
+using ColumnMask  = BlockBitBoard::ColumnMask;
+using ColumnMasks = BlockBitBoard::ColumnMasks;
+
+constexpr const BlockId k_all_block_kinds[] = {
+    BlockId::red, BlockId::blue, BlockId::green, BlockId::magenta,
+    BlockId::yellow, BlockId::glass, BlockId::hard_glass
+};
+
+template <typename Sink>
+class EffectsFinisher {
+public:
+    explicit EffectsFinisher(Sink & effects): m_effects(effects) {}
+    EffectsFinisher(const EffectsFinisher &) = delete;
+    EffectsFinisher & operator = (const EffectsFinisher &) = delete;
+    ~EffectsFinisher() { m_effects.finish(); }
+private:
+    Sink & m_effects;
+};
+
+template <typename Sink, typename = void>
+struct HasBatchFalls : std::false_type {};
+
+template <typename Sink>
+struct HasBatchFalls<Sink, std::void_t<decltype(std::declval<Sink &>().post_block_falls
+    (std::declval<const BlockFall *>(), std::declval<const BlockFall *>()))>> :
+    std::true_type {};
+
+template <typename Sink, typename = void>
+struct HasBatchPops : std::false_type {};
+
+template <typename Sink>
+struct HasBatchPops<Sink, std::void_t<decltype(std::declval<Sink &>().post_pop_effects
+    (std::declval<const BlockPop *>(), std::declval<const BlockPop *>()))>> :
+    std::true_type {};
+
+// collects falls until flushed, if the sink takes them in batches, otherwise
+// posts each one as it comes
+template <typename Sink>
+class FallBatch {
+public:
+    explicit FallBatch(Sink & effects): m_effects(effects) {}
+
+    void post(VectorI from, VectorI to, BlockId bid) {
+        if constexpr (k_is_batched) {
+            m_falls.push_back(BlockFall { from, to, bid });
+        } else {
+            m_effects.post_block_fall(from, to, bid);
+        }
+    }
+
+    void flush() {
+        if constexpr (k_is_batched) {
+            if (m_falls.empty()) return;
+            m_effects.post_block_falls(m_falls.data(), m_falls.data() + m_falls.size());
+            m_falls.clear();
+        }
+    }
+
+private:
+    static constexpr const bool k_is_batched = HasBatchFalls<Sink>::value;
+
+    Sink & m_effects;
+    std::vector<BlockFall> m_falls;
+};
+
+// same as FallBatch, but for pop effects
+template <typename Sink>
+class PopBatch {
+public:
+    explicit PopBatch(Sink & effects): m_effects(effects) {}
+
+    void post(VectorI at, BlockId bid) {
+        if constexpr (k_is_batched) {
+            m_pops.push_back(BlockPop { at, bid });
+        } else {
+            m_effects.post_pop_effect(at, bid);
+        }
+    }
+
+    void flush() {
+        if constexpr (k_is_batched) {
+            if (m_pops.empty()) return;
+            m_effects.post_pop_effects(m_pops.data(), m_pops.data() + m_pops.size());
+            m_pops.clear();
+        }
+    }
+
+private:
+    static constexpr const bool k_is_batched = HasBatchPops<Sink>::value;
+
+    Sink & m_effects;
+    std::vector<BlockPop> m_pops;
+};
+
+// blocks in column x which have at least one neighbor of the same kind
+ColumnMask with_neighbors_of_kind(const ColumnMasks & kind, int x, int width);
+
+struct GlassDecay {
+    ColumnMask glass_hits = 0;
+    ColumnMask hard_once  = 0;
+    ColumnMask hard_twice = 0;
+};
+
+// decays glass in column x next to popped blocks, a neighbor of two or more
+// popped blocks decays twice
+GlassDecay decay_glass_in_column(BlockBitBoard &, const ColumnMasks & popped, int x);
+
+void verify_row_fill_counts(const char * caller, const BlockGrid &,
+                            const std::vector<int> & row_fill_counts);
+
+// used for boards too large for a bit board
+Grid<bool> get_columns_popped_blocks(const BlockGrid &, int pop_requirement);
+
+template <typename Func>
+void for_each_cell(const ColumnMasks & masks, int first_x, int width, Func && f) {
+    for (int x = first_x; x != width; ++x) {
+        for (auto m = masks[x]; m; m &= (m - 1)) {
+            f(VectorI(x, __builtin_ctz(m)));
+        }
+    }
+}
+
+// moves every block in column x down over any empty cells below it, in a
+// single pass from the bottom
+template <typename OnStationary, typename OnFall>
+void compact_column
+    (BlockSubGrid & grid, int x, OnStationary && on_stationary, OnFall && on_fall)
+{
+    // write is the lowest cell not yet known to be filled
+    int write = grid.height() - 1;
+    for (int y = grid.height() - 1; y != -1; --y) {
+        auto bid = grid(x, y);
+        if (bid == k_empty_block) continue;
+        if (y == write) {
+            on_stationary(VectorI(x, y), bid);
+        } else {
+            grid(x, write) = bid;
+            grid(x, y    ) = k_empty_block;
+            on_fall(VectorI(x, y), VectorI(x, write), bid);
+        }
+        --write;
+    }
+}
+
+template <typename PopSink>
+void pop_special_neighbors(BlockGrid & grid, VectorI location, PopBatch<PopSink> & pops) {
+    for (auto n : { VectorI(1, 0) + location, VectorI(-1, 0) + location,
+                    VectorI(0, 1) + location, VectorI(0, -1) + location })
+    {
+        if (!grid.has_position(n)) continue;
+        switch (grid(n)) {
+        case BlockId::hard_glass: case BlockId::glass:
+            pops.post(n, grid(n));
+            grid(n) = decay_block(grid(n));
+            break;
+        default: break;
+        }
+    }
+}
+
+template <typename PopSink>
+void pop_special_neighbors
+    (BlockBitBoard & board, const ColumnMasks & popped, PopBatch<PopSink> & pops)
+{
+    for (int x = 0; x != board.width(); ++x) {
+        auto decay = decay_glass_in_column(board, popped, x);
+        for (auto m = decay.glass_hits; m; m &= (m - 1)) {
+            pops.post(VectorI(x, __builtin_ctz(m)), BlockId::glass);
+        }
+        for (auto m = decay.hard_once | decay.hard_twice; m; m &= (m - 1)) {
+            VectorI r(x, __builtin_ctz(m));
+            pops.post(r, BlockId::hard_glass);
+            if (decay.hard_twice & (ColumnMask(1) << r.y)) {
+                pops.post(r, BlockId::glass);
+            }
+        }
+    }
+    pops.flush();
+}
+
+// pops the group in "selections", with its pops posted as one batch
+template <typename PopSink>
+void pop_grid_group(BlockGrid & grid, const std::vector<VectorI> & selections,
+                    PopBatch<PopSink> & pops, PopSink & effects)
+{
+    for (auto u : selections) {
+        pop_special_neighbors(grid, u, pops);
+        pops.post(u, grid(u));
+        grid(u) = k_empty_block;
+    }
+    pops.flush();
+    effects.post_group(selections);
+}
+
+} // end of block_algorithm_detail namespace
+
+// ----------------------------------------------------------------------------
+
+template <typename FallSink, typename>
+void make_blocks_fall(BlockSubGrid grid, FallSink & effects) {
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<FallSink> finisher(effects);
+    FallBatch<FallSink> falls(effects);
+    for (int x = 0; x != grid.width(); ++x) {
+        compact_column(grid, x,
+            [&effects](VectorI at, BlockId bid)
+                { effects.post_stationary_block(at, bid); },
+            [&falls](VectorI from, VectorI to, BlockId bid)
+                { falls.post(from, to, bid); });
+        falls.flush();
+    }
+}
+
+inline void make_blocks_fall(BlockSubGrid grid) {
+    NullFallEffects effects;
+    make_blocks_fall(grid, effects);
+}
+
+inline void make_blocks_fall_in(BlockGrid & blocks, const BlockGrid & fall_ins)
+    { make_blocks_fall_in(blocks, fall_ins, FallBlockEffects::default_instance()); }
+
+template <typename FallSink, typename>
+void make_tetris_rows_fall(BlockSubGrid blocks, FallSink & effects) {
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<FallSink> finisher(effects);
+    FallBatch<FallSink> falls(effects);
+
+    int cleared_rows = 0;
+    for (int y = blocks.height() - 1; y != -1; --y) {
+        bool row_is_clear = [&blocks, y]() {
+            for (int x = 0; x != blocks.width(); ++x) {
+                if (blocks(x, y) != k_empty_block) return false;
+            }
+            return true;
+        }();
+        if (row_is_clear) {
+            ++cleared_rows;
+        } else if (cleared_rows > 0) {
+            for (int x = 0; x != blocks.width(); ++x) {
+                if (!is_block_color(blocks(x, y))) continue;
+                falls.post(VectorI(x, y), VectorI(x, y + cleared_rows), blocks(x, y));
+                std::swap(blocks(x, y), blocks(x, y + cleared_rows));
+            }
+        } else {
+            for (int x = 0; x != blocks.width(); ++x) {
+                if (!is_block_color(blocks(x, y))) continue;
+                effects.post_stationary_block(VectorI(x, y), blocks(x, y));
+            }
+        }
+    }
+    falls.flush();
+}
+
+inline void make_tetris_rows_fall(BlockSubGrid blocks) {
+    NullFallEffects effects;
+    make_tetris_rows_fall(blocks, effects);
+}
+
+template <typename T>
+void flip_along_trace(const Grid<T> & source, Grid<T> & dest) {
+    dest.clear();
+    dest.set_size(source.height(), source.width());
+    for (VectorI r; r != source.end_position(); r = source.next(r)) {
+        dest(r.y, r.x) = source(r);
+    }
+}
+
+template <typename PopSink, typename>
+bool pop_connected_blocks(BlockGrid & grid, int amount_required, PopSink & effects) {
+    if (!BlockBitBoard::can_represent(grid)) {
+        ConnectedGroups groups;
+        return pop_connected_blocks(grid, amount_required, groups, effects);
+    }
+    BlockBitBoard bitboard(grid);
+    if (!pop_connected_blocks(bitboard, amount_required, effects)) {
+        return false;
+    }
+    bitboard.store(grid);
+    return true;
+}
+
+inline bool pop_connected_blocks(BlockGrid & grid, int amount_required) {
+    NullPopEffects effects;
+    return pop_connected_blocks(grid, amount_required, effects);
+}
+
+template <typename PopSink, typename>
+bool pop_connected_blocks(BlockBitBoard & board, int amount_required, PopSink & effects) {
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+
+    const int width = board.width();
+    bool any_popped = false;
+    ColumnMasks popped = {};
+    std::vector<VectorI> selections;
+    for (int i = k_min_colors; i != k_max_colors + 1; ++i) {
+        auto color = map_int_to_color(i);
+        auto & color_masks = board.masks_for(color);
+        ColumnMasks unexplored = color_masks;
+        if (amount_required > 1) {
+            // lone blocks can never pop, so they need not be filled
+            for (int x = 0; x != width; ++x) {
+                unexplored[x] &= with_neighbors_of_kind(color_masks, x, width);
+            }
+        }
+        for (int x = 0; x != width; ++x) {
+        while (unexplored[x]) {
+            // every column left of x is fully explored, so no group
+            // found from here may reach them
+            ColumnMasks group = {};
+            group[x] = unexplored[x] & (~unexplored[x] + 1);
+            flood_fill(color_masks, group, width);
+            for (int gx = x; gx != width; ++gx) {
+                unexplored[gx] &= ~group[gx];
+            }
+            if (count_cells(group, width) < amount_required) continue;
+
+            any_popped = true;
+            selections.clear();
+            for_each_cell(group, x, width, [&](VectorI r) {
+                pops.post(r, color);
+                selections.push_back(r);
+            });
+            for (int gx = x; gx != width; ++gx) {
+                popped     [gx] |=  group[gx];
+                color_masks[gx] &= ~group[gx];
+            }
+            pops.flush();
+            effects.post_group(selections);
+        }}
+    }
+    if (any_popped) {
+        pop_special_neighbors(board, popped, pops);
+    }
+    return any_popped;
+}
+
+inline bool pop_connected_blocks(BlockBitBoard & board, int amount_required) {
+    NullPopEffects effects;
+    return pop_connected_blocks(board, amount_required, effects);
+}
+
+template <typename PopSink, typename>
+bool pop_connected_blocks
+    (BlockGrid & grid, int amount_required, ConnectedGroups & groups,
+     PopSink & effects)
+{
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+
+    groups.label(grid);
+    bool any_popped = false;
+    std::vector<VectorI> selections;
+    for (int group = 0; group != groups.group_count(); ++group) {
+        if (!is_block_color(groups.group_color(group))) continue;
+        if (groups.group_size(group) < amount_required) continue;
+
+        any_popped = true;
+        groups.copy_group(group, selections);
+        pop_grid_group(grid, selections, pops, effects);
+    }
+    return any_popped;
+}
+
+inline bool pop_connected_blocks
+    (BlockGrid & grid, int amount_required, ConnectedGroups & groups)
+{
+    NullPopEffects effects;
+    return pop_connected_blocks(grid, amount_required, groups, effects);
+}
+
+template <typename PopSink, typename>
+bool pop_connected_blocks
+    (BlockGrid & grid, int amount_required,
+     const std::vector<VectorI> & dirty_cells, GroupSearch & search,
+     PopSink & effects)
+{
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+
+    search.reset(grid.width(), grid.height());
+    bool any_popped = false;
+    std::vector<VectorI> selections;
+    for (auto r : dirty_cells) {
+        if (!grid.has_position(r) || !is_block_color(grid(r))) continue;
+        if (!search.select(grid, r, selections)) continue;
+        if (int(selections.size()) < amount_required) continue;
+
+        any_popped = true;
+        pop_grid_group(grid, selections, pops, effects);
+    }
+    return any_popped;
+}
+
+inline bool pop_connected_blocks
+    (BlockGrid & grid, int amount_required,
+     const std::vector<VectorI> & dirty_cells, GroupSearch & search)
+{
+    NullPopEffects effects;
+    return pop_connected_blocks(grid, amount_required, dirty_cells, search, effects);
+}
+
+template <typename PopSink, typename>
+bool pop_columns_blocks(BlockGrid & blocks, int pop_requirement, PopSink & effects) {
+    if (BlockBitBoard::can_represent(blocks)) {
+        BlockBitBoard bitboard(blocks);
+        if (!pop_columns_blocks(bitboard, pop_requirement, effects)) {
+            return false;
+        }
+        bitboard.store(blocks);
+        return true;
+    }
+
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+    auto popped_blocks = get_columns_popped_blocks(blocks, pop_requirement);
+    assert(popped_blocks.size() == blocks.size());
+    bool any_popped = false;
+    for (VectorI i; i != blocks.end_position(); i = blocks.next(i)) {
+        if (!popped_blocks(i)) continue;
+        pops.post(i, blocks(i));
+        blocks(i) = k_empty_block;
+        any_popped = true;
+    }
+    pops.flush();
+    return any_popped;
+}
+
+inline bool pop_columns_blocks(BlockGrid & blocks, int pop_requirement) {
+    NullPopEffects effects;
+    return pop_columns_blocks(blocks, pop_requirement, effects);
+}
+
+template <typename PopSink, typename>
+bool pop_columns_blocks(BlockBitBoard & board, int pop_requirement, PopSink & effects) {
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+
+    ColumnMasks matched;
+    bool any_popped = false;
+    for (auto kind : k_all_block_kinds) {
+        if (!find_columns_matches(board.masks_for(kind), board.width(),
+                                  board.height(), pop_requirement, matched))
+        { continue; }
+        any_popped = true;
+        auto & kind_masks = board.masks_for(kind);
+        for_each_cell(matched, 0, board.width(), [&pops, kind](VectorI r)
+            { pops.post(r, kind); });
+        for (int x = 0; x != board.width(); ++x) {
+            kind_masks[x] &= ~matched[x];
+        }
+    }
+    pops.flush();
+    return any_popped;
+}
+
+inline bool pop_columns_blocks(BlockBitBoard & board, int pop_requirement) {
+    NullPopEffects effects;
+    return pop_columns_blocks(board, pop_requirement, effects);
+}
+
+template <typename PopSink, typename>
+int clear_tetris_rows(BlockGrid & blocks, PopSink & effects) {
+    using namespace block_algorithm_detail;
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+
+    int rv = 0;
+    for (int y = 0; y != blocks.height(); ++y) {
+        bool is_filled = true;
+        for (int x = 0; x != blocks.width(); ++x) {
+            if (blocks(x, y) == k_empty_block) is_filled = false;
+        }
+        if (is_filled) {
+            ++rv;
+            for (int x = 0; x != blocks.width(); ++x) {
+                pops.post(VectorI(x, y), blocks(x, y));
+                blocks(x, y) = k_empty_block;
+            }
+        }
+    }
+    pops.flush();
+    return rv;
+}
+
+inline int clear_tetris_rows(BlockGrid & blocks) {
+    NullPopEffects effects;
+    return clear_tetris_rows(blocks, effects);
+}
+
+template <typename PopSink, typename>
+int clear_tetris_rows
+    (BlockGrid & blocks, std::vector<int> & row_fill_counts,
+     int first_row, int last_row, PopSink & effects)
+{
+    using namespace block_algorithm_detail;
+    verify_row_fill_counts("clear_tetris_rows", blocks, row_fill_counts);
+    effects.start();
+    EffectsFinisher<PopSink> finisher(effects);
+    PopBatch<PopSink> pops(effects);
+
+    int rv = 0;
+    first_row = std::max(first_row, 0);
+    last_row  = std::min(last_row , blocks.height() - 1);
+    for (int y = first_row; y <= last_row; ++y) {
+        auto & count = row_fill_counts[std::size_t(y)];
+        if (count != blocks.width()) continue;
+        ++rv;
+        for (int x = 0; x != blocks.width(); ++x) {
+            pops.post(VectorI(x, y), blocks(x, y));
+            blocks(x, y) = k_empty_block;
+        }
+        count = 0;
+    }
+    pops.flush();
+    return rv;
+}
+
+inline int clear_tetris_rows
+    (BlockGrid & blocks, std::vector<int> & row_fill_counts,
+     int first_row, int last_row)
+{
+    NullPopEffects effects;
+    return clear_tetris_rows(blocks, row_fill_counts, first_row, last_row, effects);
+}
+
+template <typename FallSink, typename>
+void make_tetris_rows_fall
+    (BlockGrid & blocks, std::vector<int> & row_fill_counts, FallSink & effects)
+{
+    using namespace block_algorithm_detail;
+    verify_row_fill_counts("make_tetris_rows_fall", blocks, row_fill_counts);
+    effects.start();
+    EffectsFinisher<FallSink> finisher(effects);
+    FallBatch<FallSink> falls(effects);
+
+    const int width = blocks.width();
+    auto row_begin = [&blocks, width](int y) { return blocks.begin() + y*width; };
+    int cleared_rows = 0;
+    for (int y = blocks.height() - 1; y != -1; --y) {
+        auto & count = row_fill_counts[std::size_t(y)];
+        if (count == 0) {
+            ++cleared_rows;
+            continue;
+        }
+        if (cleared_rows == 0) {
+            for (int x = 0; x != width; ++x) {
+                if (!is_block_color(blocks(x, y))) continue;
+                effects.post_stationary_block(VectorI(x, y), blocks(x, y));
+            }
+            continue;
+        }
+        const int dest_y = y + cleared_rows;
+        auto & dest_count = row_fill_counts[std::size_t(dest_y)];
+        const auto src = row_begin(y);
+        bool only_colors = std::all_of(src, src + width, [](BlockId bid)
+            { return bid == k_empty_block || is_block_color(bid); });
+        for (int x = 0; x != width; ++x) {
+            if (!is_block_color(blocks(x, y))) continue;
+            falls.post(VectorI(x, y), VectorI(x, dest_y), blocks(x, y));
+        }
+        if (only_colors && dest_count == 0) {
+            // the whole row lands as is
+            std::copy(src, src + width, row_begin(dest_y));
+            std::fill(src, src + width, k_empty_block);
+            dest_count = count;
+            count = 0;
+            continue;
+        }
+        // like the sub grid version, non-color blocks stay where they are
+        for (int x = 0; x != width; ++x) {
+            if (!is_block_color(blocks(x, y))) continue;
+            std::swap(blocks(x, y), blocks(x, dest_y));
+        }
+        auto count_row = [width](auto beg) {
+            return int(std::count_if(beg, beg + width, [](BlockId bid)
+                { return bid != k_empty_block; }));
+        };
+        count      = count_row(src);
+        dest_count = count_row(row_begin(dest_y));
+    }
+    falls.flush();
+}
 
-int clear_tetris_rows(BlockGrid &, PopEffects & = PopEffects::default_instance());
+inline void make_tetris_rows_fall(BlockGrid & blocks, std::vector<int> & row_fill_counts) {
+    NullFallEffects effects;
+    make_tetris_rows_fall(blocks, row_fill_counts, effects);
+}
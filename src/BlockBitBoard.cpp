@@ -0,0 +1,111 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "BlockBitBoard.hpp"
+
+#include <stdexcept>
+
+static_assert(k_max_board_size <= int(sizeof(BlockBitBoard::ColumnMask)*8),
+              "Columns must fit inside of a single mask.");
+
+/* static */ bool BlockBitBoard::can_represent(int width, int height) noexcept {
+    return    width  >= 0 && width  <= k_max_board_size
+           && height >= 0 && height <= k_max_board_size;
+}
+
+void BlockBitBoard::load(const ConstBlockSubGrid & grid) {
+    if (!can_represent(grid)) {
+        throw std::invalid_argument("BlockBitBoard::load: grid is too large to "
+                                    "be represented as a bit board.");
+    }
+    m_width  = grid.width ();
+    m_height = grid.height();
+    for (auto & masks : m_masks) {
+        std::fill(masks.begin(), masks.end(), 0);
+    }
+    for (int x = 0; x != m_width ; ++x) {
+    for (int y = 0; y != m_height; ++y) {
+        auto bid = grid(x, y);
+        if (bid == k_empty_block) continue;
+        m_masks[kind_index(bid)][x] |= (ColumnMask(1) << y);
+    }}
+}
+
+void BlockBitBoard::store(BlockSubGrid grid) const {
+    if (grid.width() != m_width || grid.height() != m_height) {
+        throw std::invalid_argument("BlockBitBoard::store: grid size must match "
+                                    "this bit board's size.");
+    }
+    for (int x = 0; x != m_width ; ++x) {
+    for (int y = 0; y != m_height; ++y) {
+        grid(x, y) = block_at(VectorI(x, y));
+    }}
+}
+
+BlockId BlockBitBoard::block_at(VectorI r) const {
+    if (r.x < 0 || r.y < 0 || r.x >= m_width || r.y >= m_height) {
+        throw std::out_of_range("BlockBitBoard::block_at: position is not on the board.");
+    }
+    auto bit = ColumnMask(1) << r.y;
+    for (int i = 0; i != k_kind_count; ++i) {
+        if (m_masks[i][r.x] & bit) return static_cast<BlockId>(i + 1);
+    }
+    return k_empty_block;
+}
+
+void BlockBitBoard::set_block(VectorI r, BlockId bid) {
+    if (r.x < 0 || r.y < 0 || r.x >= m_width || r.y >= m_height) {
+        throw std::out_of_range("BlockBitBoard::set_block: position is not on the board.");
+    }
+    auto bit = ColumnMask(1) << r.y;
+    for (auto & masks : m_masks) {
+        masks[r.x] &= ~bit;
+    }
+    if (bid != k_empty_block) {
+        m_masks[kind_index(bid)][r.x] |= bit;
+    }
+}
+
+const BlockBitBoard::ColumnMasks & BlockBitBoard::masks_for(BlockId bid) const
+    { return m_masks[kind_index(bid)]; }
+
+BlockBitBoard::ColumnMasks & BlockBitBoard::masks_for(BlockId bid)
+    { return m_masks[kind_index(bid)]; }
+
+BlockBitBoard::ColumnMask BlockBitBoard::occupied_column(int x) const {
+    ColumnMask rv = 0;
+    for (const auto & masks : m_masks) {
+        rv |= masks[x];
+    }
+    return rv;
+}
+
+BlockBitBoard::ColumnMask BlockBitBoard::full_column() const noexcept {
+    if (m_height == int(sizeof(ColumnMask)*8)) return ~ColumnMask(0);
+    return (ColumnMask(1) << m_height) - 1;
+}
+
+/* private static */ int BlockBitBoard::kind_index(BlockId bid) {
+    int idx = static_cast<int>(bid) - 1;
+    if (idx < 0 || idx >= k_kind_count) {
+        throw std::invalid_argument("BlockBitBoard::kind_index: there are no "
+                                    "masks for empty (or invalid) blocks.");
+    }
+    return idx;
+}
@@ -0,0 +1,83 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+
+#include <array>
+
+#include <cstdint>
+
+/** A board which keeps one mask per column for each kind of (non-empty) block.
+ *  Bit n of a column mask is row n of that column (so row zero, the top of
+ *  the board, is the lowest bit).
+ *
+ *  Boards larger than k_max_board_size in either dimension cannot be
+ *  represented (some scenarios size themselves to the screen), callers
+ *  should check with can_represent and use the BlockGrid algorithms
+ *  otherwise.
+ */
+class BlockBitBoard {
+public:
+    using ColumnMask  = uint32_t;
+    using ColumnMasks = std::array<ColumnMask, k_max_board_size>;
+
+    static bool can_represent(int width, int height) noexcept;
+
+    static bool can_represent(const ConstBlockSubGrid & grid) noexcept
+        { return can_represent(grid.width(), grid.height()); }
+
+    BlockBitBoard() {}
+
+    explicit BlockBitBoard(const ConstBlockSubGrid & grid) { load(grid); }
+
+    void load(const ConstBlockSubGrid &);
+
+    void store(BlockSubGrid) const;
+
+    int width() const noexcept { return m_width; }
+
+    int height() const noexcept { return m_height; }
+
+    BlockId block_at(VectorI) const;
+
+    void set_block(VectorI, BlockId);
+
+    /** @throws if the block id is empty, there is no mask for empty blocks
+     *          (use occupied_column instead)
+     */
+    const ColumnMasks & masks_for(BlockId) const;
+
+    ColumnMasks & masks_for(BlockId);
+
+    ColumnMask occupied_column(int x) const;
+
+    /** @returns a mask with a bit set for every row on the board */
+    ColumnMask full_column() const noexcept;
+
+private:
+    static constexpr const int k_kind_count = static_cast<int>(BlockId::hard_glass);
+
+    static int kind_index(BlockId);
+
+    std::array<ColumnMasks, k_kind_count> m_masks = {};
+    int m_width  = 0;
+    int m_height = 0;
+};
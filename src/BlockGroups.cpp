@@ -0,0 +1,190 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "BlockGroups.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include <cassert>
+
+void ConnectedGroups::label(const ConstBlockSubGrid & grid) {
+    m_labels.set_size(grid.width(), grid.height());
+    m_parents.clear();
+    m_colors.clear();
+
+    // first pass: provisional labels, joined with the left and upper
+    // neighbors where they match
+    auto joins = [&grid](VectorI a, VectorI b)
+        { return is_block_color(grid(a)) && grid(a) == grid(b); };
+    for (int y = 0; y != grid.height(); ++y) {
+    for (int x = 0; x != grid.width (); ++x) {
+        VectorI r(x, y);
+        if (grid(r) == k_empty_block) {
+            m_labels(r) = k_no_group;
+            continue;
+        }
+        int left = (x != 0 && joins(r, VectorI(x - 1, y))) ? find_root(m_labels(x - 1, y)) : k_no_group;
+        int up   = (y != 0 && joins(r, VectorI(x, y - 1))) ? find_root(m_labels(x, y - 1)) : k_no_group;
+        if (left == k_no_group && up == k_no_group) {
+            m_labels(r) = int(m_parents.size());
+            m_parents.push_back(m_labels(r));
+        } else if (left == k_no_group || up == k_no_group) {
+            m_labels(r) = std::max(left, up);
+        } else {
+            // the older label always wins, so roots stay the first cell seen
+            m_labels(r) = std::min(left, up);
+            m_parents[std::max(left, up)] = m_labels(r);
+        }
+    }}
+
+    // second pass: number groups by first appearance and count their sizes
+    m_remap.clear();
+    m_remap.resize(m_parents.size(), k_no_group);
+    m_group_starts.clear();
+    for (int y = 0; y != height(); ++y) {
+    for (int x = 0; x != width (); ++x) {
+        VectorI r(x, y);
+        if (m_labels(r) == k_no_group) continue;
+        auto & group = m_remap[find_root(m_labels(r))];
+        if (group == k_no_group) {
+            group = int(m_colors.size());
+            m_colors.push_back(grid(r));
+            m_group_starts.push_back(0);
+        }
+        m_labels(r) = group;
+        ++m_group_starts[group];
+    }}
+    // sizes -> starting offsets
+    int offset = 0;
+    for (auto & start : m_group_starts) {
+        int size = start;
+        start = offset;
+        offset += size;
+    }
+    m_group_starts.push_back(offset);
+
+    m_cells.resize(offset);
+    // m_remap is finished with, so it's used for each group's next free cell
+    m_remap.assign(m_group_starts.begin(), m_group_starts.end() - 1);
+    for (int y = 0; y != height(); ++y) {
+    for (int x = 0; x != width (); ++x) {
+        if (m_labels(x, y) == k_no_group) continue;
+        m_cells[m_remap[m_labels(x, y)]++] = VectorI(x, y);
+    }}
+}
+
+int ConnectedGroups::group_of(VectorI r) const {
+    if (!m_labels.has_position(r)) {
+        throw std::invalid_argument("ConnectedGroups::group_of: position is not on the labeled board.");
+    }
+    return m_labels(r);
+}
+
+int ConnectedGroups::group_size(int group) const {
+    verify_group("group_size", group);
+    return m_group_starts[group + 1] - m_group_starts[group];
+}
+
+int ConnectedGroups::group_size_at(VectorI r) const {
+    auto group = group_of(r);
+    return group == k_no_group ? 0 : group_size(group);
+}
+
+BlockId ConnectedGroups::group_color(int group) const {
+    verify_group("group_color", group);
+    return m_colors[group];
+}
+
+const VectorI * ConnectedGroups::group_begin(int group) const {
+    verify_group("group_begin", group);
+    return m_cells.data() + m_group_starts[group];
+}
+
+const VectorI * ConnectedGroups::group_end(int group) const {
+    verify_group("group_end", group);
+    return m_cells.data() + m_group_starts[group + 1];
+}
+
+void ConnectedGroups::copy_group(int group, std::vector<VectorI> & cells) const {
+    cells.assign(group_begin(group), group_end(group));
+}
+
+/* private */ void ConnectedGroups::verify_group
+    (const char * caller, int group) const
+{
+    if (group >= 0 && group < group_count()) return;
+    throw std::out_of_range("ConnectedGroups::" + std::string(caller)
+                            + ": group number is out of range.");
+}
+
+/* private */ int ConnectedGroups::find_root(int label) {
+    assert(label >= 0 && label < int(m_parents.size()));
+    int root = label;
+    while (m_parents[root] != root) root = m_parents[root];
+    // path compression
+    while (m_parents[label] != root) {
+        int next = m_parents[label];
+        m_parents[label] = root;
+        label = next;
+    }
+    return root;
+}
+
+// ----------------------------------------------------------------------------
+
+void GroupSearch::reset(int width, int height) {
+    if (m_marks.width() != width || m_marks.height() != height) {
+        m_marks.clear();
+        m_marks.set_size(width, height, 0u);
+        m_current_mark = 0;
+    }
+    if (++m_current_mark == 0) {
+        // wrapped around, old marks could be mistaken for new ones
+        for (auto & mark : m_marks) mark = 0;
+        m_current_mark = 1;
+    }
+}
+
+bool GroupSearch::select
+    (const ConstBlockSubGrid & grid, VectorI start, std::vector<VectorI> & group)
+{
+    if (grid.width() != m_marks.width() || grid.height() != m_marks.height()) {
+        throw std::invalid_argument("GroupSearch::select: grid size must match "
+                                    "the size given on reset.");
+    }
+    group.clear();
+    if (grid(start) == k_empty_block || is_visited(start)) return false;
+
+    m_marks(start) = m_current_mark;
+    group.push_back(start);
+    auto color = grid(start);
+    if (!is_block_color(color)) return true;
+    for (std::size_t i = 0; i != group.size(); ++i) {
+        auto r = group[i];
+        for (auto n : { VectorI(r.x - 1, r.y), VectorI(r.x + 1, r.y),
+                        VectorI(r.x, r.y - 1), VectorI(r.x, r.y + 1) })
+        {
+            if (!grid.has_position(n) || grid(n) != color || is_visited(n)) continue;
+            m_marks(n) = m_current_mark;
+            group.push_back(n);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+
+#include <vector>
+
+/** Labels every connected group of blocks on a board in two raster passes
+ *  (union-find over provisional labels), and keeps each group's cells so
+ *  that repeated queries on an unchanged board cost nothing more.
+ *
+ *  Colored blocks are grouped with four-way neighbors of the same color.
+ *  Any other non-empty block (glass) is a group by itself, and empty cells
+ *  belong to no group.
+ */
+class ConnectedGroups {
+public:
+    static constexpr const int k_no_group = -1;
+
+    ConnectedGroups() {}
+
+    explicit ConnectedGroups(const ConstBlockSubGrid & grid) { label(grid); }
+
+    /** Relabels all groups, scratch space is kept between calls. */
+    void label(const ConstBlockSubGrid &);
+
+    int width() const noexcept { return m_labels.width(); }
+
+    int height() const noexcept { return m_labels.height(); }
+
+    int group_count() const noexcept { return int(m_colors.size()); }
+
+    /** Groups are numbered in the order their first cell appears, scanning
+     *  rows from the top left.
+     *  @returns k_no_group for empty cells
+     */
+    int group_of(VectorI) const;
+
+    int group_size(int group) const;
+
+    /** @returns zero for empty cells */
+    int group_size_at(VectorI) const;
+
+    BlockId group_color(int group) const;
+
+    /** @returns all cells of a group, in the order they were labeled */
+    const VectorI * group_begin(int group) const;
+
+    const VectorI * group_end(int group) const;
+
+    void copy_group(int group, std::vector<VectorI> &) const;
+
+private:
+    void verify_group(const char * caller, int group) const;
+
+    int find_root(int label);
+
+    Grid<int> m_labels;
+    // provisional labels from the first pass, then final group numbers
+    std::vector<int> m_parents;
+    std::vector<int> m_remap;
+
+    std::vector<BlockId> m_colors;
+    // m_cells[m_group_starts[n] ... m_group_starts[n + 1]) are group n's cells
+    std::vector<int> m_group_starts;
+    std::vector<VectorI> m_cells;
+};
+
+/** Finds single groups by searching out from a cell, remembering which cells
+ *  have been visited since the last reset. Forgetting visited cells does not
+ *  touch the board, so many small searches cost only what they visit.
+ */
+class GroupSearch {
+public:
+    /** Forgets all visited cells, resizing if the board's size has changed. */
+    void reset(int width, int height);
+
+    /** Selects every block connected to "start" (using the same rules as
+     *  ConnectedGroups), marking them visited.
+     *  @returns false, selecting nothing, if start is empty or was already
+     *           visited
+     */
+    bool select(const ConstBlockSubGrid &, VectorI start, std::vector<VectorI> & group);
+
+private:
+    bool is_visited(VectorI r) const { return m_marks(r) == m_current_mark; }
+
+    Grid<unsigned> m_marks;
+    unsigned m_current_mark = 0;
+};
@@ -20,11 +20,15 @@
 #include "BoardStates.hpp"
 #include "Graphics.hpp"
 #include "PuyoScenario.hpp"
+#include "PuyoState.hpp"
+#include "ColumnsClone.hpp"
 #include "DialogState.hpp"
 
 #include <SFML/Window/Event.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <variant>
 #include <unordered_set>
@@ -38,6 +42,68 @@ using InvArg       = std::invalid_argument;
 
 } // end of <anonymous> namespace
 
+BoardState::~BoardState() {
+    if (m_replay_player || m_replay.frame_count() == 0 ||
+        m_replay.header().game == ReplayGame::count)
+    { return; }
+    (void)m_replay.save(k_last_replay_filename);
+}
+
+void BoardState::seek_replay(const ReplayKeyframe & keyframe) {
+    if (!m_replay_player) {
+        throw std::runtime_error("BoardState::seek_replay: state must be playing a replay.");
+    }
+    ReplayDecoder decoder { ByteView(keyframe.board_state) };
+    restore_keyframe(decoder);
+    if (!decoder.at_end()) {
+        throw std::runtime_error("BoardState::seek_replay: keyframe is longer than "
+                                 "the state it holds.");
+    }
+    m_replay_player->seek(keyframe);
+}
+
+/* static */ std::unique_ptr<BoardState> BoardState::make_for_replay
+    (const ReplayHeader & header)
+{
+    const auto & scenarios = Scenario::get_all_scenarios();
+    if (   header.game == ReplayGame::puyo_scenario
+        && (header.scenario < 0 || header.scenario >= int(scenarios.size())))
+    {
+        throw InvArg("BoardState::make_for_replay: scenario must be one of the built in "
+                     "scenarios.");
+    }
+    set_seed_position(header.seeds);
+    switch (header.game) {
+    case ReplayGame::puyo_vs      : return std::make_unique<PuyoStateVS>();
+    case ReplayGame::puyo_scenario: return std::make_unique<PuyoStateN>(header.scenario);
+    case ReplayGame::tetris       : return std::make_unique<TetrisState>();
+    case ReplayGame::tetris_ai    :
+        return std::make_unique<TetrisState>(TetrisState::Player::ai);
+    case ReplayGame::samegame     : return std::make_unique<SameGame>();
+    case ReplayGame::columns      : return std::make_unique<ColumnsState>();
+    default: break;
+    }
+    throw InvArg("BoardState::make_for_replay: header must name a game.");
+}
+
+/* static */ void BoardState::apply_replay_settings
+    (const ReplayHeader & header, Settings & settings)
+{
+    settings.tetris   = header.tetris;
+    settings.samegame = header.samegame;
+    if (header.game != ReplayGame::puyo_scenario) return;
+    auto scen_settings = settings.get_puyo_settings
+        (Scenario::get_all_scenarios().at(std::size_t(header.scenario))->name());
+    // fields the scenario does not use are left alone
+    auto apply = [](auto * setting, auto value)
+        { if (setting) *setting = value; };
+    apply(scen_settings.width_ptr          (), header.puyo.width          );
+    apply(scen_settings.height_ptr         (), header.puyo.height         );
+    apply(scen_settings.color_count_ptr    (), header.puyo.colors         );
+    apply(scen_settings.pop_requirement_ptr(), header.puyo.pop_requirement);
+    apply(scen_settings.fall_speed_ptr     (), header.puyo.fall_speed     );
+}
+
 /* protected */ void BoardState::process_event(const sf::Event & event) {
     if (event.type == sf::Event::KeyReleased) {
         if (event.key.code == sf::Keyboard::Escape) {
@@ -48,11 +114,33 @@ using InvArg       = std::invalid_argument;
 }
 
 /* protected */ void BoardState::update(double) {
+    if (m_replay_player) {
+        m_replay_player->send_frame(*this);
+        return;
+    }
+    auto turn = keyframe_turn();
+    if (turn != k_not_a_turn_start && turn >= m_next_keyframe_turn) {
+        std::vector<uint8_t> state;
+        ReplayEncoder encoder(state);
+        save_keyframe(encoder);
+        m_replay.push_keyframe(ByteView(state));
+        m_next_keyframe_turn = turn + k_keyframe_interval;
+    }
+    m_replay.push_frame(m_pc_handler.states());
     m_pc_handler.send_events(*this);
 }
 
+/* protected */ void BoardState::restore_keyframe(ReplayDecoder &) {
+    throw std::runtime_error("BoardState::restore_keyframe: this game is not keyed.");
+}
+
 /* private */ void BoardState::setup_(Settings & settings) {
     setup_board(settings);
+    ReplayHeader header;
+    header.seeds = m_seed_position;
+    describe_session(header, settings);
+    m_replay = ReplayLog(header);
+    m_next_keyframe_turn = 0;
 }
 
 /* protected */ void BoardState::set_max_colors(int n) {
@@ -89,7 +177,7 @@ using InvArg       = std::invalid_argument;
     brush.setTexture(load_builtin_block_texture());
     for (int y = 0; y != board_height; ++y) {
     for (int x = 0; x != board_width ; ++x) {
-        brush.setTextureRect(texture_rect_for_wood_board(IntDistri(0, k_wood_board_count - 1)(rng)));
+        brush.setTextureRect(texture_rect_for_wood_board(random_int(rng, 0, k_wood_board_count - 1)));
         brush.setPosition(sf::Vector2f(VectorI(x, y)*k_block_size + offset));
         target.draw(brush);
     }}
@@ -156,30 +244,46 @@ void PauseableWithFallingPieceState::handle_event(PlayControlEvent event) {
 
 // ----------------------------------------------------------------------------
 
-/* private */ void TetrisState::setup_board(const Settings & settings) {
-    const auto & conf = settings.tetris;
-    m_blocks.set_size(conf.width, conf.height);
-
-    const auto & all_p = Polyomino::all_polyminos();
-    assert(m_available_polyominos.empty());
-    m_available_polyominos.reserve(all_p.size());
-    assert(all_p.size() == PolyominoEnabledSet().size());
-    for (std::size_t i = 0; i != all_p.size(); ++i) {
-        if (conf.enabled_polyominos.test(i)) {
-            m_available_polyominos.push_back(all_p[i]);
-        }
+TetrisState::TetrisState(Player player) {
+    if (player == Player::ai) {
+        m_ai_player = std::make_unique<TetrisAi>();
     }
-    // force dominos if the set is empty
-    if (m_available_polyominos.empty()) {
-        m_available_polyominos.push_back(all_p[0]);
+}
+
+void TetrisState::save_snapshot(Snapshot & snapshot) const {
+    snapshot.blocks.pack(m_engine.blocks());
+    snapshot.piece     = m_engine.piece();
+    snapshot.fall_time = m_fall_time;
+}
+
+void TetrisState::restore_snapshot(const Snapshot & snapshot) {
+    if (   snapshot.blocks.width () != m_engine.blocks().width ()
+        || snapshot.blocks.height() != m_engine.blocks().height())
+    {
+        m_fef.setup(snapshot.blocks.width(), snapshot.blocks.height(),
+                    load_builtin_block_texture());
     }
+    m_engine.restore(snapshot.blocks, snapshot.piece);
+    m_fall_time = snapshot.fall_time;
+    m_fef.restart();
+}
 
-    reset_piece();
+/* private */ void TetrisState::setup_board(const Settings & settings) {
+    const auto & conf = settings.tetris;
+    m_engine.setup(conf.width, conf.height, conf.enabled_polyominos,
+                   next_seed(RngStream::tetris_pieces));
     m_fef.setup(conf.width, conf.height, load_builtin_block_texture());
     m_fef.set_render_blocks_merged_enabled(false);
     set_max_colors(conf.colors);
 }
 
+/* private */ void TetrisState::describe_session
+    (ReplayHeader & header, const Settings & settings) const
+{
+    header.game   = m_ai_player ? ReplayGame::tetris_ai : ReplayGame::tetris;
+    header.tetris = settings.tetris;
+}
+
 /* private */ void TetrisState::update(double et) {
     PauseableWithFallingPieceState::update(et);
     if (is_paused()) return;
@@ -187,137 +291,125 @@ void PauseableWithFallingPieceState::handle_event(PlayControlEvent event) {
         m_fef.update(et);
     } else if ((m_fall_time += (et*fall_multiplier())) > m_fall_delay) {
         m_fall_time = 0.;
-        auto temp = m_piece;
-        if (!m_piece.move_down(m_blocks)) {
-            temp.move_down(m_blocks);
-            m_piece.place(m_blocks);
-            reset_piece();
-            clear_tetris_rows(m_blocks);
-            make_tetris_rows_fall(m_blocks, m_fef);
-        }
+        (void)m_engine.descend(m_fef);
+    }
+    if (m_ai_player) {
+        m_ai_player->play(m_engine.blocks(), m_engine.piece(),
+                          m_engine.piece_number(), *this);
     }
 }
 
 /* private */ void TetrisState::draw(sf::RenderTarget & target, sf::RenderStates) const {
-    draw_fill_with_background(target, m_blocks.width(), m_blocks.height());
+    const auto & blocks = m_engine.blocks();
+    const auto & piece  = m_engine.piece();
+    draw_fill_with_background(target, blocks.width(), blocks.height());
     if (m_fef.has_effects()) {
         target.draw(m_fef);
     } else {
         sf::Sprite brush;
         brush.setTexture(load_builtin_block_texture());
-        for (int i = 0; i != m_piece.block_count(); ++i) {
-            auto loc = m_piece.block_location(i);
+        for (int i = 0; i != piece.block_count(); ++i) {
+            auto loc = piece.block_location(i);
             brush.setPosition(float(loc.x*k_block_size), float(loc.y*k_block_size));
-            brush.setTextureRect(texture_rect_for(m_piece.block_color(i)));
-            brush.setColor(base_color_for_block(m_piece.block_color(i)));
+            brush.setTextureRect(texture_rect_for(piece.block_color(i)));
+            brush.setColor(base_color_for_block(piece.block_color(i)));
             target.draw(brush);
         }
         brush.setPosition(0.f, 0.f);
-        render_blocks(m_blocks, brush, target);
-    }
-}
-
-/* private */ void TetrisState::reset_piece() {
-    assert(!m_available_polyominos.empty());
-    const auto & polys = m_available_polyominos;
-    const auto & piece = polys[IntDistri(0, polys.size() - 1)(m_rng)];
-    m_piece = piece;
-    m_piece.set_colors(map_int_to_color(k_min_colors + ( (&piece - &polys.front()) % k_max_colors )));
-    m_piece.set_location(m_blocks.width() / 2, 0);
-
-    if (m_piece.obstructed_by(m_blocks)) {
-        make_all_blocks_fall_out(m_blocks, m_fef);
+        render_blocks(blocks, brush, target);
     }
 }
 
 // ----------------------------------------------------------------------------
 
-namespace {
-
-template <typename T>
-void flip_along_trace(const Grid<T> &, Grid<T> &);
-
-} // end of <anonymous> namespace
-
 /* private */ void SameGame::setup_board(const Settings & settings) {
     const auto & conf = settings.samegame;
     m_pop_ef.assign_texture(load_builtin_block_texture());
-    m_blocks.set_size(conf.width, conf.height);
+    m_engine.setup(conf.width, conf.height, conf.colors, next_seed(RngStream::samegame_boards));
+    m_engine.set_pop_singles(!conf.gameover_on_singles);
     m_fall_ef.setup(conf.width, conf.height, load_builtin_block_texture());
-    set_max_colors(conf.colors);
-    for (auto & block : m_blocks) {
-        block = random_color(m_rng);
-    }
-    m_pop_singles_enabled = !conf.gameover_on_singles;
+
+    // hints are solved beside the game, and kept short so they show soon
+    static constexpr const double k_hint_time_budget = 0.2;
+    SameGameSolver::SearchSettings solver_settings;
+    solver_settings.time_budget = k_hint_time_budget;
+    solver_settings.pop_singles = m_engine.pops_singles();
+    m_solver = std::make_unique<SameGameSolver>(solver_settings);
+}
+
+/* private */ void SameGame::describe_session
+    (ReplayHeader & header, const Settings & settings) const
+{
+    header.game     = ReplayGame::samegame;
+    header.samegame = settings.samegame;
 }
 
 /* private */ void SameGame::update(double et) {
     BoardState::update(et);
+    take_hint();
     if (m_pop_ef.has_effects()) {
         m_pop_ef.update(et);
         if (!m_pop_ef.has_effects()) {
-            make_blocks_fall(m_blocks, m_fall_ef);
-            if (!m_fall_ef.has_effects()) {
-                try_sweep();
-            }
-        }        
+            m_engine.settle(m_fall_ef);
+            m_sweep_pending = true;
+        }
     } else if (m_fall_ef.has_effects()) {
         m_fall_ef.update(et);
-        if (!m_fall_ef.has_effects() && !m_blocks.is_empty()) {
-            try_sweep();
-        } else if (!m_fall_ef.has_effects() && !m_sweep_temp.is_empty()) {
-            flip_along_trace(m_sweep_temp, m_blocks);
-            m_sweep_temp.clear();
-        }
+    } else if (m_sweep_pending) {
+        m_engine.sweep_columns(m_fall_ef);
+        m_sweep_pending = false;
     }
-    assert(m_blocks.is_empty() ^ m_sweep_temp.is_empty());
 }
 
 /* private */ void SameGame::process_event(const sf::Event & event) {    
     BoardState::process_event(event);
-    if (m_blocks.is_empty()) return;
+    const auto & blocks = m_engine.blocks();
     switch (event.type) {
     case sf::Event::MouseMoved: {
         // no view-dependant transformations
         VectorI r(event.mouseMove.x, event.mouseMove.y);
         r.x /= (k_block_size*scale());
         r.y /= (k_block_size*scale());
-        r.x = std::max(std::min(r.x, m_blocks.width () - 1), 0);
-        r.y = std::max(std::min(r.y, m_blocks.height() - 1), 0);
+        r.x = std::max(std::min(r.x, blocks.width () - 1), 0);
+        r.y = std::max(std::min(r.y, blocks.height() - 1), 0);
         m_selection = r;
         }
         break;
     case sf::Event::MouseButtonReleased:
         do_selection();
         break;
+    case sf::Event::KeyReleased:
+        if (event.key.code == sf::Keyboard::H) show_hint();
+        break;
     default: break;
     }
 }
 
 void SameGame::handle_event(PlayControlEvent event) {
+    const auto & blocks = m_engine.blocks();
     if (event.state == PlayControlState::just_released) {
         switch (event.id) {
         case PlayControlId::down:
             ++m_selection.y;
-            if (!m_blocks.has_position(m_selection)) {
+            if (!blocks.has_position(m_selection)) {
                 m_selection.y = 0;
             }
             break;
         case PlayControlId::up:
             --m_selection.y;
-            if (!m_blocks.has_position(m_selection)) {
-                m_selection.y = m_blocks.height() - 1;
+            if (!blocks.has_position(m_selection)) {
+                m_selection.y = blocks.height() - 1;
             }
             break;
         case PlayControlId::left:
             --m_selection.x;
-            if (!m_blocks.has_position(m_selection)) {
-                m_selection.x = m_blocks.height() - 1;
+            if (!blocks.has_position(m_selection)) {
+                m_selection.x = blocks.height() - 1;
             }
             break;
         case PlayControlId::right:
             ++m_selection.x;
-            if (!m_blocks.has_position(m_selection)) {
+            if (!blocks.has_position(m_selection)) {
                 m_selection.x = 0;
             }
             break;
@@ -330,9 +422,7 @@ void SameGame::handle_event(PlayControlEvent event) {
 }
 
 /* private */ void SameGame::draw(sf::RenderTarget & target, sf::RenderStates states) const {
-    draw_fill_with_background(target,
-        m_blocks.is_empty() ? m_sweep_temp.height() : m_blocks.width (),
-        m_blocks.is_empty() ? m_sweep_temp.width () : m_blocks.height());
+    draw_fill_with_background(target, m_engine.blocks().width(), m_engine.blocks().height());
 
     DrawRectangle drect;
     drect.set_size(k_block_size, k_block_size);
@@ -344,39 +434,92 @@ void SameGame::handle_event(PlayControlEvent event) {
     if (!m_fall_ef.has_effects() && !m_pop_ef.has_effects()) {
         sf::Sprite brush;
         brush.setTexture(load_builtin_block_texture());
-        render_merged_blocks(m_blocks, brush, target);
+        render_merged_blocks(m_engine.blocks(), brush, target);
     }
 }
 
 /* private */ void SameGame::do_selection() {
-    if (m_pop_ef.has_effects() || m_fall_ef.has_effects()) return;
-    m_pop_ef.do_pop(m_blocks, m_selection, m_pop_singles_enabled);
-    if (!m_pop_ef.has_effects()) {
-        try_sweep();
+    if (m_pop_ef.has_effects() || m_fall_ef.has_effects() || m_sweep_pending) return;
+    (void)m_pop_ef.do_pop(m_engine, m_selection);
+}
+
+/* private */ void SameGame::show_hint() {
+    if (m_pop_ef.has_effects() || m_fall_ef.has_effects() || m_sweep_pending) return;
+    if (m_hint.valid()) return;
+    m_hint_board = m_engine.blocks();
+    m_hint = std::async(std::launch::async,
+        [solver = m_solver.get(), board = m_hint_board]() {
+            const auto & solution = solver->solve(board);
+            if (solution.selections.empty()) return VectorI(-1, -1);
+            return solution.selections.front();
+        });
+}
+
+/* private */ void SameGame::take_hint() {
+    using namespace std::chrono_literals;
+    if (!m_hint.valid() || m_hint.wait_for(0s) != std::future_status::ready) return;
+    auto selection = m_hint.get();
+    const auto & blocks = m_engine.blocks();
+    if (   !blocks.has_position(selection)
+        || !std::equal(blocks.begin(), blocks.end(), m_hint_board.begin(), m_hint_board.end()))
+    { return; }
+    m_selection = selection;
+}
+
+// ----------------------------------------------------------------------------
+
+ReplayState::ReplayState(ReplayLog && log):
+    m_log(std::move(log)),
+    m_player(m_log),
+    m_board_state(BoardState::make_for_replay(m_log.header()))
+{ m_board_state->assign_replay_player(m_player); }
+
+void ReplayState::update(double et) {
+    if (m_player.is_finished()) {
+        set_next_state(std::make_unique<DialogState>());
+        return;
     }
+    board_state().update(et);
 }
 
-/* private */ void SameGame::try_sweep() {
-    flip_along_trace(m_blocks, m_sweep_temp);
-    m_fall_ef.set_vector_transform(FallEffectsFull::flip_xy);
-    make_tetris_rows_fall(m_sweep_temp, m_fall_ef);
-    m_fall_ef.set_vector_transform(FallEffectsFull::identity_func);
-    if (m_fall_ef.has_effects()) {
-        m_blocks.clear();
-    } else {
-        m_sweep_temp.clear();
+void ReplayState::seek(int frame_) {
+    frame_ = std::clamp(frame_, 0, frame_count());
+    ReplayKeyframe keyframe;
+    bool has_keyframe = m_log.find_keyframe(frame_, keyframe);
+    if (has_keyframe && (frame_ < frame() || keyframe.frame > frame())) {
+        m_board_state->seek_replay(keyframe);
+    } else if (frame_ < frame()) {
+        restart();
+    }
+    while (frame() < frame_) {
+        board_state().update(ReplayLog::k_frame_time);
     }
 }
 
-namespace {
+/* private */ void ReplayState::setup_(Settings &) {
+    m_settings = std::make_unique<Settings>(Settings::TransientTag());
+    BoardState::apply_replay_settings(m_log.header(), *m_settings);
+    board_state().setup(m_settings);
+}
 
-template <typename T>
-void flip_along_trace(const Grid<T> & source, Grid<T> & dest) {
-    dest.clear();
-    dest.set_size(source.height(), source.width());
-    for (VectorI r; r != source.end_position(); r = source.next(r)) {
-        dest(r.y, r.x) = source(r);
+/* private */ void ReplayState::process_event(const sf::Event & event) {
+    if (event.type != sf::Event::KeyReleased) return;
+    switch (event.key.code) {
+    case sf::Keyboard::Escape:
+        set_next_state(std::make_unique<DialogState>());
+        break;
+    case sf::Keyboard::Left : seek(frame() - k_seek_frames); break;
+    case sf::Keyboard::Right: seek(frame() + k_seek_frames); break;
+    default: break;
     }
 }
 
-} // end of <anonymous> namespace
+/* private */ void ReplayState::restart() {
+    m_player.restart();
+    m_board_state = BoardState::make_for_replay(m_log.header());
+    m_board_state->assign_replay_player(m_player);
+    board_state().setup(m_settings);
+}
+
+/* private */ void ReplayState::draw(sf::RenderTarget & target, sf::RenderStates states) const
+    { target.draw(*m_board_state, states); }
@@ -26,13 +26,44 @@
 #include "FallingPiece.hpp"
 #include "Settings.hpp"
 #include "PlayControl.hpp"
+#include "PackedBlockGrid.hpp"
+#include "Replay.hpp"
+#include "TetrisAi.hpp"
+#include "SameGameSolver.hpp"
 
-#include <random>
+#include <future>
 
 class BoardState : public AppState, public PlayControlEventReceiver {
 public:
     using BoardOptions = Settings::Board;
 
+    /** Saves the session's replay (unless it was itself a replay, or cannot
+     *  be replayed) to k_last_replay_filename.
+     */
+    ~BoardState() override;
+
+    /** Controls come from the player in place of SFML events, and nothing is
+     *  recorded. Should be set before the first update.
+     *  @param player must outlive this state
+     */
+    void assign_replay_player(ReplayPlayer & player)
+        { m_replay_player = &player; }
+
+    /** Continues the replay (player and state both) from a keyframe this
+     *  game took while recording.
+     *  @throws std::runtime_error if the keyframe does not decode
+     */
+    void seek_replay(const ReplayKeyframe &);
+
+    /** Makes the board state a replay was recorded from (not yet set up).
+     *  Seeds are restored first, so it draws what the recorded one did.
+     *  @throws if the header's game or scenario does not exist
+     */
+    static std::unique_ptr<BoardState> make_for_replay(const ReplayHeader &);
+
+    /** Sets what a replay's board state reads from settings. */
+    static void apply_replay_settings(const ReplayHeader &, Settings &);
+
     static void draw_fill_with_background
         (sf::RenderTarget &, int board_width, int board_height,
          VectorI offset = VectorI(), sf::Color mask = sf::Color::White);
@@ -42,8 +73,14 @@ public:
          VectorI offset = VectorI());
 
 protected:
-    using Rng       = std::default_random_engine;
-    using IntDistri = std::uniform_int_distribution<int>;
+    using Rng = Pcg32;
+
+    static constexpr const int k_not_a_turn_start = -1;
+    // replays are keyed this often, so seeking steps through fewer turns
+    static constexpr const int k_keyframe_interval = 16;
+
+    // seeds are drawn from here on (effects are drawn from as members are made)
+    BoardState(): m_seed_position(seed_position()) {}
 
     double width() const final { return double(width_in_blocks ()*k_block_size); }
 
@@ -59,6 +96,26 @@ protected:
 
     virtual int height_in_blocks() const = 0;
 
+    /** Fills in which game this is and the settings it was set up with.
+     *  Sessions that cannot be replayed leave the game as count (and are
+     *  not saved).
+     */
+    virtual void describe_session(ReplayHeader &, const Settings &) const = 0;
+
+    /** @returns turns played so far, if the state may be keyed right now
+     *           (before the next frame), otherwise k_not_a_turn_start;
+     *           games that never may are replayed without keyframes
+     */
+    virtual int keyframe_turn() const { return k_not_a_turn_start; }
+
+    /** Writes everything the next frames depend on (that the replay's
+     *  header does not already hold).
+     */
+    virtual void save_keyframe(ReplayEncoder &) const {}
+
+    /** Reads what save_keyframe wrote, to continue from there. */
+    virtual void restore_keyframe(ReplayDecoder &);
+
     /** Sets board settings */
     void setup_(Settings &) final;
 
@@ -74,6 +131,10 @@ protected:
 private:
     int m_max_colors = k_min_colors;
     PlayControlEventHandler m_pc_handler;
+    SeedPosition m_seed_position;
+    ReplayLog m_replay;
+    ReplayPlayer * m_replay_player = nullptr;
+    int m_next_keyframe_turn = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -106,61 +167,147 @@ private:
 // ----------------------------------------------------------------------------
 
 class TetrisState final : public PauseableWithFallingPieceState {
+public:
+    // with the AI playing, the game runs unattended (as a demo)
+    enum class Player { human, ai };
+
+    TetrisState() {}
+
+    explicit TetrisState(Player);
+
+    struct Snapshot {
+        PackedBlockGrid blocks;
+        Polyomino piece;
+        double fall_time = 0.;
+    };
+
+    /** Reuses the snapshot's buffer where it can, so saving repeatedly into
+     *  the same snapshot does not allocate.
+     */
+    void save_snapshot(Snapshot &) const;
+
+    /** Any effects playing are dropped. */
+    void restore_snapshot(const Snapshot &);
+
+private:
     static constexpr const double k_default_fall_delay = 1.;
     void setup_board(const Settings &) override;
+    void describe_session(ReplayHeader &, const Settings &) const override;
     void update(double et) override;
 
     void draw(sf::RenderTarget &, sf::RenderStates) const override;
 
-    int width_in_blocks () const override { return m_blocks.width(); }
+    int width_in_blocks () const override { return m_engine.blocks().width(); }
 
-    int height_in_blocks() const override { return m_blocks.height(); }
+    int height_in_blocks() const override { return m_engine.blocks().height(); }
 
     int scale() const override { return 2; }
 
-    FallingPieceBase & piece_base() override { return m_piece; }
-
-    const BlockGrid & blocks() const override { return m_blocks; }
+    FallingPieceBase & piece_base() override { return m_engine.piece(); }
 
-    void reset_piece();
+    const BlockGrid & blocks() const override { return m_engine.blocks(); }
 
-    BlockGrid m_blocks;
-    Polyomino m_piece;
+    TetrisEngine m_engine;
     double m_fall_time = 0.;
 
     double m_fall_delay = k_default_fall_delay;
     FallEffectsFull m_fef;
-    std::vector<Polyomino> m_available_polyominos;
 
-    Rng m_rng { std::random_device()() };
+    std::unique_ptr<TetrisAi> m_ai_player;
 };
 
 // ----------------------------------------------------------------------------
 
 class SameGame final : public BoardState {
     void setup_board(const Settings &) override;
+    void describe_session(ReplayHeader &, const Settings &) const override;
     void update(double et) override;
     void process_event(const sf::Event &) override;
     void handle_event(PlayControlEvent) override;
 
     void draw(sf::RenderTarget &, sf::RenderStates) const override;
 
-    int width_in_blocks () const override { return m_blocks.width(); }
+    int width_in_blocks () const override { return m_engine.blocks().width(); }
 
-    int height_in_blocks() const override { return m_blocks.height(); }
+    int height_in_blocks() const override { return m_engine.blocks().height(); }
 
     int scale() const override { return 3; }
 
     void do_selection();
 
-    void try_sweep();
+    // solves for a hint off of this thread, see take_hint
+    void show_hint();
+
+    // moves the selection to the solver's first pick, once the solve is
+    // done (if the board is still the one solved)
+    void take_hint();
 
     VectorI m_selection;
-    BlockGrid m_blocks;
-    BlockGrid m_sweep_temp;
+    SameGameEngine m_engine;
+    // columns are swept once blocks have fallen
+    bool m_sweep_pending = false;
     SameGamePopEffects m_pop_ef;
     FallEffectsFull m_fall_ef;
-    bool m_pop_singles_enabled = false;
+    std::unique_ptr<SameGameSolver> m_solver;
+    // while valid, the solver is only used by the hint's thread (waited on
+    // before the solver goes)
+    std::future<VectorI> m_hint;
+    BlockGrid m_hint_board;
+};
+
+// ----------------------------------------------------------------------------
+
+/** Plays a recorded session back through the board state it was recorded
+ *  from, which sees the recorded controls in place of SFML's.
+ */
+class ReplayState final : public AppState {
+public:
+    /** @throws if the log's board state cannot be made */
+    explicit ReplayState(ReplayLog &&);
+
+    // how far the arrow keys seek: ten seconds
+    static constexpr const int k_seek_frames = 600;
+
+    /** Steps the next recorded frame, returning to the menu once none are
+     *  left. May be called without a window (to fast forward).
+     */
+    void update(double et) override;
+
+    /** Moves to the frame (clamped to the replay), from the last keyframe
+     *  before it where that is closer than the frame now. At most a keyframe
+     *  interval's turns are stepped through. Should be called after setup.
+     */
+    void seek(int frame);
+
+    bool is_finished() const noexcept { return m_player.is_finished(); }
+
+    int frame() const noexcept { return m_player.frame(); }
+
+    int frame_count() const noexcept { return m_log.frame_count(); }
+
+private:
+    // settings are the recorded ones, rather than those passed
+    void setup_(Settings &) override;
+
+    void process_event(const sf::Event &) override;
+
+    double width() const override { return board_state().width(); }
+
+    double height() const override { return board_state().height(); }
+
+    int scale() const override { return board_state().scale(); }
+
+    void draw(sf::RenderTarget &, sf::RenderStates) const override;
+
+    // back to the first frame, with a newly made board state
+    void restart();
+
+    AppState & board_state() { return *m_board_state; }
+
+    const AppState & board_state() const { return *m_board_state; }
 
-    Rng m_rng { std::random_device()() };
+    ReplayLog m_log;
+    ReplayPlayer m_player;
+    SettingsPtr m_settings;
+    std::unique_ptr<BoardState> m_board_state;
 };
@@ -0,0 +1,193 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "ChainResolver.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cassert>
+
+namespace {
+
+// records each group into a trace, while popping a single wave
+// a static effects sink, so the pops go through the templated algorithms
+class TraceRecorder final {
+public:
+    TraceRecorder(ChainTrace & trace, int wave_number, int pop_requirement):
+        m_trace(trace), m_wave_number(wave_number),
+        m_pop_requirement(pop_requirement) {}
+
+    void start() {}
+
+    void finish() {}
+
+    void post_pop_effect(VectorI, BlockId color) {
+        // glass breaking is also posted, but never last before a group
+        if (is_block_color(color)) m_last_color = color;
+    }
+
+    void post_group(const std::vector<VectorI> & group_locations);
+
+private:
+    ChainTrace & m_trace;
+    int m_wave_number;
+    int m_pop_requirement;
+    int m_group_number = 0;
+    BlockId m_last_color = k_empty_block;
+};
+
+void place_pair(BlockGrid &, const PlacedPair &);
+
+ZobristHash hash_column(const BlockGrid &, int x);
+
+} // end of <anonymous> namespace
+
+int puyo_group_score
+    (int group_size, int wave_number, int pop_requirement, int group_number)
+{
+    int delta = group_size*wave_number;
+    if (group_size > pop_requirement) {
+        delta += group_size / pop_requirement;
+    }
+    return delta + group_number;
+}
+
+void ChainTrace::clear() {
+    waves .clear();
+    groups.clear();
+    cells .clear();
+    total_score = 0;
+    final_board.clear();
+}
+
+ChainTrace resolve_chain(const BlockGrid & blocks, int pop_requirement) {
+    ChainTrace rv;
+    resolve_chain(blocks, pop_requirement, nullptr, rv);
+    return rv;
+}
+
+ChainTrace resolve_chain
+    (const BlockGrid & blocks, int pop_requirement, const PlacedPair & pair)
+{
+    ChainTrace rv;
+    resolve_chain(blocks, pop_requirement, &pair, rv);
+    return rv;
+}
+
+void resolve_chain
+    (const BlockGrid & blocks, int pop_requirement, const PlacedPair * pair,
+     ChainTrace & trace)
+{
+    if (pop_requirement < 1) {
+        throw std::invalid_argument("resolve_chain: pop requirement must be a positive integer.");
+    }
+    trace.clear();
+    trace.final_board = blocks;
+    if (pair) place_pair(trace.final_board, *pair);
+
+    auto pop_wave = [&trace, pop_requirement](auto & board) {
+        ChainTrace::Wave wave;
+        wave.first_group = int(trace.groups.size());
+        TraceRecorder recorder(trace, int(trace.waves.size()) + 1, pop_requirement);
+        if (!pop_connected_blocks(board, pop_requirement, recorder)) return false;
+        wave.group_count = int(trace.groups.size()) - wave.first_group;
+        for (int i = wave.first_group; i != int(trace.groups.size()); ++i) {
+            wave.score += trace.groups[i].score;
+        }
+        trace.total_score += wave.score;
+        trace.waves.push_back(wave);
+        return true;
+    };
+
+    if (BlockBitBoard::can_represent(trace.final_board)) {
+        BlockBitBoard board(trace.final_board);
+        do {
+            make_blocks_fall(board);
+        } while (pop_wave(board));
+        board.store(trace.final_board);
+    } else {
+        do {
+            make_blocks_fall(trace.final_board);
+        } while (pop_wave(trace.final_board));
+    }
+}
+
+ZobristHash zobrist_hash_after_chain
+    (ZobristHash hash, const BlockGrid & blocks, const PlacedPair * pair,
+     const ChainTrace & trace)
+{
+    auto rehash_column = [&](int x)
+        { hash ^= hash_column(blocks, x) ^ hash_column(trace.final_board, x); };
+    // columns popped blocks span, and those beside them
+    int first_x = blocks.width(), last_x = -1;
+    for (auto r : trace.cells) {
+        first_x = std::min(first_x, r.x - 1);
+        last_x  = std::max(last_x , r.x + 1);
+    }
+    first_x = std::max(first_x, 0);
+    last_x  = std::min(last_x , blocks.width() - 1);
+    for (int x = first_x; x <= last_x; ++x) rehash_column(x);
+    if (!pair) return hash;
+
+    // the pair's columns, which its blocks may have fallen down
+    int pair_first = std::max(std::min(pair->location.x, pair->other_location.x), 0);
+    int pair_last  = std::min(std::max(pair->location.x, pair->other_location.x),
+                              blocks.width() - 1);
+    for (int x = pair_first; x <= pair_last; ++x) {
+        if (x < first_x || x > last_x) rehash_column(x);
+    }
+    return hash;
+}
+
+namespace {
+
+void TraceRecorder::post_group
+    (const std::vector<VectorI> & group_locations)
+{
+    assert(is_block_color(m_last_color));
+    ChainTrace::Group group;
+    group.color      = m_last_color;
+    group.size       = int(group_locations.size());
+    group.score      = puyo_group_score(group.size, m_wave_number,
+                                        m_pop_requirement, m_group_number++);
+    group.first_cell = int(m_trace.cells.size());
+    m_trace.cells.insert(m_trace.cells.end(), group_locations.begin(), group_locations.end());
+    m_trace.groups.push_back(group);
+}
+
+void place_pair(BlockGrid & blocks, const PlacedPair & pair) {
+    if (blocks.has_position(pair.location)) {
+        blocks(pair.location) = pair.color;
+    }
+    if (blocks.has_position(pair.other_location)) {
+        blocks(pair.other_location) = pair.other_color;
+    }
+}
+
+ZobristHash hash_column(const BlockGrid & blocks, int x) {
+    ZobristHash rv = 0;
+    for (int y = 0; y != blocks.height(); ++y) {
+        if (blocks(x, y) == k_empty_block) continue;
+        rv ^= zobrist_key(VectorI(x, y), blocks(x, y));
+    }
+    return rv;
+}
+
+} // end of <anonymous> namespace
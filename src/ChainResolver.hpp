@@ -0,0 +1,94 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "BlockAlgorithm.hpp"
+#include "ZobristHash.hpp"
+
+#include <vector>
+
+/** Score for one popped group, as shown (and counted) by Puyo games.
+ *  @param wave_number  one for the first wave of a chain
+ *  @param group_number zero for the first group popped in a wave
+ */
+int puyo_group_score(int group_size, int wave_number, int pop_requirement,
+                     int group_number);
+
+/** A pair of blocks to place before resolving, blocks off the board are
+ *  ignored (much like a piece that is partly above the board).
+ */
+struct PlacedPair {
+    PlacedPair() {}
+    PlacedPair(VectorI location_, BlockId color_,
+               VectorI other_location_, BlockId other_color_):
+        location(location_), other_location(other_location_),
+        color(color_), other_color(other_color_) {}
+
+    VectorI location, other_location;
+    BlockId color = k_empty_block, other_color = k_empty_block;
+};
+
+struct ChainTrace {
+    struct Group {
+        BlockId color = k_empty_block;
+        int size  = 0;
+        int score = 0;
+        // into ChainTrace::cells
+        int first_cell = 0;
+    };
+
+    struct Wave {
+        // into ChainTrace::groups
+        int first_group = 0;
+        int group_count = 0;
+        int score = 0;
+    };
+
+    void clear();
+
+    std::vector<Wave > waves;
+    std::vector<Group> groups;
+    std::vector<VectorI> cells;
+    int total_score = 0;
+    BlockGrid final_board;
+};
+
+/** Resolves a whole Puyo cascade at once, without any effects or animation.
+ *  Blocks fall, every group of at least pop_requirement pops (breaking
+ *  nearby glass), and so on until nothing more pops.
+ *
+ *  Scores are identical to those PuyoPopEffects counts for the same chain.
+ */
+ChainTrace resolve_chain(const BlockGrid &, int pop_requirement);
+
+ChainTrace resolve_chain(const BlockGrid &, int pop_requirement, const PlacedPair &);
+
+/** Reuses the trace's memory, "pair" is optional. */
+void resolve_chain(const BlockGrid &, int pop_requirement, const PlacedPair * pair,
+                   ChainTrace & trace);
+
+/** Hash of the trace's final board, updated from "hash" (of the board the
+ *  chain was resolved from, without the pair) rather than hashed in full.
+ *  Only the pair's columns, and the columns popped blocks span with one to
+ *  either side (where glass breaks), are hashed again. So the board must
+ *  have settled already.
+ */
+ZobristHash zobrist_hash_after_chain
+    (ZobristHash hash, const BlockGrid &, const PlacedPair * pair, const ChainTrace &);
@@ -23,144 +23,19 @@
 
 #include <cassert>
 
-namespace {
-
-template <typename Cont>
-int wrap_index(const Cont &, int);
-
-} // end of <anonymous> namespace
-
-ColumnsPiece::ColumnsPiece(BlockId bottom, BlockId mid, BlockId top) {
-    for (auto b : { bottom, mid, top }) {
-        if (is_block_color(b)) continue;
-        throw std::invalid_argument("ColumnsPiece::ColumnsPiece: all blocks must be colors.");
-    }
-    m_blocks[k_top   ] = top;
-    m_blocks[k_middle] = mid;
-    m_blocks[k_bottom] = bottom;
-    check_invarients();
-}
-
-void ColumnsPiece::rotate_down()
-    { rotate(k_top - k_bottom); }
-
-void ColumnsPiece::rotate_up()
-    { rotate(k_bottom - k_top); }
-
-bool ColumnsPiece::descend(const BlockGrid & grid)
-    { return move(grid, VectorI(0, 1)); }
-
-void ColumnsPiece::move_left(const BlockGrid & grid)
-    { (void)move(grid, VectorI(-1, 0)); }
-
-void ColumnsPiece::move_right(const BlockGrid & grid)
-    { (void)move(grid, VectorI(1, 0)); }
-
-void ColumnsPiece::place(BlockGrid & grid) const {
-    auto my_blocks = as_blocks();
-    for (auto [pos, id] : my_blocks) {
-        // this would prevent piece placement at the top if it won't fit
-        if (!grid.has_position(pos)) continue;
-        grid(pos) = id;
-    }
-}
-
-void ColumnsPiece::set_column_position(int col) {
-    if (col < 0) {
-        throw std::invalid_argument(
-            "ColumnsPiece::set_column_position: negative columns are rejected, "
-            "because no grid may have negative columns.");
-    }
-    m_bottom = VectorI(col, -1);
-    check_invarients();
-}
-
-ColumnsPiece::BlocksArray ColumnsPiece::as_blocks() const {
-    using std::make_pair;
-    return {
-        make_pair(m_bottom                       , m_blocks[k_bottom]),
-        make_pair(m_bottom + offset_for(k_middle), m_blocks[k_middle]),
-        make_pair(m_bottom + offset_for(k_top   ), m_blocks[k_top   ])
-    };
-}
-
-VectorI ColumnsPiece::bottom() const
-    { return m_bottom; }
-
-/* private static */ constexpr const decltype(ColumnsPiece::k_positions) ColumnsPiece::k_positions;
-
-/* private static */ VectorI ColumnsPiece::offset_for
-    (decltype(k_top) piece_pos)
-{
-    switch (piece_pos) {
-    case k_top   : return VectorI(0, -2);
-    case k_middle: return VectorI(0, -1);
-    case k_bottom: return VectorI(0,  0);
-    }
-    throw std::runtime_error("ColumnsPiece::offset_for: impossible branch");
-}
-
-/* private */ void ColumnsPiece::rotate(int direction) {
-    if (direction == 0) return;
-    direction /= magnitude(direction);
-    decltype(m_blocks) t;
-    for (int i = 0; i != k_piece_size; ++i) {
-        t[wrap_index(t, i - direction)] = m_blocks[i];
-    }
-    m_blocks = t;
-
-    check_invarients();
-}
-
-/* private */ bool ColumnsPiece::move(const BlockGrid & grid, VectorI offset) {
-    int old_inside_of_grid = 0;
-    int new_inside_of_grid = 0;
-    for (auto pos : k_positions) {
-        auto block_position = m_bottom + offset_for(pos);
-        auto block_new_position = offset + block_position;
-        if (grid.has_position(block_position    )) ++old_inside_of_grid;
-        if (grid.has_position(block_new_position)) ++new_inside_of_grid;
-    }
-    if (new_inside_of_grid < old_inside_of_grid) return false;
-
-    // reject if new position is an occupied block
-    for (auto pos : k_positions) {
-        auto block_new_position = offset + m_bottom + offset_for(pos);
-        if (!grid.has_position(block_new_position)) continue;
-        if (grid(block_new_position) != k_empty_block) return false;
-    }
-
-    m_bottom += offset;
-    check_invarients();
-    return true;
-}
-
-/* private */ void ColumnsPiece::check_invarients() const {
-    for (auto i : m_blocks) {
-        assert(is_block_color(i) || i == k_empty_block);
-    }
-    assert(m_bottom.x >=  0);
-    assert(m_bottom.y >= -1);
-}
-
-// ----------------------------------------------------------------------------
-
 /* private */ void ColumnsState::setup_board(const Settings & settings) {
     (void)settings;
     const Settings::Puyo conf;
-    m_blocks.set_size(conf.width, conf.height);
+    m_engine.setup(conf.width, conf.height, conf.colors, next_seed(RngStream::columns_pieces));
     m_fall_ef.setup(conf.width, conf.height, load_builtin_block_texture());
     m_fall_ef.set_render_blocks_merged_enabled(false);
-    set_max_colors(conf.colors);
-    m_falling_piece = ColumnsPiece(random_color(m_rng), random_color(m_rng), random_color(m_rng));
-    m_falling_piece.set_column_position(m_blocks.width() / 2);
 }
 
 /* private */ int ColumnsState::width_in_blocks() const
-    { return m_blocks.width(); }
+    { return m_engine.blocks().width(); }
 
 /* private */ int ColumnsState::height_in_blocks() const
-    { return m_blocks.height(); }
+    { return m_engine.blocks().height(); }
 
 /* private */ void ColumnsState::update(double et) {
     PauseableWithFallingPieceState::update(et);
@@ -168,23 +43,10 @@ VectorI ColumnsPiece::bottom() const
     if (m_fall_ef.has_effects()) {
         m_fall_ef.update(et);
         if (!m_fall_ef.has_effects()) {
-            if (pop_columns_blocks(m_blocks, 3)) {
-                make_blocks_fall(m_blocks, m_fall_ef);
-            }
+            (void)m_engine.pop_wave(m_fall_ef);
         }
     } else if ((m_fall_offset += et*m_fall_rate*fall_multiplier()) > 1.) {
-        if (!m_falling_piece.descend(m_blocks)) {
-            m_falling_piece.place(m_blocks);
-            m_falling_piece = ColumnsPiece(random_color(m_rng), random_color(m_rng), random_color(m_rng));
-            m_falling_piece.set_column_position(m_blocks.width() / 2);
-            if (m_blocks(m_blocks.width() / 2, 0) == k_empty_block) {
-                if (pop_columns_blocks(m_blocks, 3)) {
-                    make_blocks_fall(m_blocks, m_fall_ef);
-                }
-            } else {
-                make_all_blocks_fall_out(m_blocks, m_fall_ef);
-            }
-        }
+        (void)m_engine.descend(m_fall_ef);
         m_fall_offset = 0.;
     }
     check_invarients();
@@ -234,27 +96,28 @@ VectorI ColumnsPiece::bottom() const
 /* private */ void ColumnsState::draw
     (sf::RenderTarget & target, sf::RenderStates) const
 {
-    BoardState::draw_fill_with_background(target, m_blocks.width(), m_blocks.height());
+    const auto & blocks = m_engine.blocks();
+    BoardState::draw_fill_with_background(target, blocks.width(), blocks.height());
     if (m_fall_ef.has_effects()) {
         target.draw(m_fall_ef);
         return;
     }
-    auto y_offset = [this]() {
-        auto one_below = m_falling_piece.bottom() + VectorI(0, 1);
-        if (!m_blocks.has_position(one_below)) return 0.;
-        if (m_blocks(one_below) != k_empty_block) return 0.;
+    auto y_offset = [this, &blocks]() {
+        auto one_below = m_engine.piece().bottom() + VectorI(0, 1);
+        if (!blocks.has_position(one_below)) return 0.;
+        if (blocks(one_below) != k_empty_block) return 0.;
         return m_fall_offset*k_block_size;
     } ();
     sf::Sprite brush;
     brush.setTexture(load_builtin_block_texture());
-    for (auto [pos, id] : m_falling_piece.as_blocks()) {
+    for (auto [pos, id] : m_engine.piece().as_blocks()) {
         brush.setPosition(float(pos.x*k_block_size),float(pos.y*k_block_size + y_offset));
         brush.setColor(base_color_for_block(id));
         brush.setTextureRect(texture_rect_for(id));
         target.draw(brush);
     }
     brush.setPosition(0.f, 0.f);
-    render_blocks(m_blocks, brush, target);
+    render_blocks(blocks, brush, target);
 }
 
 /* private */ void ColumnsState::check_invarients() const {
@@ -274,15 +137,3 @@ VectorI ColumnsPiece::bottom() const
         .add(m_unimplemented).add_line_seperator()
         .add(m_back_to_main);
 }
-
-namespace {
-
-template <typename Cont>
-int wrap_index(const Cont & cont, int i) {
-    auto size = std::end(cont) - std::begin(cont);
-    if (i <     0) return size - 1;
-    if (i >= size) return 0;
-    return i;
-}
-
-} // end of <anonymous> namespace
@@ -23,49 +23,12 @@
 #include "Dialog.hpp"
 #include "PlayControl.hpp"
 
-class ColumnsPiece final : public FallingPieceBase {
-public:
-    static constexpr const int k_piece_size = 3;
-    using BlocksArray = std::array<std::pair<VectorI, BlockId>, k_piece_size>;
-    ColumnsPiece() {}
-    ColumnsPiece(BlockId bottom, BlockId mid, BlockId top);
-
-    void rotate_down();
-    void rotate_up();
-
-    bool descend(const BlockGrid &);
-    void move_left(const BlockGrid &) override;
-    void move_right(const BlockGrid &) override;
-
-    void place(BlockGrid &) const;
-    // places piece at the top
-    void set_column_position(int);
-
-    // it is quite possible for a block to fall outside of the grid
-    BlocksArray as_blocks() const;
-
-    VectorI bottom() const;
-
-private:
-    void rotate_left(const BlockGrid &) override { rotate_up(); }
-    void rotate_right(const BlockGrid &) override { rotate_down(); }
-
-    enum { k_top, k_middle, k_bottom };
-    static constexpr const auto k_positions = { k_top, k_middle, k_bottom };
-
-    static VectorI offset_for(decltype(k_top));
-
-    void rotate(int direction);
-    bool move(const BlockGrid &, VectorI offset);
-    void check_invarients() const;
-
-    std::array<BlockId, k_piece_size> m_blocks = {};
-    VectorI m_bottom = VectorI(0, -1);
-};
-
 class ColumnsState final : public PauseableWithFallingPieceState {
     void setup_board(const Settings &) override;
 
+    void describe_session(ReplayHeader & header, const Settings &) const override
+        { header.game = ReplayGame::columns; }
+
     int width_in_blocks () const override;
 
     int height_in_blocks() const override;
@@ -80,16 +43,16 @@ class ColumnsState final : public PauseableWithFallingPieceState {
 
     int scale() const override { return 3; }
 
-    FallingPieceBase & piece_base() override { return m_falling_piece; }
+    FallingPieceBase & piece_base() override { return m_engine.piece(); }
 
-    const BlockGrid & blocks() const override { return m_blocks; }
+    const BlockGrid & blocks() const override { return m_engine.blocks(); }
 
     void check_invarients() const;
 #   if 0
     static constexpr const double k_fast_fall = 5.;
     static constexpr const double k_slow_fall = 1.;
 #   endif
-    ColumnsPiece m_falling_piece;
+    ColumnsEngine m_engine;
     double m_fall_offset     = 0.; // normalized to [0 1]
     double m_fall_rate       = 1.5;
 #   if 0
@@ -97,9 +60,6 @@ class ColumnsState final : public PauseableWithFallingPieceState {
     bool m_paused = false;
 #   endif
     FallEffectsFull m_fall_ef;
-
-    BlockGrid m_blocks;
-    Rng m_rng = Rng{ std::random_device()() };
 };
 
 class ColumnsSettingsDialog final : public Dialog {
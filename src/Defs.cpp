@@ -71,6 +71,32 @@ BlockId map_int_to_color(int n) {
     throw std::runtime_error("map_int_to_color: returning block id that is not a color.");
 }
 
+ColorPairQueue::ColorPairQueue(uint64_t seed, int colors):
+    m_rng(seed, uint64_t(RngStream::puyo_pairs)),
+    m_colors(colors)
+{
+    if (colors < k_min_colors || colors > k_max_colors) {
+        throw std::invalid_argument("ColorPairQueue::ColorPairQueue: colors must be in [" +
+                                    std::to_string(k_min_colors) + " " +
+                                    std::to_string(k_max_colors) + "].");
+    }
+}
+
+ColorPairQueue::ColorPair ColorPairQueue::pair_at(std::size_t n) {
+    while (n >= m_pairs.size()) {
+        draw_batch();
+    }
+    return m_pairs[n];
+}
+
+/* private */ void ColorPairQueue::draw_batch() {
+    ColorBlockDistri colors(m_colors);
+    for (std::size_t i = 0; i != k_batch_size; ++i) {
+        auto first = colors(m_rng);
+        m_pairs.emplace_back(first, colors(m_rng));
+    }
+}
+
 UString to_ustring(const std::string & str) {
     UString rv;
     rv.reserve(str.length());
@@ -78,6 +104,8 @@ UString to_ustring(const std::string & str) {
     return rv;
 }
 
+FallingPieceBase::~FallingPieceBase() {}
+
 GameSelection to_game_selection(std::size_t idx) {
     if (idx >= static_cast<std::size_t>(GameSelection::count)) {
         throw std::invalid_argument("to_game_selection: parameter does not map to a game.");
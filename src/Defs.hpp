@@ -19,7 +19,10 @@
 
 #pragma once
 
+#include "Random.hpp"
+
 #include <bitset>
+#include <vector>
 
 #include <SFML/System/Vector2.hpp>
 #include <SFML/Graphics/Rect.hpp>
@@ -76,7 +79,8 @@ struct GetEdgeValue<edge, Types...> : public GetEdgeValue<Types...> {
 [[maybe_unused]] constexpr const int k_max_board_size     = 30;
 [[maybe_unused]] constexpr const int k_free_play_scenario = -1;
 
-enum class BlockId {
+// a byte per block, so board copies stay small
+enum class BlockId : uint8_t {
     empty,
     red, blue, green, magenta, yellow,
     glass, hard_glass,
@@ -148,7 +152,7 @@ public:
 
     template <typename Rng>
     BlockId operator () (Rng & rng) const {
-        auto rv = static_cast<BlockId>(std::uniform_int_distribution<int>(k_min_colors, m_max_colors)(rng));
+        auto rv = static_cast<BlockId>(random_int(rng, k_min_colors, m_max_colors));
         if (is_block_color(rv)) return rv;
         throw std::runtime_error("ColorBlockDistri::operator(): failed to generate valid block color id.");
     }
@@ -157,6 +161,32 @@ private:
     int m_max_colors = k_min_colors;
 };
 
+/** Pairs of colors dealt from one seed, drawn a batch at a time ahead of
+ *  play. Each player keeps their own place in the queue, so every player is
+ *  dealt the same pairs.
+ */
+class ColorPairQueue final {
+public:
+    using ColorPair = std::pair<BlockId, BlockId>;
+
+    static constexpr const std::size_t k_batch_size = 64;
+
+    ColorPairQueue() {}
+
+    /** @throws if colors is not in [k_min_colors k_max_colors] */
+    ColorPairQueue(uint64_t seed, int colors);
+
+    // the nth pair dealt, drawing more batches as needed
+    ColorPair pair_at(std::size_t n);
+
+private:
+    void draw_batch();
+
+    Pcg32 m_rng;
+    int m_colors = k_min_colors;
+    std::vector<ColorPair> m_pairs;
+};
+
 enum class PlayControlId : uint8_t {
     left, right, down, up,
     rotate_left, rotate_right,
@@ -166,6 +196,17 @@ enum class PlayControlId : uint8_t {
 
 static constexpr const int k_play_control_id_count = static_cast<int>(PlayControlId::count);
 
+// kept apart from the rest of play control, so that game rules may move
+// pieces without anything of SFML's that needs linking
+struct FallingPieceBase {
+    virtual ~FallingPieceBase();
+
+    virtual void rotate_left(const BlockGrid &) = 0;
+    virtual void rotate_right(const BlockGrid &) = 0;
+    virtual void move_right(const BlockGrid &) = 0;
+    virtual void move_left(const BlockGrid &) = 0;
+};
+
 using UString = ksg::Text::UString;
 
 UString to_ustring(const std::string &);
@@ -379,6 +379,8 @@ void GameSelectionDialog::setup_() {
         auto sel = to_game_selection(m_game_slider.selected_option_index());
         if (sel == Game::puyo_clone) {
             set_next_state(make_dialog<PuyoScenarioDialog>());
+        } else if (sel == Game::tetris_clone) {
+            set_next_state(std::make_unique<TetrisState>(TetrisState::Player::ai));
         }
     });
 #   if 0
@@ -417,6 +419,11 @@ void GameSelectionDialog::on_game_selection_update() {
     using Game = GameSelection;
     switch (to_game_selection(m_game_slider.selected_option_index())) {
     case Game::puyo_clone:
+        m_scenario.set_string(U"Scenarios");
+        m_scenario.set_visible(true);
+        break;
+    case Game::tetris_clone:
+        m_scenario.set_string(U"Watch Demo");
         m_scenario.set_visible(true);
         break;
     default:
@@ -23,17 +23,18 @@
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <SFML/Graphics/Texture.hpp>
 
-#include <random>
-
 #include <cassert>
 
 namespace {
 
-using Rng = std::default_random_engine;
-
 template <typename T, bool (*del_f)(const T &)>
 void remove_from_container(std::vector<T> &);
 
+// makes room for "count" more elements, while keeping the vector's
+// geometric growth (reserving exactly would reallocate every batch)
+template <typename T>
+void reserve_for_append(std::vector<T> &, std::size_t count);
+
 } // end of <anonymous> namespace
 
 void FallEffectsFull::restart() {
@@ -43,15 +44,19 @@ void FallEffectsFull::restart() {
 
 void FallEffectsFull::setup
     (int board_width, int board_height, const sf::Texture & texture)
+{ setup(board_width, board_height, texture, next_seed(RngStream::fall_effects)); }
+
+void FallEffectsFull::setup
+    (int board_width, int board_height, const sf::Texture & texture, uint64_t seed)
 {
     auto emp = k_empty_block;
     m_blocks_copy.set_size(board_width, board_height, std::move(emp));
     m_texture = &texture;
 
-    Rng rng { std::random_device()() };
+    Pcg32 rng { seed, uint64_t(RngStream::fall_effects) };
     m_rates_for_col.resize(board_width, 1.);
     for (auto & rate : m_rates_for_col) {
-        rate = std::uniform_real_distribution<double>(0.75, 1.2)(rng)*double(board_height);
+        rate = random_real(rng, 0.75, 1.2)*double(board_height);
     }
 }
 
@@ -73,54 +78,8 @@ bool FallEffectsFull::has_effects() const {
 void FallEffectsFull::do_fall_in
     (BlockGrid & original_board, const BlockGrid & board_of_fallins)
 {
-    if (original_board.width () != board_of_fallins.width () ||
-        original_board.height() != board_of_fallins.height())
-    {
-        throw std::invalid_argument("FallEffectsFull::do_fall_in: board size mismatch");
-    }
-    if (original_board.height() == 0 || original_board.width() == 0)
-        { return; }
-
-    const auto end_position = board_of_fallins.end_position();
     m_blocks_copy.set_size(original_board.width(), original_board.height());
-    start();
-    for (VectorI r; r != end_position; r = board_of_fallins.next(r)) {
-        if (original_board(r) != k_empty_block) {
-            post_stationary_block(r, original_board(r));
-        }
-    }
-    for (int x = 0; x != original_board.width(); ++x) {
-        // find the lowest empty space
-        // (assumes all blocks have fallen)
-        int lowest_empty = original_board.height() - 1;
-        for (int y = 0; y != original_board.height(); ++y) {
-            if (original_board(x, y) == k_empty_block) continue;
-            lowest_empty = y - 1;
-            break;
-        }
-        // no space available for fallins
-        if (lowest_empty == -1) continue;
-        // start from the bottom of the fallins grid
-        int fallins_y = board_of_fallins.height() - 1;
-        // iterate empty blocks
-        for (int y = lowest_empty; y != -1; --y) {
-            // find first fallin block
-            for ( ;fallins_y != -1; --fallins_y) {
-                if (board_of_fallins(x, fallins_y) != k_empty_block) { break; }
-            }
-            // breaks once we're out of fallins
-            if (fallins_y == -1) { break; }
-            assert(board_of_fallins(x, fallins_y) != k_empty_block);
-            assert(original_board(x, y) == k_empty_block);
-
-            auto fallins_block = board_of_fallins(x, fallins_y);
-            original_board(x, y) = fallins_block;
-            post_block_fall(VectorI(x, y - lowest_empty - 1),
-                            VectorI(x, y), fallins_block);
-            --fallins_y;
-        }
-    }
-    finish();
+    make_blocks_fall_in(original_board, board_of_fallins, *this);
 }
 
 /* private */ void FallEffectsFull::start() {
@@ -130,21 +89,31 @@ void FallEffectsFull::do_fall_in
 /* private */ void FallEffectsFull::post_stationary_block
     (VectorI at, BlockId color)
 {
-    m_blocks_copy(m_transf_v(at)) = color;
+    m_blocks_copy(at) = color;
 }
 
 /* private */ void FallEffectsFull::post_block_fall
     (VectorI from, VectorI to, BlockId color)
 {
-    if (from == to) {
-        throw std::invalid_argument("FallEffectsFull::post_block_fall: from and to cannot be the same location");
+    BlockFall fall { from, to, color };
+    post_block_falls(&fall, &fall + 1);
+}
+
+/* private */ void FallEffectsFull::post_block_falls
+    (const BlockFall * beg, const BlockFall * end)
+{
+    reserve_for_append(m_fall_effects, std::size_t(end - beg));
+    for (auto itr = beg; itr != end; ++itr) {
+        if (itr->from == itr->to) {
+            throw std::invalid_argument("FallEffectsFull::post_block_falls: from and to cannot be the same location");
+        }
+        FallEffect effect;
+        effect.to    = itr->to;
+        effect.from  = itr->from;
+        effect.color = itr->color;
+        effect.rate  = m_rates_for_col[itr->from.x];
+        m_fall_effects.push_back(effect);
     }
-    FallEffect effect;
-    effect.to    = m_transf_v(to  );
-    effect.from  = m_transf_v(from);
-    effect.color = color;
-    effect.rate  = m_rates_for_col[from.x];
-    m_fall_effects.push_back(effect);
 }
 
 /* private */ void FallEffectsFull::finish() {}
@@ -203,6 +172,12 @@ bool PopEffectsPartial::has_effects() const {
     return !m_flash_effects.empty() || !m_piece_effects.empty() || !m_char_effects.empty();
 }
 
+void PopEffectsPartial::clear() {
+    m_flash_effects.clear();
+    m_piece_effects.clear();
+    m_char_effects .clear();
+}
+
 /* protected */ void PopEffectsPartial::start() {
 
 }
@@ -212,17 +187,27 @@ bool PopEffectsPartial::has_effects() const {
 }
 
 /* protected */ void PopEffectsPartial::post_pop_effect(VectorI at, BlockId block_id) {
+    BlockPop pop { at, block_id };
+    post_pop_effects(&pop, &pop + 1);
+}
+
+/* protected */ void PopEffectsPartial::post_pop_effects
+    (const BlockPop * beg, const BlockPop * end)
+{
     // we can insert further pop behaviors here
-    FlashEffect effect;
-    effect.at = at;
-    effect.block_id = block_id;
-    m_flash_effects.push_back(effect);
-    if (!m_blocks_copy.has_position(at)) {
-        throw std::runtime_error("PopEffectsFull::post_pop_effect: pop effects "
-                                 "does not have its own copy of the board, this "
-                                 "can be fixed by calling the do_pop member function");
+    reserve_for_append(m_flash_effects, std::size_t(end - beg));
+    for (auto itr = beg; itr != end; ++itr) {
+        if (!m_blocks_copy.has_position(itr->at)) {
+            throw std::runtime_error("PopEffectsFull::post_pop_effects: pop effects "
+                                     "does not have its own copy of the board, this "
+                                     "can be fixed by calling the do_pop member function");
+        }
+        FlashEffect effect;
+        effect.at = itr->at;
+        effect.block_id = itr->color;
+        m_flash_effects.push_back(effect);
+        m_blocks_copy(itr->at) = decay_block(m_blocks_copy(itr->at));
     }
-    m_blocks_copy(at) = decay_block(m_blocks_copy(at));
 }
 
 /* protected */ void PopEffectsPartial::post_number(VectorI at, int delta) {
@@ -320,16 +305,14 @@ bool PopEffectsPartial::has_effects() const {
     using std::make_pair;
     static constexpr const auto k_pi = get_pi<double>();
 
-    using RealDistri = std::uniform_real_distribution<double>;
-    RealDistri top_interval   (0, k_pi / 4.);
-    RealDistri bottom_interval(0, k_pi / 5.);
-    auto & rng = m_rng;
+    auto top_interval    = [this] { return random_real(m_rng, 0, k_pi / 4.); };
+    auto bottom_interval = [this] { return random_real(m_rng, 0, k_pi / 5.); };
 
     auto piece_list = {
-        make_pair(VectorI(0, 0), -(1./8. + 0.5)*k_pi - top_interval   (rng)),
-        make_pair(VectorI(0, 1), -(1./6. + 0.5)*k_pi - bottom_interval(rng)),
-        make_pair(VectorI(1, 0),  (1./8. - 0.5)*k_pi + top_interval   (rng)),
-        make_pair(VectorI(1, 1),  (1./6. - 0.5)*k_pi + bottom_interval(rng))
+        make_pair(VectorI(0, 0), -(1./8. + 0.5)*k_pi - top_interval   ()),
+        make_pair(VectorI(0, 1), -(1./6. + 0.5)*k_pi - bottom_interval()),
+        make_pair(VectorI(1, 0),  (1./8. - 0.5)*k_pi + top_interval   ()),
+        make_pair(VectorI(1, 1),  (1./6. - 0.5)*k_pi + bottom_interval())
     };
 
     static constexpr const auto k_init_speed = PieceEffect::k_init_speed;
@@ -359,4 +342,10 @@ void remove_from_container(std::vector<T> & cont) {
     cont.erase(std::remove_if(cont.begin(), cont.end(), del_f), cont.end());
 }
 
+template <typename T>
+void reserve_for_append(std::vector<T> & cont, std::size_t count) {
+    if (cont.size() + count <= cont.capacity()) return;
+    cont.reserve(std::max(cont.size() + count, cont.capacity()*2));
+}
+
 } // end of <anonymous> namespace
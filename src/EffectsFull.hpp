@@ -21,9 +21,9 @@
 
 #include "Defs.hpp"
 #include "BlockAlgorithm.hpp"
+#include "GameEngines.hpp"
 #include "Graphics.hpp"
 
-#include <random>
 #include <common/Util.hpp>
 #include <SFML/Graphics/Drawable.hpp>
 #include <SFML/Graphics/Color.hpp>
@@ -32,20 +32,17 @@ namespace sf { class Sprite; }
 
 class FallEffectsFull final : public FallBlockEffects, public sf::Drawable {
 public:
-    using TransformVectorFunc = VectorI(*)(VectorI);
     void restart();
     void setup(int board_width, int board_height, const sf::Texture &);
+    // each column falls at its own rate, drawn from the seed
+    void setup(int board_width, int board_height, const sf::Texture &, uint64_t seed);
     void update(double et);
     bool has_effects() const;
 
     void do_fall_in(BlockGrid & original_board, const BlockGrid & board_of_fallins);
 
-    void set_vector_transform(TransformVectorFunc f) { m_transf_v = f; }
     void set_render_blocks_merged_enabled(bool b) { m_render_merged = b; }
 
-    static VectorI identity_func(VectorI r) { return r; }
-    static VectorI flip_xy(VectorI r) { return VectorI(r.y, r.x); }
-
 private:
     struct FallEffect {
         BlockId color = k_empty_block;
@@ -60,6 +57,7 @@ private:
     void start() override;
     void post_stationary_block(VectorI, BlockId) override;
     void post_block_fall(VectorI, VectorI, BlockId) override;
+    void post_block_falls(const BlockFall * beg, const BlockFall * end) override;
     void finish() override;
     void draw(sf::RenderTarget & target, sf::RenderStates states) const override;
 
@@ -67,7 +65,6 @@ private:
     std::vector<double> m_rates_for_col;
     BlockGrid m_blocks_copy;
     const sf::Texture * m_texture = nullptr;
-    TransformVectorFunc m_transf_v = identity_func;
     bool m_render_merged = true;
 };
 
@@ -82,6 +79,9 @@ public:
 
     bool has_effects() const;
 
+    // drops every effect playing
+    void clear();
+
 protected:
     PopEffectsPartial() {}
     ~PopEffectsPartial() override {}
@@ -92,6 +92,7 @@ protected:
     void start() override;
     void finish() override;
     void post_pop_effect(VectorI at, BlockId color) override;
+    void post_pop_effects(const BlockPop * beg, const BlockPop * end) override;
     void post_number(VectorI at, int);
 
 private:
@@ -142,7 +143,7 @@ private:
     std::vector<CharEffect > m_char_effects ;
 
     BlockGrid m_blocks_copy;
-    std::default_random_engine m_rng = std::default_random_engine { std::random_device()() };
+    Pcg32 m_rng = make_rng(RngStream::pop_effects);
     const sf::Texture * m_texture = nullptr;
 };
 
@@ -150,45 +151,32 @@ private:
 
 class PuyoPopEffects final : public PopEffectsPartial {
 public:
-    bool do_pop(BlockGrid & grid, int pop_requirement) {
-        ++m_wave_number;
+    /** Pops the engine's next wave, numbering each group's score as the
+     *  engine counts it.
+     *  @returns true if anything popped
+     */
+    bool do_pop(PuyoEngine & engine) {
+        m_wave_number = engine.chain_length() + 1;
         m_group_number = 0;
-        m_pop_requirement = pop_requirement;
-        auto rv = pop_connected_blocks(grid, pop_requirement, *this);
-        set_internal_grid_copy(grid);
-        return rv;
-    }
-
-    int get_score_delta_and_reset_wave_number() {
-        int rv = m_score_delta;
-        m_score_delta = m_wave_number = 0;
-        return rv;
+        m_pop_requirement = engine.pop_requirement();
+        // popped blocks are shown decaying on the board as it was
+        set_internal_grid_copy(engine.blocks());
+        return engine.pop_wave(*this);
     }
 
 private:
-    void post_pop_effect(VectorI at, BlockId color) override {
-        PopEffectsPartial::post_pop_effect(at, color);
-        if (!is_block_color(color)) return;
-    }
-
     void post_group(const std::vector<VectorI> & group_locations) override {
         VectorI avg_tile;
         int group_size = int(group_locations.size());
         for (auto v : group_locations) avg_tile += v;
         avg_tile.x /= group_size;
         avg_tile.y /= group_size;
-        int delta = group_size*m_wave_number;
-        if (group_size > m_pop_requirement) {
-            delta += group_size / m_pop_requirement;
-        }
-        delta += m_group_number;
-        ++m_group_number;
+        int delta = puyo_group_score(group_size, m_wave_number, m_pop_requirement,
+                                     m_group_number++);
         post_number(avg_tile, delta);
-        m_score_delta += delta;
     }
 
     int m_wave_number = 0;
-    int m_score_delta = 0;
     int m_pop_requirement = 0;
     int m_group_number = 0;
 };
@@ -197,24 +185,12 @@ private:
 
 class SameGamePopEffects final : public PopEffectsPartial {
 public:
-    void do_pop(BlockGrid & grid, VectorI selection, bool pop_single_blocks) {
-        if (!grid.has_position(selection)) {
-            throw std::invalid_argument("SameGamePopEffects::do_pop: selection is outside of the grid.");
-        }
-        if (grid(selection) == k_empty_block) return;
-        set_internal_grid_copy(grid);
-        auto selections = select_connected_blocks(grid, selection);
-        if (selections.size() == 1 && !pop_single_blocks) {
-            return;
-        }
-
-        start();
-        for (auto r : selections) {
-            post_pop_effect(r, grid(r));
-            grid(r) = k_empty_block;
-        }
-        finish();
-
+    /** Removes the engine's group at the selection, if it may be removed.
+     *  @returns blocks removed
+     */
+    int do_pop(SameGameEngine & engine, VectorI selection) {
+        set_internal_grid_copy(engine.blocks());
+        return engine.pop_group(selection, *this);
     }
 
 private:
@@ -71,6 +71,11 @@ void FallingPiece::set_location(VectorI r) {
     check_invarients();
 }
 
+void FallingPiece::set_other_location(VectorI r) {
+    m_offset = r - m_location;
+    check_invarients();
+}
+
 /* private */ void FallingPiece::set_rotation(const BlockGrid & grid, VectorI offset) {
     assert(offset_ok(offset));
     auto other_location_ = m_location + offset;
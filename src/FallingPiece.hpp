@@ -47,6 +47,10 @@ public:
     // hard move, without regard to the state of the board
     void set_location(VectorI);
 
+    // hard turn, without regard to the state of the board, must be next to
+    // the location
+    void set_other_location(VectorI);
+
 private:
     void set_rotation(const BlockGrid &, VectorI offset);
     bool move(const BlockGrid &, VectorI offset);
@@ -0,0 +1,641 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "GameEngines.hpp"
+
+#include <common/Util.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cassert>
+
+namespace {
+
+using InvArg = std::invalid_argument;
+
+// forwards everything, while recording where each falling block lands
+class DirtyCellRecorder final : public FallBlockEffects {
+public:
+    DirtyCellRecorder(FallBlockEffects & effects, std::vector<VectorI> & dirty_cells):
+        m_effects(effects), m_dirty_cells(dirty_cells) {}
+
+    void start() override { m_effects.start(); }
+
+    void post_stationary_block(VectorI at, BlockId bid) override
+        { m_effects.post_stationary_block(at, bid); }
+
+    void post_block_fall(VectorI from, VectorI to, BlockId bid) override {
+        m_dirty_cells.push_back(to);
+        m_effects.post_block_fall(from, to, bid);
+    }
+
+    void post_block_falls(const BlockFall * beg, const BlockFall * end) override {
+        for (auto itr = beg; itr != end; ++itr) {
+            m_dirty_cells.push_back(itr->to);
+        }
+        m_effects.post_block_falls(beg, end);
+    }
+
+    void finish() override { m_effects.finish(); }
+
+private:
+    FallBlockEffects & m_effects;
+    std::vector<VectorI> & m_dirty_cells;
+};
+
+// forwards everything, while scoring each group as PuyoPopEffects shows it
+class ScoringPopEffects final : public PopEffects {
+public:
+    ScoringPopEffects(PopEffects & effects, int wave_number, int pop_requirement):
+        m_effects(effects), m_wave_number(wave_number),
+        m_pop_requirement(pop_requirement) {}
+
+    void start() override { m_effects.start(); }
+
+    void finish() override { m_effects.finish(); }
+
+    void post_pop_effect(VectorI at, BlockId bid) override
+        { m_effects.post_pop_effect(at, bid); }
+
+    void post_pop_effects(const BlockPop * beg, const BlockPop * end) override
+        { m_effects.post_pop_effects(beg, end); }
+
+    void post_group(const std::vector<VectorI> & group_locations) override {
+        m_score += puyo_group_score(int(group_locations.size()), m_wave_number,
+                                    m_pop_requirement, m_group_number++);
+        m_effects.post_group(group_locations);
+    }
+
+    int score() const noexcept { return m_score; }
+
+private:
+    PopEffects & m_effects;
+    int m_wave_number;
+    int m_pop_requirement;
+    int m_group_number = 0;
+    int m_score = 0;
+};
+
+// forwards everything with x and y swapped back, for algorithms run on a
+// board flipped with flip_along_trace
+class FlippedFallEffects final : public FallBlockEffects {
+public:
+    explicit FlippedFallEffects(FallBlockEffects & effects):
+        m_effects(effects) {}
+
+    void start() override { m_effects.start(); }
+
+    void post_stationary_block(VectorI at, BlockId bid) override
+        { m_effects.post_stationary_block(flip(at), bid); }
+
+    void post_block_fall(VectorI from, VectorI to, BlockId bid) override
+        { m_effects.post_block_fall(flip(from), flip(to), bid); }
+
+    void post_block_falls(const BlockFall * beg, const BlockFall * end) override {
+        m_falls.clear();
+        for (auto itr = beg; itr != end; ++itr) {
+            m_falls.push_back(BlockFall { flip(itr->from), flip(itr->to), itr->color });
+        }
+        m_effects.post_block_falls(m_falls.data(), m_falls.data() + m_falls.size());
+    }
+
+    void finish() override { m_effects.finish(); }
+
+private:
+    static VectorI flip(VectorI r) { return VectorI(r.y, r.x); }
+
+    FallBlockEffects & m_effects;
+    std::vector<BlockFall> m_falls;
+};
+
+// the row a block dropped down the column comes to rest in, -1 if the
+// column is full (the board must have settled)
+int landing_row(const BlockGrid &, int x);
+
+// on the board, and clear of its blocks
+bool fits_on(const BlockGrid &, const Polyomino &);
+
+int count_blocks(const BlockGrid &);
+
+void verify_colors(const char * caller, int colors);
+
+} // end of <anonymous> namespace
+
+PuyoEngine::PuyoEngine(int width, int height, int pop_requirement) {
+    set_size(width, height);
+    set_pop_requirement(pop_requirement);
+}
+
+void PuyoEngine::set_size(int width, int height) {
+    m_blocks.clear();
+    m_blocks.set_size(width, height, k_empty_block);
+    ++m_blocks_version;
+    m_dirty_cells.clear();
+    m_all_cells_dirty = true;
+}
+
+void PuyoEngine::set_pop_requirement(int n) {
+    if (n < 1) {
+        throw InvArg("PuyoEngine::set_pop_requirement: pop requirement must be "
+                     "a positive integer.");
+    }
+    if (n == m_pop_requirement) return;
+    m_pop_requirement = n;
+    // groups left under the old requirement may meet the new one
+    m_all_cells_dirty = true;
+}
+
+BlockSubGrid PuyoEngine::edit_blocks() {
+    m_all_cells_dirty = true;
+    ++m_blocks_version;
+    return make_sub_grid(m_blocks);
+}
+
+VectorI PuyoEngine::spawn_point() const noexcept {
+    auto w = m_blocks.width();
+    return VectorI((w / 2) - (w % 2 ? 0 : 1), 0);
+}
+
+bool PuyoEngine::is_gameover() const {
+    auto spawn = spawn_point();
+    return m_blocks.has_position(spawn) && m_blocks(spawn) != k_empty_block;
+}
+
+void PuyoEngine::push_pair(BlockId first, BlockId second) {
+    if (!is_block_color(first) || !is_block_color(second)) {
+        throw InvArg("PuyoEngine::push_pair: both blocks must be colors.");
+    }
+    m_pairs.emplace_back(first, second);
+}
+
+void PuyoEngine::legal_actions(std::vector<Action> & actions) const {
+    static const std::array<VectorI, 4> k_offsets = {
+        VectorI(0, -1), VectorI(1, 0), VectorI(0, 1), VectorI(-1, 0)
+    };
+    actions.clear();
+    for (int x = 0; x != m_blocks.width(); ++x) {
+        for (auto offset : k_offsets) {
+            Action action(x, offset);
+            if (is_legal(action)) actions.push_back(action);
+        }
+    }
+}
+
+bool PuyoEngine::is_legal(const Action & action) const noexcept {
+    auto offset = action.other_offset;
+    if (magnitude(offset.x) + magnitude(offset.y) != 1) return false;
+    auto in_range = [this](int x) { return x >= 0 && x < m_blocks.width(); };
+    return in_range(action.column) && in_range(action.column + offset.x);
+}
+
+PuyoEngine::TurnResult PuyoEngine::step_turn(const Action & action) {
+    if (!is_legal(action)) {
+        throw InvArg("PuyoEngine::step_turn: action must be legal.");
+    }
+    if (m_pairs.empty()) {
+        throw std::runtime_error("PuyoEngine::step_turn: no pair is queued.");
+    }
+    if (is_gameover()) {
+        throw std::runtime_error("PuyoEngine::step_turn: game is already over.");
+    }
+    auto [first, second] = m_pairs.front();
+    m_pairs.pop_front();
+
+    const int x = action.column;
+    const int other_x = x + action.other_offset.x;
+    VectorI location(x, landing_row(m_blocks, x));
+    VectorI other_location(other_x, landing_row(m_blocks, other_x));
+    // stacked in the same column, one lands on the other
+    if (action.other_offset.y < 0) {
+        --other_location.y;
+    } else if (action.other_offset.y > 0) {
+        --location.y;
+    }
+    PlacedPair placed(location, first, other_location, second);
+    resolve_chain(m_blocks, m_pop_requirement, &placed, m_trace);
+    std::swap(m_blocks, m_trace.final_board);
+    ++m_blocks_version;
+    // nothing is left that could pop
+    m_dirty_cells.clear();
+    m_all_cells_dirty = false;
+
+    TurnResult rv;
+    rv.score        = m_trace.total_score;
+    rv.chain_length = int(m_trace.waves.size());
+    return rv;
+}
+
+void PuyoEngine::place_pair(const PlacedPair & pair) {
+    ++m_blocks_version;
+    for (auto [r, color] : { std::make_pair(pair.location, pair.color),
+                             std::make_pair(pair.other_location, pair.other_color) })
+    {
+        if (!m_blocks.has_position(r)) continue;
+        m_blocks(r) = color;
+        m_dirty_cells.push_back(r);
+    }
+}
+
+void PuyoEngine::settle(FallBlockEffects & effects) {
+    DirtyCellRecorder recorder(effects, m_dirty_cells);
+    make_blocks_fall(m_blocks, recorder);
+    ++m_blocks_version;
+}
+
+bool PuyoEngine::pop_wave(PopEffects & effects) {
+    // only blocks which have moved (or landed) since the last pop can make
+    // new groups
+    ScoringPopEffects scorer(effects, m_turn.chain_length + 1, m_pop_requirement);
+    bool rv = m_all_cells_dirty
+        ? pop_connected_blocks(m_blocks, m_pop_requirement, scorer)
+        : pop_connected_blocks(m_blocks, m_pop_requirement, m_dirty_cells,
+                               m_group_search, scorer);
+    m_dirty_cells.clear();
+    m_all_cells_dirty = false;
+    if (rv) {
+        ++m_blocks_version;
+        ++m_turn.chain_length;
+        m_turn.score += scorer.score();
+    }
+    return rv;
+}
+
+PuyoEngine::TurnResult PuyoEngine::finish_turn() {
+    TurnResult rv;
+    std::swap(rv, m_turn);
+    return rv;
+}
+
+void PuyoEngine::push_fall_in_blocks
+    (const BlockGrid & fall_ins, FallBlockEffects & effects)
+{
+    // the board may have been changed from outside too
+    m_all_cells_dirty = true;
+    ++m_blocks_version;
+    if (!fall_ins.is_empty()) {
+        make_blocks_fall_in(m_blocks, fall_ins, effects);
+    } else {
+        make_blocks_fall(m_blocks, effects);
+    }
+}
+
+void PuyoEngine::drop_all_blocks(FallBlockEffects & effects) {
+    make_all_blocks_fall_out(m_blocks, effects);
+    ++m_blocks_version;
+}
+
+void PuyoEngine::restore(const PackedBlockGrid & packed) {
+    packed.unpack(m_blocks);
+    ++m_blocks_version;
+    m_turn = TurnResult();
+    m_dirty_cells.clear();
+    m_all_cells_dirty = true;
+}
+
+// ----------------------------------------------------------------------------
+
+void TetrisEngine::setup
+    (int width, int height, const PolyominoEnabledSet & enabled_polyominos,
+     uint64_t seed)
+{
+    m_blocks.clear();
+    m_blocks.set_size(width, height, k_empty_block);
+    m_row_fill_counts.clear();
+    m_row_fill_counts.resize(std::size_t(height), 0);
+    m_rng = Pcg32(seed, uint64_t(RngStream::tetris_pieces));
+
+    const auto & all_p = Polyomino::all_polyminos();
+    assert(all_p.size() == enabled_polyominos.size());
+    m_available_polyominos.clear();
+    for (std::size_t i = 0; i != all_p.size(); ++i) {
+        if (enabled_polyominos.test(i)) {
+            m_available_polyominos.push_back(all_p[i]);
+        }
+    }
+    // force dominos if the set is empty
+    if (m_available_polyominos.empty()) {
+        m_available_polyominos.push_back(all_p[0]);
+    }
+    (void)spawn_piece(FallBlockEffects::default_instance());
+}
+
+void TetrisEngine::legal_actions(std::vector<Action> & actions) const {
+    actions.clear();
+    const int turn_count = m_piece.is_rotation_enabled() ? 4 : 1;
+    auto piece = m_piece;
+    for (int turns = 0; turns != turn_count; ++turns) {
+        int min_x = 0, max_x = 0, min_y = 0;
+        for (int i = 0; i != piece.block_count(); ++i) {
+            auto offset = piece.block_location(i) - piece.location();
+            min_x = std::min(min_x, offset.x);
+            max_x = std::max(max_x, offset.x);
+            min_y = std::min(min_y, offset.y);
+        }
+        for (int x = -min_x; x < m_blocks.width() - max_x; ++x) {
+            piece.set_location(x, -min_y);
+            if (!fits_on(m_blocks, piece)) continue;
+            int y = -min_y;
+            for (; ; ++y) {
+                piece.set_location(x, y + 1);
+                if (!fits_on(m_blocks, piece)) break;
+            }
+            actions.emplace_back(turns, VectorI(x, y));
+        }
+        piece.hard_rotate_left();
+    }
+}
+
+bool TetrisEngine::is_legal(const Action & action) const {
+    if (action.turns < 0 || action.turns > 3) return false;
+    if (action.turns != 0 && !m_piece.is_rotation_enabled()) return false;
+    auto piece = turned_piece(action);
+    if (!fits_on(m_blocks, piece)) return false;
+    piece.set_location(action.location.x, action.location.y + 1);
+    return !fits_on(m_blocks, piece);
+}
+
+TetrisEngine::TurnResult TetrisEngine::step_turn(const Action & action) {
+    if (!is_legal(action)) {
+        throw InvArg("TetrisEngine::step_turn: action must be legal.");
+    }
+    m_piece = turned_piece(action);
+    return place_piece(FallBlockEffects::default_instance());
+}
+
+bool TetrisEngine::descend(FallBlockEffects & effects) {
+    if (m_piece.move_down(m_blocks)) return false;
+    (void)place_piece(effects);
+    return true;
+}
+
+void TetrisEngine::restore(const PackedBlockGrid & packed, const Polyomino & piece) {
+    packed.unpack(m_blocks);
+    count_row_fills(m_blocks, m_row_fill_counts);
+    m_piece = piece;
+    ++m_piece_number;
+}
+
+/* private */ TetrisEngine::TurnResult TetrisEngine::place_piece
+    (FallBlockEffects & effects)
+{
+    m_piece.place(m_blocks, m_row_fill_counts);
+    // only rows the piece was placed in may have been filled
+    int first_row = m_blocks.height(), last_row = -1;
+    for (int i = 0; i != m_piece.block_count(); ++i) {
+        first_row = std::min(first_row, m_piece.block_location(i).y);
+        last_row  = std::max(last_row , m_piece.block_location(i).y);
+    }
+    TurnResult rv;
+    rv.rows_cleared = clear_tetris_rows(m_blocks, m_row_fill_counts, first_row, last_row);
+    make_tetris_rows_fall(m_blocks, m_row_fill_counts, effects);
+    rv.topped_out = spawn_piece(effects);
+    return rv;
+}
+
+/* private */ bool TetrisEngine::spawn_piece(FallBlockEffects & effects) {
+    assert(!m_available_polyominos.empty());
+    const auto & polys = m_available_polyominos;
+    const auto & piece = polys[std::size_t(random_int(m_rng, 0, int(polys.size()) - 1))];
+    m_piece = piece;
+    ++m_piece_number;
+    m_piece.set_colors(map_int_to_color(k_min_colors + ( (&piece - &polys.front()) % k_max_colors )));
+    m_piece.set_location(m_blocks.width() / 2, 0);
+
+    if (!m_piece.obstructed_by(m_blocks)) return false;
+    make_all_blocks_fall_out(m_blocks, effects);
+    std::fill(m_row_fill_counts.begin(), m_row_fill_counts.end(), 0);
+    return true;
+}
+
+/* private */ Polyomino TetrisEngine::turned_piece(const Action & action) const {
+    auto piece = m_piece;
+    for (int i = 0; i != action.turns; ++i) {
+        piece.hard_rotate_left();
+    }
+    piece.set_location(action.location.x, action.location.y);
+    return piece;
+}
+
+// ----------------------------------------------------------------------------
+
+/* static */ int SameGameEngine::score_for_group(int size) noexcept
+    { return size > 2 ? (size - 2)*(size - 2) : 0; }
+
+void SameGameEngine::setup(int width, int height, int colors, uint64_t seed) {
+    verify_colors("SameGameEngine::setup", colors);
+    Pcg32 rng { seed, uint64_t(RngStream::samegame_boards) };
+    BlockGrid blocks;
+    blocks.set_size(width, height);
+    for (auto & block : blocks) {
+        block = ColorBlockDistri(colors)(rng);
+    }
+    set_blocks(blocks);
+}
+
+void SameGameEngine::set_blocks(const BlockGrid & blocks) {
+    m_blocks = blocks;
+    m_groups.label(m_blocks);
+    m_score = 0;
+}
+
+bool SameGameEngine::is_gameover() const {
+    for (int group = 0; group != m_groups.group_count(); ++group) {
+        if (m_groups.group_size(group) >= min_group_size()) return false;
+    }
+    return true;
+}
+
+void SameGameEngine::legal_actions(std::vector<Action> & actions) const {
+    actions.clear();
+    for (int group = 0; group != m_groups.group_count(); ++group) {
+        if (m_groups.group_size(group) < min_group_size()) continue;
+        actions.push_back(*m_groups.group_begin(group));
+    }
+}
+
+bool SameGameEngine::is_legal(const Action & selection) const {
+    if (!m_blocks.has_position(selection)) return false;
+    if (m_blocks(selection) == k_empty_block) return false;
+    return m_groups.group_size(m_groups.group_of(selection)) >= min_group_size();
+}
+
+SameGameEngine::TurnResult SameGameEngine::step_turn(const Action & selection) {
+    if (!is_legal(selection)) {
+        throw InvArg("SameGameEngine::step_turn: action must be legal.");
+    }
+    auto & no_effects = FallBlockEffects::default_instance();
+    int score_before = m_score;
+    TurnResult rv;
+    rv.blocks_removed = pop_group(selection, PopEffects::default_instance());
+    settle(no_effects);
+    sweep_columns(no_effects);
+    rv.score = m_score - score_before;
+    return rv;
+}
+
+int SameGameEngine::pop_group(VectorI selection, PopEffects & effects) {
+    if (!is_legal(selection)) return 0;
+    auto group = m_groups.group_of(selection);
+    m_pops.clear();
+    m_group_cells.assign(m_groups.group_begin(group), m_groups.group_end(group));
+    for (auto r : m_group_cells) {
+        m_pops.push_back(BlockPop { r, m_blocks(r) });
+        m_blocks(r) = k_empty_block;
+    }
+    effects.start();
+    effects.post_pop_effects(m_pops.data(), m_pops.data() + m_pops.size());
+    effects.post_group(m_group_cells);
+    effects.finish();
+
+    int removed = int(m_group_cells.size());
+    m_score += score_for_group(removed);
+    if (count_blocks(m_blocks) == 0) {
+        m_score += k_clear_bonus;
+    }
+    m_groups.label(m_blocks);
+    return removed;
+}
+
+void SameGameEngine::settle(FallBlockEffects & effects) {
+    make_blocks_fall(m_blocks, effects);
+    m_groups.label(m_blocks);
+}
+
+void SameGameEngine::sweep_columns(FallBlockEffects & effects) {
+    // columns are rows of the flipped board
+    FlippedFallEffects flipped_effects(effects);
+    flip_along_trace(m_blocks, m_flipped);
+    make_tetris_rows_fall(m_flipped, flipped_effects);
+    flip_along_trace(m_flipped, m_blocks);
+    m_groups.label(m_blocks);
+}
+
+// ----------------------------------------------------------------------------
+
+void ColumnsEngine::setup(int width, int height, int colors, uint64_t seed) {
+    verify_colors("ColumnsEngine::setup", colors);
+    m_blocks.clear();
+    m_blocks.set_size(width, height, k_empty_block);
+    m_colors = colors;
+    m_rng = Pcg32(seed, uint64_t(RngStream::columns_pieces));
+    spawn_piece();
+}
+
+void ColumnsEngine::legal_actions(std::vector<Action> & actions) const {
+    actions.clear();
+    for (int x = 0; x != m_blocks.width(); ++x) {
+        for (int rotations = 0; rotations != ColumnsPiece::k_piece_size; ++rotations) {
+            actions.emplace_back(x, rotations);
+        }
+    }
+}
+
+bool ColumnsEngine::is_legal(const Action & action) const noexcept {
+    return    action.column >= 0 && action.column < m_blocks.width()
+           && action.rotations >= 0 && action.rotations < ColumnsPiece::k_piece_size;
+}
+
+ColumnsEngine::TurnResult ColumnsEngine::step_turn(const Action & action) {
+    if (!is_legal(action)) {
+        throw InvArg("ColumnsEngine::step_turn: action must be legal.");
+    }
+    auto & no_effects = FallBlockEffects::default_instance();
+    for (int i = 0; i != action.rotations; ++i) {
+        m_piece.rotate_down();
+    }
+    m_piece.set_column_position(action.column);
+    while (m_piece.descend(m_blocks)) {}
+    auto rv = place_piece(no_effects);
+    if (rv.topped_out) return rv;
+    while (int popped = pop_wave(no_effects)) {
+        rv.blocks_popped += popped;
+        ++rv.chain_length;
+    }
+    return rv;
+}
+
+bool ColumnsEngine::descend(FallBlockEffects & effects) {
+    if (m_piece.descend(m_blocks)) return false;
+    if (!place_piece(effects).topped_out) {
+        (void)pop_wave(effects);
+    }
+    return true;
+}
+
+int ColumnsEngine::pop_wave(FallBlockEffects & effects) {
+    int blocks_before = count_blocks(m_blocks);
+    if (!pop_columns_blocks(m_blocks, k_pop_requirement)) return 0;
+    int popped = blocks_before - count_blocks(m_blocks);
+    make_blocks_fall(m_blocks, effects);
+    return popped;
+}
+
+/* private */ ColumnsEngine::TurnResult ColumnsEngine::place_piece
+    (FallBlockEffects & effects)
+{
+    m_piece.place(m_blocks);
+    spawn_piece();
+    TurnResult rv;
+    if (m_blocks(m_blocks.width() / 2, 0) != k_empty_block) {
+        make_all_blocks_fall_out(m_blocks, effects);
+        rv.topped_out = true;
+    }
+    return rv;
+}
+
+/* private */ void ColumnsEngine::spawn_piece() {
+    ColorBlockDistri colors(m_colors);
+    auto bottom = colors(m_rng);
+    auto mid    = colors(m_rng);
+    m_piece = ColumnsPiece(bottom, mid, colors(m_rng));
+    m_piece.set_column_position(m_blocks.width() / 2);
+}
+
+namespace {
+
+int landing_row(const BlockGrid & blocks, int x) {
+    for (int y = 0; y != blocks.height(); ++y) {
+        if (blocks(x, y) != k_empty_block) return y - 1;
+    }
+    return blocks.height() - 1;
+}
+
+bool fits_on(const BlockGrid & blocks, const Polyomino & piece) {
+    for (int i = 0; i != piece.block_count(); ++i) {
+        auto r = piece.block_location(i);
+        if (!blocks.has_position(r)) return false;
+        if (blocks(r) != k_empty_block) return false;
+    }
+    return true;
+}
+
+int count_blocks(const BlockGrid & blocks) {
+    return int(std::count_if(blocks.begin(), blocks.end(), [](BlockId block)
+        { return block != k_empty_block; }));
+}
+
+void verify_colors(const char * caller, int colors) {
+    if (colors >= k_min_colors && colors <= k_max_colors) return;
+    throw InvArg(std::string(caller) + ": colors must be in [" +
+                 std::to_string(k_min_colors) + " " +
+                 std::to_string(k_max_colors) + "].");
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,406 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "ChainResolver.hpp"
+#include "ColumnsPiece.hpp"
+#include "PackedBlockGrid.hpp"
+#include "Polyomino.hpp"
+
+#include <deque>
+#include <vector>
+
+// Each game's rules, without anything drawn or timed. Engines play a whole
+// turn at once with step_turn, as fast as the rules allow. Board states
+// play the same rules a step at a time (so each step may be animated),
+// passing their effects in as sinks.
+//
+// Nothing here needs any of SFML's libraries (only the header only
+// sf::Vector2), so engines link into tools without a display.
+
+/** Puyo's rules, where a turn is a pair dropped into place and the whole
+ *  chain that follows.
+ */
+class PuyoEngine final {
+public:
+    using ColorPair = std::pair<BlockId, BlockId>;
+
+    static constexpr const int k_default_pop_requirement = 4;
+
+    /** Where the pair is dropped, straight down from above the board. Whether
+     *  a falling pair could reach there is not considered.
+     */
+    struct Action {
+        Action() {}
+        Action(int column_, VectorI other_offset_):
+            column(column_), other_offset(other_offset_) {}
+
+        // of the pair's first block
+        int column = 0;
+        // of the second block from the first, a step in any direction
+        VectorI other_offset = VectorI(0, -1);
+    };
+
+    struct TurnResult {
+        int score = 0;
+        // waves that popped anything
+        int chain_length = 0;
+    };
+
+    PuyoEngine() {}
+
+    /** @throws if the pop requirement is not a positive integer */
+    PuyoEngine(int width, int height, int pop_requirement);
+
+    /** Empties the board. */
+    void set_size(int width, int height);
+
+    /** A new requirement has the next pop consider the whole board.
+     *  @throws if the pop requirement is not a positive integer
+     */
+    void set_pop_requirement(int);
+
+    int pop_requirement() const noexcept { return m_pop_requirement; }
+
+    const BlockGrid & blocks() const noexcept { return m_blocks; }
+
+    /** The next pop considers the whole board, and the version moves on.
+     *  Blocks left hanging by changes made through this fall on the next
+     *  call to push_fall_in_blocks (which also moves the version on again,
+     *  for changes made later).
+     */
+    BlockSubGrid edit_blocks();
+
+    // changes whenever blocks do, so results worked out from them can be
+    // kept until it does
+    std::size_t blocks_version() const noexcept { return m_blocks_version; }
+
+    // where each pair first appears
+    VectorI spawn_point() const noexcept;
+
+    // once the spawn point is covered, the next pair cannot come into play
+    bool is_gameover() const;
+
+    // -------------------------------- turns ---------------------------------
+
+    // pairs are dropped in the order pushed
+    void push_pair(BlockId first, BlockId second);
+
+    int queued_pairs() const noexcept { return int(m_pairs.size()); }
+
+    /** Every legal action, always in the same order (replaces what was in
+     *  "actions").
+     */
+    void legal_actions(std::vector<Action> & actions) const;
+
+    // both blocks must drop down columns of the board
+    bool is_legal(const Action &) const noexcept;
+
+    /** Drops the first pair queued, and resolves the whole chain it starts.
+     *  @throws if the action is not legal, if no pair is queued, or if the
+     *          game is over
+     */
+    TurnResult step_turn(const Action &);
+
+    // --------------------------- a step at a time ---------------------------
+
+    /** For a pair that came to rest by falling, blocks off of the board are
+     *  lost.
+     */
+    void place_pair(const PlacedPair &);
+
+    void settle(FallBlockEffects &);
+
+    /** Each group is scored as part of the wave after the last that popped
+     *  this turn.
+     *  @returns true if anything popped
+     */
+    bool pop_wave(PopEffects &);
+
+    // waves popped this turn so far
+    int chain_length() const noexcept { return m_turn.chain_length; }
+
+    /** @returns the turn's score and chain, which then start over */
+    TurnResult finish_turn();
+
+    /** Drops the fall-ins (see make_blocks_fall_in), or lets the board settle
+     *  if there are none.
+     */
+    void push_fall_in_blocks(const BlockGrid &, FallBlockEffects &);
+
+    // every block falls out of the board, as when a game is lost
+    void drop_all_blocks(FallBlockEffects &);
+
+    void restore(const PackedBlockGrid &);
+
+private:
+    BlockGrid m_blocks;
+    std::size_t m_blocks_version = 0;
+    int m_pop_requirement = k_default_pop_requirement;
+    TurnResult m_turn;
+    std::deque<ColorPair> m_pairs;
+
+    // only groups including these cells may pop, unless all are dirty
+    std::vector<VectorI> m_dirty_cells;
+    bool m_all_cells_dirty = true;
+    GroupSearch m_group_search;
+
+    ChainTrace m_trace;
+};
+
+// ----------------------------------------------------------------------------
+
+/** Tetris' rules (as TetrisState plays them), where a turn is a piece put
+ *  into place, and rows it fills cleared. A piece with no room to appear
+ *  empties the board, and play goes on.
+ */
+class TetrisEngine final {
+public:
+    /** Where the piece comes to rest, as TetrisAi::Placement describes it. */
+    struct Action {
+        Action() {}
+        Action(int turns_, VectorI location_):
+            turns(turns_), location(location_) {}
+
+        // left turns from how the piece is facing now
+        int turns = 0;
+        VectorI location;
+    };
+
+    struct TurnResult {
+        int rows_cleared = 0;
+        // the next piece had no room to appear
+        bool topped_out = false;
+    };
+
+    /** @param enabled_polyominos indexes Polyomino::all_polyminos, if none
+     *         are enabled dominos are played
+     *  @param seed pieces are drawn from this
+     */
+    void setup(int width, int height, const PolyominoEnabledSet & enabled_polyominos,
+               uint64_t seed);
+
+    const BlockGrid & blocks() const noexcept { return m_blocks; }
+
+    const Polyomino & piece() const noexcept { return m_piece; }
+
+    // to move and turn the piece as it falls
+    Polyomino & piece() noexcept { return m_piece; }
+
+    /** Changes whenever the piece is replaced (spawned, or restored), so
+     *  that a player can tell a new piece from the last one.
+     */
+    int piece_number() const noexcept { return m_piece_number; }
+
+    // -------------------------------- turns ---------------------------------
+
+    /** Every place the piece can be dropped to, straight down from the top
+     *  of the board, turned each way it can turn (replaces what was in
+     *  "actions"). Pieces that look the same turned some other way give the
+     *  same places more than once.
+     */
+    void legal_actions(std::vector<Action> & actions) const;
+
+    // the piece must be on the board, clear of its blocks, and resting on
+    // something
+    bool is_legal(const Action &) const;
+
+    /** @throws if the action is not legal */
+    TurnResult step_turn(const Action &);
+
+    // --------------------------- a step at a time ---------------------------
+
+    /** Moves the piece down a row, or places it if it cannot move. Rows
+     *  falling into cleared ones (or out of the board, on topping out) are
+     *  posted to the effects.
+     *  @returns true if the piece was placed
+     */
+    bool descend(FallBlockEffects &);
+
+    void restore(const PackedBlockGrid &, const Polyomino &);
+
+private:
+    TurnResult place_piece(FallBlockEffects &);
+
+    bool spawn_piece(FallBlockEffects &);
+
+    Polyomino turned_piece(const Action &) const;
+
+    BlockGrid m_blocks;
+    // number of blocks in each row of m_blocks
+    std::vector<int> m_row_fill_counts;
+    Polyomino m_piece;
+    int m_piece_number = 0;
+    std::vector<Polyomino> m_available_polyominos;
+    Pcg32 m_rng;
+};
+
+// ----------------------------------------------------------------------------
+
+/** SameGame's rules, where a turn is a group removed, the blocks above it
+ *  falling into its place, and columns emptied closing up.
+ */
+class SameGameEngine final {
+public:
+    // any cell of the group to remove
+    using Action = VectorI;
+
+    struct TurnResult {
+        int blocks_removed = 0;
+        int score = 0;
+    };
+
+    // scored on top of the last group, for leaving the board empty
+    static constexpr const int k_clear_bonus = 1000;
+
+    // (n - 2)^2 for a group of n blocks
+    static int score_for_group(int size) noexcept;
+
+    /** Fills the board with random colors.
+     *  @throws if colors is not in [k_min_colors k_max_colors]
+     */
+    void setup(int width, int height, int colors, uint64_t seed);
+
+    void set_blocks(const BlockGrid &);
+
+    // without this, groups must have at least two blocks to be removed
+    void set_pop_singles(bool b) { m_pop_singles = b; }
+
+    bool pops_singles() const noexcept { return m_pop_singles; }
+
+    const BlockGrid & blocks() const noexcept { return m_blocks; }
+
+    // of all turns so far
+    int score() const noexcept { return m_score; }
+
+    // there are no groups left that may be removed
+    bool is_gameover() const;
+
+    // -------------------------------- turns ---------------------------------
+
+    /** One cell of each group that may be removed (replaces what was in
+     *  "actions").
+     */
+    void legal_actions(std::vector<Action> & actions) const;
+
+    bool is_legal(const Action &) const;
+
+    /** @throws if the action is not legal */
+    TurnResult step_turn(const Action &);
+
+    // --------------------------- a step at a time ---------------------------
+
+    /** Removes the group at the selection, if it may be removed.
+     *  @returns blocks removed
+     */
+    int pop_group(VectorI selection, PopEffects &);
+
+    void settle(FallBlockEffects &);
+
+    // empty columns are closed up, by what is left of them moving right
+    void sweep_columns(FallBlockEffects &);
+
+private:
+    // min size a group must be to be removed
+    int min_group_size() const noexcept { return m_pop_singles ? 1 : 2; }
+
+    BlockGrid m_blocks;
+    BlockGrid m_flipped;
+    // always labeling the board as it is now
+    ConnectedGroups m_groups;
+    std::vector<BlockPop> m_pops;
+    std::vector<VectorI> m_group_cells;
+    bool m_pop_singles = false;
+    int m_score = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+/** Columns' rules (as ColumnsState plays them), where a turn is a piece
+ *  dropped into place, and each wave of lines popping that follows. A piece
+ *  with no room to appear empties the board, and play goes on.
+ */
+class ColumnsEngine final {
+public:
+    static constexpr const int k_pop_requirement = 3;
+
+    struct Action {
+        Action() {}
+        Action(int column_, int rotations_):
+            column(column_), rotations(rotations_) {}
+
+        int column = 0;
+        // times the piece is rotated down, from how it is now
+        int rotations = 0;
+    };
+
+    struct TurnResult {
+        int blocks_popped = 0;
+        // waves that popped anything
+        int chain_length = 0;
+        // the next piece had no room to appear
+        bool topped_out = false;
+    };
+
+    /** @throws if colors is not in [k_min_colors k_max_colors]
+     *  @param seed pieces are drawn from this
+     */
+    void setup(int width, int height, int colors, uint64_t seed);
+
+    const BlockGrid & blocks() const noexcept { return m_blocks; }
+
+    const ColumnsPiece & piece() const noexcept { return m_piece; }
+
+    // to move and rotate the piece as it falls
+    ColumnsPiece & piece() noexcept { return m_piece; }
+
+    // -------------------------------- turns ---------------------------------
+
+    /** Every column, with each rotation (replaces what was in "actions"). */
+    void legal_actions(std::vector<Action> & actions) const;
+
+    bool is_legal(const Action &) const noexcept;
+
+    /** @throws if the action is not legal */
+    TurnResult step_turn(const Action &);
+
+    // --------------------------- a step at a time ---------------------------
+
+    /** Moves the piece down a row, or places it if it cannot move, after
+     *  which the first wave pops.
+     *  @returns true if the piece was placed
+     */
+    bool descend(FallBlockEffects &);
+
+    /** Pops every line long enough, and lets what is left fall.
+     *  @returns blocks popped
+     */
+    int pop_wave(FallBlockEffects &);
+
+private:
+    TurnResult place_piece(FallBlockEffects &);
+
+    void spawn_piece();
+
+    BlockGrid m_blocks;
+    ColumnsPiece m_piece;
+    int m_colors = k_min_colors;
+    Pcg32 m_rng;
+};
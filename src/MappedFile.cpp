@@ -0,0 +1,110 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#ifdef MACRO_PLATFORM_LINUX
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+ByteView ByteView::subview(std::size_t position, std::size_t length) const {
+    if (position > m_size || length > m_size - position) {
+        throw std::out_of_range("ByteView::subview: view must hold the whole range.");
+    }
+    return ByteView(m_data + position, length);
+}
+
+// ----------------------------------------------------------------------------
+
+MappedFile::MappedFile(const std::string & filename) {
+    static auto throw_cannot = [](const std::string & what, const std::string & filename_)
+        { throw std::runtime_error("MappedFile::MappedFile: cannot " + what + " \"" + filename_ + "\"."); };
+#   ifdef MACRO_PLATFORM_LINUX
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) throw_cannot("open", filename);
+    struct stat status;
+    if (::fstat(fd, &status) == -1) {
+        ::close(fd);
+        throw_cannot("read", filename);
+    }
+    // an empty file cannot be mapped, but there is nothing to read anyway
+    if (status.st_size > 0) {
+        auto size = std::size_t(status.st_size);
+        void * mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            m_mapping      = static_cast<const uint8_t *>(mapping);
+            m_mapping_size = size;
+        }
+    }
+    ::close(fd);
+    if (m_mapping || status.st_size == 0) return;
+    // some file systems do not map, those are read as everywhere else
+#   endif
+    std::ifstream fin;
+    fin.open(filename, std::ios::binary);
+    if (!fin) throw_cannot("open", filename);
+    m_read.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    if (fin.bad()) throw_cannot("read", filename);
+}
+
+MappedFile::MappedFile(std::vector<uint8_t> && bytes_):
+    m_read(std::move(bytes_))
+{}
+
+MappedFile::MappedFile(MappedFile && rhs) noexcept
+    { swap(rhs); }
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile & MappedFile::operator = (MappedFile && rhs) noexcept {
+    if (this != &rhs) {
+        MappedFile temp(std::move(rhs));
+        swap(temp);
+    }
+    return *this;
+}
+
+ByteView MappedFile::bytes() const noexcept {
+    if (m_mapping) return ByteView(m_mapping, m_mapping_size);
+    return ByteView(m_read);
+}
+
+void MappedFile::swap(MappedFile & rhs) noexcept {
+    std::swap(m_read        , rhs.m_read        );
+    std::swap(m_mapping     , rhs.m_mapping     );
+    std::swap(m_mapping_size, rhs.m_mapping_size);
+}
+
+/* private */ void MappedFile::unmap() noexcept {
+#   ifdef MACRO_PLATFORM_LINUX
+    if (m_mapping) {
+        ::munmap(const_cast<uint8_t *>(m_mapping), m_mapping_size);
+    }
+#   endif
+    m_mapping      = nullptr;
+    m_mapping_size = 0;
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+/** A read only run of bytes, owned by something else. */
+class ByteView final {
+public:
+    ByteView() {}
+
+    ByteView(const uint8_t * data_, std::size_t size_):
+        m_data(data_), m_size(size_) {}
+
+    explicit ByteView(const std::vector<uint8_t> & bytes):
+        m_data(bytes.data()), m_size(bytes.size()) {}
+
+    const uint8_t * data() const noexcept { return m_data; }
+
+    std::size_t size() const noexcept { return m_size; }
+
+    bool empty() const noexcept { return m_size == 0; }
+
+    const uint8_t * begin() const noexcept { return m_data; }
+
+    const uint8_t * end() const noexcept { return m_data + m_size; }
+
+    /** @throws std::out_of_range if the view does not have that many bytes */
+    ByteView subview(std::size_t position, std::size_t length) const;
+
+private:
+    const uint8_t * m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+/** A file's bytes, read only. Where the platform allows it, the file is
+ *  memory mapped, so only the pages that are read are ever loaded (and
+ *  scanning the start of many files is cheap). Elsewhere it is read whole.
+ */
+class MappedFile final {
+public:
+    MappedFile() {}
+
+    /** @throws std::runtime_error if the file cannot be opened or read */
+    explicit MappedFile(const std::string & filename);
+
+    /** Holds bytes already read in some other way (like from a stream). */
+    explicit MappedFile(std::vector<uint8_t> &&);
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&) noexcept;
+
+    ~MappedFile();
+
+    MappedFile & operator = (const MappedFile &) = delete;
+
+    MappedFile & operator = (MappedFile &&) noexcept;
+
+    ByteView bytes() const noexcept;
+
+    bool is_mapped() const noexcept { return m_mapping != nullptr; }
+
+    void swap(MappedFile &) noexcept;
+
+private:
+    void unmap() noexcept;
+
+    // if not mapped
+    std::vector<uint8_t> m_read;
+    const uint8_t * m_mapping = nullptr;
+    std::size_t m_mapping_size = 0;
+};
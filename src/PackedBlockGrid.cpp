@@ -0,0 +1,81 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "PackedBlockGrid.hpp"
+
+#include <stdexcept>
+#include <string>
+
+static_assert(static_cast<int>(BlockId::hard_glass) < 16,
+              "Every block id must fit inside of four bits.");
+
+void PackedBlockGrid::pack(const ConstBlockSubGrid & grid) {
+    m_width  = grid.width ();
+    m_height = grid.height();
+    m_cells.assign((std::size_t(m_width*m_height) + 1) / 2, 0);
+    std::size_t i = 0;
+    for (VectorI r; r != grid.end_position(); r = grid.next(r), ++i) {
+        m_cells[i / 2] |= uint8_t(static_cast<uint8_t>(grid(r)) << ((i % 2)*4));
+    }
+}
+
+void PackedBlockGrid::unpack(BlockSubGrid grid) const {
+    if (grid.width() != m_width || grid.height() != m_height) {
+        throw std::invalid_argument("PackedBlockGrid::unpack: grid size must "
+                                    "match this snapshot's size.");
+    }
+    std::size_t i = 0;
+    for (VectorI r; r != grid.end_position(); r = grid.next(r), ++i) {
+        grid(r) = static_cast<BlockId>((m_cells[i / 2] >> ((i % 2)*4)) & 0xF);
+    }
+}
+
+void PackedBlockGrid::unpack(BlockGrid & grid) const {
+    if (grid.width() != m_width || grid.height() != m_height) {
+        grid.set_size(m_width, m_height, k_empty_block);
+    }
+    unpack(make_sub_grid(grid));
+}
+
+BlockId PackedBlockGrid::block_at(VectorI r) const {
+    auto i = index_of("block_at", r);
+    return static_cast<BlockId>((m_cells[i / 2] >> ((i % 2)*4)) & 0xF);
+}
+
+void PackedBlockGrid::set_block(VectorI r, BlockId bid) {
+    auto i = index_of("set_block", r);
+    auto shift = (i % 2)*4;
+    auto & byte = m_cells[i / 2];
+    byte = uint8_t((byte & ~(0xF << shift)) | (static_cast<uint8_t>(bid) << shift));
+}
+
+bool PackedBlockGrid::operator == (const PackedBlockGrid & rhs) const noexcept {
+    return    m_width == rhs.m_width && m_height == rhs.m_height
+           && m_cells == rhs.m_cells;
+}
+
+/* private */ std::size_t PackedBlockGrid::index_of
+    (const char * caller, VectorI r) const
+{
+    if (r.x < 0 || r.y < 0 || r.x >= m_width || r.y >= m_height) {
+        throw std::out_of_range("PackedBlockGrid::" + std::string(caller)
+                                + ": position is not on the board.");
+    }
+    return std::size_t(r.x + r.y*m_width);
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+
+#include <vector>
+
+#include <cstdint>
+
+/** A snapshot of a board, stored as four bits per block in one contiguous
+ *  buffer (a 30x30 board fits in 450 bytes). Blocks are packed in the same
+ *  order as BlockGrid iterates them, two per byte with the first in the
+ *  low bits.
+ *
+ *  Algorithms do not run on this form directly, a snapshot is unpacked back
+ *  into a BlockGrid (or loaded into a BlockBitBoard through one) first.
+ */
+class PackedBlockGrid {
+public:
+    PackedBlockGrid() {}
+
+    explicit PackedBlockGrid(const ConstBlockSubGrid & grid) { pack(grid); }
+
+    /** Reuses the buffer already held, where it is large enough. */
+    void pack(const ConstBlockSubGrid &);
+
+    /** @throws if the grid is not the same size as this snapshot */
+    void unpack(BlockSubGrid) const;
+
+    /** Resizes the grid to match this snapshot first. */
+    void unpack(BlockGrid &) const;
+
+    int width() const noexcept { return m_width; }
+
+    int height() const noexcept { return m_height; }
+
+    BlockId block_at(VectorI) const;
+
+    void set_block(VectorI, BlockId);
+
+    const uint8_t * data() const noexcept { return m_cells.data(); }
+
+    std::size_t byte_size() const noexcept { return m_cells.size(); }
+
+    bool operator == (const PackedBlockGrid &) const noexcept;
+
+    bool operator != (const PackedBlockGrid & rhs) const noexcept
+        { return !(*this == rhs); }
+
+private:
+    std::size_t index_of(const char * caller, VectorI) const;
+
+    std::vector<uint8_t> m_cells;
+    int m_width  = 0;
+    int m_height = 0;
+};
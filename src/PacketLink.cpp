@@ -0,0 +1,182 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "PacketLink.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string>
+
+#ifdef MACRO_PLATFORM_LINUX
+#   include <arpa/inet.h>
+#   include <netinet/in.h>
+#   include <sys/socket.h>
+#   include <unistd.h>
+#endif
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+using BytesQueue = std::deque<Bytes>;
+
+class LoopbackLink final : public PacketLink {
+public:
+    LoopbackLink(std::shared_ptr<BytesQueue> outbox, std::shared_ptr<BytesQueue> inbox):
+        m_outbox(std::move(outbox)), m_inbox(std::move(inbox)) {}
+
+    void send(ByteView bytes) override
+        { m_outbox->emplace_back(bytes.begin(), bytes.end()); }
+
+    bool receive(Bytes & packet) override {
+        if (m_inbox->empty()) return false;
+        packet = std::move(m_inbox->front());
+        m_inbox->pop_front();
+        return true;
+    }
+
+private:
+    std::shared_ptr<BytesQueue> m_outbox;
+    std::shared_ptr<BytesQueue> m_inbox;
+};
+
+#ifdef MACRO_PLATFORM_LINUX
+sockaddr_in make_loopback_address(uint16_t port);
+#endif
+
+} // end of <anonymous> namespace
+
+/* static */ std::pair<std::unique_ptr<PacketLink>, std::unique_ptr<PacketLink>>
+    PacketLink::make_loopback_pair()
+{
+    auto first_to_second = std::make_shared<BytesQueue>();
+    auto second_to_first = std::make_shared<BytesQueue>();
+    return std::make_pair(std::make_unique<LoopbackLink>(first_to_second, second_to_first),
+                          std::make_unique<LoopbackLink>(second_to_first, first_to_second));
+}
+
+// ----------------------------------------------------------------------------
+
+#ifdef MACRO_PLATFORM_LINUX
+UdpLink::UdpLink(uint16_t local_port, uint16_t remote_port):
+    m_remote_port(remote_port)
+{
+    m_socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_socket == -1) {
+        throw std::runtime_error("UdpLink::UdpLink: cannot make a socket.");
+    }
+    auto address = make_loopback_address(local_port);
+    if (::bind(m_socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+        ::close(m_socket);
+        throw std::runtime_error("UdpLink::UdpLink: cannot bind port " +
+                                 std::to_string(local_port) + ".");
+    }
+}
+
+UdpLink::~UdpLink() { ::close(m_socket); }
+
+void UdpLink::send(ByteView bytes) {
+    auto address = make_loopback_address(m_remote_port);
+    // a peer not yet listening is the same as a lost packet
+    (void)::sendto(m_socket, bytes.data(), bytes.size(), 0,
+                   reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+}
+
+bool UdpLink::receive(std::vector<uint8_t> & packet) {
+    uint8_t buffer[k_max_packet_size];
+    while (true) {
+        sockaddr_in from {};
+        socklen_t from_size = sizeof(from);
+        auto size = ::recvfrom(m_socket, buffer, sizeof(buffer), 0,
+                               reinterpret_cast<sockaddr *>(&from), &from_size);
+        // would block, or errors (like a peer refusing an earlier packet)
+        // which leave nothing to read
+        if (size < 0) return false;
+        if (   from.sin_addr.s_addr != htonl(INADDR_LOOPBACK)
+            || from.sin_port != htons(m_remote_port))
+        { continue; }
+        packet.assign(buffer, buffer + size);
+        return true;
+    }
+}
+#else
+UdpLink::UdpLink(uint16_t, uint16_t)
+    { throw std::runtime_error("UdpLink::UdpLink: sockets are not supported on this platform."); }
+
+UdpLink::~UdpLink() {}
+
+void UdpLink::send(ByteView) {}
+
+bool UdpLink::receive(std::vector<uint8_t> &) { return false; }
+#endif
+
+// ----------------------------------------------------------------------------
+
+ConditionedLink::ConditionedLink
+    (std::unique_ptr<PacketLink> && link, const Conditions & conditions, uint64_t seed):
+    m_link(std::move(link)),
+    m_conditions(conditions),
+    m_rng(seed)
+{
+    if (!m_link) {
+        throw std::invalid_argument("ConditionedLink::ConditionedLink: link must not be null.");
+    }
+    if (   conditions.latency < 0. || conditions.jitter < 0.
+        || conditions.loss < 0. || conditions.loss > 1.)
+    {
+        throw std::invalid_argument("ConditionedLink::ConditionedLink: conditions must be "
+                                    "non-negative, and loss no more than one.");
+    }
+}
+
+void ConditionedLink::send(ByteView bytes) {
+    if (random_real(m_rng, 0., 1.) < m_conditions.loss) return;
+    HeldPacket held;
+    held.due = m_time + m_conditions.latency + random_real(m_rng, 0., 1.)*m_conditions.jitter;
+    held.bytes.assign(bytes.begin(), bytes.end());
+    m_held.emplace_back(std::move(held));
+}
+
+void ConditionedLink::update(double et) {
+    m_link->update(et);
+    m_time += et;
+    // stable, so that packets due at once go in the order they were sent
+    auto not_due = std::stable_partition(m_held.begin(), m_held.end(),
+        [this](const HeldPacket & held) { return held.due <= m_time; });
+    std::stable_sort(m_held.begin(), not_due,
+        [](const HeldPacket & lhs, const HeldPacket & rhs) { return lhs.due < rhs.due; });
+    for (auto itr = m_held.begin(); itr != not_due; ++itr) {
+        m_link->send(ByteView(itr->bytes));
+    }
+    m_held.erase(m_held.begin(), not_due);
+}
+
+namespace {
+
+#ifdef MACRO_PLATFORM_LINUX
+sockaddr_in make_loopback_address(uint16_t port) {
+    sockaddr_in rv {};
+    rv.sin_family      = AF_INET;
+    rv.sin_port        = htons(port);
+    rv.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return rv;
+}
+#endif
+
+} // end of <anonymous> namespace
@@ -0,0 +1,123 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "MappedFile.hpp"
+#include "Random.hpp"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
+/** Sends and receives whole datagrams, never blocking. Datagrams may be
+ *  lost, repeated or reordered (as UDP's are), so anything built on a link
+ *  must cope with that itself.
+ */
+class PacketLink {
+public:
+    virtual ~PacketLink() {}
+
+    virtual void send(ByteView) = 0;
+
+    /** @returns false if nothing has arrived (packet is left as it was) */
+    virtual bool receive(std::vector<uint8_t> & packet) = 0;
+
+    /** Called once a frame, for links that hold anything back. */
+    virtual void update(double /* et */) {}
+
+    /** Two links joined to each other in memory, what one sends the other
+     *  receives (in order, and without loss).
+     */
+    static std::pair<std::unique_ptr<PacketLink>, std::unique_ptr<PacketLink>>
+        make_loopback_pair();
+};
+
+/** A UDP socket bound to a port of the loopback address, exchanging
+ *  datagrams with another port there (so two instances on one machine may
+ *  play each other). Datagrams from anywhere else are ignored.
+ *
+ *  Only built with POSIX sockets (MACRO_PLATFORM_LINUX), elsewhere it cannot
+ *  be made.
+ */
+class UdpLink final : public PacketLink {
+public:
+    static constexpr const std::size_t k_max_packet_size = 1024;
+
+    /** @throws std::runtime_error if the port cannot be bound */
+    UdpLink(uint16_t local_port, uint16_t remote_port);
+
+    UdpLink(const UdpLink &) = delete;
+
+    UdpLink & operator = (const UdpLink &) = delete;
+
+    ~UdpLink() override;
+
+    void send(ByteView) override;
+
+    bool receive(std::vector<uint8_t> &) override;
+
+private:
+    int m_socket = -1;
+    uint16_t m_remote_port = 0;
+};
+
+/** Holds back and drops what another link sends, as a slower and lossier
+ *  network would, so netplay may be tried on one machine. Time only moves
+ *  with update, so the same conditions and seed delay and drop the same
+ *  packets.
+ */
+class ConditionedLink final : public PacketLink {
+public:
+    struct Conditions {
+        // seconds each packet is held back, plus up to jitter more (which
+        // may reorder them)
+        double latency = 0.;
+        double jitter  = 0.;
+        // chance each packet is dropped, in [0 1]
+        double loss    = 0.;
+    };
+
+    /** @throws std::invalid_argument if any condition is negative, or the
+     *          loss is more than one
+     */
+    ConditionedLink(std::unique_ptr<PacketLink> &&, const Conditions &, uint64_t seed);
+
+    void send(ByteView) override;
+
+    bool receive(std::vector<uint8_t> & packet) override
+        { return m_link->receive(packet); }
+
+    // passes on the packets now due
+    void update(double et) override;
+
+private:
+    struct HeldPacket {
+        double due = 0.;
+        std::vector<uint8_t> bytes;
+    };
+
+    std::unique_ptr<PacketLink> m_link;
+    Conditions m_conditions;
+    Pcg32 m_rng;
+    double m_time = 0.;
+    std::vector<HeldPacket> m_held;
+};
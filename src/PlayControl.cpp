@@ -32,8 +32,6 @@ static PlayControlState update_state(PlayControlState old_state, bool is_press)
 
 PlayControlEventReceiver::~PlayControlEventReceiver() {}
 
-FallingPieceBase::~FallingPieceBase() {}
-
 std::size_t EntryHasher::operator () (const SfEventEntry & entry) const noexcept
     { return (entry.index() << 16) ^ alt_hash(entry); }
 
@@ -92,9 +90,14 @@ void PlayControlEventHandler::update(const sf::Event & event) {
     }
 }
 
-void PlayControlEventHandler::send_events(PlayControlEventReceiver & receiver) {
-    send_events_(receiver);
-    degrade_states();
+void PlayControlEventHandler::send_events(PlayControlEventReceiver & receiver)
+    { send_events(m_state_array, receiver); }
+
+/* static */ void PlayControlEventHandler::send_events
+    (PlayControlArray & states, PlayControlEventReceiver & receiver)
+{
+    send_events_(states, receiver);
+    degrade_states(states);
 }
 
 /* private static */ PlayControlEventHandler::PlayControlArray PlayControlEventHandler::
@@ -239,9 +242,8 @@ void PlayControlEventHandler::send_events(PlayControlEventReceiver & receiver) {
     });
 }
 
-/* private */ void PlayControlEventHandler::degrade_states() {
-    // degrade states
-    for (auto & state : m_state_array) {
+/* static */ void PlayControlEventHandler::degrade_states(PlayControlArray & states) {
+    for (auto & state : states) {
         using Pcs = PlayControlState;
         switch (state) {
         case Pcs::just_pressed  : state = Pcs::still_pressed ; break;
@@ -253,11 +255,11 @@ void PlayControlEventHandler::send_events(PlayControlEventReceiver & receiver) {
     }
 }
 
-/* private */ void PlayControlEventHandler::send_events_
-    (PlayControlEventReceiver & receiver) const
+/* private static */ void PlayControlEventHandler::send_events_
+    (const PlayControlArray & states, PlayControlEventReceiver & receiver)
 {
-    for (const auto & state : m_state_array) {
-        auto idx = std::size_t(&state - &m_state_array.front());
+    for (const auto & state : states) {
+        auto idx = std::size_t(&state - &states.front());
         assert(idx < static_cast<std::size_t>(PlayControlId::count));
         if (state == PlayControlState::still_released) continue;
         receiver.handle_event(PlayControlEvent(static_cast<PlayControlId>(idx), state));
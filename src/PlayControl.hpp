@@ -70,17 +70,6 @@ struct PlayControlEventReceiver {
     virtual void handle_event(PlayControlEvent) = 0;
 };
 
-// ----------------------------------------------------------------------------
-
-struct FallingPieceBase {
-    virtual ~FallingPieceBase();
-
-    virtual void rotate_left(const BlockGrid &) = 0;
-    virtual void rotate_right(const BlockGrid &) = 0;
-    virtual void move_right(const BlockGrid &) = 0;
-    virtual void move_left(const BlockGrid &) = 0;
-};
-
 // ---------------------------- SFML relevant stuff ---------------------------
 
 struct JoystickEntry {
@@ -154,6 +143,18 @@ public:
     void update(const sf::Event &);
     // does not send still_released events
     void send_events(PlayControlEventReceiver &);
+
+    /** As the above, for states that come from somewhere other than SFML
+     *  (like a replay). The states are degraded afterwards.
+     */
+    static void send_events(PlayControlArray &, PlayControlEventReceiver &);
+
+    // the states the next send_events call will send
+    const PlayControlArray & states() const { return m_state_array; }
+
+    // just pressed/released become still pressed/released
+    static void degrade_states(PlayControlArray &);
+
     void set_mappings(const PlayControlSet & playset) {
         m_mappings    = playset;
         m_state_array = make_default_play_control_array();
@@ -172,8 +173,7 @@ private:
     void update_button(const sf::Event &, PlayControlSetConstIter);
     void update_axis  (const sf::Event &, PlayControlSetConstIter);
 
-    void degrade_states();
-    void send_events_(PlayControlEventReceiver &) const;
+    static void send_events_(const PlayControlArray &, PlayControlEventReceiver &);
 
     PlayControlArray m_state_array = make_default_play_control_array();
     PlayControlSet   m_mappings    = make_default_play_control_set  ();
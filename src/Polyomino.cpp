@@ -227,6 +227,13 @@ void Polyomino::move_left(const BlockGrid & grid)
 void Polyomino::set_location(int x, int y)
     { m_location = VectorI(x, y); }
 
+void Polyomino::hard_rotate_left() {
+    if (!m_rotation_enabled) return;
+    for (auto & block : m_blocks) {
+        block.offset = rotate_plus_halfpi(block.offset);
+    }
+}
+
 void Polyomino::place(BlockGrid & grid) const {
     for (const auto & block : m_blocks) {
         auto loc = block.offset + m_location;
@@ -235,6 +242,20 @@ void Polyomino::place(BlockGrid & grid) const {
     }
 }
 
+void Polyomino::place(BlockGrid & grid, std::vector<int> & row_fill_counts) const {
+    if (int(row_fill_counts.size()) != grid.height()) {
+        throw std::invalid_argument("Polyomino::place: there must be exactly one fill count for each row of the grid.");
+    }
+    for (const auto & block : m_blocks) {
+        auto loc = block.offset + m_location;
+        if (!grid.has_position(loc)) continue;
+        if (grid(loc) == k_empty_block && block.color != k_empty_block) {
+            ++row_fill_counts[std::size_t(loc.y)];
+        }
+        grid(loc) = block.color;
+    }
+}
+
 void Polyomino::set_colors(BlockId i)
     { for (auto & block : m_blocks) { block.color = i; } }
 
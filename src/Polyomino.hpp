@@ -61,11 +61,17 @@ public:
     void move_right(const BlockGrid &);
     void move_left(const BlockGrid &);
     void set_location(int x, int y);
+    // hard turn, without regard to the state of any board (does nothing if
+    // rotation is disabled)
+    void hard_rotate_left();
     void place(BlockGrid &) const;
+    // also counts each newly filled cell in its row's fill count
+    void place(BlockGrid &, std::vector<int> & row_fill_counts) const;
     VectorI location() const { return m_location; }
     void set_colors(BlockId);
     void enable_rotation() { m_rotation_enabled = true; }
     void disable_rotation() { m_rotation_enabled = false; }
+    bool is_rotation_enabled() const { return m_rotation_enabled; }
 
     int block_count() const;
     BlockId block_color(int) const;
@@ -24,6 +24,171 @@
 #include <common/TestSuite.hpp>
 
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+// low enough to lose to any board still in play, and still a float (as
+// leaves are stored)
+constexpr const double k_lost_value = -1e30;
+
+// rounded to a float, whether or not it goes into the transposition table,
+// so that a value is the same whichever thread resolved the board first
+float evaluate_board(const BlockGrid &, VectorI spawn, const PuyoAiWeights &);
+
+int column_height(const BlockGrid &, int x);
+
+TranspositionTable::Value pack_leaf(int chain_score, float value);
+
+void unpack_leaf(TranspositionTable::Value, int & chain_score, float & value);
+
+// leaves depend on more than their boards, this is xor'ed into their keys
+// so that a leaf searched with other settings is never found
+ZobristHash leaf_context_key(int pop_requirement, VectorI spawn);
+
+// names in the weights file, in declaration order
+using WeightField = std::pair<const char *, double PuyoAiWeights::*>;
+const std::array<WeightField, PuyoAiWeights::k_count> k_weight_fields = { {
+    { "chain_score"     , &PuyoAiWeights::chain_score      },
+    { "adjacent_pairs"  , &PuyoAiWeights::adjacent_pairs   },
+    { "height_past_half", &PuyoAiWeights::height_past_half },
+    { "bumpiness"       , &PuyoAiWeights::bumpiness        }
+} };
+
+struct GridReachables {
+    bool get(VectorI r) const { return grid(r); }
+    void clear(VectorI r) { grid(r) = false; }
+
+    Grid<bool> & grid;
+};
+
+// same layout as ReachabilityCache
+struct BitReachables {
+    bool get(VectorI r) const;
+    void clear(VectorI r);
+
+    std::vector<uint64_t> & bits;
+    int height;
+};
+
+/** Starts from a set of every cell on the board, and takes away those the
+ *  pivot cannot reach.
+ */
+template <typename ReachableSet>
+void find_reachables(VectorI pivot, const ConstBlockSubGrid &, ReachableSet &);
+
+// ------------------------- for plan_frame_inputs ---------------------------
+
+using HeldMask = uint8_t;
+
+constexpr HeldMask held_bit(PlayControlId id)
+    { return HeldMask(1u << static_cast<unsigned>(id)); }
+
+// states searched before giving up on a target, it is several times what
+// any reachable target on a 6 by 12 board takes
+constexpr const std::size_t k_max_frame_search_nodes = std::size_t(1) << 16;
+
+struct FrameRules {
+    FrameRules(const BlockGrid &, const TurnPlan &, double frame_time_,
+               double fall_delay_);
+
+    double frame_time, fall_delay, fast_fall;
+    // the pivot's row when landing on the targets
+    int landing_row;
+    int target_x;
+    // holding down, from a timer of zero
+    int frames_per_fall;
+    // lowest empty row of each column
+    std::vector<int> rest_rows;
+};
+
+// as the board counts them, holding down
+int frames_until_fall(double fall_time, const FrameRules &);
+
+struct FrameSearchNode {
+    static constexpr const int k_no_parent = -1;
+
+    FallingPiece piece;
+    double fall_time = 0.;
+    double move_time = 0.;
+    // what this frame's input holds, a bit per PlayControlId
+    HeldMask held = 0;
+    // not part of the state, only of how it was reached
+    int parent = k_no_parent;
+    int frames = 0;
+    // (on the targets)
+    bool has_landed = false;
+};
+
+/** Columns are settled stacks, and a pivot never rises more than a row (by
+ *  kicking up off of what is below), so one that has fallen past the top of
+ *  a column between it and its target never gets there.
+ */
+bool can_still_reach(const FrameSearchNode &, const FrameRules &);
+
+/** Never more than the frames a pair needs to land, which is at least the
+ *  time to fall the rest of the way (and once more, onto what stops it)
+ *  holding down the whole time. Less a row on the top row, where turning up
+ *  kicks the pair down off of the board's edge (columns are settled, so
+ *  there is nothing above to kick off of anywhere else).
+ */
+int frames_left_bound(const FrameSearchNode &, const FrameRules &);
+
+/** Nodes of the same key are taken for the same state. Timers are counted
+ *  in whole frames, as sums of frame times taken in a different order can
+ *  differ in their last bits. Each node keeps the times of the path that
+ *  reached it first, so the inputs found replay exactly.
+ */
+uint64_t state_key(const FrameSearchNode &, const FrameRules &);
+
+// taps only, holding left or right is slower than tapping it, and holding a
+// turn does nothing
+bool can_send_after(HeldMask previous, HeldMask next);
+
+/** As ControllerState::update sends a frame's input, and
+ *  PauseableBoard::handle_event takes it.
+ */
+void send_frame_inputs(const BlockGrid &, HeldMask previous, FrameSearchNode &);
+
+/** PauseableBoard::update followed by PuyoBoard::update_piece.
+ *  @returns true if the pair landed
+ */
+bool update_frame(const BlockGrid &, const FrameRules &, FrameSearchNode &);
+
+// where each block of a pair landing here comes to rest
+bool rests_on_targets(const BlockGrid &, const FallingPiece &, const TurnPlan &);
+
+ControllerState::StatesArray to_states_array(HeldMask);
+
+// none, one or the other of left and right, likewise for the turns, with or
+// without down
+constexpr std::array<HeldMask, 18> make_frame_inputs() {
+    using Pid = PlayControlId;
+    std::array<HeldMask, 18> inputs {};
+    std::size_t i = 0;
+    for (HeldMask move : { HeldMask(0), held_bit(Pid::left), held_bit(Pid::right) }) {
+    for (HeldMask turn : { HeldMask(0), held_bit(Pid::rotate_left), held_bit(Pid::rotate_right) }) {
+    for (HeldMask down : { HeldMask(0), held_bit(Pid::down) }) {
+        inputs[i++] = HeldMask(move | turn | down);
+    }}}
+    return inputs;
+}
+
+constexpr const auto k_frame_inputs = make_frame_inputs();
+
+// ----------------------------------------------------------------------------
+
+// anything with handle_event
+template <typename Receiver>
+void send_state_changes
+    (const ControllerState::StatesArray & old_states,
+     const ControllerState::StatesArray & new_states, Receiver &);
+
+} // end of <anonymous> namespace
 
 void ControllerState::update
     (IdList new_presses, IdList new_releases, BoardBase & board)
@@ -87,21 +252,33 @@ bool ControllerState::is_pressed(PlayControlId id) const {
 }
 
 void ControllerState::update(const StatesArray & new_states, BoardBase & board) {
-    using Pcs = PlayControlState;
-    for (std::size_t i = 0; i != k_id_count; ++i) {
-        auto state = [&]() {
-            if (new_states[i] == m_control_states[i]) {
-                return new_states[i] ? Pcs::still_pressed : Pcs::still_released;
-            } else {
-                return new_states[i] ? Pcs::just_pressed : Pcs::just_released;
-            }
-        } ();
-        if (state == Pcs::still_released) continue;
-        board.handle_event(PlayControlEvent( static_cast<PlayControlId>(i), state ));
-    }
+    send_state_changes(m_control_states, new_states, board);
+    m_control_states = new_states;
+}
+
+void ControllerState::update
+    (const StatesArray & new_states, PlayControlEventReceiver & receiver)
+{
+    send_state_changes(m_control_states, new_states, receiver);
     m_control_states = new_states;
 }
 
+void ControllerState::queue_inputs(const std::vector<StatesArray> & inputs) {
+    m_queued_inputs = inputs;
+    m_next_queued = 0;
+}
+
+void ControllerState::clear_queued_inputs() {
+    m_queued_inputs.clear();
+    m_next_queued = 0;
+}
+
+bool ControllerState::replay_queued(BoardBase & board) {
+    if (m_next_queued == m_queued_inputs.size()) return false;
+    update(m_queued_inputs[m_next_queued++], board);
+    return true;
+}
+
 /* private */ void ControllerState::update_with_present_state
     (StatesArray & sent, BoardBase & board)
 {
@@ -157,73 +334,9 @@ void SimpleMatcher::play_board(const BoardBase & board, StatesArray & states) {
     if (!blocks.has_position(pivot)) {
         return std::move(reachables);
     }
-
-    // consider [-1 1] tiles accessible x-ways for this row unless...
-    // row blocks below are occupied, then all spaces above occupied blocks
-    // are accessible, so long as they are not obstructed
     reachables.set_size(blocks.width(), blocks.height(), true);
-    for (VectorI r; r != blocks.end_position(); r = blocks.next(r)) {
-        if (r.y >= pivot.y) break;
-        reachables(r) = false;
-    }
-
-    using std::make_tuple;
-    auto sweep_list = { make_tuple(pivot.x, blocks.width(), 1),
-                        make_tuple(pivot.x, -1, -1) };
-    for (auto [beg, lim, step] : sweep_list) {
-        bool obstructed = false;
-        for (int i = beg; i != lim; i += step) {
-            VectorI r(i, pivot.y);
-            bool floor_below = !blocks.has_position(r + VectorI(0, 1));
-            if (!floor_below) floor_below = blocks(r + VectorI(0, 1)) != k_empty_block;
-
-            if (blocks(r) != k_empty_block || obstructed) {
-                obstructed = true;
-                reachables(r) = false;
-            } else if (magnitude(i - pivot.x) <= 1) {
-                // (do nothing)
-            } else if (floor_below) {
-                // must be support by a "floor" and unobstructed
-                // (do nothing)
-            } else {
-                obstructed = true;
-                reachables(r) = false;
-            }
-        }
-    }
-
-    auto clear_col = [&blocks, &reachables](int i) {
-        for (int y = 0; y != blocks.height(); ++y) {
-            reachables(i, y) = false;
-        }
-    };
-    // the rest of the board is processed as columns
-    for (auto [beg, lim, step] : sweep_list) {
-        bool total_obstruction = false;
-        for (int i = beg; i != lim; i += step) {
-            if (total_obstruction) {
-                clear_col(i);
-                continue;
-            }
-            VectorI r(i, pivot.y);
-            auto below = r + VectorI(0, 1);
-            // skip column
-            if (!blocks.has_position(below)) break;
-            if (!reachables(r) && blocks(below) != k_empty_block) {
-                clear_col(i);
-                total_obstruction = true;
-                continue;
-            }
-            bool obstructed = false;
-            for (int y = below.y; y != blocks.height(); ++y) {
-                if (obstructed || blocks(i, y) != k_empty_block) {
-                    reachables(i, y) = false;
-                    obstructed = true;
-
-                }
-            }
-        }
-    }
+    GridReachables set { reachables };
+    find_reachables(pivot, blocks, set);
     return std::move(reachables);
 }
 
@@ -299,8 +412,9 @@ void SimpleMatcher::play_board(const BoardBase & board, StatesArray & states) {
 /* private */ void SimpleMatcher::on_turn_change(const BoardBase & board) {
     const auto & current_piece = board.current_piece();
     const auto & blocks        = board.blocks();
-    find_reachable_ground_blocks(current_piece.location(), m_accessibles, blocks);
-    auto acc_end = m_accessibles.end();
+    m_reachability.update(board);
+    const auto & accessibles = m_reachability.ground_cells();
+    auto acc_end = accessibles.end();
 
     auto do_match = [&blocks](BlockId color, VectorI r) {
         auto below = r + VectorI(0, 1);
@@ -314,16 +428,16 @@ void SimpleMatcher::play_board(const BoardBase & board, StatesArray & states) {
     };
     using namespace std::placeholders;
 
-    auto pivot_match = std::find_if(m_accessibles.begin(), acc_end,
+    auto pivot_match = std::find_if(accessibles.begin(), acc_end,
         std::bind(do_match, current_piece.color(), _1));
 
-    auto adjacent_match = std::find_if(m_accessibles.begin(), acc_end,
+    auto adjacent_match = std::find_if(accessibles.begin(), acc_end,
         std::bind(do_match, current_piece.other_color(), _1));
 
     if (pivot_match == acc_end && adjacent_match == acc_end) {
-        auto itr = std::max_element(m_accessibles.begin(), m_accessibles.end(),
+        auto itr = std::max_element(accessibles.begin(), acc_end,
                                     [](VectorI l, VectorI r) { return l.y < r.y; });
-        m_pivot_target = itr == m_accessibles.end() ? k_no_location : *itr;
+        m_pivot_target = itr == acc_end ? k_no_location : *itr;
         m_adjacent_target = k_no_location;
     } else {
         m_pivot_target    = pivot_match    == acc_end ? k_no_location : *pivot_match   ;
@@ -344,30 +458,947 @@ void SimpleMatcher::play_board(const BoardBase & board, StatesArray & states) {
 #   endif
 }
 
-// sorts closest location first (x-ways)
-/* private static */ void SimpleMatcher::find_reachable_ground_blocks
-    (VectorI pivot, std::vector<VectorI> & accessibles,
-     const ConstBlockSubGrid & blocks)
+// ----------------------------------------------------------------------------
+
+bool ReachabilityCache::update(const BoardBase & board) {
+    return update(board.current_piece().location(), board.blocks(),
+                  board.blocks_version());
+}
+
+bool ReachabilityCache::update
+    (VectorI pivot, const ConstBlockSubGrid & blocks, std::size_t blocks_version)
 {
-    accessibles.clear();
-    if (!blocks.has_position(pivot)) return;
-    auto reachables = compute_reachable_blocks(pivot, blocks);
-    for (int x = 0; x != reachables.width(); ++x) {
-        for (int y = reachables.height() - 1; y != -1; --y) {
-            if (reachables(x, y)) {
-                accessibles.push_back(VectorI(x, y));
+    // a resized board is a new version too
+    if (m_is_computed && m_pivot == pivot && m_blocks_version == blocks_version)
+        { return false; }
+    recompute(pivot, blocks);
+    m_pivot          = pivot;
+    m_blocks_version = blocks_version;
+    m_is_computed    = true;
+    return true;
+}
+
+bool ReachabilityCache::is_reachable(VectorI r) const noexcept {
+    if (r.x < 0 || r.y < 0 || r.x >= m_width || r.y >= m_height) return false;
+    auto idx = std::size_t(r.x*m_height + r.y);
+    return (m_bits[idx / 64] >> (idx % 64)) & 1;
+}
+
+/* private */ void ReachabilityCache::recompute
+    (VectorI pivot, const ConstBlockSubGrid & blocks)
+{
+    m_ground_cells.clear();
+    m_bits.clear();
+    // as compute_reachable_blocks, no set at all from off the board
+    if (!blocks.has_position(pivot)) {
+        m_width = m_height = 0;
+        return;
+    }
+    m_width  = blocks.width();
+    m_height = blocks.height();
+    m_bits.resize((std::size_t(m_width*m_height) + 63) / 64, ~uint64_t(0));
+    BitReachables set { m_bits, m_height };
+    find_reachables(pivot, blocks, set);
+
+    for (int x = 0; x != m_width; ++x) {
+        for (int y = m_height - 1; y != -1; --y) {
+            if (set.get(VectorI(x, y))) {
+                m_ground_cells.push_back(VectorI(x, y));
                 break; // skip rest of column
             }
         }
     }
-    std::sort(accessibles.begin(), accessibles.end(),
+    std::sort(m_ground_cells.begin(), m_ground_cells.end(),
               [pivot](const VectorI & lhs, const VectorI & rhs)
     {
         return magnitude(lhs - pivot) < magnitude(rhs - pivot);
     });
-    if (!accessibles.empty()) {
-        auto itr = std::find_if(accessibles.begin(), accessibles.end(), [pivot](VectorI r) { return r.x == pivot.x; });
-        if (itr == accessibles.end())
-            throw "what";
+}
+
+// ----------------------------------------------------------------------------
+
+PuyoAiWeights::Array PuyoAiWeights::to_array() const noexcept {
+    Array rv;
+    for (std::size_t i = 0; i != k_count; ++i) {
+        rv[i] = this->*k_weight_fields[i].second;
+    }
+    return rv;
+}
+
+/* static */ const char * PuyoAiWeights::name_of(int index)
+    { return k_weight_fields.at(std::size_t(index)).first; }
+
+/* static */ PuyoAiWeights PuyoAiWeights::from_array(const Array & array) noexcept {
+    PuyoAiWeights rv;
+    for (std::size_t i = 0; i != k_count; ++i) {
+        rv.*k_weight_fields[i].second = array[i];
+    }
+    return rv;
+}
+
+bool PuyoAiWeights::save(const std::string & filename) const {
+    std::ofstream fout;
+    fout.open(filename);
+    fout.precision(std::numeric_limits<double>::max_digits10);
+    for (const auto & [name, member] : k_weight_fields) {
+        fout << name << " " << this->*member << "\n";
+    }
+    fout.flush();
+    return bool(fout);
+}
+
+bool PuyoAiWeights::load(const std::string & filename) {
+    std::ifstream fin;
+    fin.open(filename);
+    if (!fin) return false;
+    auto loaded = *this;
+    std::string name;
+    double value = 0.;
+    while (fin >> name >> value) {
+        auto itr = std::find_if(k_weight_fields.begin(), k_weight_fields.end(),
+            [&name](const WeightField & field) { return name == field.first; });
+        if (itr == k_weight_fields.end()) return false;
+        loaded.*itr->second = value;
+    }
+    // stopping anywhere but the end means something there is not a weight
+    if (!fin.eof()) return false;
+    *this = loaded;
+    return true;
+}
+
+/* static */ const PuyoAiWeights & PuyoAiWeights::load_tuned() {
+    static const PuyoAiWeights inst = [] {
+        PuyoAiWeights weights;
+        weights.load(k_puyo_ai_weights_filename);
+        return weights;
+    } ();
+    return inst;
+}
+
+// ----------------------------------------------------------------------------
+
+BeamSearchMatcher::BeamSearchMatcher(const SearchSettings & settings):
+    m_settings(settings),
+    m_table(settings.table_size)
+{
+    using InvArg = std::invalid_argument;
+    if (settings.beam_width < 1) {
+        throw InvArg("BeamSearchMatcher::BeamSearchMatcher: beam width must be a positive integer.");
+    }
+    if (!(settings.time_budget >= 0.)) {
+        throw InvArg("BeamSearchMatcher::BeamSearchMatcher: time budget must be a non-negative number.");
+    }
+    if (settings.pop_requirement < 1) {
+        throw InvArg("BeamSearchMatcher::BeamSearchMatcher: pop requirement must be a positive integer.");
+    }
+}
+
+void BeamSearchMatcher::play_board(const BoardBase & board, StatesArray & states) {
+    if (!board.is_ready()) {
+        // between turns, plan again once the board has settled
+        m_has_plan = false;
+        clear_queued_inputs();
+        std::fill(states.begin(), states.end(), false);
+        return;
+    }
+    if (!m_has_plan) {
+        m_snapshot.assign(board);
+        on_turn_change(m_snapshot);
+        m_has_plan = true;
+        m_has_inputs = false;
+        if (m_pivot_target != SimpleMatcher::k_no_location) {
+            m_plan.pivot_target    = m_pivot_target;
+            m_plan.adjacent_target = m_adjacent_target;
+            m_has_inputs = plan_frame_inputs(m_snapshot, m_plan);
+            if (m_has_inputs) queue_inputs(m_plan.inputs);
+        }
+    }
+    if (m_pivot_target == SimpleMatcher::k_no_location) return;
+    if (m_has_inputs) {
+        // once the queued inputs run out
+        std::fill(states.begin(), states.end(), false);
+        states[static_cast<std::size_t>(PlayControlId::down)] = true;
+        return;
+    }
+
+    // same rule as SimpleMatcher: one controller, no more than what a human
+    // could press
+    on_turn_update(board, states);
+    static constexpr const auto k_down = static_cast<std::size_t>(PlayControlId::down);
+    states[k_down] = false;
+    states[k_down] = std::none_of(states.begin(), states.end(), [](bool b) { return b; });
+}
+
+void BeamSearchMatcher::plan_turn(const TurnSnapshot & snapshot, TurnPlan & plan) {
+    on_turn_change(snapshot);
+    plan.pivot_target    = m_pivot_target;
+    plan.adjacent_target = m_adjacent_target;
+}
+
+/* private */ void BeamSearchMatcher::on_turn_change(const TurnSnapshot & snapshot) {
+    using Clock = std::chrono::steady_clock;
+    const auto start_time = Clock::now();
+    auto out_of_time = [this, start_time]() {
+        std::chrono::duration<double> elapsed = Clock::now() - start_time;
+        return elapsed.count() > m_settings.time_budget;
+    };
+
+    m_pivot_target = m_adjacent_target = SimpleMatcher::k_no_location;
+    m_boards_searched = 0;
+
+    const auto & blocks = snapshot.blocks;
+    const auto & weights = m_settings.weights;
+    // the next pair spawns where the current one did
+    const auto spawn = snapshot.location;
+    const auto current = snapshot.current;
+
+    auto resolve = [this](const BlockGrid & grid, const PlacedPair & placed,
+                          Scratch & scratch)
+    {
+        resolve_chain(grid, m_settings.pop_requirement, &placed, scratch.trace);
+        ++scratch.boards_searched;
+    };
+    auto place = [](ColorPair pair, const Placement & placement)
+        { return PlacedPair(placement.pivot, pair.first, placement.adjacent, pair.second); };
+
+    // current pair, always searched in full
+    find_placements(spawn, blocks, current, m_reachables, m_placements);
+    if (m_placements.empty()) return;
+    const auto placement_count = m_placements.size();
+    if (m_beam   .size() < placement_count) m_beam   .resize(placement_count);
+    if (m_scratch.size() < placement_count) m_scratch.resize(placement_count);
+    for (auto & scratch : m_scratch) scratch.boards_searched = 0;
+
+    // candidates' hashes are updated from this, rather than hashed in full
+    const auto board_hash = zobrist_hash(blocks);
+    auto & pool = this->pool();
+    pool.for_each_index(int(placement_count), [&](int i) {
+        auto & candidate = m_beam[i];
+        auto & scratch   = m_scratch[i];
+        const auto placed = place(current, m_placements[i]);
+        resolve(blocks, placed, scratch);
+        candidate.hash = zobrist_hash_after_chain(board_hash, blocks, &placed, scratch.trace);
+        std::swap(candidate.board, scratch.trace.final_board);
+        candidate.first = m_placements[i];
+        candidate.score = scratch.trace.total_score;
+        candidate.value = weights.chain_score*candidate.score
+                          + evaluate_board(candidate.board, spawn, weights);
+    });
+    const auto beam_size = std::min(placement_count, std::size_t(m_settings.beam_width));
+    const auto beam_end  = m_beam.begin() + beam_size;
+    std::partial_sort(m_beam.begin(), beam_end, m_beam.begin() + placement_count,
+                      [](const Candidate & lhs, const Candidate & rhs)
+                      { return lhs.value > rhs.value; });
+    const Candidate * best = &m_beam.front();
+
+    // next pair, for as long as time allows, each candidate of the beam is
+    // one task
+    const auto next = snapshot.next;
+    const bool has_next = is_block_color(next.first);
+    const auto context_key = leaf_context_key(m_settings.pop_requirement, spawn);
+    pool.for_each_index(has_next ? int(beam_size) : 0, [&](int i) {
+        const auto & candidate = m_beam[i];
+        auto & scratch = m_scratch[i];
+        scratch.searched_next = false;
+        // no next pair for a board that's already lost
+        if (out_of_time() || candidate.board(spawn) != k_empty_block) return;
+        find_placements(spawn, candidate.board, next, scratch.reachables,
+                        scratch.placements);
+        for (const auto & placement : scratch.placements) {
+            if (out_of_time()) break;
+            // hash of the board with the pair placed, before resolving
+            const auto key =   candidate.hash ^ context_key
+                             ^ zobrist_key(placement.pivot   , next.first )
+                             ^ zobrist_key(placement.adjacent, next.second);
+            int chain_score = 0;
+            float board_value = 0.f;
+            TranspositionTable::Value entry;
+            if (m_table.find(key, entry)) {
+                unpack_leaf(entry, chain_score, board_value);
+                ++scratch.boards_searched;
+            } else {
+                resolve(candidate.board, place(next, placement), scratch);
+                chain_score = scratch.trace.total_score;
+                board_value = evaluate_board(scratch.trace.final_board, spawn, weights);
+                m_table.store(key, pack_leaf(chain_score, board_value));
+            }
+            double value = weights.chain_score*(candidate.score + chain_score) + board_value;
+            if (!scratch.searched_next || value > scratch.best_value) {
+                scratch.best_value    = value;
+                scratch.searched_next = true;
+            }
+        }
+    });
+
+    // reduced in beam order, so ties go to the same candidate as a search
+    // on a single thread
+    double best_value = k_lost_value;
+    bool searched_next = false;
+    for (std::size_t i = 0; has_next && i != beam_size; ++i) {
+        const auto & scratch = m_scratch[i];
+        if (!scratch.searched_next) continue;
+        if (!searched_next || scratch.best_value > best_value) {
+            best = &m_beam[i];
+            best_value = scratch.best_value;
+            searched_next = true;
+        }
+    }
+    for (const auto & scratch : m_scratch) {
+        m_boards_searched += scratch.boards_searched;
+    }
+
+    m_pivot_target    = best->first.pivot;
+    m_adjacent_target = best->first.adjacent;
+}
+
+/* private */ void BeamSearchMatcher::on_turn_update
+    (const BoardBase & board, StatesArray & con_states) const
+{
+    auto idx = [](PlayControlId id) { return static_cast<std::size_t>(id); };
+    const auto & piece = board.current_piece();
+
+    auto diff = m_adjacent_target - m_pivot_target;
+    auto target_offset = diff.x == 0 ? diff : VectorI(diff.x, 0);
+    auto offset = piece.other_location() - piece.location();
+    auto & rotate_left  = con_states[idx(PlayControlId::rotate_left )];
+    auto & rotate_right = con_states[idx(PlayControlId::rotate_right)];
+    if (offset == target_offset) {
+        rotate_left = rotate_right = false;
+    } else {
+        // taps rotation, going left only if that is a single turn away
+        // (see FallingPiece::rotate_left)
+        bool turn_left = VectorI(offset.y, -offset.x) == target_offset;
+        auto & tapped = turn_left ? rotate_left : rotate_right;
+        (turn_left ? rotate_right : rotate_left) = false;
+        tapped = !tapped;
+    }
+
+    auto & left  = con_states[idx(PlayControlId::left )];
+    auto & right = con_states[idx(PlayControlId::right)];
+    left  = m_pivot_target.x < piece.location().x;
+    right = m_pivot_target.x > piece.location().x;
+}
+
+/* private */ WorkStealingPool & BeamSearchMatcher::pool() const {
+    if (m_settings.pool) return *m_settings.pool;
+    return WorkStealingPool::shared_instance();
+}
+
+/* private static */ void BeamSearchMatcher::find_placements
+    (VectorI spawn, const BlockGrid & blocks, ColorPair pair,
+     Grid<bool> & reachables, std::vector<Placement> & placements)
+{
+    placements.clear();
+    reachables = SimpleMatcher::compute_reachable_blocks(spawn, blocks, std::move(reachables));
+    if (reachables.is_empty()) return;
+
+    auto is_reachable = [&reachables](VectorI r)
+        { return reachables.has_position(r) && reachables(r); };
+    // swapping a pair of one color changes nothing
+    const bool swaps_matter = pair.first != pair.second;
+    for (int x = 0; x != blocks.width(); ++x) {
+        VectorI bottom(x, blocks.height() - column_height(blocks, x) - 1);
+        if (!is_reachable(bottom)) continue;
+        auto above = bottom - VectorI(0, 1);
+        if (blocks.has_position(above)) {
+            placements.push_back(Placement { bottom, above });
+            if (swaps_matter) placements.push_back(Placement { above, bottom });
+        }
+        if (x + 1 == blocks.width()) continue;
+        VectorI right(x + 1, blocks.height() - column_height(blocks, x + 1) - 1);
+        if (!is_reachable(right)) continue;
+        placements.push_back(Placement { bottom, right });
+        if (swaps_matter) placements.push_back(Placement { right, bottom });
     }
 }
+
+// ----------------------------------------------------------------------------
+
+void TurnSnapshot::assign(const BoardBase & board) {
+    const auto & piece = board.current_piece();
+    blocks         = board.blocks();
+    location       = piece.location();
+    other_location = piece.other_location();
+    current        = ColorPair(piece.color(), piece.other_color());
+    next           = board.next_piece();
+    fall_delay     = board.fall_delay();
+    fall_time      = board.fall_time();
+}
+
+void plan_tap_inputs(const TurnSnapshot & snapshot, TurnPlan & plan) {
+    plan.inputs.clear();
+    auto tap = [&plan](PlayControlId id) {
+        TurnPlan::StatesArray pressed {};
+        pressed[static_cast<std::size_t>(id)] = true;
+        plan.inputs.push_back(pressed);
+        plan.inputs.emplace_back();
+    };
+
+    // same turning rule as BeamSearchMatcher::on_turn_update
+    auto diff = plan.adjacent_target - plan.pivot_target;
+    auto target_offset = diff.x == 0 ? diff : VectorI(diff.x, 0);
+    auto offset = snapshot.other_location - snapshot.location;
+    if (VectorI(offset.y, -offset.x) == target_offset) {
+        tap(PlayControlId::rotate_left);
+    } else {
+        // (see FallingPiece::rotate_right)
+        for (int i = 0; i != 3 && offset != target_offset; ++i) {
+            tap(PlayControlId::rotate_right);
+            offset = VectorI(-offset.y, offset.x);
+        }
+    }
+
+    int dx = plan.pivot_target.x - snapshot.location.x;
+    for (; dx < 0; ++dx) tap(PlayControlId::left );
+    for (; dx > 0; --dx) tap(PlayControlId::right);
+}
+
+bool plan_frame_inputs
+    (const TurnSnapshot & snapshot, TurnPlan & plan, double frame_time, int idle_frames)
+{
+    plan.inputs.clear();
+    if (!(frame_time > 0.)) {
+        throw std::invalid_argument("plan_frame_inputs: frame time must be a positive real number.");
+    }
+    if (idle_frames < 0) {
+        throw std::invalid_argument("plan_frame_inputs: idle frames must be a non-negative integer.");
+    }
+    const auto & blocks = snapshot.blocks;
+    if (   !blocks.has_position(plan.pivot_target)
+        || !blocks.has_position(plan.adjacent_target))
+    { return false; }
+
+    const FrameRules rules(blocks, plan, frame_time, snapshot.fall_delay);
+    FrameSearchNode root;
+    root.piece = FallingPiece(snapshot.current.first, snapshot.current.second);
+    root.piece.set_location(snapshot.location);
+    root.piece.set_other_location(snapshot.other_location);
+    root.fall_time = snapshot.fall_time;
+
+    // A*, nodes are taken in order of frames so far plus a bound on the
+    // frames left, so the first landing on the targets taken has used the
+    // fewest frames
+    std::vector<FrameSearchNode> nodes { root };
+    std::vector<std::vector<int>> open;
+    std::unordered_map<uint64_t, int> fewest_frames { { state_key(root, rules), 0 } };
+    auto push_open = [&open, &nodes, &rules](int i) {
+        auto f = std::size_t(nodes[i].frames + frames_left_bound(nodes[i], rules));
+        if (open.size() <= f) open.resize(f + 1);
+        open[f].push_back(i);
+    };
+    push_open(0);
+    for (std::size_t f = 0; f < open.size(); ++f) {
+        // last in first out, so that ties go to nodes furthest along
+        while (!open[f].empty()) {
+            if (nodes.size() >= k_max_frame_search_nodes) return false;
+            const int i = open[f].back();
+            open[f].pop_back();
+            if (nodes[i].has_landed) {
+                for (int k = i; nodes[k].parent != FrameSearchNode::k_no_parent; k = nodes[k].parent) {
+                    plan.inputs.push_back(to_states_array(nodes[k].held));
+                }
+                std::reverse(plan.inputs.begin(), plan.inputs.end());
+                return true;
+            }
+            auto itr = fewest_frames.find(state_key(nodes[i], rules));
+            // reached in fewer frames since
+            if (itr != fewest_frames.end() && itr->second < nodes[i].frames) continue;
+
+            const auto previous = nodes[i].held;
+            for (auto held : k_frame_inputs) {
+                if (!can_send_after(previous, held)) continue;
+                if (nodes[i].frames < idle_frames && held != 0) continue;
+                // (nodes may move as it grows)
+                auto node = nodes[i];
+                node.held   = held;
+                node.parent = i;
+                ++node.frames;
+                send_frame_inputs(blocks, previous, node);
+                if (update_frame(blocks, rules, node)) {
+                    if (!rests_on_targets(blocks, node.piece, plan)) continue;
+                    node.has_landed = true;
+                } else if (!can_still_reach(node, rules)) {
+                    continue;
+                } else {
+                    auto [seen, is_new] = fewest_frames.emplace(state_key(node, rules), node.frames);
+                    if (!is_new && seen->second <= node.frames) continue;
+                    seen->second = node.frames;
+                }
+                nodes.push_back(node);
+                push_open(int(nodes.size()) - 1);
+            }
+        }
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+
+AsyncAiScript::AsyncAiScript(std::unique_ptr<TurnPlanner> && planner):
+    m_planner(std::move(planner))
+{
+    if (!m_planner) {
+        throw std::invalid_argument("AsyncAiScript::AsyncAiScript: planner must not be null.");
+    }
+    m_thread = std::thread(&AsyncAiScript::run_worker, this);
+}
+
+AsyncAiScript::~AsyncAiScript() {
+    {
+    std::unique_lock lock(m_mutex);
+    m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void AsyncAiScript::wait_for_plan() {
+    if (m_awaiting_plan) collect_plan(true);
+    if (!m_awaiting_inputs) return;
+    // (collected by the next play)
+    std::unique_lock lock(m_mutex);
+    m_plan_ready.wait(lock, [this] { return bool(m_has_inputs); });
+}
+
+/* private */ void AsyncAiScript::play_board
+    (const BoardBase & board, StatesArray & states)
+{
+    std::fill(states.begin(), states.end(), false);
+    if (!board.is_ready()) {
+        // between turns, anything left of the old plan is dropped
+        clear_queued_inputs();
+        if (m_awaiting_plan  ) m_discard_plan   = true;
+        if (m_awaiting_inputs) m_discard_inputs = true;
+        m_needs_plan   = true;
+        m_needs_inputs = false;
+        m_pivot_target = m_adjacent_target = SimpleMatcher::k_no_location;
+        return;
+    }
+    if (m_awaiting_plan  ) collect_plan(false);
+    if (m_awaiting_inputs) collect_inputs(board);
+    if (m_needs_plan && !m_awaiting_plan) request_plan(board);
+    if (m_awaiting_plan || m_pivot_target == SimpleMatcher::k_no_location) return;
+    if (m_needs_inputs && !m_awaiting_inputs) request_inputs(board);
+    if (m_needs_inputs) {
+        ++m_idle_frames;
+        return;
+    }
+
+    // once the queued inputs run out
+    states[static_cast<std::size_t>(PlayControlId::down)] = true;
+}
+
+/* private */ void AsyncAiScript::request_plan(const BoardBase & board) {
+    {
+    std::unique_lock lock(m_mutex);
+    m_snapshot.assign(board);
+    m_has_request = true;
+    }
+    m_wake.notify_one();
+    m_awaiting_plan = true;
+}
+
+/* private */ void AsyncAiScript::collect_plan(bool block) {
+    if (!block && !m_has_plan) return;
+    std::unique_lock lock(m_mutex);
+    m_plan_ready.wait(lock, [this] { return bool(m_has_plan); });
+    m_has_plan = false;
+    m_awaiting_plan = false;
+    if (m_error) {
+        auto error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+    if (m_discard_plan) {
+        m_discard_plan = false;
+        return;
+    }
+    m_needs_plan      = false;
+    m_needs_inputs    = true;
+    m_pivot_target    = m_plan.pivot_target;
+    m_adjacent_target = m_plan.adjacent_target;
+}
+
+/* private */ void AsyncAiScript::request_inputs(const BoardBase & board) {
+    {
+    std::unique_lock lock(m_mutex);
+    // the pair has moved on since the snapshot the search had
+    m_input_snapshot.assign(board);
+    m_input_plan.pivot_target    = m_pivot_target;
+    m_input_plan.adjacent_target = m_adjacent_target;
+    m_has_input_request = true;
+    }
+    m_wake.notify_one();
+    m_awaiting_inputs = true;
+    m_idle_frames     = 0;
+}
+
+/* private */ void AsyncAiScript::collect_inputs(const BoardBase & board) {
+    if (!m_has_inputs) return;
+    std::unique_lock lock(m_mutex);
+    m_has_inputs      = false;
+    m_awaiting_inputs = false;
+    if (m_discard_inputs) {
+        m_discard_inputs = false;
+        return;
+    }
+    m_needs_inputs = false;
+    auto & inputs = m_input_plan.inputs;
+    if (m_inputs_found && m_idle_frames <= k_input_lead_frames) {
+        // the idle frames already sent
+        inputs.erase(inputs.begin(),
+                     inputs.begin() + std::min(inputs.size(), std::size_t(m_idle_frames)));
+        queue_inputs(inputs);
+        return;
+    }
+    lock.unlock();
+    m_tap_plan.pivot_target    = m_pivot_target;
+    m_tap_plan.adjacent_target = m_adjacent_target;
+    plan_tap_inputs(TurnSnapshot(board), m_tap_plan);
+    queue_inputs(m_tap_plan.inputs);
+}
+
+/* private */ void AsyncAiScript::run_worker() {
+    // the worker's own copies, swapped in and out under the lock
+    TurnSnapshot snapshot, input_snapshot;
+    TurnPlan plan, input_plan;
+    while (true) {
+        bool finds_inputs = false;
+        {
+        std::unique_lock lock(m_mutex);
+        m_wake.wait(lock, [this]
+            { return m_stopping || m_has_request || m_has_input_request; });
+        if (m_stopping) return;
+        // inputs first, as the pair is moving while they are found
+        finds_inputs = m_has_input_request;
+        if (finds_inputs) {
+            std::swap(input_snapshot, m_input_snapshot);
+            input_plan.pivot_target    = m_input_plan.pivot_target;
+            input_plan.adjacent_target = m_input_plan.adjacent_target;
+            m_has_input_request = false;
+        } else {
+            std::swap(snapshot, m_snapshot);
+            m_has_request = false;
+        }
+        }
+
+        if (finds_inputs) {
+            bool found = plan_frame_inputs(input_snapshot, input_plan, 1. / 60.,
+                                           k_input_lead_frames);
+            {
+            std::unique_lock lock(m_mutex);
+            std::swap(input_plan, m_input_plan);
+            m_inputs_found = found;
+            m_has_inputs   = true;
+            }
+            m_plan_ready.notify_one();
+            continue;
+        }
+
+        std::exception_ptr error;
+        try {
+            plan.pivot_target = plan.adjacent_target = SimpleMatcher::k_no_location;
+            m_planner->plan_turn(snapshot, plan);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+        std::unique_lock lock(m_mutex);
+        std::swap(plan, m_plan);
+        m_error = error;
+        m_has_plan = true;
+        }
+        m_plan_ready.notify_one();
+    }
+}
+
+namespace {
+
+float evaluate_board(const BlockGrid & blocks, VectorI spawn, const PuyoAiWeights & weights) {
+    if (!blocks.has_position(spawn) || blocks(spawn) != k_empty_block) {
+        return float(k_lost_value);
+    }
+    int adjacent_pairs = 0;
+    for (VectorI r; r != blocks.end_position(); r = blocks.next(r)) {
+        auto id = blocks(r);
+        if (!is_block_color(id)) continue;
+        for (auto n : { r + VectorI(1, 0), r + VectorI(0, 1) }) {
+            if (blocks.has_position(n) && blocks(n) == id) ++adjacent_pairs;
+        }
+    }
+    int height_past_half = 0, bumpiness = 0;
+    for (int x = 0; x != blocks.width(); ++x) {
+        int height = column_height(blocks, x);
+        int over = height - blocks.height() / 2;
+        if (over > 0) height_past_half += over*over;
+        if (x != 0) bumpiness += std::abs(height - column_height(blocks, x - 1));
+    }
+    return float(  weights.adjacent_pairs*adjacent_pairs
+                 + weights.height_past_half*height_past_half
+                 + weights.bumpiness*bumpiness);
+}
+
+bool BitReachables::get(VectorI r) const {
+    auto idx = std::size_t(r.x*height + r.y);
+    return (bits[idx / 64] >> (idx % 64)) & 1;
+}
+
+void BitReachables::clear(VectorI r) {
+    auto idx = std::size_t(r.x*height + r.y);
+    bits[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+}
+
+template <typename ReachableSet>
+void find_reachables
+    (VectorI pivot, const ConstBlockSubGrid & blocks, ReachableSet & reachables)
+{
+    // consider [-1 1] tiles accessible x-ways for this row unless...
+    // row blocks below are occupied, then all spaces above occupied blocks
+    // are accessible, so long as they are not obstructed
+    for (VectorI r; r != blocks.end_position(); r = blocks.next(r)) {
+        if (r.y >= pivot.y) break;
+        reachables.clear(r);
+    }
+
+    using std::make_tuple;
+    auto sweep_list = { make_tuple(pivot.x, blocks.width(), 1),
+                        make_tuple(pivot.x, -1, -1) };
+    for (auto [beg, lim, step] : sweep_list) {
+        bool obstructed = false;
+        for (int i = beg; i != lim; i += step) {
+            VectorI r(i, pivot.y);
+            bool floor_below = !blocks.has_position(r + VectorI(0, 1));
+            if (!floor_below) floor_below = blocks(r + VectorI(0, 1)) != k_empty_block;
+
+            if (blocks(r) != k_empty_block || obstructed) {
+                obstructed = true;
+                reachables.clear(r);
+            } else if (magnitude(i - pivot.x) <= 1) {
+                // (do nothing)
+            } else if (floor_below) {
+                // must be support by a "floor" and unobstructed
+                // (do nothing)
+            } else {
+                obstructed = true;
+                reachables.clear(r);
+            }
+        }
+    }
+
+    auto clear_col = [&blocks, &reachables](int i) {
+        for (int y = 0; y != blocks.height(); ++y) {
+            reachables.clear(VectorI(i, y));
+        }
+    };
+    // the rest of the board is processed as columns
+    for (auto [beg, lim, step] : sweep_list) {
+        bool total_obstruction = false;
+        for (int i = beg; i != lim; i += step) {
+            if (total_obstruction) {
+                clear_col(i);
+                continue;
+            }
+            VectorI r(i, pivot.y);
+            auto below = r + VectorI(0, 1);
+            // skip column
+            if (!blocks.has_position(below)) break;
+            if (!reachables.get(r) && blocks(below) != k_empty_block) {
+                clear_col(i);
+                total_obstruction = true;
+                continue;
+            }
+            bool obstructed = false;
+            for (int y = below.y; y != blocks.height(); ++y) {
+                if (obstructed || blocks(i, y) != k_empty_block) {
+                    reachables.clear(VectorI(i, y));
+                    obstructed = true;
+
+                }
+            }
+        }
+    }
+}
+
+uint64_t state_key(const FrameSearchNode & node, const FrameRules & rules) {
+    auto frames_of = [&rules](double t)
+        { return uint64_t(std::llround(t / rules.frame_time)); };
+    auto loc    = node.piece.location();
+    auto offset = node.piece.other_location() - loc;
+    // a pair spawns with its other block a row above the board
+    uint64_t cell =   uint64_t(loc.x)*(k_max_board_size + 1) + uint64_t(loc.y + 1);
+    uint64_t turn =   uint64_t(offset.x + 1) + uint64_t(offset.y + 1)*2;
+    // down is left out, it changes nothing about the frames after
+    auto held = node.held & ~held_bit(PlayControlId::down);
+    return   (frames_of(node.fall_time) << 32) ^ (frames_of(node.move_time) << 24)
+           ^ (uint64_t(held) << 16) ^ (cell << 3) ^ turn;
+}
+
+int frames_left_bound(const FrameSearchNode & node, const FrameRules & rules) {
+    if (node.has_landed) return 0;
+    const int y = node.piece.location().y;
+    int falls = rules.landing_row - y + (y == 0 ? 0 : 1);
+    if (falls < 1) return 0;
+    return   frames_until_fall(node.fall_time, rules)
+           + (falls - 1)*rules.frames_per_fall;
+}
+
+bool can_still_reach(const FrameSearchNode & node, const FrameRules & rules) {
+    auto pivot = node.piece.location();
+    int step = rules.target_x < pivot.x ? -1 : 1;
+    for (int x = pivot.x + step; pivot.x != rules.target_x && x != rules.target_x; x += step) {
+        if (pivot.y - 1 > rules.rest_rows[x]) return false;
+    }
+    return true;
+}
+
+FrameRules::FrameRules
+    (const BlockGrid & blocks, const TurnPlan & plan, double frame_time_,
+     double fall_delay_):
+    frame_time(frame_time_),
+    fall_delay(fall_delay_),
+    fast_fall(PauseableBoard::fast_fall_multiplier(blocks.height())),
+    // a lying pair lands on the higher of its two columns
+    landing_row(plan.pivot_target.x == plan.adjacent_target.x
+        ? plan.pivot_target.y
+        : std::min(plan.pivot_target.y, plan.adjacent_target.y)),
+    target_x(plan.pivot_target.x),
+    frames_per_fall(frames_until_fall(0., *this))
+{
+    rest_rows.reserve(blocks.width());
+    for (int x = 0; x != blocks.width(); ++x) {
+        rest_rows.push_back(blocks.height() - column_height(blocks, x) - 1);
+    }
+}
+
+int frames_until_fall(double fall_time, const FrameRules & rules) {
+    int frames = 0;
+    // same sums as PuyoBoard::update_piece
+    for (; fall_time <= rules.fall_delay; ++frames) {
+        fall_time += rules.frame_time*rules.fast_fall;
+    }
+    return frames;
+}
+
+bool can_send_after(HeldMask previous, HeldMask next) {
+    using Pid = PlayControlId;
+    static constexpr const HeldMask k_taps =
+          held_bit(Pid::left) | held_bit(Pid::right)
+        | held_bit(Pid::rotate_left) | held_bit(Pid::rotate_right);
+    return (previous & next & k_taps) == 0;
+}
+
+void send_frame_inputs
+    (const BlockGrid & blocks, HeldMask previous, FrameSearchNode & node)
+{
+    using Pid = PlayControlId;
+    auto just_pressed = [previous, &node](Pid id)
+        { return (node.held & held_bit(id)) && !(previous & held_bit(id)); };
+    auto & piece = node.piece;
+    // in order of id, as sent
+    if (just_pressed(Pid::left ) && node.move_time == 0.) piece.move_left (blocks);
+    if (just_pressed(Pid::right) && node.move_time == 0.) piece.move_right(blocks);
+    if (just_pressed(Pid::rotate_left )) piece.rotate_left (blocks);
+    if (just_pressed(Pid::rotate_right)) piece.rotate_right(blocks);
+}
+
+bool update_frame
+    (const BlockGrid & blocks, const FrameRules & rules, FrameSearchNode & node)
+{
+    using Pid = PlayControlId;
+    const bool moves_left  = node.held & held_bit(Pid::left );
+    const bool moves_right = node.held & held_bit(Pid::right);
+    if (!moves_left && !moves_right) {
+        node.move_time = 0.;
+    } else if ((node.move_time += rules.frame_time) >= PauseableBoard::k_move_delay) {
+        // right is sent after left, and so wins
+        if (moves_right) node.piece.move_right(blocks);
+        else             node.piece.move_left (blocks);
+        node.move_time = 0.;
+    }
+
+    double multiplier = (node.held & held_bit(Pid::down)) ? rules.fast_fall : 1.;
+    if ((node.fall_time += rules.frame_time*multiplier) <= rules.fall_delay) {
+        return false;
+    }
+    node.fall_time = 0.;
+    return !node.piece.descend(blocks);
+}
+
+bool rests_on_targets
+    (const BlockGrid & blocks, const FallingPiece & piece, const TurnPlan & plan)
+{
+    auto loc   = piece.location();
+    auto other = piece.other_location();
+    if (!blocks.has_position(loc) || !blocks.has_position(other)) return false;
+    auto rest_of = [&blocks](int x)
+        { return VectorI(x, blocks.height() - column_height(blocks, x) - 1); };
+    auto loc_rest   = rest_of(loc  .x);
+    auto other_rest = rest_of(other.x);
+    // the lower block of a standing pair rests first
+    if (loc.x == other.x) {
+        (loc.y > other.y ? other_rest : loc_rest) -= VectorI(0, 1);
+    }
+    return loc_rest == plan.pivot_target && other_rest == plan.adjacent_target;
+}
+
+ControllerState::StatesArray to_states_array(HeldMask held) {
+    ControllerState::StatesArray states {};
+    for (std::size_t i = 0; i != states.size(); ++i) {
+        states[i] = (held >> i) & 1;
+    }
+    return states;
+}
+
+// values are stored as two 32 bit halves, the value's half holding a
+// float's bits
+TranspositionTable::Value pack_leaf(int chain_score, float value) {
+    static_assert(sizeof(float) == sizeof(uint32_t), "");
+    uint32_t value_bits = 0;
+    std::memcpy(&value_bits, &value, sizeof(float));
+    return   (TranspositionTable::Value(uint32_t(chain_score)) << 32)
+           | TranspositionTable::Value(value_bits);
+}
+
+void unpack_leaf(TranspositionTable::Value packed, int & chain_score, float & value) {
+    chain_score = int(uint32_t(packed >> 32));
+    auto value_bits = uint32_t(packed & 0xFFFFFFFFu);
+    std::memcpy(&value, &value_bits, sizeof(float));
+}
+
+// splitmix64's finalizer, over the settings packed into one word
+ZobristHash leaf_context_key(int pop_requirement, VectorI spawn) {
+    auto z =   (uint64_t(uint32_t(pop_requirement)) << 32)
+             | (uint64_t(uint16_t(spawn.x)) << 16) | uint64_t(uint16_t(spawn.y));
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// blocks at rest from the bottom, up to the first empty cell
+int column_height(const BlockGrid & blocks, int x) {
+    int y = blocks.height();
+    while (y != 0 && blocks(x, y - 1) != k_empty_block) --y;
+    return blocks.height() - y;
+}
+
+template <typename Receiver>
+void send_state_changes
+    (const ControllerState::StatesArray & old_states,
+     const ControllerState::StatesArray & new_states, Receiver & receiver)
+{
+    using Pcs = PlayControlState;
+    for (std::size_t i = 0; i != new_states.size(); ++i) {
+        auto state = [&]() {
+            if (new_states[i] == old_states[i]) {
+                return new_states[i] ? Pcs::still_pressed : Pcs::still_released;
+            } else {
+                return new_states[i] ? Pcs::just_pressed : Pcs::just_released;
+            }
+        } ();
+        if (state == Pcs::still_released) continue;
+        receiver.handle_event(PlayControlEvent( static_cast<PlayControlId>(i), state ));
+    }
+}
+
+} // end of <anonymous> namespace
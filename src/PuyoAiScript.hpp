@@ -20,8 +20,17 @@
 #pragma once
 
 #include "PlayControl.hpp"
-
-#include <random>
+#include "ChainResolver.hpp"
+#include "WorkStealingPool.hpp"
+#include "TranspositionTable.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <common/SubGrid.hpp>
 
@@ -44,11 +53,29 @@ public:
 
     void update(const StatesArray &, BoardBase &);
 
+    // for boards outside of puyo's (like TetrisState)
+    void update(const StatesArray &, PlayControlEventReceiver &);
+
     const StatesArray & states() const { return m_control_states; }
 
+    /** Frames of input to replay, one per call to replay_queued. Replaces
+     *  anything still queued.
+     */
+    void queue_inputs(const std::vector<StatesArray> &);
+
+    void clear_queued_inputs();
+
+    /** Sends the next queued frame, the same as update would.
+     *  @returns false if nothing is left queued
+     */
+    bool replay_queued(BoardBase &);
+
 private:
     void update_with_present_state(StatesArray & sent, BoardBase &);
     StatesArray m_control_states;
+
+    std::vector<StatesArray> m_queued_inputs;
+    std::size_t m_next_queued = 0;
 };
 
 class AiScript {
@@ -56,9 +83,11 @@ public:
     using StatesArray = ControllerState::StatesArray;
     virtual ~AiScript() {}
 
+    // queued inputs take the place of what the script would press
     void play_board(BoardBase & board) {
         StatesArray new_states = m_controller_state.states();
         play_board(board, new_states);
+        if (m_controller_state.replay_queued(board)) return;
         m_controller_state.update(new_states, board);
     }
 
@@ -70,6 +99,11 @@ public:
 protected:
     virtual void play_board(const BoardBase &, StatesArray &) = 0;
 
+    void queue_inputs(const std::vector<StatesArray> & inputs)
+        { m_controller_state.queue_inputs(inputs); }
+
+    void clear_queued_inputs() { m_controller_state.clear_queued_inputs(); }
+
 private:
     ControllerState m_controller_state;
 };
@@ -77,12 +111,14 @@ private:
 class RandomPresses final : public AiScript {
 public:
     RandomPresses() {}
+
+    // for presses that are the same every run
+    explicit RandomPresses(uint64_t seed): m_rng(seed, uint64_t(RngStream::ai_scripts)) {}
 private:
-    using IntDistri = std::uniform_int_distribution<int>;
 
     void play_board(const BoardBase &, StatesArray & states) {
         static constexpr const int k_mutation_chance = 4;
-        if (IntDistri(0, k_mutation_chance)(m_rng) != 0) {
+        if (random_int(m_rng, 0, k_mutation_chance) != 0) {
             return;
         }
 
@@ -94,11 +130,54 @@ private:
             PId::rotate_left, PId::rotate_left,
             PId::rotate_right, PId::rotate_right
         };
-        auto chosen_id = *(k_control_id_list.begin() + IntDistri(0, k_control_id_list.size() - 1)(m_rng));
+        auto chosen_id = *(k_control_id_list.begin() + random_int(m_rng, 0, int(k_control_id_list.size()) - 1));
         auto & state = states[ static_cast<std::size_t>(chosen_id) ];
         state = !state;
     }
-    std::default_random_engine m_rng = std::default_random_engine { std::random_device() () };
+    Pcg32 m_rng = make_rng(RngStream::ai_scripts);
+};
+
+/** Cells a pair's pivot can reach (as SimpleMatcher::compute_reachable_blocks
+ *  finds them), kept as one bit per cell. The set is only recomputed when
+ *  the board's version or the pivot changes, which for a falling pair is
+ *  once a row (or a step sideways) rather than every frame.
+ *
+ *  Meant to follow a single board, as versions of different boards are
+ *  not comparable.
+ */
+class ReachabilityCache final {
+public:
+    /** @returns true if the set had to be recomputed */
+    bool update(const BoardBase &);
+
+    bool update(VectorI pivot, const ConstBlockSubGrid &, std::size_t blocks_version);
+
+    /** @returns false for cells outside of the board */
+    bool is_reachable(VectorI) const noexcept;
+
+    /** The lowest reachable cell of each column that has one, closest to the
+     *  pivot first.
+     */
+    const std::vector<VectorI> & ground_cells() const noexcept
+        { return m_ground_cells; }
+
+    // both zero when the pivot is off the board
+    int width() const noexcept { return m_width; }
+
+    int height() const noexcept { return m_height; }
+
+private:
+    void recompute(VectorI pivot, const ConstBlockSubGrid &);
+
+    // column major, bit (x*height + y)
+    std::vector<uint64_t> m_bits;
+    std::vector<VectorI> m_ground_cells;
+    int m_width  = 0;
+    int m_height = 0;
+
+    VectorI m_pivot;
+    std::size_t m_blocks_version = 0;
+    bool m_is_computed = false;
 };
 
 class SimpleMatcher final : public AiScript {
@@ -130,18 +209,318 @@ private:
 
     void on_turn_change(const BoardBase &);
 
-    // sorts closest location first (x-ways)
-    static void find_reachable_ground_blocks
-        (VectorI pivot, std::vector<VectorI> & accessibles,
-         const ConstBlockSubGrid & blocks);
-
-    std::vector<VectorI> m_accessibles;
+    // this is checked every frame between turns
+    ReachabilityCache m_reachability;
 
     VectorI m_pivot_target    = k_no_location;
     VectorI m_adjacent_target = k_no_location;
     int m_states_int = 0;
 };
 
+/** What an AI needs of a board to plan a turn, copied when the turn starts
+ *  so that planning can go on elsewhere while the board plays on.
+ */
+struct TurnSnapshot {
+    using ColorPair = std::pair<BlockId, BlockId>;
+
+    TurnSnapshot() {}
+
+    explicit TurnSnapshot(const BoardBase & board) { assign(board); }
+
+    /** Reuses the memory already held for blocks. */
+    void assign(const BoardBase &);
+
+    BlockGrid blocks;
+    VectorI location, other_location;
+    ColorPair current = ColorPair(k_empty_block, k_empty_block);
+    ColorPair next    = ColorPair(k_empty_block, k_empty_block);
+    // see BoardBase::fall_delay
+    double fall_delay = 0.5;
+    double fall_time  = 0.;
+};
+
+struct TurnPlan {
+    using StatesArray = ControllerState::StatesArray;
+
+    // where the pair should come to rest
+    VectorI pivot_target    = SimpleMatcher::k_no_location;
+    VectorI adjacent_target = SimpleMatcher::k_no_location;
+    // a frame each, see ControllerState::queue_inputs
+    std::vector<StatesArray> inputs;
+};
+
+/** Sets plan.inputs to taps (pressed a frame, released the next) that turn
+ *  the pair and then move it over to the plan's targets. Nothing in the way
+ *  of the pair is accounted for, and down is left for after the inputs.
+ */
+void plan_tap_inputs(const TurnSnapshot &, TurnPlan &);
+
+/** Sets plan.inputs to the fewest frames of input that bring the pair to
+ *  rest on the plan's targets. States of the pair (where it is, which way it
+ *  faces, how far along its fall and move timers are, and what is held) are
+ *  searched a frame at a time (A*, bounded below by the time to fall holding
+ *  down), under the same rules the board plays by: FallingPiece's moves and
+ *  kicks, PauseableBoard's move delay and fast fall.
+ *
+ *  Each frame's input is sent before that frame's update (as in the game's
+ *  loop, where the AI plays after the board updates for the next frame),
+ *  starting from the snapshot with nothing held.
+ *  @param idle_frames nothing is held for this many frames at the start
+ *  @throws if idle_frames is negative
+ *  @returns false, leaving inputs empty, if the pair cannot get there (or
+ *           the search gives up, after some tens of thousands of states)
+ */
+bool plan_frame_inputs(const TurnSnapshot &, TurnPlan &,
+                       double frame_time = 1. / 60., int idle_frames = 0);
+
+constexpr const char * const k_puyo_ai_weights_filename = "puyoaiweights.txt";
+
+/** How BeamSearchMatcher values a board, higher is better. The defaults are
+ *  hand picked, tuned weights are kept in k_puyo_ai_weights_filename (see
+ *  PuyoAiTuner).
+ */
+struct PuyoAiWeights {
+    static constexpr const int k_count = 4;
+    using Array = std::array<double, k_count>;
+
+    // whole chains are worth more than the blocks they used to leave lying
+    // next to each other, so the AI will pop rather than hoard
+    double chain_score       =  4.;
+    // same colored blocks lying next to each other, what later groups grow
+    // from
+    double adjacent_pairs    =  1.;
+    // squared, for each column stacked past the board's midpoint
+    double height_past_half  = -1.;
+    // differences in height between neighboring columns
+    double bumpiness         =  0.;
+
+    // in the order they are declared
+    Array to_array() const noexcept;
+
+    // as in the weights file, in the same order as to_array
+    static const char * name_of(int index);
+
+    static PuyoAiWeights from_array(const Array &) noexcept;
+
+    /** One "name value" line per weight.
+     *  @returns false if the file could not be written
+     */
+    bool save(const std::string & filename) const;
+
+    /** Weights missing from the file are left as they are.
+     *  @returns false, leaving all weights untouched, if the file could not
+     *           be read (or has something other than weights in it)
+     */
+    bool load(const std::string & filename);
+
+    /** Weights from k_puyo_ai_weights_filename, read on the first call, or
+     *  defaults if there is no such file.
+     */
+    static const PuyoAiWeights & load_tuned();
+};
+
+class TurnPlanner {
+public:
+    virtual ~TurnPlanner() {}
+
+    /** Sets the plan's targets (inputs are left alone), leaving no location
+     *  there if the pair has nowhere to go. Calls may come from any thread,
+     *  but never from two at once.
+     */
+    virtual void plan_turn(const TurnSnapshot &, TurnPlan &) = 0;
+};
+
+/** Looks past the current pair: every legal placement of the current pair
+ *  is resolved headlessly (see resolve_chain), the best few resulting boards
+ *  are kept (the "beam") and each is expanded again with every placement of
+ *  the next pair. The placement leading to the best board two pairs out is
+ *  the one played.
+ *
+ *  All planning happens on a turn change, the inputs played to get there
+ *  included (see plan_frame_inputs). Only the next pair's expansion is
+ *  subject to the time budget, so there is always a placement to play.
+ *
+ *  Boards are spread over a WorkStealingPool and reduced in placement order,
+ *  so a search that finishes within its budget picks the same placement
+ *  whatever the pool's thread count. Boards two pairs out are kept in a
+ *  transposition table (by Zobrist hash of the board before resolving, with
+ *  the pop requirement and spawn mixed in), so one reached by more than one
+ *  path is only resolved once.
+ */
+class BeamSearchMatcher final : public AiScript, public TurnPlanner {
+public:
+    struct SearchSettings {
+        // boards kept after placing the current pair
+        int beam_width = 8;
+        // in seconds, per turn
+        double time_budget = 0.004;
+        int pop_requirement = 4;
+        // nullptr for the shared pool, a pool with no threads keeps all of
+        // the search on the calling thread
+        WorkStealingPool * pool = nullptr;
+        // transposition table entries, rounded up to a power of two (and
+        // must be positive)
+        std::size_t table_size = std::size_t(1) << 16;
+        PuyoAiWeights weights;
+    };
+
+    BeamSearchMatcher(): BeamSearchMatcher(SearchSettings()) {}
+
+    explicit BeamSearchMatcher(const SearchSettings &);
+
+    void play_board(const BoardBase &, StatesArray &) override;
+
+    void plan_turn(const TurnSnapshot &, TurnPlan &) override;
+
+    VectorI pivot_target() const noexcept { return m_pivot_target; }
+    VectorI adjacent_target() const noexcept { return m_adjacent_target; }
+
+    /** @returns number of boards resolved (or found in the transposition
+     *           table) while planning the last turn
+     */
+    int boards_searched() const noexcept { return m_boards_searched; }
+
+private:
+    using ColorPair = std::pair<BlockId, BlockId>;
+
+    // where each block of the pair comes to rest
+    struct Placement {
+        VectorI pivot, adjacent;
+    };
+
+    struct Candidate {
+        BlockGrid board;
+        Placement first;
+        ZobristHash hash = 0;
+        // sum of the chain scores along the way
+        int score = 0;
+        double value = 0.;
+    };
+
+    // memory for one task of the search, no two threads share one
+    struct Scratch {
+        std::vector<Placement> placements;
+        Grid<bool> reachables;
+        ChainTrace trace;
+        int boards_searched = 0;
+        // best value two pairs out, from one candidate of the beam
+        double best_value = 0.;
+        bool searched_next = false;
+    };
+
+    void on_turn_change(const TurnSnapshot &);
+
+    void on_turn_update(const BoardBase &, StatesArray &) const;
+
+    WorkStealingPool & pool() const;
+
+    static void find_placements(VectorI spawn, const BlockGrid &, ColorPair,
+                                Grid<bool> & reachables, std::vector<Placement> &);
+
+    SearchSettings m_settings;
+
+    VectorI m_pivot_target    = SimpleMatcher::k_no_location;
+    VectorI m_adjacent_target = SimpleMatcher::k_no_location;
+    bool m_has_plan = false;
+    // inputs are queued for the plan, steering is only needed without them
+    bool m_has_inputs = false;
+    int m_boards_searched = 0;
+
+    // kept between turns, so planning reuses their memory
+    TurnSnapshot m_snapshot;
+    TurnPlan m_plan;
+    std::vector<Placement> m_placements;
+    std::vector<Candidate> m_beam;
+    Grid<bool> m_reachables;
+    std::vector<Scratch> m_scratch;
+    // shared by all tasks, and kept between turns
+    TranspositionTable m_table;
+};
+
+/** Plans each turn on a thread of its own, so play_board never waits on a
+ *  search. The board is copied when its turn starts. Once the plan's targets
+ *  come back, inputs to reach them are searched for (on the same thread)
+ *  from where the pair is by then, and replayed a frame at a time, holding
+ *  down after. Nothing is pressed while waiting on either.
+ *
+ *  The input search plans its first frames idle, as they are while it runs.
+ *  If it takes longer than those, the pair has moved on unguided, and it is
+ *  tapped to the targets from where it is instead (see plan_tap_inputs).
+ */
+class AsyncAiScript final : public AiScript {
+public:
+    // idle frames the input search plans for
+    static constexpr const int k_input_lead_frames = 4;
+
+    explicit AsyncAiScript(std::unique_ptr<TurnPlanner> &&);
+
+    AsyncAiScript(const AsyncAiScript &) = delete;
+    AsyncAiScript & operator = (const AsyncAiScript &) = delete;
+
+    ~AsyncAiScript() override;
+
+    // targets of the plan being played, if any
+    VectorI pivot_target() const noexcept { return m_pivot_target; }
+    VectorI adjacent_target() const noexcept { return m_adjacent_target; }
+
+    bool is_waiting_on_plan() const noexcept { return m_awaiting_plan; }
+
+    /** Blocks until the plan (or inputs) being made, if any, come back,
+     *  meant for test cases and headless play.
+     *  @throws anything the planner threw
+     */
+    void wait_for_plan();
+
+private:
+    void play_board(const BoardBase &, StatesArray &) override;
+
+    void request_plan(const BoardBase &);
+
+    void collect_plan(bool block);
+
+    void request_inputs(const BoardBase &);
+
+    // if they are in
+    void collect_inputs(const BoardBase &);
+
+    void run_worker();
+
+    std::unique_ptr<TurnPlanner> m_planner;
+
+    // main thread only
+    VectorI m_pivot_target    = SimpleMatcher::k_no_location;
+    VectorI m_adjacent_target = SimpleMatcher::k_no_location;
+    bool m_needs_plan    = true;
+    bool m_awaiting_plan = false;
+    // turn ended while the plan was being made
+    bool m_discard_plan  = false;
+    // targets are in, but not yet the inputs to reach them
+    bool m_needs_inputs    = false;
+    bool m_awaiting_inputs = false;
+    bool m_discard_inputs  = false;
+    // sent with nothing pressed since inputs were requested
+    int m_idle_frames = 0;
+    TurnPlan m_tap_plan;
+
+    // shared with the worker, under m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_plan_ready;
+    TurnSnapshot m_snapshot;
+    TurnPlan m_plan;
+    std::exception_ptr m_error;
+    bool m_has_request = false;
+    bool m_stopping    = false;
+    std::atomic<bool> m_has_plan { false };
+    TurnSnapshot m_input_snapshot;
+    TurnPlan m_input_plan;
+    bool m_has_input_request = false;
+    bool m_inputs_found      = false;
+    std::atomic<bool> m_has_inputs { false };
+
+    std::thread m_thread;
+};
+
 inline std::unique_ptr<AiScript> AiScript::make_random_script() {
     return std::make_unique<SimpleMatcher>();
 }
@@ -0,0 +1,128 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "PuyoAiTuner.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cmath>
+
+namespace {
+
+using InvArg = std::invalid_argument;
+
+// score ahead of the reference, per match, that is worth a whole win
+constexpr const double k_score_per_win = 100000.;
+
+} // end of <anonymous> namespace
+
+PuyoAiTuner::PuyoAiTuner
+    (const Settings & settings, const Weights & start, const Weights & reference):
+    m_settings(settings),
+    m_mean(start),
+    m_reference(reference),
+    m_rng(settings.seed)
+{
+    if (settings.population < 1) {
+        throw InvArg("PuyoAiTuner::PuyoAiTuner: population must be a positive integer.");
+    }
+    if (settings.elite_count < 1 || settings.elite_count > settings.population) {
+        throw InvArg("PuyoAiTuner::PuyoAiTuner: elite count must be in [1 population].");
+    }
+    if (settings.matches_per_candidate < 1) {
+        throw InvArg("PuyoAiTuner::PuyoAiTuner: matches per candidate must be a positive integer.");
+    }
+    if (settings.max_frames < 1) {
+        throw InvArg("PuyoAiTuner::PuyoAiTuner: max frames must be a positive integer.");
+    }
+    if (!(settings.initial_spread > 0.)) {
+        throw InvArg("PuyoAiTuner::PuyoAiTuner: initial spread must be a positive real number.");
+    }
+    auto mean = m_mean.to_array();
+    for (std::size_t i = 0; i != mean.size(); ++i) {
+        m_spread[i] = mean[i] == 0. ? 1. : std::abs(mean[i])*settings.initial_spread;
+    }
+}
+
+const PuyoAiTuner::Candidate & PuyoAiTuner::run_generation() {
+    // drawn on this thread, in order, so that the draws do not depend on
+    // the pool
+    m_candidates.resize(std::size_t(m_settings.population));
+    const auto mean = m_mean.to_array();
+    for (std::size_t c = 0; c != m_candidates.size(); ++c) {
+        auto weights = mean;
+        for (std::size_t i = 0; c != 0 && i != weights.size(); ++i) {
+            weights[i] += std::normal_distribution<double>(0., m_spread[i])(m_rng);
+        }
+        m_candidates[c].weights = Weights::from_array(weights);
+    }
+
+    const auto root_seed = uint32_t(m_rng());
+    auto & pool = m_settings.pool ? *m_settings.pool : WorkStealingPool::shared_instance();
+    pool.for_each_index(m_settings.population, [this, root_seed](int c) {
+        auto & candidate = m_candidates[std::size_t(c)];
+        candidate.fitness = evaluate(candidate.weights, root_seed);
+    });
+    // ties go to the earlier candidate, the mean first of all
+    std::stable_sort(m_candidates.begin(), m_candidates.end(),
+        [](const Candidate & lhs, const Candidate & rhs)
+        { return lhs.fitness > rhs.fitness; });
+
+    const auto elite_count = std::size_t(m_settings.elite_count);
+    Array new_mean = {}, variance = {};
+    for (std::size_t c = 0; c != elite_count; ++c) {
+        auto weights = m_candidates[c].weights.to_array();
+        for (std::size_t i = 0; i != weights.size(); ++i) {
+            new_mean[i] += weights[i] / double(elite_count);
+        }
+    }
+    for (std::size_t c = 0; c != elite_count; ++c) {
+        auto weights = m_candidates[c].weights.to_array();
+        for (std::size_t i = 0; i != weights.size(); ++i) {
+            auto diff = weights[i] - new_mean[i];
+            variance[i] += diff*diff / double(elite_count);
+        }
+    }
+    // spread is smoothed with the last, so a few elites that happen to agree
+    // do not end the search early
+    for (std::size_t i = 0; i != m_spread.size(); ++i) {
+        m_spread[i] = std::max(k_min_spread, 0.5*m_spread[i] + 0.5*std::sqrt(variance[i]));
+    }
+    m_mean = Weights::from_array(new_mean);
+    ++m_generation;
+    return m_candidates.front();
+}
+
+/* private */ double PuyoAiTuner::evaluate
+    (const Weights & weights, uint32_t root_seed) const
+{
+    // already on one of the pool's threads, so matches stay on it
+    WorkStealingPool no_threads(0);
+    PuyoTournamentSettings settings;
+    settings.match_count = m_settings.matches_per_candidate;
+    settings.root_seed   = root_seed;
+    settings.max_frames  = m_settings.max_frames;
+    settings.pool        = &no_threads;
+    auto report = run_puyo_tournament(settings, [this, &weights](int player, uint32_t)
+        { return make_puyo_beam_script(player == 0 ? weights : m_reference); });
+    double score_ahead = double(report.totals[0].score - report.totals[1].score);
+    return   report.win_rate(0)
+           + score_ahead / (double(report.matches)*k_score_per_win);
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "PuyoTournament.hpp"
+
+#include <random>
+#include <vector>
+
+/** Tunes PuyoAiWeights by the cross-entropy method (CMA-ES' simpler cousin,
+ *  keeping a spread per weight rather than a whole covariance matrix).
+ *
+ *  Each generation draws candidates around the mean, the mean itself always
+ *  being the first, and has each play headless matches against a fixed
+ *  reference. The mean and spread then move to those of the best few. Every
+ *  candidate of a generation plays the same seeds, so that luck of the draw
+ *  does not decide between them. Candidates are spread over the pool, each
+ *  playing its matches on one thread.
+ */
+class PuyoAiTuner final {
+public:
+    using Weights = PuyoAiWeights;
+
+    struct Settings {
+        // candidates per generation, the mean included
+        int population = 16;
+        // best candidates the next generation is drawn around
+        int elite_count = 4;
+        // against the reference, for each candidate
+        int matches_per_candidate = 8;
+        // three minutes of play, after which a match is a draw
+        int max_frames = 60*60*3;
+        uint32_t seed = 0;
+        // starting spread, as a fraction of each weight (weights at zero
+        // start with a spread of one)
+        double initial_spread = 0.5;
+        // nullptr for the shared pool
+        WorkStealingPool * pool = nullptr;
+    };
+
+    struct Candidate {
+        Weights weights;
+        // win rate against the reference, where each point of score
+        // ahead of it in a match is worth a small fraction of a win
+        double fitness = 0.;
+    };
+
+    /** @throws if the population is not positive, the elite count is not in
+     *          [1 population], the number of matches or max frames is not
+     *          positive, or the initial spread is not positive
+     */
+    PuyoAiTuner(const Settings &, const Weights & start, const Weights & reference);
+
+    /** Plays one generation's matches, and moves on to the next.
+     *  @returns the generation's best candidate
+     */
+    const Candidate & run_generation();
+
+    // what the next generation is drawn around
+    const Weights & mean() const noexcept { return m_mean; }
+
+    // of the last generation, best first
+    const std::vector<Candidate> & candidates() const noexcept { return m_candidates; }
+
+    // generations run so far
+    int generation() const noexcept { return m_generation; }
+
+private:
+    using Array = Weights::Array;
+
+    static constexpr const double k_min_spread = 0.01;
+
+    double evaluate(const Weights &, uint32_t root_seed) const;
+
+    Settings m_settings;
+    Weights m_mean;
+    Array m_spread;
+    Weights m_reference;
+    int m_generation = 0;
+    std::vector<Candidate> m_candidates;
+    std::default_random_engine m_rng;
+};
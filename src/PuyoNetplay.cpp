@@ -0,0 +1,385 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "PuyoNetplay.hpp"
+
+#include <SFML/Graphics/RenderTarget.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+using InvArg           = std::invalid_argument;
+using PlayControlArray = PuyoVsSimulation::PlayControlArray;
+using PackedControls   = uint32_t;
+
+static constexpr const int k_bits_per_control = 2;
+static constexpr const char k_magic[4] = { 'B', 'G', 'N', 'P' };
+// as PuyoScoreBoard::width
+static constexpr const int k_score_board_width = 3;
+
+static_assert(int(PlayControlState::count) <= (1 << k_bits_per_control),
+              "every control state must fit its bits");
+static_assert(k_play_control_id_count*k_bits_per_control <= 32,
+              "packed control states must fit 32 bits");
+
+PackedControls pack_controls(const PlayControlArray &);
+
+PlayControlArray unpack_controls(PackedControls);
+
+PlayControlArray make_released_controls();
+
+} // end of <anonymous> namespace
+
+PuyoVsSimulation::PuyoVsSimulation(uint64_t seed) {
+    m_pairs = ColorPairQueue(seed, PuyoStateVS::k_colors);
+    m_state.refuge_rng = Pcg32 { mix_seed(seed, 0), uint64_t(RngStream::puyo_refuge) };
+    m_fall_ins.set_size(PuyoStateVS::k_board_width, PuyoStateVS::k_board_height);
+    for (int i = 0; i != 2; ++i) {
+        auto & board = m_state.boards[std::size_t(i)];
+        board.set_settings(PuyoStateVS::k_fall_speed, PuyoStateVS::k_pop_requirement);
+        board.assign_score_board(i, m_state.score_board);
+        board.set_size(PuyoStateVS::k_board_width, PuyoStateVS::k_board_height,
+                       mix_seed(seed, uint64_t(1 + i)));
+        // the first is the pair in play, the second is shown next
+        deal_pair(i);
+        deal_pair(i);
+    }
+}
+
+void PuyoVsSimulation::step(const PlayerControls & controls) {
+    ++m_state.frame;
+    if (is_over()) return;
+    for (int i = 0; i != 2; ++i) {
+        const auto & states = controls[std::size_t(i)];
+        auto & board = m_state.boards[std::size_t(i)];
+        for (std::size_t id = 0; id != states.size(); ++id) {
+            if (states[id] == PlayControlState::still_released) continue;
+            board.handle_event(PlayControlEvent(PlayControlId(id), states[id]));
+        }
+    }
+    step_board(0);
+    step_board(1);
+}
+
+void PuyoVsSimulation::restore(const State & state) {
+    m_state = state;
+    // the copies point to whichever score board they were copied from
+    for (int i = 0; i != 2; ++i) {
+        m_state.boards[std::size_t(i)].assign_score_board(i, m_state.score_board);
+    }
+}
+
+bool PuyoVsSimulation::is_over() const {
+    return m_state.boards[0].is_gameover() || m_state.boards[1].is_gameover();
+}
+
+uint64_t PuyoVsSimulation::checksum() const {
+    uint64_t rv = mix_seed(uint64_t(m_state.frame), m_state.refuge_rng.state());
+    for (int i = 0; i != 2; ++i) {
+        const auto & board = m_state.boards[std::size_t(i)];
+        for (auto block : board.blocks()) {
+            rv = mix_seed(rv, uint64_t(block));
+        }
+        const auto & piece = board.current_piece();
+        for (auto n : { piece.location().x, piece.location().y,
+                        piece.other_location().x, piece.other_location().y,
+                        int(piece.color()), int(piece.other_color()),
+                        int(m_state.pairs_dealt[std::size_t(i)]) })
+        { rv = mix_seed(rv, uint64_t(n)); }
+    }
+    return mix_seed(rv, uint64_t(m_state.score_board.score(0)));
+}
+
+/* private */ void PuyoVsSimulation::step_board(int player) {
+    // as PuyoStateVS::update_board, less the AI
+    auto & board = m_state.boards[std::size_t(player)];
+    board.update(k_frame_time);
+    if (!board.is_ready()) {
+        int other_delta = m_state.score_board.take_last_delta(1 - player);
+        if (other_delta != 0) {
+            PuyoStateVS::make_refuge_fall_ins(other_delta, m_fall_ins, m_state.refuge_rng);
+            board.push_fall_in_blocks(m_fall_ins);
+        }
+    }
+    if (board.is_gameover()) return;
+    while (!board.is_ready()) {
+        deal_pair(player);
+    }
+}
+
+/* private */ void PuyoVsSimulation::deal_pair(int player) {
+    auto & pairs_dealt = m_state.pairs_dealt[std::size_t(player)];
+    auto [first, second] = m_pairs.pair_at(pairs_dealt++);
+    m_state.boards[std::size_t(player)].push_falling_piece(first, second);
+}
+
+// ----------------------------------------------------------------------------
+
+PuyoRollbackSession::PuyoRollbackSession
+    (int local_player, uint64_t seed, std::unique_ptr<PacketLink> && link,
+     const NetplaySettings & settings):
+    m_local_player(local_player),
+    m_seed(seed),
+    m_link(std::move(link)),
+    m_settings(settings)
+{
+    if (local_player != 0 && local_player != 1) {
+        throw InvArg("PuyoRollbackSession::PuyoRollbackSession: local player must be 0 or 1.");
+    }
+    if (!m_link) {
+        throw InvArg("PuyoRollbackSession::PuyoRollbackSession: link must not be null.");
+    }
+    if (   settings.input_delay < 0 || settings.max_rollback < 1
+        || settings.input_delay + settings.max_rollback > k_max_controls_per_packet)
+    {
+        throw InvArg("PuyoRollbackSession::PuyoRollbackSession: input delay must be "
+                     "non-negative, max rollback positive, and together no more than " +
+                     std::to_string(k_max_controls_per_packet) + ".");
+    }
+    // the frames before the first local controls arrive
+    m_local_controls.assign(std::size_t(settings.input_delay),
+                            pack_controls(make_released_controls()));
+    m_snapshots.resize(std::size_t(settings.max_rollback));
+}
+
+bool PuyoRollbackSession::advance(const PlayControlArray & local_controls) {
+    m_link->update(PuyoVsSimulation::k_frame_time);
+    receive_packets();
+    if (!is_connected()) {
+        send_packet();
+        return false;
+    }
+    if (m_rollback_frame != k_no_rollback) {
+        roll_back_to(m_rollback_frame);
+    }
+    bool can_step = frame() < confirmed_frames() + m_settings.max_rollback;
+    if (can_step) {
+        m_local_controls.push_back(pack_controls(local_controls));
+        step_frame();
+    }
+    send_packet();
+    return can_step;
+}
+
+const PuyoVsSimulation & PuyoRollbackSession::simulation() const {
+    if (!m_simulation) {
+        throw std::runtime_error("PuyoRollbackSession::simulation: session must be connected.");
+    }
+    return *m_simulation;
+}
+
+void PuyoRollbackSession::roll_back_to(int frame_) {
+    const int current = frame();
+    if (!m_simulation || frame_ < current - m_settings.max_rollback || frame_ > current) {
+        throw InvArg("PuyoRollbackSession::roll_back_to: frame must be no more than max "
+                     "rollback frames back.");
+    }
+    m_rollback_frame = k_no_rollback;
+    if (frame_ == current) return;
+    m_simulation->restore(snapshot_for(frame_));
+    while (frame() < current) {
+        step_frame();
+        ++m_frames_resimulated;
+    }
+    ++m_rollbacks;
+}
+
+/* private */ void PuyoRollbackSession::send_packet() {
+    m_packet.clear();
+    ReplayEncoder encoder(m_packet);
+    for (char c : k_magic) encoder.push_byte(uint8_t(c));
+    encoder.push_varint(k_protocol_version);
+    // player 1 has no seed of its own to send
+    encoder.push_varint(m_local_player == 0 || is_connected() ? m_seed : 0);
+    encoder.push_byte(uint8_t(m_local_player));
+    encoder.push_varint(m_remote_controls.size());
+
+    const int first = m_remote_acknowledged;
+    const int last  = std::min(int(m_local_controls.size()), first + k_max_controls_per_packet);
+    encoder.push_varint(uint64_t(first));
+    encoder.push_varint(uint64_t(last - first));
+    for (int i = first; i != last; ++i) {
+        encoder.push_varint(m_local_controls[std::size_t(i)]);
+    }
+    m_link->send(ByteView(m_packet));
+}
+
+/* private */ void PuyoRollbackSession::receive_packets() {
+    std::vector<uint8_t> packet;
+    while (m_link->receive(packet)) {
+        try {
+            read_packet(ByteView(packet));
+        } catch (std::runtime_error &) {
+            // malformed, it may as well have been lost
+        }
+    }
+}
+
+/* private */ void PuyoRollbackSession::read_packet(ByteView packet) {
+    ReplayDecoder decoder(packet);
+    for (char c : k_magic) {
+        if (decoder.read_byte() != uint8_t(c)) return;
+    }
+    if (decoder.read_varint() != k_protocol_version) return;
+    auto seed = decoder.read_varint();
+    if (decoder.read_byte() != uint8_t(1 - m_local_player)) return;
+    auto acknowledged = decoder.read_varint();
+    auto first = decoder.read_varint();
+    auto count = decoder.read_varint();
+    if (count > uint64_t(k_max_controls_per_packet)) return;
+
+    if (!m_simulation) {
+        if (m_local_player == 1) m_seed = seed;
+        m_simulation = std::make_unique<PuyoVsSimulation>(m_seed);
+    }
+    m_remote_acknowledged = int(std::clamp(acknowledged, uint64_t(m_remote_acknowledged),
+                                           uint64_t(m_local_controls.size())));
+    for (uint64_t i = 0; i != count; ++i) {
+        auto controls = PackedControls(decoder.read_varint());
+        // old, or after a gap (they are sent again until acknowledged)
+        if (first + i != m_remote_controls.size()) continue;
+        int frame_ = int(m_remote_controls.size());
+        if (frame_ < frame() && m_stepped_remote[std::size_t(frame_)] != controls) {
+            m_rollback_frame = m_rollback_frame == k_no_rollback
+                ? frame_ : std::min(m_rollback_frame, frame_);
+        }
+        m_remote_controls.push_back(controls);
+    }
+}
+
+/* private */ void PuyoRollbackSession::step_frame() {
+    const int frame_ = frame();
+    m_simulation->save(snapshot_for(frame_));
+    auto remote = remote_controls_for(frame_);
+    if (frame_ == int(m_stepped_remote.size())) {
+        m_stepped_remote.push_back(remote);
+    } else {
+        m_stepped_remote[std::size_t(frame_)] = remote;
+    }
+    PuyoVsSimulation::PlayerControls controls;
+    controls[std::size_t(    m_local_player)] = unpack_controls(m_local_controls[std::size_t(frame_)]);
+    controls[std::size_t(1 - m_local_player)] = unpack_controls(remote);
+    m_simulation->step(controls);
+}
+
+/* private */ PuyoRollbackSession::PackedControls
+    PuyoRollbackSession::remote_controls_for(int frame_) const
+{
+    if (frame_ < int(m_remote_controls.size())) {
+        return m_remote_controls[std::size_t(frame_)];
+    }
+    // predicted: held as they last were
+    if (m_remote_controls.empty()) return pack_controls(make_released_controls());
+    auto last = unpack_controls(m_remote_controls.back());
+    PlayControlEventHandler::degrade_states(last);
+    return pack_controls(last);
+}
+
+/* private */ PuyoVsSimulation::State & PuyoRollbackSession::snapshot_for(int frame_)
+    { return m_snapshots[std::size_t(frame_) % m_snapshots.size()]; }
+
+// ----------------------------------------------------------------------------
+
+PuyoNetplayState::PuyoNetplayState
+    (uint16_t local_port, uint16_t remote_port,
+     const ConditionedLink::Conditions & conditions)
+{
+    if (local_port == remote_port) {
+        throw InvArg("PuyoNetplayState::PuyoNetplayState: ports must be different.");
+    }
+    std::unique_ptr<PacketLink> link = std::make_unique<UdpLink>(local_port, remote_port);
+    if (conditions.latency > 0. || conditions.jitter > 0. || conditions.loss > 0.) {
+        link = std::make_unique<ConditionedLink>
+            (std::move(link), conditions, mix_seed(root_seed(), local_port));
+    }
+    int local_player = local_port < remote_port ? 0 : 1;
+    m_session = std::make_unique<PuyoRollbackSession>
+        (local_player, next_seed(RngStream::puyo_pairs), std::move(link));
+    m_local_controls = make_released_controls();
+}
+
+/* private */ int PuyoNetplayState::width_in_blocks() const
+    { return PuyoStateVS::k_board_width*2 + k_score_board_width; }
+
+/* private */ int PuyoNetplayState::height_in_blocks() const
+    { return PuyoStateVS::k_board_height; }
+
+/* private */ void PuyoNetplayState::handle_event(PlayControlEvent event)
+    { m_local_controls[std::size_t(event.id)] = event.state; }
+
+/* private */ void PuyoNetplayState::update(double et) {
+    // the handler sends this frame's controls, which are kept rather than
+    // played (the session plays them, delayed)
+    m_local_controls = make_released_controls();
+    BoardState::update(et);
+    (void)m_session->advance(m_local_controls);
+}
+
+/* private */ void PuyoNetplayState::setup_board(const Settings &)
+    { set_max_colors(PuyoStateVS::k_colors); }
+
+/* private */ void PuyoNetplayState::draw
+    (sf::RenderTarget & target, sf::RenderStates states) const
+{
+    static constexpr const int k_width  = PuyoStateVS::k_board_width ;
+    static constexpr const int k_height = PuyoStateVS::k_board_height;
+    draw_fill_with_background(target, k_width, k_height);
+    draw_fill_with_score_background(target, k_score_board_width, k_height,
+                                    VectorI(k_width, 0)*k_block_size);
+    draw_fill_with_background(target, k_width, k_height,
+                              VectorI(k_width + k_score_board_width, 0)*k_block_size);
+    // nothing to show until the other end is heard from
+    if (!m_session->is_connected()) return;
+
+    const auto & match = m_session->simulation().state();
+    target.draw(match.boards[0], states);
+    states.transform.translate(float( k_width*k_block_size ), 0.f);
+    target.draw(match.score_board, states);
+    states.transform.translate(float( k_score_board_width*k_block_size ), 0.f);
+    target.draw(match.boards[1], states);
+}
+
+namespace {
+
+PackedControls pack_controls(const PlayControlArray & states) {
+    PackedControls rv = 0;
+    for (std::size_t i = 0; i != states.size(); ++i) {
+        rv |= PackedControls(states[i]) << (i*k_bits_per_control);
+    }
+    return rv;
+}
+
+PlayControlArray unpack_controls(PackedControls packed) {
+    static constexpr const PackedControls k_mask = (1u << k_bits_per_control) - 1u;
+    PlayControlArray rv;
+    for (std::size_t i = 0; i != rv.size(); ++i) {
+        rv[i] = PlayControlState((packed >> (i*k_bits_per_control)) & k_mask);
+    }
+    return rv;
+}
+
+PlayControlArray make_released_controls() {
+    PlayControlArray rv;
+    std::fill(rv.begin(), rv.end(), PlayControlState::still_released);
+    return rv;
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,227 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "PacketLink.hpp"
+#include "PuyoState.hpp"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+
+/** Both boards of a VS match, under PuyoStateVS' rules, played by each
+ *  player's control states rather than an AI. Given the same seed and
+ *  controls it plays the same, so each end of a netplay session runs its
+ *  own.
+ */
+class PuyoVsSimulation final {
+public:
+    using PlayControlArray = PlayControlEventHandler::PlayControlArray;
+    using PlayerControls   = std::array<PlayControlArray, 2>;
+
+    static constexpr const double k_frame_time = 1. / 60.;
+
+    /** Everything stepping changes. Rollback keeps one of these for each
+     *  frame it may go back to, which costs a copy (no allocation once the
+     *  buffers are warm).
+     */
+    struct State {
+        std::array<PuyoBoard, 2> boards;
+        PuyoScoreBoard score_board;
+        std::array<std::size_t, 2> pairs_dealt = {};
+        Pcg32 refuge_rng;
+        int frame = 0;
+    };
+
+    /** Both boards are dealt the same pairs, drawn from the seed. */
+    explicit PuyoVsSimulation(uint64_t seed);
+
+    PuyoVsSimulation(const PuyoVsSimulation &) = delete;
+
+    PuyoVsSimulation & operator = (const PuyoVsSimulation &) = delete;
+
+    /** Steps one frame, unless the match is over.
+     *  @param controls each player's, as a handler would send them (before
+     *         degrading)
+     */
+    void step(const PlayerControls & controls);
+
+    void save(State & state) const { state = m_state; }
+
+    void restore(const State &);
+
+    const State & state() const noexcept { return m_state; }
+
+    int frame() const noexcept { return m_state.frame; }
+
+    bool is_over() const;
+
+    // tells whether two simulations have drifted apart
+    uint64_t checksum() const;
+
+private:
+    void step_board(int player);
+
+    void deal_pair(int player);
+
+    State m_state;
+    ColorPairQueue m_pairs;
+    BlockGrid m_fall_ins;
+};
+
+struct NetplaySettings {
+    // frames local controls are held back, so they usually reach the other
+    // end before it needs them
+    int input_delay = 2;
+    // frames either end may run ahead of what it has heard from the other
+    int max_rollback = 10;
+};
+
+/** One end of a netplay session (rollback, as GGPO popularized). Local
+ *  controls are delayed a few frames and sent (with every one the other end
+ *  has yet to acknowledge, so losses are covered by the next packet). The
+ *  remote player's controls are predicted (held as they last were) until
+ *  they arrive. Where a prediction was wrong, the simulation is restored
+ *  from that frame's snapshot and stepped forward again with what arrived.
+ *
+ *  Packets are built with ReplayEncoder: magic, version, the seed (once
+ *  known), the sender's player, how many of the receiver's frames it has,
+ *  then a run of its own controls (two bits a control).
+ */
+class PuyoRollbackSession final {
+public:
+    using PlayControlArray = PuyoVsSimulation::PlayControlArray;
+
+    /** @param local_player 0 or 1, the board played from this end
+     *  @param seed of the match, from player 0's end (player 1's is ignored,
+     *         as it uses what player 0 sends)
+     *  @throws std::invalid_argument if the player or settings are out of
+     *          range, or the link is null
+     */
+    PuyoRollbackSession(int local_player, uint64_t seed, std::unique_ptr<PacketLink> &&,
+                        const NetplaySettings & = NetplaySettings());
+
+    /** Exchanges packets, rolls back if a prediction was wrong, then steps
+     *  a frame with the local controls (unless the remote end is too far
+     *  behind, in which case it waits for it).
+     *  @returns true if a frame was stepped
+     */
+    bool advance(const PlayControlArray & local_controls);
+
+    // the other end has been heard from, and the match has started
+    bool is_connected() const noexcept { return bool(m_simulation); }
+
+    const PuyoVsSimulation & simulation() const;
+
+    int local_player() const noexcept { return m_local_player; }
+
+    int frame() const noexcept { return m_simulation ? m_simulation->frame() : 0; }
+
+    // frames whose remote controls have arrived
+    int confirmed_frames() const noexcept { return int(m_remote_controls.size()); }
+
+    int rollbacks() const noexcept { return m_rollbacks; }
+
+    int frames_resimulated() const noexcept { return m_frames_resimulated; }
+
+    /** Restores the simulation to a frame at most max rollback frames back,
+     *  and steps it forward again to the frame it was on.
+     *  @throws std::invalid_argument if the frame is out of that range
+     */
+    void roll_back_to(int frame);
+
+private:
+    using PackedControls = uint32_t;
+
+    static constexpr const int k_no_rollback = -1;
+    static constexpr const uint32_t k_protocol_version = 1;
+    // a packet's run of controls, enough for any delay and rollback
+    static constexpr const int k_max_controls_per_packet = 64;
+
+    void send_packet();
+
+    void receive_packets();
+
+    void read_packet(ByteView);
+
+    void step_frame();
+
+    PackedControls remote_controls_for(int frame) const;
+
+    PuyoVsSimulation::State & snapshot_for(int frame);
+
+    int m_local_player;
+    uint64_t m_seed;
+    std::unique_ptr<PacketLink> m_link;
+    NetplaySettings m_settings;
+
+    std::unique_ptr<PuyoVsSimulation> m_simulation;
+    // indexed by frame
+    std::vector<PackedControls> m_local_controls;
+    std::vector<PackedControls> m_remote_controls;
+    // remote controls each stepped frame was stepped with
+    std::vector<PackedControls> m_stepped_remote;
+    // of the frames the simulation may go back to, by frame modulo size
+    std::vector<PuyoVsSimulation::State> m_snapshots;
+    // local frames the other end has
+    int m_remote_acknowledged = 0;
+    int m_rollback_frame = k_no_rollback;
+    int m_rollbacks = 0;
+    int m_frames_resimulated = 0;
+    std::vector<uint8_t> m_packet;
+};
+
+/** Puyo VS between two instances of the game, each playing their own board
+ *  through a PuyoRollbackSession over UDP on the loopback address.
+ *
+ *  The end with the lower port is player one (the left board). Sessions are
+ *  not recorded, as a replay only holds local controls.
+ */
+class PuyoNetplayState final : public BoardState {
+public:
+    /** @param conditions latency and loss to add to what this end sends
+     *  @throws std::runtime_error if the local port cannot be bound
+     */
+    PuyoNetplayState(uint16_t local_port, uint16_t remote_port,
+                     const ConditionedLink::Conditions & conditions = ConditionedLink::Conditions());
+
+private:
+    int width_in_blocks () const override;
+
+    int height_in_blocks() const override;
+
+    int scale() const override { return 3; }
+
+    void handle_event(PlayControlEvent) override;
+
+    void update(double) override;
+
+    void setup_board(const Settings &) override;
+
+    void describe_session(ReplayHeader &, const Settings &) const override {}
+
+    void draw(sf::RenderTarget &, sf::RenderStates) const override;
+
+    // as the handler sent them this frame
+    PlayControlEventHandler::PlayControlArray m_local_controls;
+    std::unique_ptr<PuyoRollbackSession> m_session;
+};
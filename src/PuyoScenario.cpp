@@ -27,8 +27,7 @@
 
 namespace {
 
-using Rng          = std::default_random_engine;
-using IntDistri    = std::uniform_int_distribution<int>;
+using Rng          = Pcg32;
 using Response     = Scenario::Response;
 using PuyoSettings = Scenario::PuyoSettings;
 
@@ -62,13 +61,19 @@ class ForeverPop final : public NonSequentialScenario {
         auto screen_height = sf::VideoMode::getDesktopMode().height;
         params.width  = (screen_width  / (k_block_size*3)) - 3;
         params.height = (screen_height / (k_block_size*3));
-        m_rng = Rng { std::random_device()() };
+        m_rng = make_rng(RngStream::scenarios);
         m_max_colors = params.colors;
         return params;
     }
 
     Response on_turn_change() override;
 
+    void save_state(ReplayEncoder & encoder) const override
+        { encoder.push_rng(m_rng); }
+
+    void restore_state(ReplayDecoder & decoder) override
+        { m_rng = decoder.read_rng(); }
+
     const char * name() const override { return "Pop Forever"; }
     const char * description() const override {
         return "A \"non-playable\" scenario. Where the board will pop blocks "
@@ -126,6 +131,9 @@ public:
     PuyoSettings setup_(PuyoSettings params) override;
     Response on_turn_change() override;
 
+    void save_state(ReplayEncoder &) const override;
+    void restore_state(ReplayDecoder &) override;
+
     const char * name() const override { return "Glass Waves"; }
     const char * description() const override {
         return "An unending scenario. Try not to get buried in glass blocks!";
@@ -231,7 +239,7 @@ namespace {
     int count = int(board().size()) - std::count(board().begin(), board().end(), k_empty_block);
     int area  = board().width()*board().height();
     if (area == count) {
-        int y = IntDistri(0, board().height() - 1)(m_rng);
+        int y = random_int(m_rng, 0, board().height() - 1);
         auto t = board()(0, y);
         for (int x = 0; x != board().width() - 1; ++x) {
             board()(x, y) = board()(x + 1, y);
@@ -242,7 +250,7 @@ namespace {
         for (int x = 0; x != board().width(); ++x) {
             auto & top = board()(x, 0);
             if (top != k_empty_block) continue;
-            if (IntDistri(0, 4)(m_rng) == 0) top = ColorBlockDistri(m_max_colors)(m_rng);
+            if (random_int(m_rng, 0, 4) == 0) top = ColorBlockDistri(m_max_colors)(m_rng);
 #           if 0
             IntDistri(1, k_max_colors)(m_rng);
 #           endif
@@ -253,7 +261,7 @@ namespace {
         BlockGrid fallins;
         fallins.set_size(board().width(), board().height());
         for (auto & x : fallins) {
-            if (IntDistri(1, 10)(m_rng) == 10) {
+            if (random_int(m_rng, 1, 10) == 10) {
                 x = BlockId::hard_glass;
 #               if 0
                 k_hard_glass_block;
@@ -276,10 +284,20 @@ namespace {
 #   if 0
     params.max_colors = 3;
 #   endif
-    m_rng = Rng { std::random_device()() };
+    m_rng = make_rng(RngStream::scenarios);
     return params;
 }
 
+/* private */ void GlassWaves::save_state(ReplayEncoder & encoder) const {
+    encoder.push_int(m_turn_num);
+    encoder.push_rng(m_rng);
+}
+
+/* private */ void GlassWaves::restore_state(ReplayDecoder & decoder) {
+    m_turn_num = decoder.read_int();
+    m_rng      = decoder.read_rng();
+}
+
 /* private */ GlassWaves::Response GlassWaves::on_turn_change() {
     if (m_turn_num++ % 2 == 0) {
         return Response { k_random_pair };
@@ -288,8 +306,8 @@ namespace {
     auto & fallins = rv.reset<BlockGrid>();
     fallins.set_size(board().width(), board().height());
     for (int x = 0; x != board().width(); ++x) {
-        if (IntDistri(0, 3)(m_rng)) continue;
-        if (IntDistri(0, 3)(m_rng)) {
+        if (random_int(m_rng, 0, 3)) continue;
+        if (random_int(m_rng, 0, 3)) {
             fallins(x, 0) = BlockId::glass;
 #           if 0
                     k_glass_block;
@@ -37,6 +37,13 @@ public:
 
     virtual Response on_turn_change() = 0;
 
+    /** Scenarios that carry anything from turn to turn write it here, so a
+     *  replay may continue them from a keyframe.
+     */
+    virtual void save_state(ReplayEncoder &) const {}
+
+    virtual void restore_state(ReplayDecoder &) {}
+
     virtual const char * name() const = 0;
     virtual const char * description() const = 0;
     virtual bool is_sequential() const = 0;
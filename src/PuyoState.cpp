@@ -24,13 +24,20 @@
 #include <SFML/Graphics/RenderTarget.hpp>
 
 #include <cassert>
+#include <cstdlib>
 
 namespace {
 
-VectorI get_spawn_point(const ConstBlockSubGrid &);
-
 std::string pad_to_right(std::string &&, int);
 
+void push_piece(ReplayEncoder &, const FallingPiece &);
+
+FallingPiece read_piece(ReplayDecoder &);
+
+void push_block_id(ReplayEncoder &, BlockId);
+
+BlockId read_block_id(ReplayDecoder &);
+
 } // end of <anonymous> namespace
 
 // ----------------------------------------------------------------------------
@@ -89,19 +96,35 @@ void PauseableBoard::handle_event(PlayControlEvent event) {
     { *m_pause_ptr = !*m_pause_ptr; }
 
     if (event.id == PlayControlId::down) {
-        m_fall_multiplier = is_pressed(event) ? 5.*(blocks().height() / 10) : 1.;
+        m_fall_multiplier = is_pressed(event) ? fast_fall_multiplier(height()) : 1.;
     }
 }
 
+/* protected */ PauseableBoard::Motion PauseableBoard::motion() const {
+    Motion rv;
+    rv.fall_multiplier = m_fall_multiplier;
+    rv.move_time       = m_move_time;
+    rv.move_dir        = m_move_dir;
+    return rv;
+}
+
+/* protected */ void PauseableBoard::set_motion(const Motion & motion_) {
+    m_fall_multiplier = motion_.fall_multiplier;
+    m_move_time       = motion_.move_time;
+    m_move_dir        = motion_.move_dir;
+}
+
 // ----------------------------------------------------------------------------
 
 const std::pair<BlockId, BlockId> BoardBase::k_empty_pair =
     std::make_pair(k_empty_block, k_empty_block);
 
-void PuyoBoard::set_size(int width, int height) {
-    m_blocks.clear();
-    m_blocks.set_size(width, height, k_empty_block);
-    m_fef.setup(m_blocks.width(), m_blocks.height(), load_builtin_block_texture());
+void PuyoBoard::set_size(int width, int height)
+    { set_size(width, height, next_seed(RngStream::fall_effects)); }
+
+void PuyoBoard::set_size(int width, int height, uint64_t effects_seed) {
+    m_engine.set_size(width, height);
+    m_fef.setup(width, height, load_builtin_block_texture(), effects_seed);
     m_pef.assign_texture(load_builtin_block_texture());
 }
 
@@ -117,7 +140,7 @@ void PuyoBoard::set_settings(double fall_speed, int pop_requirement) {
         throw std::invalid_argument("PuyoBoard::set_settings: fall speed must be a positive real number.");
     }
     m_fall_delay = 1. / fall_speed;
-    m_pop_requirement = pop_requirement;
+    m_engine.set_pop_requirement(pop_requirement);
 }
 
 void PuyoBoard::update(double et) {
@@ -136,20 +159,104 @@ void PuyoBoard::push_falling_piece(BlockId first, BlockId second) {
         assert(m_piece.other_color() != k_empty_block);
         m_next_piece = std::make_pair(first, second);
         m_score_board->set_next_pair(m_score_board_number, first, second);
-        m_piece.set_location(get_spawn_point(m_blocks));
+        m_piece.set_location(m_engine.spawn_point());
         m_update_func = &PuyoBoard::update_piece;
     }
 }
 
 void PuyoBoard::push_fall_in_blocks(const BlockGrid & blocks_) {
-    if (!blocks_.is_empty()) {
-        m_fef.do_fall_in(m_blocks, blocks_);
-    } else {
-        make_blocks_fall(m_blocks, m_fef);
-    }
+    m_engine.push_fall_in_blocks(blocks_, m_fef);
     m_update_func = &PuyoBoard::update_fall_effects;
 }
 
+void PuyoBoard::save_snapshot(Snapshot & snapshot) const {
+    snapshot.blocks.pack(m_engine.blocks());
+    snapshot.piece             = m_piece;
+    snapshot.next_piece        = m_next_piece;
+    snapshot.fall_time         = m_fall_time;
+    snapshot.phase             = phase();
+    snapshot.motion            = motion();
+}
+
+void PuyoBoard::restore_snapshot(const Snapshot & snapshot) {
+    if (snapshot.blocks.width() != width() || snapshot.blocks.height() != height()) {
+        set_size(snapshot.blocks.width(), snapshot.blocks.height());
+    }
+    m_engine.restore(snapshot.blocks);
+    m_piece      = snapshot.piece;
+    m_next_piece = snapshot.next_piece;
+    m_fall_time  = snapshot.fall_time;
+    set_motion(snapshot.motion);
+    m_fef.restart();
+    m_pef.clear();
+    switch (snapshot.phase) {
+    case Phase::piece_in_play: m_update_func = &PuyoBoard::update_piece      ; return;
+    case Phase::idle         : m_update_func = nullptr                       ; return;
+    case Phase::gameover     : m_update_func = &PuyoBoard::update_on_gameover; return;
+    case Phase::settling     : break;
+    }
+    m_engine.settle(m_fef);
+    m_update_func = &PuyoBoard::update_fall_effects;
+}
+
+/* static */ void PuyoBoard::encode_snapshot
+    (const Snapshot & snapshot, ReplayEncoder & encoder)
+{
+    encoder.push_int(snapshot.blocks.width ());
+    encoder.push_int(snapshot.blocks.height());
+    encoder.push_bytes(ByteView(snapshot.blocks.data(), snapshot.blocks.byte_size()));
+    push_piece(encoder, snapshot.piece);
+    push_block_id(encoder, snapshot.next_piece.first );
+    push_block_id(encoder, snapshot.next_piece.second);
+    encoder.push_f64(snapshot.fall_time);
+    encoder.push_byte(uint8_t(snapshot.phase));
+    encoder.push_f64(snapshot.motion.fall_multiplier);
+    encoder.push_f64(snapshot.motion.move_time);
+    encoder.push_byte(uint8_t(snapshot.motion.move_dir));
+}
+
+/* static */ void PuyoBoard::decode_snapshot
+    (ReplayDecoder & decoder, Snapshot & snapshot)
+{
+    int width  = decoder.read_int();
+    int height = decoder.read_int();
+    if (width < 0 || height < 0) {
+        throw std::runtime_error("PuyoBoard::decode_snapshot: board must have a size.");
+    }
+    // blocks are packed as the snapshot packs them, two to a byte (a size
+    // too large for the replay to hold fails the read)
+    const auto area = uint64_t(width)*uint64_t(height);
+    auto cells = decoder.read_bytes(std::size_t((area + 1) / 2));
+    BlockGrid blocks;
+    blocks.set_size(width, height);
+    std::size_t i = 0;
+    for (auto & block : blocks) {
+        auto nibble = (cells.data()[i / 2] >> ((i % 2)*4)) & 0xFu;
+        if (nibble > uint8_t(BlockId::hard_glass)) {
+            throw std::runtime_error("PuyoBoard::decode_snapshot: board has a block that cannot be.");
+        }
+        block = BlockId(nibble);
+        ++i;
+    }
+    snapshot.blocks.pack(blocks);
+    snapshot.piece              = read_piece(decoder);
+    snapshot.next_piece.first   = read_block_id(decoder);
+    snapshot.next_piece.second  = read_block_id(decoder);
+    snapshot.fall_time          = decoder.read_f64();
+    auto phase = decoder.read_byte();
+    if (phase > uint8_t(Phase::gameover)) {
+        throw std::runtime_error("PuyoBoard::decode_snapshot: board is updating in a way it cannot.");
+    }
+    snapshot.phase              = Phase(phase);
+    snapshot.motion.fall_multiplier = decoder.read_f64();
+    snapshot.motion.move_time       = decoder.read_f64();
+    auto move_dir = decoder.read_byte();
+    if (move_dir > uint8_t(PlayControlId::count)) {
+        throw std::runtime_error("PuyoBoard::decode_snapshot: piece is moving a way it cannot.");
+    }
+    snapshot.motion.move_dir = PlayControlId(move_dir);
+}
+
 bool PuyoBoard::is_ready() const {
     return m_update_func;
 }
@@ -158,6 +265,11 @@ bool PuyoBoard::is_gameover() const {
     return m_update_func == &PuyoBoard::update_on_gameover && !m_fef.has_effects();
 }
 
+bool PuyoBoard::has_only_piece_in_play() const {
+    return    m_update_func == &PuyoBoard::update_piece
+           && !m_fef.has_effects() && !m_pef.has_effects();
+}
+
 /* private */ void PuyoBoard::draw(sf::RenderTarget & target, sf::RenderStates states) const {
     if (m_pef.has_effects()) {
         target.draw(m_pef, states);
@@ -168,17 +280,18 @@ bool PuyoBoard::is_gameover() const {
     } else {
         sf::Sprite brush;
         brush.setTexture(load_builtin_block_texture());
-        render_merged_blocks(m_blocks, brush, target, states);
+        render_merged_blocks(m_engine.blocks(), brush, target, states);
     }
 
     bool bottom_is_open = [this]() {
+        const auto & blocks = m_engine.blocks();
         auto lower_loc = m_piece.location() + VectorI(0, 1);
         auto lower_o_loc = m_piece.other_location() + VectorI(0, 1);
-        if (!m_blocks.has_position(lower_loc) ||
-            !m_blocks.has_position(lower_o_loc))
+        if (!blocks.has_position(lower_loc) ||
+            !blocks.has_position(lower_o_loc))
         { return false; }
-        return m_blocks(lower_loc  ) == k_empty_block &&
-               m_blocks(lower_o_loc) == k_empty_block;
+        return blocks(lower_loc  ) == k_empty_block &&
+               blocks(lower_o_loc) == k_empty_block;
     } ();
     int y_offset = 0;
     if (bottom_is_open) {
@@ -213,25 +326,21 @@ bool PuyoBoard::is_gameover() const {
     if ((m_fall_time += et*fall_multiplier()) <= m_fall_delay) return;
 
     m_fall_time = 0.;
-    if (!m_piece.descend(m_blocks)) {
-        if (m_blocks(get_spawn_point(m_blocks)) != k_empty_block) {
+    if (!m_piece.descend(m_engine.blocks())) {
+        if (m_engine.is_gameover()) {
             // on loss
-            make_all_blocks_fall_out(m_blocks, m_fef);
+            m_engine.drop_all_blocks(m_fef);
             m_update_func = &PuyoBoard::update_on_gameover;
             return;
         }
         // merge blocks
-        if (m_blocks.has_position(m_piece.location())) {
-            m_blocks(m_piece.location()) = m_piece.color();
-        }
-        if (m_blocks.has_position(m_piece.other_location())) {
-            m_blocks(m_piece.other_location()) = m_piece.other_color();
-        }
+        m_engine.place_pair(PlacedPair(m_piece.location(), m_piece.color(),
+                                       m_piece.other_location(), m_piece.other_color()));
         m_piece = FallingPiece(m_next_piece.first, m_next_piece.second);
-        m_piece.set_location(get_spawn_point(m_blocks));
+        m_piece.set_location(m_engine.spawn_point());
         m_next_piece = k_empty_pair;
         m_fef.restart();
-        make_blocks_fall(m_blocks, m_fef);
+        m_engine.settle(m_fef);
         m_update_func = &PuyoBoard::update_fall_effects;
     }
 }
@@ -240,7 +349,7 @@ bool PuyoBoard::is_gameover() const {
     if (m_pef.has_effects()) {
         m_pef.update(et);
     } else {
-        make_blocks_fall(m_blocks, m_fef);
+        m_engine.settle(m_fef);
         m_update_func = &PuyoBoard::update_fall_effects;
     }
 }
@@ -248,11 +357,13 @@ bool PuyoBoard::is_gameover() const {
 /* private */ void PuyoBoard::update_fall_effects(double et) {
     if (m_fef.has_effects()) {
         m_fef.update(et);
-    } else if (m_pef.do_pop(m_blocks,  m_pop_requirement)) {
+    } else if (m_pef.do_pop(m_engine)) {
         m_update_func = &PuyoBoard::update_pop_effects;
     } else {
-        // after pop
-        m_score_board->increment_score(m_score_board_number, m_pef.get_score_delta_and_reset_wave_number());
+        // after pop, the last wave having popped nothing
+        auto result = m_engine.finish_turn();
+        m_score_board->post_chain_length(m_score_board_number, result.chain_length);
+        m_score_board->increment_score(m_score_board_number, result.score);
         m_update_func = nullptr;
         // I need to signal that a turn has changed...
     }
@@ -264,6 +375,13 @@ bool PuyoBoard::is_gameover() const {
     }
 }
 
+/* private */ PuyoBoard::Phase PuyoBoard::phase() const {
+    if (m_update_func == &PuyoBoard::update_piece      ) return Phase::piece_in_play;
+    if (m_update_func == &PuyoBoard::update_on_gameover) return Phase::gameover;
+    if (!m_update_func) return Phase::idle;
+    return Phase::settling;
+}
+
 // ----------------------------------------------------------------------------
 
 const VectorI SimpleMatcher::k_no_location = VectorI(-1, -1);
@@ -364,13 +482,29 @@ PuyoStateN::PuyoStateN(int scenario_number) {
     m_board.assign_score_board(0, m_score_board);
     m_board.assign_pause_pointer(m_pause);
     m_board.set_size(params.width, params.height);
-    m_current_scenario->assign_board(m_board.blocks());
+    m_current_scenario->assign_board(m_board.edit_blocks());
     set_max_colors(params.colors);
+    m_pairs = ColorPairQueue(next_seed(RngStream::puyo_pairs), params.colors);
+    m_pairs_dealt = 0;
+    m_turns_played = 0;
     while (!m_board.is_ready()) {
         handle_response(m_current_scenario->on_turn_change());
     }
 }
 
+/* private */ void PuyoStateN::describe_session
+    (ReplayHeader & header, const Settings & settings) const
+{
+    const auto & scenarios = Scenario::get_all_scenarios();
+    auto itr = std::find_if(scenarios.begin(), scenarios.end(),
+        [this](const ConstScenarioPtr & scen)
+        { return scen->name() == m_current_scenario->name(); });
+    assert(itr != scenarios.end());
+    header.game     = ReplayGame::puyo_scenario;
+    header.scenario = int(itr - scenarios.begin());
+    header.puyo     = settings.get_puyo_settings(m_current_scenario->name());
+}
+
 /* private */ void PuyoStateN::update(double et) {
     BoardState::update(et);
 
@@ -382,6 +516,42 @@ PuyoStateN::PuyoStateN(int scenario_number) {
     }
 }
 
+/* private */ int PuyoStateN::keyframe_turn() const
+    { return m_board.has_only_piece_in_play() ? m_turns_played : k_not_a_turn_start; }
+
+/* private */ void PuyoStateN::save_keyframe(ReplayEncoder & encoder) const {
+    PuyoBoard::Snapshot snapshot;
+    m_board.save_snapshot(snapshot);
+    PuyoBoard::encode_snapshot(snapshot, encoder);
+    encoder.push_int(m_score_board.score(0));
+    encoder.push_varint(m_pairs_dealt);
+    encoder.push_int(m_turns_played);
+    encoder.push_byte(m_pause ? 1 : 0);
+    m_current_scenario->save_state(encoder);
+}
+
+/* private */ void PuyoStateN::restore_keyframe(ReplayDecoder & decoder) {
+    PuyoBoard::Snapshot snapshot;
+    PuyoBoard::decode_snapshot(decoder, snapshot);
+    if (   snapshot.blocks.width () != m_board.width ()
+        || snapshot.blocks.height() != m_board.height())
+    {
+        throw std::runtime_error("PuyoStateN::restore_keyframe: keyframe must be of "
+                                 "a board this size.");
+    }
+    auto score = decoder.read_int();
+    m_pairs_dealt  = std::size_t(decoder.read_varint());
+    m_turns_played = decoder.read_int();
+    m_pause        = decoder.read_byte() != 0;
+    m_current_scenario->restore_state(decoder);
+
+    m_board.restore_snapshot(snapshot);
+    m_score_board.reset_score(0);
+    m_score_board.increment_score(0, score);
+    (void)m_score_board.take_last_delta(0);
+    m_score_board.set_next_pair(0, snapshot.next_piece.first, snapshot.next_piece.second);
+}
+
 /* private */ void PuyoStateN::draw(sf::RenderTarget & target, sf::RenderStates states) const {
     const auto & blocks = m_board.blocks();
     draw_fill_with_background(target, blocks.width(), blocks.height());
@@ -399,9 +569,10 @@ PuyoStateN::PuyoStateN(int scenario_number) {
     if (auto * cpair = response.as_pointer<std::pair<BlockId, BlockId>>()) {
         auto pair = *cpair;
         if (pair == Scenario::k_random_pair) {
-            pair = std::make_pair(random_color(m_rng), random_color(m_rng));
+            pair = m_pairs.pair_at(m_pairs_dealt++);
         }
         m_board.push_falling_piece(pair.first, pair.second);
+        ++m_turns_played;
     } else if (auto * fallins = response.as_pointer<Grid<BlockId>>()) {
         m_board.push_fall_in_blocks(*fallins);
     } else if (response.is_type<ContinueFall>()) {
@@ -413,6 +584,34 @@ PuyoStateN::PuyoStateN(int scenario_number) {
 
 PuyoStateVS::PuyoStateVS() {}
 
+/* static */ void PuyoStateVS::make_refuge_fall_ins
+    (int opponent_delta, BlockGrid & fallins, Pcg32 & rng)
+{
+    int punishment = opponent_delta*(1 + opponent_delta / 8) / 4;
+    std::fill(fallins.begin(), fallins.end(), k_empty_block);
+    int last_y = 0;
+    auto choose_random_refuge = [&rng]() {
+        return (random_int(rng, 0, 3) == 0) ? BlockId::hard_glass : BlockId::glass;
+    };
+    for (VectorI r; r != fallins.end_position(); r = fallins.next(r)) {
+        if (punishment < fallins.width()) break;
+        fallins(r) = choose_random_refuge();
+        last_y = r.y;
+        --punishment;
+    }
+    ++last_y;
+    if (punishment != 0 && last_y < fallins.height()) {
+        std::vector<int> xs;
+        xs.resize(fallins.width());
+        std::iota(xs.begin(), xs.end(), 0);
+        shuffle_range(xs.begin(), xs.end(), rng);
+        xs.resize(punishment);
+        for (int x : xs) {
+            fallins(x, last_y) = choose_random_refuge();
+        }
+    }
+}
+
 /* private */ int PuyoStateVS::width_in_blocks() const {
     return m_p1_board.width()*2 + m_score_board.width();
 }
@@ -429,32 +628,40 @@ PuyoStateVS::PuyoStateVS() {}
     BoardState::update(et);
     if (m_pause) return;
 
-    update_board(m_p1_board, m_p1_rng, et);
-    update_board(m_p2_board, m_p2_rng, et);
+    update_board(m_p1_board, m_p1_pairs_dealt, et);
+    update_board(m_p2_board, m_p2_pairs_dealt, et);
 }
 
 /* private */ void PuyoStateVS::setup_board(const Settings &) {
-    m_refuge_rng = m_p2_rng = m_p1_rng = Rng { std::random_device() () };
+    m_pairs = ColorPairQueue(next_seed(RngStream::puyo_pairs), k_colors);
+    m_p1_pairs_dealt = m_p2_pairs_dealt = 0;
+    m_refuge_rng = make_rng(RngStream::puyo_refuge);
     for (auto * board : { &m_p1_board, &m_p2_board }) {
-        board->set_settings(1.5, 4);
+        board->set_settings(k_fall_speed, k_pop_requirement);
         board->assign_score_board(board == &m_p1_board ? 0 : 1, m_score_board);
-        board->set_size(6, 12);
-        auto & rng = board == &m_p1_board ? m_p1_rng : m_p2_rng;
-        board->push_falling_piece(random_color(rng), random_color(rng));
+        board->set_size(k_board_width, k_board_height);
+        deal_pair(*board, board == &m_p1_board ? m_p1_pairs_dealt : m_p2_pairs_dealt);
     }
 
-    set_max_colors(4);
+    set_max_colors(k_colors);
     m_p1_board.assign_pause_pointer(m_pause);
-    m_ai_player = AiScript::make_random_script();
-    m_matcher_ptr = dynamic_cast<SimpleMatcher *>(m_ai_player.get());
+    // the search runs off this thread, so the frame never waits on it
+    BeamSearchMatcher::SearchSettings ai_settings;
+    ai_settings.weights = PuyoAiWeights::load_tuned();
+    m_ai_player = std::make_unique<AsyncAiScript>(std::make_unique<BeamSearchMatcher>(ai_settings));
+    m_matcher_ptr = static_cast<AsyncAiScript *>(m_ai_player.get());
 
     assert(m_p2_board.current_piece().color() != k_empty_block);
     m_ai_player->play_board(m_p2_board);
 
-    m_p1_board.push_falling_piece(random_color(m_p1_rng), random_color(m_p1_rng));
-    m_p2_board.push_falling_piece(random_color(m_p2_rng), random_color(m_p2_rng));
+    deal_pair(m_p1_board, m_p1_pairs_dealt);
+    deal_pair(m_p2_board, m_p2_pairs_dealt);
 }
 
+/* private */ void PuyoStateVS::describe_session
+    (ReplayHeader & header, const Settings &) const
+{ header.game = ReplayGame::puyo_vs; }
+
 /* private */ void PuyoStateVS::draw
     (sf::RenderTarget & target, sf::RenderStates states) const
 {
@@ -472,14 +679,18 @@ PuyoStateVS::PuyoStateVS() {}
     static const sf::Color k_inaccess_color(200, 40, 40, 128);
     drect.set_color(k_inaccess_color);
     drect.set_size(k_block_size, k_block_size);
-    for (VectorI r; r != m_p2_accessables.end_position(); r = m_p2_accessables.next(r)) {
+    // the same size as p2's board, once there is a set to show
+    const auto & reachability = m_p2_reachability;
+    for (int y = 0; y != reachability.height(); ++y) {
+    for (int x = 0; x != reachability.width (); ++x) {
+        VectorI r(x, y);
         if (!m_matcher_ptr) {
             // do nothing
         } else if (m_matcher_ptr->pivot_target() == r) {
             drect.set_color(sf::Color(180, 180, 40, 128));
         } else if (m_matcher_ptr->adjacent_target() == r) {
             drect.set_color(sf::Color(40, 180, 180, 128));
-        } else if (m_p2_accessables(r)) {
+        } else if (reachability.is_reachable(r)) {
             continue;
         } else {
             // continue;
@@ -487,53 +698,20 @@ PuyoStateVS::PuyoStateVS() {}
         drect.set_position(sf::Vector2f(r*k_block_size));
         target.draw(drect, states);
         drect.set_color(k_inaccess_color);
-    }
-
-    {
-    sf::Sprite brush;
-    brush.setTexture(load_builtin_block_texture());
-    brush.setPosition(0.f, 0.f);
-    //brush.setPosition(sf::Vector2f(VectorI(0, m_p1_board.width() + m_score_board.width())*k_block_size));
-    for (char c : pad_to_right(std::to_string(m_matcher_ptr->states_int()), 6)) {
-        if (c != ' ') {
-            brush.setTextureRect(texture_rect_for_char(c));
-            target.draw(brush, states);
-        }
-        brush.move(float(texture_rect_for_char('0').width), 0.f);
-    }
-    }
+    }}
 }
 
-/* private */ void PuyoStateVS::update_board(PuyoBoard & board, Rng & rng, double et) {
+/* private */ void PuyoStateVS::update_board
+    (PuyoBoard & board, std::size_t & pairs_dealt, double et)
+{
     bool is_p1 = &board == &m_p1_board;
     board.update(et);
     if (!board.is_ready()) {
         int other_delta = m_score_board.take_last_delta(is_p1 ? 1 : 0);
         if (other_delta != 0) {
-            int punishment = other_delta*(1 + other_delta / 8) / 4;
             BlockGrid fallins;
             fallins.set_size(board.width(), board.height(), k_empty_block);
-            int last_y = 0;
-            auto choose_random_refuge = [this]() {
-                return (IntDistri(0, 3)(m_refuge_rng) == 0) ? BlockId::hard_glass : BlockId::glass;
-            };
-            for (VectorI r; r != fallins.end_position(); r = fallins.next(r)) {
-                if (punishment < fallins.width()) break;
-                fallins(r) = choose_random_refuge();
-                last_y = r.y;
-                --punishment;
-            }
-            ++last_y;
-            if (punishment != 0 && last_y < fallins.height()) {
-                std::vector<int> xs;
-                xs.resize(fallins.width());
-                std::iota(xs.begin(), xs.end(), 0);
-                std::shuffle(xs.begin(), xs.end(), m_refuge_rng);
-                xs.resize(punishment);
-                for (int x : xs) {
-                    fallins(x, last_y) = choose_random_refuge();
-                }
-            }
+            make_refuge_fall_ins(other_delta, fallins, m_refuge_rng);
             board.push_fall_in_blocks(fallins);
         }
     }
@@ -543,14 +721,19 @@ PuyoStateVS::PuyoStateVS() {}
         m_ai_player->play_board(m_p2_board);
     }
     if (&board == &m_p2_board) {
-        m_p2_accessables = SimpleMatcher::compute_reachable_blocks(board.current_piece().location(), board.blocks(), std::move(m_p2_accessables));
+        m_p2_reachability.update(board);
     }
 
     while (board.is_gameover() || !board.is_ready()) {
-        board.push_falling_piece(random_color(rng), random_color(rng));
+        deal_pair(board, pairs_dealt);
     }
 }
 
+/* private */ void PuyoStateVS::deal_pair(PuyoBoard & board, std::size_t & pairs_dealt) {
+    auto [first, second] = m_pairs.pair_at(pairs_dealt++);
+    board.push_falling_piece(first, second);
+}
+
 // ----------------------------------------------------------------------------
 
 void ScenarioPriv::DefDeleter::operator () (Scenario * ptr) const
@@ -679,11 +862,11 @@ void PuyoState::handle_response(const Response & response) {
     bool bottom_is_open = [this]() {
         auto lower_loc = m_piece.location() + VectorI(0, 1);
         auto lower_o_loc = m_piece.other_location() + VectorI(0, 1);
-        if (!m_blocks.has_position(lower_loc) ||
-            !m_blocks.has_position(lower_o_loc))
+        if (!blocks.has_position(lower_loc) ||
+            !blocks.has_position(lower_o_loc))
         { return false; }
-        return m_blocks(lower_loc  ) == k_empty_block &&
-               m_blocks(lower_o_loc) == k_empty_block;
+        return blocks(lower_loc  ) == k_empty_block &&
+               blocks(lower_o_loc) == k_empty_block;
     }();
     int y_offset = 0;
     if (bottom_is_open) {
@@ -741,12 +924,6 @@ void PuyoState::handle_response(const Response & response) {
 #endif
 namespace {
 
-VectorI get_spawn_point(const ConstBlockSubGrid & board) {
-    auto w = board.width();
-    auto x = (w / 2) - (w % 2 ? 0 : 1);
-    return VectorI(x, 0);
-}
-
 std::string pad_to_right(std::string && str, int pad) {
     if (int(str.length()) > pad) {
         throw std::invalid_argument("pad_to_right: string too large");
@@ -755,4 +932,42 @@ std::string pad_to_right(std::string && str, int pad) {
     return std::move(str);
 }
 
+void push_piece(ReplayEncoder & encoder, const FallingPiece & piece) {
+    push_block_id(encoder, piece.color      ());
+    push_block_id(encoder, piece.other_color());
+    encoder.push_int(piece.location().x);
+    encoder.push_int(piece.location().y);
+    encoder.push_int(piece.other_location().x);
+    encoder.push_int(piece.other_location().y);
+}
+
+FallingPiece read_piece(ReplayDecoder & decoder) {
+    auto color       = read_block_id(decoder);
+    auto other_color = read_block_id(decoder);
+    VectorI location, other_location;
+    location.x       = decoder.read_int();
+    location.y       = decoder.read_int();
+    other_location.x = decoder.read_int();
+    other_location.y = decoder.read_int();
+    auto offset = other_location - location;
+    if (std::abs(offset.x) + std::abs(offset.y) != 1) {
+        throw std::runtime_error("read_piece: piece's blocks must be next to each other.");
+    }
+    FallingPiece rv(color, other_color);
+    rv.set_location(location);
+    rv.set_other_location(other_location);
+    return rv;
+}
+
+void push_block_id(ReplayEncoder & encoder, BlockId id)
+    { encoder.push_byte(uint8_t(id)); }
+
+BlockId read_block_id(ReplayDecoder & decoder) {
+    auto id = decoder.read_byte();
+    if (id > uint8_t(BlockId::hard_glass)) {
+        throw std::runtime_error("read_block_id: block must be one that exists.");
+    }
+    return BlockId(id);
+}
+
 } // end of <anonymous> namespace
@@ -49,6 +49,9 @@ public:
     int height() const { return blocks().height(); }
 
     virtual const BlockGrid & blocks() const = 0;
+    // changes whenever blocks do, so results worked out from them can be
+    // kept until it does
+    virtual std::size_t blocks_version() const = 0;
     // false if between turns
     virtual bool is_ready() const = 0;
     virtual bool is_gameover() const = 0;
@@ -56,6 +59,11 @@ public:
     virtual const FallingPiece & current_piece() const = 0;
     virtual ColorPair next_piece() const = 0;
 
+    // seconds the piece takes to fall a row (when not falling fast), and
+    // how long since it last did
+    virtual double fall_delay() const = 0;
+    virtual double fall_time() const = 0;
+
     virtual void handle_event(PlayControlEvent) = 0;
 
 protected:
@@ -72,12 +80,23 @@ public:
     static constexpr const double k_slow_fall  = 1.;
     static constexpr const double k_move_delay = 1. / 8.;
 
+    // how much faster the piece falls while down is held
+    static double fast_fall_multiplier(int board_height)
+        { return k_fast_fall*(board_height / 10); }
+
     virtual void update(double et);
 
     void handle_event(PlayControlEvent) override;
 
     void assign_pause_pointer(bool & bptr) { m_pause_ptr = &bptr; }
 
+    // how the player is moving the piece, which carries over between frames
+    struct Motion {
+        double fall_multiplier = 1.;
+        double move_time = 0.;
+        PlayControlId move_dir = PlayControlId::count;
+    };
+
 protected:
     PauseableBoard() {}
 
@@ -85,6 +104,10 @@ protected:
 
     double fall_multiplier() const { return m_fall_multiplier; }
 
+    Motion motion() const;
+
+    void set_motion(const Motion &);
+
 private:
     static constexpr const auto k_niether_dir = PlayControlId::count;
     double m_fall_multiplier = 1.;
@@ -99,6 +122,8 @@ public:
     virtual void increment_score(int board, int delta) = 0;
     virtual void reset_score(int board) = 0;
     virtual void set_next_pair(int board, BlockId first, BlockId second) = 0;
+    // as each turn settles, with the waves of pops it took (zero for none)
+    virtual void post_chain_length(int /* board */, int /* length */) {}
     virtual ~PuyoScoreBoardBase() {}
 
     static PuyoScoreBoardBase & null_instance() {
@@ -124,6 +149,8 @@ public:
     void assign_score_board(int this_board_number, PuyoScoreBoardBase &);
     void set_settings(double fall_speed, int pop_requirement);
     void set_size(int width, int height);
+    // effects set the pace of play, so seeding them makes play repeatable
+    void set_size(int width, int height, uint64_t effects_seed);
 
     void update(double) override;
     void push_falling_piece(BlockId first, BlockId second);
@@ -131,13 +158,51 @@ public:
 
     bool is_ready() const override;
     bool is_gameover() const override;
+    // a piece is in play, and no effects are (so a snapshot drops nothing)
+    bool has_only_piece_in_play() const;
 
     const FallingPiece & current_piece() const override { return m_piece; }
 
     ColorPair next_piece() const override { return m_next_piece; }
 
-    const BlockGrid & blocks() const override { return m_blocks; }
-    auto blocks() { return make_sub_grid(m_blocks); }
+    double fall_delay() const override { return m_fall_delay; }
+    double fall_time() const override { return m_fall_time; }
+
+    const BlockGrid & blocks() const override { return m_engine.blocks(); }
+    std::size_t blocks_version() const override { return m_engine.blocks_version(); }
+    // see PuyoEngine::edit_blocks, changes made through this must be
+    // followed by a call to push_fall_in_blocks
+    BlockSubGrid edit_blocks() { return m_engine.edit_blocks(); }
+
+    // what the board is updating, as snapshots keep it (replays too, so
+    // values are never reordered)
+    enum class Phase : uint8_t { settling, piece_in_play, idle, gameover };
+
+    struct Snapshot {
+        PackedBlockGrid blocks;
+        FallingPiece piece;
+        ColorPair next_piece = k_empty_pair;
+        double fall_time = 0.;
+        Phase phase = Phase::settling;
+        Motion motion;
+    };
+
+    /** Reuses the snapshot's buffer where it can, so saving repeatedly into
+     *  the same snapshot does not allocate.
+     */
+    void save_snapshot(Snapshot &) const;
+
+    /** Any effects playing (pops and falls) are dropped. A board that was
+     *  settling resumes by settling again (popping anything left to pop),
+     *  otherwise it resumes as it was.
+     */
+    void restore_snapshot(const Snapshot &);
+
+    // as replay keyframes keep them
+    static void encode_snapshot(const Snapshot &, ReplayEncoder &);
+
+    /** @throws std::runtime_error if the snapshot is malformed */
+    static void decode_snapshot(ReplayDecoder &, Snapshot &);
 
 private:
     using UpdateFunc = void(PuyoBoard::*)(double);
@@ -151,6 +216,8 @@ private:
     void update_fall_effects(double);
     void update_on_gameover(double);
 
+    Phase phase() const;
+
     PuyoScoreBoardBase * m_score_board = &PuyoScoreBoardBase::null_instance();
     int m_score_board_number = PuyoScoreBoardBase::k_not_any_board;
 
@@ -160,11 +227,10 @@ private:
     double m_fall_delay = 0.5;
     double m_fall_time  = 0.;
 
-    BlockGrid m_blocks;
+    // the rules, which this board only times and shows
+    PuyoEngine m_engine;
     FallEffectsFull m_fef;
     PuyoPopEffects m_pef;
-
-    int m_pop_requirement = k_init_pop_requirement;
 };
 
 class PuyoScoreBoard final : public PuyoScoreBoardBase, public sf::Drawable {
@@ -175,6 +241,8 @@ public:
     void set_next_pair(int board, BlockId first, BlockId second) override;
     int width() const { return 3; }
     int take_last_delta(int board);
+    // only the first player's score is kept
+    int score(int board) const { return board == 0 ? m_first_player_score : 0; }
 
 private:
     using ColorPair = PuyoBoard::ColorPair;
@@ -217,11 +285,22 @@ private:
 
     void setup_board(const Settings &) override;
 
+    void describe_session(ReplayHeader &, const Settings &) const override;
+
+    int keyframe_turn() const override;
+
+    void save_keyframe(ReplayEncoder &) const override;
+
+    void restore_keyframe(ReplayDecoder &) override;
+
     void draw(sf::RenderTarget &, sf::RenderStates) const override;
 
     void handle_response(const Response &);
 
-    Rng m_rng = Rng { std::random_device()() };
+    ColorPairQueue m_pairs;
+    std::size_t m_pairs_dealt = 0;
+    // pieces pushed, both random and the scenario's own
+    int m_turns_played = 0;
     PuyoScoreBoard m_score_board;
     PuyoBoard m_board;
     ScenarioPtr m_current_scenario;
@@ -233,8 +312,25 @@ class PuyoStateVS final : public BoardState {
 public:
     // needed by Scenario
     using Response = MultiType<std::pair<int, int>, BlockGrid>;
+
+    // rules both boards play by
+    static constexpr const int k_board_width     =  6;
+    static constexpr const int k_board_height    = 12;
+    static constexpr const int k_pop_requirement =  4;
+    static constexpr const int k_colors          =  4;
+    static constexpr const double k_fall_speed   = 1.5;
+
     PuyoStateVS();
 
+    /** Fills fallins with the refuge blocks (glass, now and then hard glass)
+     *  a board is sent once its opponent's turn scores delta. They fill from
+     *  the top while a row's worth is left, the rest are scattered across the
+     *  row below.
+     *  @param fallins must already be the size of the board
+     */
+    static void make_refuge_fall_ins
+        (int opponent_delta, BlockGrid & fallins, Pcg32 & rng);
+
 private:
     int width_in_blocks () const override;
 
@@ -248,23 +344,30 @@ private:
 
     void setup_board(const Settings &) override;
 
+    void describe_session(ReplayHeader &, const Settings &) const override;
+
     void draw(sf::RenderTarget &, sf::RenderStates) const override;
 
-    void update_board(PuyoBoard &, Rng &, double et);
+    void update_board(PuyoBoard &, std::size_t & pairs_dealt, double et);
+
+    // both boards are dealt the same pairs
+    void deal_pair(PuyoBoard &, std::size_t & pairs_dealt);
 
-    Rng m_p1_rng, m_p2_rng, m_refuge_rng;
+    ColorPairQueue m_pairs;
+    std::size_t m_p1_pairs_dealt = 0, m_p2_pairs_dealt = 0;
+    Rng m_refuge_rng;
 
     PuyoScoreBoard m_score_board;
     PuyoBoard m_p1_board;
     PuyoBoard m_p2_board;
 
     std::unique_ptr<AiScript> m_ai_player;
-    SimpleMatcher * m_matcher_ptr = nullptr;
+    AsyncAiScript * m_matcher_ptr = nullptr;
 
     // actually state wide
     bool m_pause = false;
 
-    Grid<bool> m_p2_accessables;
+    ReachabilityCache m_p2_reachability;
 };
 
 #if 0
@@ -0,0 +1,217 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "PuyoTournament.hpp"
+
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+using InvArg = std::invalid_argument;
+
+// beam searches run alongside other matches, so each keeps to its own thread
+WorkStealingPool & serial_pool();
+
+} // end of <anonymous> namespace
+
+PuyoMatch::PuyoMatch(uint32_t seed, AiScriptPtr && first, AiScriptPtr && second):
+    m_score_keeper(m_result),
+    m_ai_scripts { std::move(first), std::move(second) }
+{
+    if (!m_ai_scripts[0] || !m_ai_scripts[1]) {
+        throw InvArg("PuyoMatch::PuyoMatch: both players must have an AI script.");
+    }
+    m_pairs = ColorPairQueue(seed, PuyoStateVS::k_colors);
+    m_refuge_rng = Rng { mix_seed(seed, 0), uint64_t(RngStream::puyo_refuge) };
+    m_fall_ins.set_size(PuyoStateVS::k_board_width, PuyoStateVS::k_board_height);
+    for (int i = 0; i != 2; ++i) {
+        auto & board = m_boards[std::size_t(i)];
+        board.set_settings(PuyoStateVS::k_fall_speed, PuyoStateVS::k_pop_requirement);
+        board.assign_score_board(i, m_score_keeper);
+        board.set_size(PuyoStateVS::k_board_width, PuyoStateVS::k_board_height,
+                       mix_seed(seed, uint64_t(1 + i)));
+        // the first is the pair in play, the second is shown next
+        push_pair(i);
+        push_pair(i);
+    }
+}
+
+const PuyoMatch::Result & PuyoMatch::run(int max_frames) {
+    for (; !m_is_over && m_result.frames < max_frames; ++m_result.frames) {
+        step(0);
+        step(1);
+        bool first_lost  = m_boards[0].is_gameover();
+        bool second_lost = m_boards[1].is_gameover();
+        if (!first_lost && !second_lost) continue;
+        if (first_lost != second_lost)
+            { m_result.winner = first_lost ? 1 : 0; }
+        m_is_over = true;
+    }
+    return m_result;
+}
+
+/* private */ void PuyoMatch::ScoreKeeper::increment_score(int board, int delta) {
+    m_deltas[std::size_t(board)] += delta;
+    m_result.players[std::size_t(board)].score += delta;
+}
+
+/* private */ void PuyoMatch::ScoreKeeper::post_chain_length(int board, int length) {
+    if (length == 0) return;
+    auto & player = m_result.players[std::size_t(board)];
+    ++player.chains;
+    player.chain_links  += length;
+    player.longest_chain = std::max(player.longest_chain, length);
+}
+
+/* private */ int PuyoMatch::ScoreKeeper::take_last_delta(int board) {
+    int rv = 0;
+    std::swap(m_deltas[std::size_t(board)], rv);
+    return rv;
+}
+
+/* private */ void PuyoMatch::step(int player) {
+    // as PuyoStateVS::update_board
+    auto & board = m_boards[std::size_t(player)];
+    board.update(k_frame_time);
+    if (!board.is_ready()) {
+        int other_delta = m_score_keeper.take_last_delta(1 - player);
+        if (other_delta != 0) {
+            PuyoStateVS::make_refuge_fall_ins(other_delta, m_fall_ins, m_refuge_rng);
+            board.push_fall_in_blocks(m_fall_ins);
+        }
+    }
+    if (board.is_gameover()) return;
+    m_ai_scripts[std::size_t(player)]->play_board(board);
+    while (!board.is_ready()) {
+        push_pair(player);
+    }
+}
+
+/* private */ void PuyoMatch::push_pair(int player) {
+    auto [first, second] = m_pairs.pair_at(m_pairs_dealt[std::size_t(player)]++);
+    m_boards[std::size_t(player)].push_falling_piece(first, second);
+    ++m_result.players[std::size_t(player)].turns;
+}
+
+// ----------------------------------------------------------------------------
+
+double PuyoTournamentReport::win_rate(int player) const {
+    if (matches == 0) return 0.;
+    return double(wins[std::size_t(player)]) / double(matches);
+}
+
+double PuyoTournamentReport::average_chain_length(int player) const {
+    const auto & stats = totals[std::size_t(player)];
+    if (stats.chains == 0) return 0.;
+    return double(stats.chain_links) / double(stats.chains);
+}
+
+double PuyoTournamentReport::turns_per_second() const {
+    if (seconds <= 0.) return 0.;
+    return double(totals[0].turns + totals[1].turns) / seconds;
+}
+
+double PuyoTournamentReport::matches_per_second() const {
+    if (seconds <= 0.) return 0.;
+    return double(matches) / seconds;
+}
+
+PuyoTournamentReport run_puyo_tournament
+    (const PuyoTournamentSettings & settings, const PuyoAiScriptFactory & make_script)
+{
+    using Clock = std::chrono::steady_clock;
+    if (settings.match_count < 0) {
+        throw InvArg("run_puyo_tournament: match count must be a non-negative integer.");
+    }
+    if (settings.max_frames < 1) {
+        throw InvArg("run_puyo_tournament: max frames must be a positive integer.");
+    }
+    auto & pool = settings.pool ? *settings.pool : WorkStealingPool::shared_instance();
+    std::vector<PuyoMatch::Result> results(std::size_t(settings.match_count));
+    auto start_time = Clock::now();
+    pool.for_each_index(settings.match_count, [&](int i) {
+        auto seed = uint32_t(mix_seed(settings.root_seed, uint64_t(i)));
+        bool swapped = i % 2 == 1;
+        auto first  = make_script(0, uint32_t(mix_seed(seed, 1)));
+        auto second = make_script(1, uint32_t(mix_seed(seed, 2)));
+        if (swapped) std::swap(first, second);
+        PuyoMatch match(seed, std::move(first), std::move(second));
+        auto result = match.run(settings.max_frames);
+        if (swapped) {
+            std::swap(result.players[0], result.players[1]);
+            if (result.winner != PuyoMatch::k_draw) result.winner = 1 - result.winner;
+        }
+        results[std::size_t(i)] = result;
+    });
+
+    PuyoTournamentReport report;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    report.matches = settings.match_count;
+    for (const auto & result : results) {
+        report.frames += result.frames;
+        if (result.winner == PuyoMatch::k_draw) {
+            ++report.draws;
+        } else {
+            ++report.wins[std::size_t(result.winner)];
+        }
+        for (std::size_t p = 0; p != 2; ++p) {
+            auto & total = report.totals[p];
+            const auto & stats = result.players[p];
+            total.turns         += stats.turns;
+            total.score         += stats.score;
+            total.chains        += stats.chains;
+            total.chain_links   += stats.chain_links;
+            total.longest_chain  = std::max(total.longest_chain, stats.longest_chain);
+        }
+    }
+    return report;
+}
+
+std::unique_ptr<AiScript> make_puyo_ai_script(const std::string & name, uint32_t seed) {
+    if (name == "simple") {
+        return std::make_unique<SimpleMatcher>();
+    } else if (name == "beam") {
+        return make_puyo_beam_script(PuyoAiWeights::load_tuned());
+    } else if (name == "random") {
+        return std::make_unique<RandomPresses>(seed);
+    }
+    throw InvArg("make_puyo_ai_script: \"" + name + "\" is not an AI script "
+                 "(must be one of simple, beam or random).");
+}
+
+std::unique_ptr<AiScript> make_puyo_beam_script(const PuyoAiWeights & weights) {
+    BeamSearchMatcher::SearchSettings settings;
+    settings.time_budget = std::numeric_limits<double>::infinity();
+    settings.pop_requirement = PuyoStateVS::k_pop_requirement;
+    settings.pool = &serial_pool();
+    settings.weights = weights;
+    return std::make_unique<BeamSearchMatcher>(settings);
+}
+
+namespace {
+
+WorkStealingPool & serial_pool() {
+    // a pool without threads is never shared state, so any thread may use it
+    static WorkStealingPool inst { 0 };
+    return inst;
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,160 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "PuyoState.hpp"
+
+#include <functional>
+
+#include <cstdint>
+
+/** One PuyoBoard against another, each played by an AiScript, under
+ *  PuyoStateVS' rules (refuge blocks included). Nothing is drawn, and frames
+ *  are stepped as fast as they can be.
+ */
+class PuyoMatch final {
+public:
+    using AiScriptPtr = std::unique_ptr<AiScript>;
+
+    static constexpr const int k_draw = -1;
+    static constexpr const double k_frame_time = 1. / 60.;
+
+    struct PlayerStats {
+        // pairs played
+        int turns = 0;
+        int score = 0;
+        // turns that popped anything, and the sum of their chain lengths
+        int chains = 0;
+        int chain_links = 0;
+        int longest_chain = 0;
+    };
+
+    struct Result {
+        // the winning player (0 or 1), or k_draw
+        int winner = k_draw;
+        int frames = 0;
+        std::array<PlayerStats, 2> players;
+    };
+
+    /** Both boards are dealt the same pairs, drawn from the seed.
+     *  @throws if either script is missing
+     */
+    PuyoMatch(uint32_t seed, AiScriptPtr && first, AiScriptPtr && second);
+
+    PuyoMatch(const PuyoMatch &) = delete;
+    PuyoMatch & operator = (const PuyoMatch &) = delete;
+
+    /** Plays until a board is lost (both at once is a draw), or until
+     *  max_frames have gone by (also a draw).
+     */
+    const Result & run(int max_frames);
+
+private:
+    using Rng = Pcg32;
+
+    class ScoreKeeper final : public PuyoScoreBoardBase {
+    public:
+        explicit ScoreKeeper(Result & result): m_result(result) {}
+
+        void increment_score(int board, int delta) override;
+
+        void reset_score(int) override {}
+
+        void set_next_pair(int, BlockId, BlockId) override {}
+
+        void post_chain_length(int board, int length) override;
+
+        int take_last_delta(int board);
+
+    private:
+        Result & m_result;
+        std::array<int, 2> m_deltas = {};
+    };
+
+    void step(int player);
+
+    void push_pair(int player);
+
+    Result m_result;
+    ScoreKeeper m_score_keeper;
+    std::array<PuyoBoard, 2> m_boards;
+    std::array<AiScriptPtr, 2> m_ai_scripts;
+    ColorPairQueue m_pairs;
+    std::array<std::size_t, 2> m_pairs_dealt = {};
+    Rng m_refuge_rng;
+    BlockGrid m_fall_ins;
+    bool m_is_over = false;
+};
+
+struct PuyoTournamentSettings {
+    int match_count = 100;
+    // every match's seed comes from this and the match's number alone
+    uint32_t root_seed = 0;
+    // ten minutes of play, after which a match is a draw
+    int max_frames = 60*60*10;
+    // nullptr for the shared pool
+    WorkStealingPool * pool = nullptr;
+};
+
+struct PuyoTournamentReport {
+    int matches = 0;
+    int draws   = 0;
+    std::array<int, 2> wins = {};
+    std::array<PuyoMatch::PlayerStats, 2> totals;
+    long long frames = 0;
+    double seconds = 0.;
+
+    double win_rate(int player) const;
+
+    // of turns which popped anything
+    double average_chain_length(int player) const;
+
+    // both players' turns
+    double turns_per_second() const;
+
+    double matches_per_second() const;
+};
+
+/** Makes the script for a player (0 or 1) of a match, seeded for scripts
+ *  that are random. Called from the pool's threads.
+ */
+using PuyoAiScriptFactory =
+    std::function<std::unique_ptr<AiScript>(int player, uint32_t seed)>;
+
+/** Runs matches in parallel over the pool. Players swap boards every other
+ *  match (the first board steps first in each frame), with results always
+ *  reported by player. Results are the same for any thread count, so long
+ *  as the scripts' choices do not depend on time.
+ *  @throws if the match count is negative, or max frames is not positive
+ */
+PuyoTournamentReport run_puyo_tournament
+    (const PuyoTournamentSettings &, const PuyoAiScriptFactory &);
+
+/** @param name one of "simple", "beam" (with PuyoAiWeights::load_tuned) or
+ *         "random"
+ *  @throws if the name is none of these
+ */
+std::unique_ptr<AiScript> make_puyo_ai_script(const std::string & name, uint32_t seed);
+
+/** A BeamSearchMatcher given enough time to always finish its search, so
+ *  that it plays the same on any machine, and kept to the calling thread (as
+ *  matches already fill the pool).
+ */
+std::unique_ptr<AiScript> make_puyo_beam_script(const PuyoAiWeights &);
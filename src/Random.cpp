@@ -0,0 +1,109 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "Random.hpp"
+
+#include <array>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+using SeedCounters = std::array<std::atomic<uint64_t>, k_rng_stream_count>;
+
+std::atomic<uint64_t> & root_seed_instance();
+
+SeedCounters & seed_counters();
+
+} // end of <anonymous> namespace
+
+Pcg32::Pcg32(uint64_t seed, uint64_t stream):
+    m_increment((stream << 1u) | 1u)
+{
+    (void)(*this)();
+    m_state += seed;
+    (void)(*this)();
+}
+
+Pcg32 Pcg32::split() {
+    auto draw64 = [this] { return uint64_t((*this)()) << 32 | (*this)(); };
+    auto seed = draw64();
+    return Pcg32(seed, draw64());
+}
+
+/* static */ Pcg32 Pcg32::from_state(uint64_t state, uint64_t increment) {
+    if ((increment & 1u) == 0) {
+        throw std::invalid_argument("Pcg32::from_state: increment must be odd.");
+    }
+    Pcg32 rv;
+    rv.m_state     = state;
+    rv.m_increment = increment;
+    return rv;
+}
+
+uint64_t mix_seed(uint64_t seed, uint64_t salt) {
+    uint64_t z = seed + (salt + 1)*0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+uint64_t root_seed() { return root_seed_instance(); }
+
+void set_root_seed(uint64_t seed) { root_seed_instance() = seed; }
+
+uint64_t next_seed(RngStream stream) {
+    assert(stream != RngStream::count);
+    auto n = seed_counters()[std::size_t(stream)]++;
+    return mix_seed(mix_seed(root_seed(), uint64_t(stream)), n);
+}
+
+SeedPosition seed_position() {
+    SeedPosition rv;
+    rv.root = root_seed();
+    for (std::size_t i = 0; i != k_rng_stream_count; ++i) {
+        rv.counts[i] = seed_counters()[i];
+    }
+    return rv;
+}
+
+void set_seed_position(const SeedPosition & position) {
+    set_root_seed(position.root);
+    for (std::size_t i = 0; i != k_rng_stream_count; ++i) {
+        seed_counters()[i] = position.counts[i];
+    }
+}
+
+namespace {
+
+std::atomic<uint64_t> & root_seed_instance() {
+    static std::atomic<uint64_t> inst { []() {
+        std::random_device rdev;
+        return uint64_t(rdev()) << 32 | rdev();
+    } () };
+    return inst;
+}
+
+SeedCounters & seed_counters() {
+    static SeedCounters inst {};
+    return inst;
+}
+
+} // end of <anonymous> namespace
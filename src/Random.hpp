@@ -0,0 +1,181 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <utility>
+
+#include <cassert>
+#include <cstdint>
+
+/** PCG32 (O'Neill's XSH RR variant): a 64 bit counter with a permuted 32 bit
+ *  output. Small, fast, and its sequences are the same on every platform.
+ *
+ *  Each stream is a different sequence for the same seed, so one seed may
+ *  be split across everything that draws from it.
+ */
+class Pcg32 final {
+public:
+    using result_type = uint32_t;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+
+    Pcg32(): Pcg32(0) {}
+
+    explicit Pcg32(uint64_t seed, uint64_t stream = 0);
+
+    result_type operator () () {
+        auto old = m_state;
+        m_state = old*k_multiplier + m_increment;
+        auto xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        auto rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+    }
+
+    /** @returns a generator with its own seed and stream, drawn from (and so
+     *           moving on) this one
+     */
+    Pcg32 split();
+
+    // the generator's whole state, as saved (by replays) and restored
+    uint64_t state    () const noexcept { return m_state    ; }
+    uint64_t increment() const noexcept { return m_increment; }
+
+    /** @throws std::invalid_argument if the increment is even (as no
+     *          generator's is)
+     */
+    static Pcg32 from_state(uint64_t state, uint64_t increment);
+
+    bool operator == (const Pcg32 & rhs) const noexcept
+        { return m_state == rhs.m_state && m_increment == rhs.m_increment; }
+
+    bool operator != (const Pcg32 & rhs) const noexcept
+        { return !(*this == rhs); }
+
+private:
+    static constexpr const uint64_t k_multiplier = 6364136223846793005ull;
+
+    uint64_t m_state = 0;
+    uint64_t m_increment = 1;
+};
+
+// a different, well mixed, seed for each salt (splitmix64's finalizer)
+uint64_t mix_seed(uint64_t seed, uint64_t salt);
+
+/** Everything that draws from the root seed, each on its own stream. */
+enum class RngStream : uint8_t {
+    puyo_pairs, puyo_refuge, scenarios, tetris_pieces, samegame_boards,
+    columns_pieces, fall_effects, pop_effects, ai_scripts,
+    count
+};
+
+static constexpr const std::size_t k_rng_stream_count = std::size_t(RngStream::count);
+
+/** The root seed and how many seeds each stream has given, which is enough
+ *  to draw the same seeds again (as replays do).
+ */
+struct SeedPosition {
+    uint64_t root = 0;
+    std::array<uint64_t, k_rng_stream_count> counts = {};
+};
+
+/** The seed every game and effect is drawn from. Unless set, it is drawn
+ *  once from std::random_device.
+ */
+uint64_t root_seed();
+
+// should be set before anything is drawn from it
+void set_root_seed(uint64_t);
+
+/** Seeds are the stream's 1st, 2nd, 3rd... from the root seed, so a run
+ *  that starts the same things in the same order draws the same.
+ */
+uint64_t next_seed(RngStream);
+
+SeedPosition seed_position();
+
+void set_seed_position(const SeedPosition &);
+
+inline Pcg32 make_rng(RngStream stream)
+    { return Pcg32(next_seed(stream), uint64_t(stream)); }
+
+/** Unlike std::uniform_int_distribution, draws the same on every standard
+ *  library (and costs nothing to make for each draw).
+ *  @returns a value in [low high]
+ */
+template <typename Urbg>
+int random_int(Urbg &, int low, int high);
+
+// in [low high)
+template <typename Urbg>
+double random_real(Urbg &, double low, double high);
+
+// as std::shuffle, but the same on every standard library
+template <typename Iter, typename Urbg>
+void shuffle_range(Iter beg, Iter end, Urbg &);
+
+// ----------------------------------------------------------------------------
+
+template <typename Urbg>
+int random_int(Urbg & rng, int low, int high) {
+    assert(low <= high);
+    static constexpr const uint64_t k_rng_span = uint64_t(Urbg::max() - Urbg::min()) + 1;
+    static_assert(k_rng_span <= (uint64_t(1) << 32), "random_int: generator's range must fit 32 bits.");
+    const uint64_t span = uint64_t(int64_t(high) - int64_t(low)) + 1;
+    assert(span <= k_rng_span);
+    if (span == k_rng_span) {
+        return int(int64_t(low) + int64_t(rng() - Urbg::min()));
+    }
+    if constexpr (k_rng_span == (uint64_t(1) << 32)) {
+        // Lemire's multiply and shift, only redrawing for the (rare) low
+        // products that would bias the result
+        auto draw = [&rng] { return uint64_t(rng() - Urbg::min()); };
+        uint64_t product = draw()*span;
+        if (uint32_t(product) < span) {
+            const auto threshold = uint32_t(-uint32_t(span)) % uint32_t(span);
+            while (uint32_t(product) < threshold) {
+                product = draw()*span;
+            }
+        }
+        return int(int64_t(low) + int64_t(product >> 32));
+    } else {
+        const uint64_t limit = k_rng_span - (k_rng_span % span);
+        uint64_t r = 0;
+        do {
+            r = uint64_t(rng() - Urbg::min());
+        } while (r >= limit);
+        return int(int64_t(low) + int64_t(r % span));
+    }
+}
+
+template <typename Urbg>
+double random_real(Urbg & rng, double low, double high) {
+    static constexpr const double k_rng_span = double(Urbg::max() - Urbg::min()) + 1.;
+    return low + (high - low)*(double(rng() - Urbg::min()) / k_rng_span);
+}
+
+template <typename Iter, typename Urbg>
+void shuffle_range(Iter beg, Iter end, Urbg & rng) {
+    using std::swap;
+    for (int i = int(end - beg) - 1; i > 0; --i) {
+        swap(*(beg + i), *(beg + random_int(rng, 0, i)));
+    }
+}
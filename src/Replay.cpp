@@ -0,0 +1,478 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "Replay.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include <cstring>
+
+namespace {
+
+using Bytes            = std::vector<uint8_t>;
+using PlayControlArray = ReplayLog::PlayControlArray;
+using Board            = Settings::Board;
+
+static constexpr const int k_bits_per_control = 3;
+static constexpr const uint32_t k_control_mask = (1u << k_bits_per_control) - 1u;
+static constexpr const char k_magic[4] = { 'B', 'G', 'R', 'P' };
+static constexpr const char k_index_magic[4] = { 'B', 'G', 'K', 'I' };
+// index position, then magic
+static constexpr const std::size_t k_trailer_size = 8 + sizeof(k_index_magic);
+
+static_assert(k_play_control_id_count*k_bits_per_control <= 32,
+              "packed control states must fit 32 bits");
+
+[[noreturn]] void throw_bad_replay(const char * caller, const char * what);
+
+void push_magic(ReplayEncoder &, const char (&)[4]);
+
+// @returns false if the next bytes are not the magic
+bool read_magic(ReplayDecoder &, const char (&)[4]);
+
+void push_header(ReplayEncoder &, const ReplayHeader &);
+
+// @returns the version
+uint32_t read_header(ReplayDecoder &, ReplayHeader &);
+
+void  push_board(ReplayEncoder &, const Board &);
+
+Board read_board(ReplayDecoder &);
+
+// @returns the frame's states packed as the log stores them
+uint32_t pack_changes(const PlayControlArray & expected, const PlayControlArray & states);
+
+void unpack_changes(uint32_t packed, PlayControlArray & states);
+
+} // end of <anonymous> namespace
+
+void ReplayEncoder::push_varint(uint64_t n) {
+    while (n >= 0x80u) {
+        m_bytes->push_back(uint8_t(n | 0x80u));
+        n >>= 7;
+    }
+    m_bytes->push_back(uint8_t(n));
+}
+
+void ReplayEncoder::push_int(int n) {
+    auto wide = int64_t(n);
+    push_varint((uint64_t(wide) << 1) ^ uint64_t(wide >> 63));
+}
+
+void ReplayEncoder::push_fixed64(uint64_t n) {
+    for (int i = 0; i != 8; ++i) {
+        m_bytes->push_back(uint8_t(n >> (i*8)));
+    }
+}
+
+void ReplayEncoder::push_f64(double x) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &x, sizeof(double));
+    push_fixed64(bits);
+}
+
+void ReplayEncoder::push_rng(const Pcg32 & rng) {
+    push_varint(rng.state    ());
+    push_varint(rng.increment());
+}
+
+void ReplayEncoder::push_bytes(ByteView bytes)
+    { m_bytes->insert(m_bytes->end(), bytes.begin(), bytes.end()); }
+
+// ----------------------------------------------------------------------------
+
+uint8_t ReplayDecoder::read_byte() {
+    if (at_end()) throw_bad_replay("ReplayDecoder::read_byte", "replay ends early.");
+    return m_bytes.data()[m_position++];
+}
+
+uint64_t ReplayDecoder::read_varint() {
+    uint64_t rv = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (at_end()) break;
+        auto byte = m_bytes.data()[m_position++];
+        rv |= uint64_t(byte & 0x7Fu) << shift;
+        if ((byte & 0x80u) == 0) return rv;
+    }
+    throw_bad_replay("ReplayDecoder::read_varint", "replay ends in the middle of a number.");
+}
+
+int ReplayDecoder::read_int() {
+    auto zigzag = read_varint();
+    return int(int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1u));
+}
+
+uint64_t ReplayDecoder::read_fixed64() {
+    if (m_bytes.size() - m_position < 8) {
+        throw_bad_replay("ReplayDecoder::read_fixed64", "replay ends in the middle of a number.");
+    }
+    uint64_t rv = 0;
+    for (int i = 0; i != 8; ++i) {
+        rv |= uint64_t(m_bytes.data()[m_position++]) << (i*8);
+    }
+    return rv;
+}
+
+double ReplayDecoder::read_f64() {
+    auto bits = read_fixed64();
+    double rv = 0.;
+    std::memcpy(&rv, &bits, sizeof(double));
+    return rv;
+}
+
+Pcg32 ReplayDecoder::read_rng() {
+    auto state = read_varint();
+    auto increment = read_varint();
+    if ((increment & 1u) == 0) {
+        throw_bad_replay("ReplayDecoder::read_rng", "replay has a generator that cannot be.");
+    }
+    return Pcg32::from_state(state, increment);
+}
+
+ByteView ReplayDecoder::read_bytes(std::size_t length) {
+    if (m_bytes.size() - m_position < length) {
+        throw_bad_replay("ReplayDecoder::read_bytes", "replay ends early.");
+    }
+    auto rv = m_bytes.subview(m_position, length);
+    m_position += length;
+    return rv;
+}
+
+// ----------------------------------------------------------------------------
+
+void ReplayLog::push_frame(const PlayControlArray & states) {
+    auto packed = pack_changes(m_last_states, states);
+    if (packed != 0) {
+        ReplayEncoder encoder(m_frames);
+        encoder.push_varint(uint64_t(m_frame_count - m_last_change - 1));
+        encoder.push_varint(packed);
+        m_last_change = m_frame_count;
+    }
+    m_last_states = states;
+    PlayControlEventHandler::degrade_states(m_last_states);
+    ++m_frame_count;
+}
+
+void ReplayLog::push_keyframe(ByteView board_state) {
+    if (m_file) {
+        throw std::runtime_error("ReplayLog::push_keyframe: cannot add to a loaded replay.");
+    }
+    if (!m_keyframe_index.empty() && m_keyframe_index.back().frame == m_frame_count) {
+        return;
+    }
+    KeyframeEntry entry;
+    entry.frame  = m_frame_count;
+    entry.offset = m_keyframes.size();
+    m_keyframe_index.push_back(entry);
+
+    ReplayEncoder encoder(m_keyframes);
+    encoder.push_varint(uint64_t(m_frame_count));
+    encoder.push_varint(m_frames.size());
+    encoder.push_int   (m_last_change);
+    encoder.push_varint(pack_changes(make_released_states(), m_last_states));
+    encoder.push_varint(board_state.size());
+    encoder.push_bytes (board_state);
+}
+
+bool ReplayLog::find_keyframe(int frame, ReplayKeyframe & keyframe) const {
+    auto itr = std::upper_bound(m_keyframe_index.begin(), m_keyframe_index.end(), frame,
+        [](int frame_, const KeyframeEntry & entry) { return frame_ < entry.frame; });
+    if (itr == m_keyframe_index.begin()) return false;
+    --itr;
+
+    static constexpr const char * k_caller = "ReplayLog::find_keyframe";
+    auto data = keyframe_data();
+    ReplayDecoder decoder(data.subview(itr->offset, data.size() - itr->offset));
+    keyframe.frame = int(std::min(decoder.read_varint(), uint64_t(std::numeric_limits<int>::max())));
+    if (keyframe.frame != itr->frame) {
+        throw_bad_replay(k_caller, "keyframe is not on the frame its index says.");
+    }
+    keyframe.position    = std::size_t(decoder.read_varint());
+    keyframe.last_change = decoder.read_int();
+    if (   keyframe.position > frame_data().size()
+        || keyframe.last_change < ReplayPlayer::k_no_change
+        || keyframe.last_change >= keyframe.frame)
+    { throw_bad_replay(k_caller, "keyframe is somewhere the frames are not."); }
+    keyframe.states = make_released_states();
+    unpack_changes(uint32_t(decoder.read_varint()), keyframe.states);
+    auto board_state = decoder.read_bytes(std::size_t(decoder.read_varint()));
+    keyframe.board_state.assign(board_state.begin(), board_state.end());
+    return true;
+}
+
+void ReplayLog::save(std::ostream & out) const {
+    Bytes bytes;
+    ReplayEncoder encoder(bytes);
+    push_magic (encoder, k_magic);
+    push_header(encoder, m_header);
+
+    encoder.push_varint(uint64_t(m_frame_count));
+    encoder.push_varint(frame_data().size());
+    encoder.push_bytes (frame_data());
+    encoder.push_varint(keyframe_data().size());
+    encoder.push_bytes (keyframe_data());
+
+    auto index_position = bytes.size();
+    encoder.push_varint(m_keyframe_index.size());
+    int last_frame = 0;
+    for (const auto & entry : m_keyframe_index) {
+        encoder.push_varint(uint64_t(entry.frame - last_frame));
+        encoder.push_varint(entry.offset);
+        last_frame = entry.frame;
+    }
+    encoder.push_fixed64(index_position);
+    push_magic(encoder, k_index_magic);
+    out.write(reinterpret_cast<const char *>(bytes.data()), std::streamsize(bytes.size()));
+}
+
+bool ReplayLog::save(const std::string & filename) const noexcept {
+    try {
+        std::ofstream fout;
+        fout.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        fout.open(filename, std::ios::binary);
+        save(fout);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+/* static */ ReplayLog ReplayLog::load(std::istream & in) {
+    Bytes bytes { std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    return load(std::make_shared<const MappedFile>(std::move(bytes)));
+}
+
+/* static */ ReplayLog ReplayLog::load(const std::string & filename)
+    { return load(std::make_shared<const MappedFile>(filename)); }
+
+/* static */ ReplayHeader ReplayLog::load_header(const std::string & filename) {
+    MappedFile file { filename };
+    ReplayDecoder decoder(file.bytes());
+    ReplayHeader rv;
+    (void)read_header(decoder, rv);
+    return rv;
+}
+
+/* private static */ ReplayLog ReplayLog::load(std::shared_ptr<const MappedFile> file) {
+    static constexpr const char * k_caller = "ReplayLog::load";
+    static auto throw_bad = [](const char * what) { throw_bad_replay(k_caller, what); };
+    const auto bytes = file->bytes();
+    ReplayDecoder decoder(bytes);
+
+    ReplayLog rv;
+    auto version = read_header(decoder, rv.m_header);
+    rv.m_frame_count = int(std::min(decoder.read_varint(), uint64_t(std::numeric_limits<int>::max())));
+    rv.m_loaded_frames = decoder.read_bytes(std::size_t(decoder.read_varint()));
+    if (version == 1) {
+        if (!decoder.at_end()) throw_bad("replay's frames are not the length it says they are.");
+    } else {
+        rv.m_loaded_keyframes = decoder.read_bytes(std::size_t(decoder.read_varint()));
+        auto index_position = decoder.position();
+
+        // the index is found from the end, as readers after only it would
+        if (bytes.size() < k_trailer_size) throw_bad("replay ends early.");
+        ReplayDecoder trailer(bytes.subview(bytes.size() - k_trailer_size, k_trailer_size));
+        if (   trailer.read_fixed64() != index_position
+            || !read_magic(trailer, k_index_magic))
+        { throw_bad("replay's keyframe index is not where it says it is."); }
+
+        ReplayDecoder index(bytes.subview(index_position, bytes.size() - k_trailer_size - index_position));
+        auto count = index.read_varint();
+        uint64_t frame = 0;
+        for (uint64_t i = 0; i != count; ++i) {
+            frame += index.read_varint();
+            KeyframeEntry entry;
+            entry.offset = std::size_t(index.read_varint());
+            if (   (i != 0 && frame == uint64_t(rv.m_keyframe_index.back().frame))
+                || frame > uint64_t(rv.m_frame_count)
+                || entry.offset >= rv.m_loaded_keyframes.size())
+            { throw_bad("replay's keyframe index is out of order."); }
+            entry.frame = int(frame);
+            rv.m_keyframe_index.push_back(entry);
+        }
+        if (!index.at_end()) throw_bad("replay's keyframe index is not the length it says it is.");
+    }
+    rv.m_file = std::move(file);
+
+    // every change must be valid, and on a frame that was recorded
+    ReplayPlayer player(rv);
+    auto states = make_released_states();
+    while (player.m_next_change != ReplayPlayer::k_no_change) {
+        if (player.m_next_change >= rv.m_frame_count) {
+            throw_bad("replay has changes after its last frame.");
+        }
+        unpack_changes(player.m_next_states, states);
+        player.read_next_change();
+    }
+    return rv;
+}
+
+/* private static */ PlayControlArray ReplayLog::make_released_states() {
+    PlayControlArray rv;
+    std::fill(rv.begin(), rv.end(), PlayControlState::still_released);
+    return rv;
+}
+
+// ----------------------------------------------------------------------------
+
+ReplayPlayer::ReplayPlayer(const ReplayLog & log):
+    m_log(&log)
+{ read_next_change(); }
+
+void ReplayPlayer::send_frame(PlayControlEventReceiver & receiver) {
+    if (is_finished()) return;
+    if (m_frame == m_next_change) {
+        unpack_changes(m_next_states, m_states);
+        read_next_change();
+    }
+    PlayControlEventHandler::send_events(m_states, receiver);
+    ++m_frame;
+}
+
+void ReplayPlayer::seek(const ReplayKeyframe & keyframe) {
+    m_position    = keyframe.position;
+    m_frame       = keyframe.frame;
+    m_next_change = keyframe.last_change;
+    m_states      = keyframe.states;
+    read_next_change();
+}
+
+void ReplayPlayer::restart()
+    { *this = ReplayPlayer(*m_log); }
+
+/* private */ void ReplayPlayer::read_next_change() {
+    const auto frames = m_log->frame_data();
+    if (m_position == frames.size()) {
+        m_next_change = k_no_change;
+        return;
+    }
+    ReplayDecoder decoder(frames.subview(m_position, frames.size() - m_position));
+    // a gap too large to be in the log is left for ReplayLog::load to catch
+    auto next = uint64_t(m_next_change + 1) + decoder.read_varint();
+    m_next_change = int(std::min(next, uint64_t(std::numeric_limits<int>::max())));
+    m_next_states = uint32_t(decoder.read_varint());
+    m_position += decoder.position();
+}
+
+namespace {
+
+void throw_bad_replay(const char * caller, const char * what)
+    { throw std::runtime_error(std::string(caller) + ": " + what); }
+
+void push_magic(ReplayEncoder & encoder, const char (&magic)[4])
+    { for (char c : magic) encoder.push_byte(uint8_t(c)); }
+
+bool read_magic(ReplayDecoder & decoder, const char (&magic)[4]) {
+    for (char c : magic) {
+        if (decoder.at_end() || decoder.read_byte() != uint8_t(c)) return false;
+    }
+    return true;
+}
+
+void push_header(ReplayEncoder & encoder, const ReplayHeader & header) {
+    encoder.push_varint(ReplayLog::k_version);
+    encoder.push_byte(uint8_t(header.game));
+    encoder.push_int(header.scenario);
+
+    encoder.push_varint(header.seeds.root);
+    encoder.push_varint(header.seeds.counts.size());
+    for (auto count : header.seeds.counts) encoder.push_varint(count);
+
+    push_board         (encoder, header.puyo);
+    encoder.push_int   (header.puyo.pop_requirement);
+    encoder.push_f64   (header.puyo.fall_speed);
+    push_board         (encoder, header.tetris);
+    encoder.push_f64   (header.tetris.fall_speed);
+    encoder.push_varint(header.tetris.enabled_polyominos.to_ulong());
+    push_board         (encoder, header.samegame);
+    encoder.push_byte  (header.samegame.gameover_on_singles ? 1 : 0);
+}
+
+uint32_t read_header(ReplayDecoder & decoder, ReplayHeader & header) {
+    static constexpr const char * k_caller = "ReplayLog::load";
+    if (!read_magic(decoder, k_magic)) {
+        throw_bad_replay(k_caller, "stream does not hold a replay.");
+    }
+    auto version = decoder.read_varint();
+    if (version == 0 || version > ReplayLog::k_version) {
+        throw_bad_replay(k_caller, "replay is of another version.");
+    }
+    auto game = decoder.read_byte();
+    if (game >= uint8_t(ReplayGame::count)) {
+        throw_bad_replay(k_caller, "replay is of an unknown game.");
+    }
+    header.game     = ReplayGame(game);
+    header.scenario = decoder.read_int();
+
+    header.seeds.root = decoder.read_varint();
+    if (decoder.read_varint() != header.seeds.counts.size()) {
+        throw_bad_replay(k_caller, "replay has a different number of random streams.");
+    }
+    for (auto & count : header.seeds.counts) count = decoder.read_varint();
+
+    static_cast<Board &>(header.puyo) = read_board(decoder);
+    header.puyo.pop_requirement = decoder.read_int();
+    header.puyo.fall_speed      = decoder.read_f64();
+    static_cast<Board &>(header.tetris) = read_board(decoder);
+    header.tetris.fall_speed         = decoder.read_f64();
+    header.tetris.enabled_polyominos = PolyominoEnabledSet(decoder.read_varint());
+    static_cast<Board &>(header.samegame) = read_board(decoder);
+    header.samegame.gameover_on_singles = decoder.read_byte() != 0;
+    return uint32_t(version);
+}
+
+void push_board(ReplayEncoder & encoder, const Board & board) {
+    encoder.push_int(board.width );
+    encoder.push_int(board.height);
+    encoder.push_int(board.colors);
+}
+
+Board read_board(ReplayDecoder & decoder) {
+    Board rv;
+    rv.width  = decoder.read_int();
+    rv.height = decoder.read_int();
+    rv.colors = decoder.read_int();
+    return rv;
+}
+
+uint32_t pack_changes(const PlayControlArray & expected, const PlayControlArray & states) {
+    uint32_t rv = 0;
+    for (std::size_t i = 0; i != states.size(); ++i) {
+        if (states[i] == expected[i]) continue;
+        rv |= (uint32_t(states[i]) + 1u) << (i*k_bits_per_control);
+    }
+    return rv;
+}
+
+void unpack_changes(uint32_t packed, PlayControlArray & states) {
+    for (std::size_t i = 0; i != states.size(); ++i) {
+        auto code = (packed >> (i*k_bits_per_control)) & k_control_mask;
+        if (code == 0) continue;
+        if (code - 1u >= uint32_t(PlayControlState::count)) {
+            throw std::runtime_error("unpack_changes: replay has an invalid control state.");
+        }
+        states[i] = PlayControlState(code - 1u);
+    }
+}
+
+} // end of <anonymous> namespace
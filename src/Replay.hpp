@@ -0,0 +1,274 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "MappedFile.hpp"
+#include "PlayControl.hpp"
+#include "Random.hpp"
+#include "Settings.hpp"
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+// the last board session played, overwritten by the next
+constexpr const char * const k_last_replay_filename = "blockgameslastsession.bin";
+
+/** Which board state a session was, so that it may be started again. */
+enum class ReplayGame : uint8_t {
+    puyo_vs, puyo_scenario, tetris, tetris_ai, samegame, columns,
+    count
+};
+
+/** Everything a board state is started from. Since games are stepped one
+ *  (fixed length) frame at a time, this and the controls of each frame are
+ *  enough to play a session over again.
+ */
+struct ReplayHeader {
+    ReplayGame game = ReplayGame::count;
+    // index in Scenario::get_all_scenarios, for puyo scenarios only
+    int scenario = 0;
+    SeedPosition seeds;
+    // the scenario's own settings
+    Settings::Puyo puyo;
+    Settings::Tetris tetris;
+    Settings::SameGame samegame;
+};
+
+/** Writes the varints, zigzag encoded ints and little endian doubles that
+ *  replays (and the board states saved in them) are made of.
+ */
+class ReplayEncoder final {
+public:
+    explicit ReplayEncoder(std::vector<uint8_t> & bytes): m_bytes(&bytes) {}
+
+    void push_byte(uint8_t byte) { m_bytes->push_back(byte); }
+
+    void push_varint(uint64_t);
+
+    // zigzag, so that small negatives stay small
+    void push_int(int);
+
+    void push_fixed64(uint64_t);
+
+    void push_f64(double);
+
+    void push_rng(const Pcg32 &);
+
+    void push_bytes(ByteView);
+
+private:
+    std::vector<uint8_t> * m_bytes;
+};
+
+/** Reads what a ReplayEncoder writes. Every read throws std::runtime_error
+ *  if it would run past the end.
+ */
+class ReplayDecoder final {
+public:
+    explicit ReplayDecoder(ByteView bytes): m_bytes(bytes) {}
+
+    uint8_t read_byte();
+
+    uint64_t read_varint();
+
+    int read_int();
+
+    uint64_t read_fixed64();
+
+    double read_f64();
+
+    Pcg32 read_rng();
+
+    // the bytes are not copied, nor read, only skipped over
+    ByteView read_bytes(std::size_t length);
+
+    std::size_t position() const noexcept { return m_position; }
+
+    bool at_end() const noexcept { return m_position == m_bytes.size(); }
+
+private:
+    ByteView m_bytes;
+    std::size_t m_position = 0;
+};
+
+/** Where a replay may be resumed from without playing every frame before
+ *  it: where the player was in the frames, and the board state as it saved
+ *  itself.
+ */
+struct ReplayKeyframe {
+    using PlayControlArray = PlayControlEventHandler::PlayControlArray;
+
+    // the next frame to play
+    int frame = 0;
+    // of the frame data, where the next change is read from
+    std::size_t position = 0;
+    // the frame last recorded with a change
+    int last_change = -1;
+    // as the frame before left them (degraded)
+    PlayControlArray states;
+    std::vector<uint8_t> board_state;
+};
+
+/** A recorded session: its header, the play control states sent on each
+ *  frame, and keyframes taken along the way.
+ *
+ *  Only changes are kept. A frame is stored as a varint of how many frames
+ *  since the last change (so idle frames are run length encoded), then a
+ *  varint of three bits per control: zero if it only degraded as
+ *  PlayControlEventHandler does, otherwise one plus its new state.
+ *
+ *  Keyframes follow the frames, then an index of them (frame and offset of
+ *  each) at the end of the file. Its position is the file's last twelve
+ *  bytes (eight for the offset, four of magic), so a seek reads the index
+ *  and one keyframe, and nothing in between.
+ *
+ *  Logs loaded from a file keep it memory mapped, frames and keyframes are
+ *  only read as they are played.
+ */
+class ReplayLog final {
+public:
+    using PlayControlArray = PlayControlEventHandler::PlayControlArray;
+
+    static constexpr const double k_frame_time = 1. / 60.;
+
+    // version one has no keyframes, it is still read
+    static constexpr const uint32_t k_version = 2;
+
+    ReplayLog() {}
+
+    explicit ReplayLog(const ReplayHeader & header_): m_header(header_) {}
+
+    /** @param states as they are about to be sent, before degrading */
+    void push_frame(const PlayControlArray & states);
+
+    /** Keys the frame about to be pushed.
+     *  @param board_state as the board state encoded itself
+     */
+    void push_keyframe(ByteView board_state);
+
+    const ReplayHeader & header() const noexcept { return m_header; }
+
+    int frame_count() const noexcept { return m_frame_count; }
+
+    int keyframe_count() const noexcept { return int(m_keyframe_index.size()); }
+
+    /** Reads the last keyframe at or before the frame.
+     *  @returns false if there are none
+     *  @throws if the keyframe is malformed
+     */
+    bool find_keyframe(int frame, ReplayKeyframe &) const;
+
+    // the encoded frames
+    ByteView frame_data() const noexcept
+        { return m_file ? m_loaded_frames : ByteView(m_frames); }
+
+    void save(std::ostream &) const;
+
+    /** @returns false if the file cannot be written */
+    bool save(const std::string & filename) const noexcept;
+
+    /** @throws if the stream does not hold a replay of a known version */
+    static ReplayLog load(std::istream &);
+
+    /** Maps the file (rather than reading it).
+     *  @throws if the file cannot be read, or does not hold a replay
+     */
+    static ReplayLog load(const std::string & filename);
+
+    /** Reads only as far as the header, for listing many replays.
+     *  @throws if the file cannot be read, or does not hold a replay
+     */
+    static ReplayHeader load_header(const std::string & filename);
+
+private:
+    struct KeyframeEntry {
+        int frame = 0;
+        // in the keyframe data
+        std::size_t offset = 0;
+    };
+
+    static ReplayLog load(std::shared_ptr<const MappedFile>);
+
+    ByteView keyframe_data() const noexcept
+        { return m_file ? m_loaded_keyframes : ByteView(m_keyframes); }
+
+    ReplayHeader m_header;
+    // loaded logs read frames and keyframes from the file, recorded ones
+    // from the vectors
+    std::shared_ptr<const MappedFile> m_file;
+    ByteView m_loaded_frames;
+    ByteView m_loaded_keyframes;
+    std::vector<uint8_t> m_frames;
+    std::vector<uint8_t> m_keyframes;
+    std::vector<KeyframeEntry> m_keyframe_index;
+    int m_frame_count = 0;
+    // the frame last pushed with a change
+    int m_last_change = -1;
+    PlayControlArray m_last_states = make_released_states();
+
+    static PlayControlArray make_released_states();
+
+    friend class ReplayPlayer;
+};
+
+/** Steps through a log's frames, sending each one's events as
+ *  PlayControlEventHandler::send_events would have when it was recorded.
+ */
+class ReplayPlayer final {
+public:
+    // the log must outlive the player
+    explicit ReplayPlayer(const ReplayLog &);
+
+    bool is_finished() const noexcept { return m_frame == m_log->frame_count(); }
+
+    int frame() const noexcept { return m_frame; }
+
+    /** Sends the next frame's events (if any are left). */
+    void send_frame(PlayControlEventReceiver &);
+
+    /** Continues from the keyframe's frame, as though every frame before it
+     *  had been sent.
+     */
+    void seek(const ReplayKeyframe &);
+
+    // back to the first frame
+    void restart();
+
+private:
+    friend class ReplayLog;
+
+    using PlayControlArray = ReplayLog::PlayControlArray;
+
+    static constexpr const int k_no_change = -1;
+
+    void read_next_change();
+
+    const ReplayLog * m_log;
+    std::size_t m_position = 0;
+    int m_frame = 0;
+    // the frame the next change is on, and its packed states
+    int m_next_change = k_no_change;
+    uint32_t m_next_states = 0;
+    PlayControlArray m_states = ReplayLog::make_released_states();
+};
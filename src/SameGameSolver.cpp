@@ -0,0 +1,272 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "SameGameSolver.hpp"
+#include "BlockAlgorithm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+using InvArg = std::invalid_argument;
+
+template <typename Iter>
+int count_blocks(Iter beg, Iter end);
+
+} // end of <anonymous> namespace
+
+/* static */ int SameGameSolver::score_for_group(int size) noexcept
+    { return SameGameEngine::score_for_group(size); }
+
+/* static */ int SameGameSolver::apply_selection
+    (BlockGrid & board, VectorI selection, bool pop_singles)
+{
+    if (!board.has_position(selection)) return 0;
+    if (board(selection) == k_empty_block) return 0;
+    auto group = select_connected_blocks(board, selection);
+    if (group.size() == 1 && !pop_singles) return 0;
+    BlockGrid flipped;
+    remove_and_settle(board, group.data(), group.data() + group.size(), flipped);
+    return int(group.size());
+}
+
+SameGameSolver::SameGameSolver(const SearchSettings & settings):
+    m_settings(settings),
+    m_table(settings.table_size == 0 ? 1 : settings.table_size)
+{
+    if (settings.beam_width < 1) {
+        throw InvArg("SameGameSolver::SameGameSolver: beam width must be a "
+                     "positive integer.");
+    }
+    if (!(settings.time_budget > 0.)) {
+        throw InvArg("SameGameSolver::SameGameSolver: time budget must be a "
+                     "positive real number.");
+    }
+    if (settings.table_size == 0) {
+        throw InvArg("SameGameSolver::SameGameSolver: table size must be a "
+                     "positive integer.");
+    }
+}
+
+const SameGameSolver::Solution & SameGameSolver::solve(const BlockGrid & board) {
+    using Clock = std::chrono::steady_clock;
+    if (board.width() > k_max_board_size || board.height() > k_max_board_size) {
+        throw InvArg("SameGameSolver::solve: board must be no larger than " +
+                     std::to_string(k_max_board_size) + " in either dimension.");
+    }
+    auto start_time = Clock::now();
+    m_width  = board.width ();
+    m_height = board.height();
+    m_boards_searched = 0;
+    m_best_step = m_best_node = -1;
+    m_table.clear();
+    if (m_steps.empty()) m_steps.emplace_back();
+
+    {
+    auto & first = m_steps.front();
+    first.nodes.clear();
+    first.cells.assign(board.begin(), board.end());
+    Node root;
+    root.hash  = zobrist_hash(board);
+    root.value = value_of(board, 0);
+    first.nodes.push_back(root);
+    }
+
+    auto beam_width = m_settings.beam_width;
+    for (std::size_t step = 0; !m_steps[step].nodes.empty(); ++step) {
+        const auto & current = m_steps[step];
+        int node_count = int(current.nodes.size());
+        if (int(m_scratch.size()) < node_count) {
+            m_scratch.resize(std::size_t(node_count));
+        }
+        pool().for_each_index(node_count, [this, &current](int i)
+            { expand(current, i, m_scratch[std::size_t(i)]); });
+
+        for (int i = 0; i != node_count; ++i) {
+            m_boards_searched += m_scratch[std::size_t(i)].boards_searched;
+            if (m_scratch[std::size_t(i)].children.nodes.empty())
+                record_if_best(int(step), i);
+        }
+
+        if (std::chrono::duration<double>(Clock::now() - start_time).count() > m_settings.time_budget)
+            { beam_width = 1; }
+        if (m_steps.size() == step + 1) m_steps.emplace_back();
+        select_next_step(int(step), beam_width);
+    }
+
+    // finished boards are always found, as a beam is only ever emptied by
+    // searching boards with nothing left to remove, or whose every child
+    // was pruned (which are recorded as finished too)
+    m_solution.selections.clear();
+    const auto & best = m_steps[std::size_t(m_best_step)].nodes[std::size_t(m_best_node)];
+    m_solution.score       = best.score;
+    m_solution.blocks_left = m_best_blocks_left;
+    for (int step = m_best_step, node = m_best_node; step != 0; --step) {
+        const auto & step_node = m_steps[std::size_t(step)].nodes[std::size_t(node)];
+        m_solution.selections.push_back(step_node.selection);
+        node = step_node.parent;
+    }
+    std::reverse(m_solution.selections.begin(), m_solution.selections.end());
+    return m_solution;
+}
+
+/* private static */ double SameGameSolver::value_of(const BlockGrid & board, int score) {
+    // each color's blocks are worth what they would score, were they all
+    // to be removed at once, a quarter of which is taken as likely
+    std::array<int, k_max_colors + 1> color_counts = {};
+    for (auto block : board) {
+        if (!is_block_color(block)) continue;
+        ++color_counts[std::size_t(static_cast<int>(block))];
+    }
+    double potential = 0.;
+    for (auto count : color_counts) {
+        potential += score_for_group(count);
+    }
+    return score + 0.25*potential;
+}
+
+/* private static */ void SameGameSolver::remove_and_settle
+    (BlockGrid & board, const VectorI * beg, const VectorI * end, BlockGrid & flipped)
+{
+    for (auto itr = beg; itr != end; ++itr) {
+        board(*itr) = k_empty_block;
+    }
+    make_blocks_fall(board);
+    flip_along_trace(board, flipped);
+    make_tetris_rows_fall(flipped);
+    flip_along_trace(flipped, board);
+}
+
+/* private */ WorkStealingPool & SameGameSolver::pool() const {
+    if (m_settings.pool) return *m_settings.pool;
+    return WorkStealingPool::shared_instance();
+}
+
+/* private */ void SameGameSolver::expand
+    (const Step & step, int node_index, Scratch & scratch) const
+{
+    auto cell_count = std::size_t(m_width*m_height);
+    const auto & node = step.nodes[std::size_t(node_index)];
+    auto * cells = step.cells.data() + std::size_t(node_index)*cell_count;
+    scratch.children.nodes.clear();
+    scratch.children.cells.clear();
+    scratch.boards_searched = 0;
+    scratch.board.set_size(m_width, m_height);
+    std::copy(cells, cells + cell_count, scratch.board.begin());
+    scratch.groups.label(scratch.board);
+
+    const int min_size = m_settings.pop_singles ? 1 : 2;
+    for (int group = 0; group != scratch.groups.group_count(); ++group) {
+        int size = scratch.groups.group_size(group);
+        if (size < min_size) continue;
+        scratch.child = scratch.board;
+        remove_and_settle(scratch.child, scratch.groups.group_begin(group),
+                          scratch.groups.group_end(group), scratch.flipped);
+
+        Node child;
+        child.parent    = node_index;
+        child.selection = *scratch.groups.group_begin(group);
+        child.score     = node.score + score_for_group(size);
+        if (count_blocks(scratch.child.begin(), scratch.child.end()) == 0)
+            { child.score += k_clear_bonus; }
+        child.value = value_of(scratch.child, child.score);
+        child.hash  = zobrist_hash(scratch.child);
+        scratch.children.nodes.push_back(child);
+        scratch.children.cells.insert(scratch.children.cells.end(),
+                                      scratch.child.begin(), scratch.child.end());
+        ++scratch.boards_searched;
+    }
+}
+
+/* private */ void SameGameSolver::select_next_step(int step, int beam_width) {
+    auto cell_count = std::size_t(m_width*m_height);
+    int node_count = int(m_steps[std::size_t(step)].nodes.size());
+    m_ranked.clear();
+    for (int i = 0; i != node_count; ++i) {
+        const auto & children = m_scratch[std::size_t(i)].children.nodes;
+        for (int j = 0; j != int(children.size()); ++j) {
+            m_ranked.emplace_back(i, j);
+        }
+    }
+    auto child_of = [this](const std::pair<int, int> & ij) -> const Node &
+        { return m_scratch[std::size_t(ij.first)].children.nodes[std::size_t(ij.second)]; };
+    // ties are left in search order, so any thread count gives the same beam
+    std::stable_sort(m_ranked.begin(), m_ranked.end(),
+        [&child_of](const std::pair<int, int> & lhs, const std::pair<int, int> & rhs)
+        { return child_of(lhs).value > child_of(rhs).value; });
+
+    auto & next = m_steps[std::size_t(step + 1)];
+    next.nodes.clear();
+    next.cells.clear();
+    m_pruned_children.assign(std::size_t(node_count), 0);
+    for (const auto & ij : m_ranked) {
+        if (int(next.nodes.size()) == beam_width) break;
+        const auto & child = child_of(ij);
+        TranspositionTable::Value best_score = 0;
+        if (   m_table.find(child.hash, best_score)
+            && int(best_score) >= child.score)
+        {
+            ++m_pruned_children[std::size_t(ij.first)];
+            continue;
+        }
+        m_table.store(child.hash, TranspositionTable::Value(child.score));
+        next.nodes.push_back(child);
+        auto * cells = m_scratch[std::size_t(ij.first)].children.cells.data()
+                       + std::size_t(ij.second)*cell_count;
+        next.cells.insert(next.cells.end(), cells, cells + cell_count);
+    }
+    // a board whose every child was reached before (with as high a score)
+    // ends its line here, else the beam may empty with nothing recorded
+    for (int i = 0; i != node_count; ++i) {
+        auto child_count = int(m_scratch[std::size_t(i)].children.nodes.size());
+        if (child_count != 0 && m_pruned_children[std::size_t(i)] == child_count)
+            { record_if_best(step, i); }
+    }
+}
+
+/* private */ void SameGameSolver::record_if_best(int step, int node_index) {
+    const auto & step_ = m_steps[std::size_t(step)];
+    const auto & node = step_.nodes[std::size_t(node_index)];
+    auto cell_count = std::size_t(m_width*m_height);
+    auto * cells = step_.cells.data() + std::size_t(node_index)*cell_count;
+    int blocks_left = count_blocks(cells, cells + cell_count);
+    if (m_best_step != -1) {
+        const auto & best = m_steps[std::size_t(m_best_step)].nodes[std::size_t(m_best_node)];
+        // ties go to fewer blocks left, so a line cut short by pruning
+        // does not win over one played out to the same score
+        if (   best.score > node.score
+            || (best.score == node.score && m_best_blocks_left <= blocks_left))
+        { return; }
+    }
+    m_best_step = step;
+    m_best_node = node_index;
+    m_best_blocks_left = blocks_left;
+}
+
+namespace {
+
+template <typename Iter>
+int count_blocks(Iter beg, Iter end) {
+    return int(std::count_if(beg, end, [](BlockId block)
+        { return block != k_empty_block; }));
+}
+
+} // end of <anonymous> namespace
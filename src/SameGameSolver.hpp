@@ -0,0 +1,142 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+#include "BlockGroups.hpp"
+#include "GameEngines.hpp"
+#include "WorkStealingPool.hpp"
+#include "TranspositionTable.hpp"
+
+#include <vector>
+
+/** Searches for a high scoring order to remove a SameGame board's groups in.
+ *
+ *  A beam search: every board of the beam has each of its groups removed in
+ *  turn (spread over a pool's threads), and the best of all of those boards
+ *  become the next beam. Boards are hashed, and one already reached with as
+ *  high a score (at any step) is not searched again.
+ *
+ *  Scores are as SameGameEngine counts them.
+ */
+class SameGameSolver final {
+public:
+    static constexpr const int k_clear_bonus = SameGameEngine::k_clear_bonus;
+
+    struct SearchSettings {
+        // boards kept after each removal
+        int beam_width = 128;
+        // in seconds, for a whole solve, after which the beam narrows to
+        // its best board (so that a solve always finishes)
+        double time_budget = 0.5;
+        // as SameGame, where the game is otherwise over once only single
+        // blocks are left
+        bool pop_singles = false;
+        // nullptr for the shared pool
+        WorkStealingPool * pool = nullptr;
+        // transposition table entries, rounded up to a power of two (and
+        // must be positive)
+        std::size_t table_size = std::size_t(1) << 16;
+    };
+
+    struct Solution {
+        // a block of each group to remove, in order
+        std::vector<VectorI> selections;
+        int score = 0;
+        int blocks_left = 0;
+    };
+
+    static int score_for_group(int size) noexcept;
+
+    /** Selects a block as SameGame does: its group is removed, blocks fall,
+     *  and then empty columns are closed up (columns moving right).
+     *  @returns the number of blocks removed, zero if the selection cannot
+     *           be removed (empty, or single and singles are not allowed)
+     */
+    static int apply_selection(BlockGrid &, VectorI selection, bool pop_singles);
+
+    SameGameSolver(): SameGameSolver(SearchSettings()) {}
+
+    /** @throws if the beam width, time budget or table size is not positive */
+    explicit SameGameSolver(const SearchSettings &);
+
+    /** @throws if the board is larger than k_max_board_size (which boards
+     *          are hashed up to) in either dimension
+     */
+    const Solution & solve(const BlockGrid &);
+
+    const Solution & last_solution() const noexcept { return m_solution; }
+
+    // boards reached (including repeats) during the last solve
+    int boards_searched() const noexcept { return m_boards_searched; }
+
+private:
+    struct Node {
+        int parent = 0;
+        VectorI selection;
+        int score = 0;
+        double value = 0.;
+        ZobristHash hash = 0;
+    };
+
+    // one step's boards, cells are stored flat and in node order
+    struct Step {
+        std::vector<Node> nodes;
+        std::vector<BlockId> cells;
+    };
+
+    // memory for one task of the search, no two threads share one
+    struct Scratch {
+        ConnectedGroups groups;
+        BlockGrid board, child, flipped;
+        Step children;
+        int boards_searched = 0;
+    };
+
+    static double value_of(const BlockGrid &, int score);
+
+    static void remove_and_settle
+        (BlockGrid &, const VectorI * beg, const VectorI * end, BlockGrid & flipped);
+
+    WorkStealingPool & pool() const;
+
+    void expand(const Step &, int node_index, Scratch &) const;
+
+    void select_next_step(int step, int beam_width);
+
+    // for a board with nothing left to remove (or left to search)
+    void record_if_best(int step, int node_index);
+
+    SearchSettings m_settings;
+    Solution m_solution;
+    int m_boards_searched = 0;
+    int m_width = 0, m_height = 0;
+
+    // kept between solves, so that their memory is reused
+    std::vector<Step> m_steps;
+    std::vector<Scratch> m_scratch;
+    std::vector<std::pair<int, int>> m_ranked;
+    // by node of the step being selected from
+    std::vector<int> m_pruned_children;
+    TranspositionTable m_table;
+    // best finished board so far, by step and node
+    int m_best_step = -1, m_best_node = -1;
+    int m_best_blocks_left = 0;
+};
@@ -124,8 +124,17 @@ Settings::Settings() {
 #   endif
 }
 
-Settings::~Settings()
-    { save_settings(*this); }
+Settings::Settings(TransientTag):
+    m_is_transient(true)
+{
+    for (const auto & scen_ptr : Scenario::get_all_scenarios()) {
+        m_puyo_settings[scen_ptr->name()] = scen_ptr->default_settings();
+    }
+}
+
+Settings::~Settings() {
+    if (!m_is_transient) save_settings(*this);
+}
 
 Settings::Puyo::Puyo(): Board(6, 12, 5) {}
 
@@ -42,7 +42,11 @@ public:
     };
     using ControlMapping = std::array<MappingEntry, k_play_control_id_count>;
 
+    struct TransientTag {};
+
     Settings();
+    // defaults, neither loaded from nor saved to the settings file
+    explicit Settings(TransientTag);
     Settings(const Settings &) = delete;
     Settings(Settings &&) = delete;
     ~Settings();
@@ -124,6 +128,7 @@ private:
     std::vector<Puyo> m_puyo_scenarios;
 #   endif
     std::map<const char *, Puyo> m_puyo_settings;
+    bool m_is_transient = false;
 };
 #if 0
 template <bool k_is_const_t>
@@ -0,0 +1,450 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "TetrisAi.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cassert>
+
+namespace {
+
+using RowMask = uint64_t;
+using InvArg  = std::invalid_argument;
+
+// board column x is bit (x + k_column_bit), leaving room on both sides for
+// a piece hanging off of the board, which Polyomino allows while those
+// blocks are above it
+constexpr const int k_column_bit = 16;
+// a piece's block, dx columns from its location, is bit (dx + k_shape_bit)
+// of its shape's row
+constexpr const int k_shape_bit  = 8;
+// locations searched, beyond the board's edges (and below its floor)
+constexpr const int k_margin     = k_shape_bit;
+
+static_assert(k_max_board_size + k_column_bit + k_shape_bit*2 <= 64,
+              "Rows with a piece hanging off of either side must fit inside of a single mask.");
+
+int count_bits(RowMask mask) { return __builtin_popcountll(mask); }
+
+int lowest_bit(RowMask mask) { return __builtin_ctzll(mask); }
+
+// shape rows are moved to a location by this much
+RowMask shift_to(RowMask shape_row, int x)
+    { return shape_row << (x + k_column_bit - k_shape_bit); }
+
+VectorI turn_left(VectorI r) { return VectorI(-r.y, r.x); }
+
+} // end of <anonymous> namespace
+
+/* static */ bool TetrisAi::can_represent(const BlockGrid & grid) noexcept {
+    return    grid.width () > 0 && grid.width () <= k_max_board_size
+           && grid.height() > 0 && grid.height() <= k_max_board_size;
+}
+
+const std::vector<TetrisAi::Placement> & TetrisAi::find_placements
+    (const BlockGrid & blocks, const Polyomino & piece)
+{
+    load(blocks, piece);
+    search();
+    m_placements.clear();
+    for (int state : m_landings) {
+        Placement placement;
+        placement.turns    = turns_of(state);
+        placement.location = location_of(state);
+        placement.score    = score(state);
+        m_placements.push_back(placement);
+    }
+    return m_placements;
+}
+
+bool TetrisAi::find_best_placement
+    (const BlockGrid & blocks, const Polyomino & piece, Placement & best)
+{
+    const auto & placements = find_placements(blocks, piece);
+    if (placements.empty()) return false;
+    // first found wins ties, which is the one needing the fewest moves
+    best = placements.front();
+    for (const auto & placement : placements) {
+        if (placement.score > best.score) best = placement;
+    }
+    return true;
+}
+
+void TetrisAi::play
+    (const BlockGrid & blocks, const Polyomino & piece, int piece_number,
+     PlayControlEventReceiver & receiver)
+{
+    using Pid = PlayControlId;
+    StatesArray states;
+    std::fill(states.begin(), states.end(), false);
+    auto press = [&states](Pid id) { states[static_cast<std::size_t>(id)] = true; };
+
+    if (can_represent(blocks) && piece.block_count() != 0) {
+        if (!m_has_piece_number || piece_number != m_piece_number) {
+            m_has_piece_number = true;
+            m_piece_number     = piece_number;
+            m_has_target       = false;
+            plan(blocks, piece);
+        }
+        auto move = next_move(blocks, piece);
+
+        // a tap is only taken if nothing but down was held the frame before
+        // (moving sideways waits for the move timer to reset)
+        bool is_tapping = false;
+        for (auto id : { Pid::left, Pid::right, Pid::rotate_left, Pid::rotate_right }) {
+            is_tapping = is_tapping || m_controller.is_pressed(id);
+        }
+        switch (move) {
+        case Move::turn_left : if (!is_tapping) press(Pid::rotate_left ); break;
+        case Move::turn_right: if (!is_tapping) press(Pid::rotate_right); break;
+        case Move::left      : if (!is_tapping) press(Pid::left        ); break;
+        case Move::right     : if (!is_tapping) press(Pid::right       ); break;
+        // there already, or nothing left to do but fall
+        case Move::none: case Move::down:
+            if (!m_path.empty()) press(Pid::down);
+            break;
+        }
+    }
+    m_controller.update(states, receiver);
+}
+
+/* private */ void TetrisAi::load(const BlockGrid & blocks, const Polyomino & piece) {
+    if (!can_represent(blocks)) {
+        throw InvArg("TetrisAi::load: board is too large to be represented as "
+                     "masks of rows.");
+    }
+    m_width  = blocks.width ();
+    m_height = blocks.height();
+    m_inside = ((RowMask(1) << m_width) - 1) << k_column_bit;
+    for (int y = 0; y != m_height; ++y) {
+        RowMask row = 0;
+        for (int x = 0; x != m_width; ++x) {
+            if (blocks(x, y) == k_empty_block) continue;
+            row |= RowMask(1) << (x + k_column_bit);
+        }
+        m_rows[std::size_t(y)] = row;
+    }
+
+    std::vector<VectorI> offsets;
+    offsets.reserve(std::size_t(piece.block_count()));
+    for (int i = 0; i != piece.block_count(); ++i) {
+        offsets.push_back(piece.block_location(i) - piece.location());
+    }
+    m_can_turn = piece.is_rotation_enabled();
+    for (auto & shape : m_shapes) {
+        shape = Shape();
+        if (offsets.empty()) continue;
+        int top = offsets.front().y, bottom = top;
+        int left = offsets.front().x, right = left;
+        for (auto r : offsets) {
+            top    = std::min(top   , r.y);
+            bottom = std::max(bottom, r.y);
+            left   = std::min(left  , r.x);
+            right  = std::max(right , r.x);
+        }
+        if (   bottom - top >= k_max_piece_span || right - left >= k_max_piece_span
+            || top  <= -k_shape_bit || bottom >= k_shape_bit
+            || left <= -k_shape_bit || right  >= k_shape_bit)
+        {
+            throw InvArg("TetrisAi::load: pieces must span no more than " +
+                         std::to_string(k_max_piece_span) + " rows and columns "
+                         "near their locations.");
+        }
+        shape.top       = top;
+        shape.row_count = bottom - top + 1;
+        for (auto r : offsets) {
+            shape.rows[std::size_t(r.y - top)] |= RowMask(1) << (r.x + k_shape_bit);
+        }
+        // next shape is this one turned left
+        for (auto & r : offsets) r = turn_left(r);
+    }
+
+    m_start      = piece.location();
+    m_first_row  = std::min(m_start.y, 0);
+    m_row_count  = m_height + k_margin - m_first_row;
+    m_span_width = m_width + k_margin*2;
+    if (   m_start.x < -k_margin || m_start.x >= m_width + k_margin
+        || m_start.y >= m_height + k_margin)
+    {
+        throw InvArg("TetrisAi::load: piece is too far off of the board.");
+    }
+}
+
+/* private */ void TetrisAi::search() {
+    m_states.clear();
+    m_states.resize(std::size_t(m_row_count*m_span_width*k_turn_count));
+    m_landings.clear();
+    m_row_states.clear();
+
+    int start = state_index(0, m_start.x, m_start.y);
+    visit(start, start, Move::none, m_row_states);
+    // the piece never rises, so each row is done with before the next,
+    // which also leaves every move sideways as early as it can be
+    for (int y = m_start.y; !m_row_states.empty(); ++y) {
+        for (std::size_t i = 0; i != m_row_states.size(); ++i) {
+            int state = m_row_states[i];
+            int turns = turns_of(state);
+            int x = location_of(state).x;
+            if (m_can_turn) {
+                int left_turns  = (turns + 1) % k_turn_count;
+                int right_turns = (turns + k_turn_count - 1) % k_turn_count;
+                if (fits_inside(left_turns, x, y))
+                    visit(state_index(left_turns, x, y), state, Move::turn_left, m_row_states);
+                if (fits_inside(right_turns, x, y))
+                    visit(state_index(right_turns, x, y), state, Move::turn_right, m_row_states);
+            }
+            // Polyomino moves if no fewer blocks are on the board after
+            int inside = inside_count(turns, x, y);
+            if (   x - 1 >= -k_margin && !overlaps(turns, x - 1, y)
+                && inside_count(turns, x - 1, y) >= inside)
+            { visit(state_index(turns, x - 1, y), state, Move::left, m_row_states); }
+            if (   x + 1 < m_width + k_margin && !overlaps(turns, x + 1, y)
+                && inside_count(turns, x + 1, y) >= inside)
+            { visit(state_index(turns, x + 1, y), state, Move::right, m_row_states); }
+        }
+
+        m_next_row_states.clear();
+        for (int state : m_row_states) {
+            int turns = turns_of(state);
+            int x = location_of(state).x;
+            if (   y + 1 < m_first_row + m_row_count && !overlaps(turns, x, y + 1)
+                && inside_count(turns, x, y + 1) >= inside_count(turns, x, y))
+            {
+                visit(state_index(turns, x, y + 1), state, Move::down, m_next_row_states);
+            } else {
+                m_landings.push_back(state);
+            }
+        }
+        std::swap(m_row_states, m_next_row_states);
+    }
+}
+
+/* private */ int TetrisAi::state_index(int turns, int x, int y) const noexcept {
+    assert(x >= -k_margin && x < m_width + k_margin);
+    assert(y >= m_first_row && y < m_first_row + m_row_count);
+    return ((y - m_first_row)*m_span_width + (x + k_margin))*k_turn_count + turns;
+}
+
+/* private */ VectorI TetrisAi::location_of(int state) const noexcept {
+    int cell = state / k_turn_count;
+    return VectorI(cell % m_span_width - k_margin, cell / m_span_width + m_first_row);
+}
+
+/* private */ int TetrisAi::inside_count(int turns, int x, int y) const noexcept {
+    const auto & shape = m_shapes[std::size_t(turns)];
+    int count = 0;
+    for (int i = 0; i != shape.row_count; ++i) {
+        int row = y + shape.top + i;
+        if (row < 0 || row >= m_height) continue;
+        count += count_bits(shift_to(shape.rows[std::size_t(i)], x) & m_inside);
+    }
+    return count;
+}
+
+/* private */ bool TetrisAi::overlaps(int turns, int x, int y) const noexcept {
+    const auto & shape = m_shapes[std::size_t(turns)];
+    for (int i = 0; i != shape.row_count; ++i) {
+        int row = y + shape.top + i;
+        if (row < 0 || row >= m_height) continue;
+        if (shift_to(shape.rows[std::size_t(i)], x) & m_rows[std::size_t(row)])
+            return true;
+    }
+    return false;
+}
+
+/* private */ bool TetrisAi::fits_inside(int turns, int x, int y) const noexcept {
+    // as Polyomino::rotate, no part may be off of the board
+    const auto & shape = m_shapes[std::size_t(turns)];
+    for (int i = 0; i != shape.row_count; ++i) {
+        int row = y + shape.top + i;
+        if (row < 0 || row >= m_height) return false;
+        auto mask = shift_to(shape.rows[std::size_t(i)], x);
+        if (mask & ~m_inside) return false;
+        if (mask & m_rows[std::size_t(row)]) return false;
+    }
+    return true;
+}
+
+/* private */ void TetrisAi::visit
+    (int state, int parent, Move move, std::vector<int> & row_states)
+{
+    auto & search_state = m_states[std::size_t(state)];
+    if (search_state.parent != k_no_state) return;
+    search_state.parent = parent;
+    search_state.move   = move;
+    row_states.push_back(state);
+}
+
+/* private */ double TetrisAi::score(int state) const {
+    auto turns = turns_of(state);
+    auto x = location_of(state).x;
+    auto y = location_of(state).y;
+    const auto & shape = m_shapes[std::size_t(turns)];
+    auto rows = m_rows;
+    int off_board = 0;
+    for (int i = 0; i != shape.row_count; ++i) {
+        int row = y + shape.top + i;
+        auto mask = shift_to(shape.rows[std::size_t(i)], x);
+        if (row < 0 || row >= m_height) {
+            off_board += count_bits(mask);
+            continue;
+        }
+        rows[std::size_t(row)] |= mask & m_inside;
+        off_board += count_bits(mask & ~m_inside);
+    }
+
+    // clear full rows, settling the rest down
+    int cleared = 0, eroded_blocks = 0;
+    int to = m_height - 1;
+    for (int from = m_height - 1; from != -1; --from) {
+        if (rows[std::size_t(from)] == m_inside) {
+            int i = from - (y + shape.top);
+            if (i >= 0 && i < shape.row_count)
+                eroded_blocks += count_bits(shift_to(shape.rows[std::size_t(i)], x) & m_inside);
+            ++cleared;
+            continue;
+        }
+        rows[std::size_t(to--)] = rows[std::size_t(from)];
+    }
+    for (; to != -1; --to) rows[std::size_t(to)] = 0;
+
+    // walls count as filled
+    const RowMask pairs = ((RowMask(1) << (m_width + 1)) - 1) << (k_column_bit - 1);
+    int row_transitions = 0, column_transitions = 0, holes = 0, well_sums = 0;
+    RowMask covered = 0, in_wells = 0;
+    std::array<int, 64> well_depths = {};
+    for (int y_ = 0; y_ != m_height; ++y_) {
+        auto row    = rows[std::size_t(y_)];
+        auto walled = row | ~m_inside;
+        row_transitions += count_bits((walled ^ (walled >> 1)) & pairs);
+        // below the last row is the floor
+        auto below = y_ + 1 == m_height ? m_inside : rows[std::size_t(y_ + 1)];
+        column_transitions += count_bits((row ^ below) & m_inside);
+        holes   += count_bits(~row & covered & m_inside);
+        covered |= row;
+
+        auto wells = ~walled & (walled << 1) & (walled >> 1);
+        for (auto ended = in_wells & ~wells; ended; ended &= ended - 1)
+            { well_depths[std::size_t(lowest_bit(ended))] = 0; }
+        for (auto cells = wells; cells; cells &= cells - 1)
+            { well_sums += ++well_depths[std::size_t(lowest_bit(cells))]; }
+        in_wells = wells;
+    }
+
+    int piece_top    = y + shape.top;
+    int piece_bottom = piece_top + shape.row_count - 1;
+    double landing_height = m_height - 0.5*(piece_top + piece_bottom + 1);
+
+    const auto & w = m_weights;
+    return   w.landing_height    *landing_height
+           + w.eroded_cells      *(cleared*eroded_blocks)
+           + w.row_transitions   *row_transitions
+           + w.column_transitions*column_transitions
+           + w.holes             *holes
+           + w.well_sums         *well_sums
+           + w.blocks_off_board  *off_board;
+}
+
+/* private */ TetrisAi::ShapeRows TetrisAi::footprint(int state, int & top) const {
+    const auto & shape = m_shapes[std::size_t(turns_of(state))];
+    auto location = location_of(state);
+    ShapeRows rows = {};
+    for (int i = 0; i != shape.row_count; ++i) {
+        rows[std::size_t(i)] = shift_to(shape.rows[std::size_t(i)], location.x);
+    }
+    top = location.y + shape.top;
+    return rows;
+}
+
+/* private static */ TetrisAi::ShapeRows TetrisAi::footprint_of
+    (const Polyomino & piece, int & top)
+{
+    top = piece.block_location(0).y;
+    for (int i = 1; i != piece.block_count(); ++i) {
+        top = std::min(top, piece.block_location(i).y);
+    }
+    ShapeRows rows = {};
+    for (int i = 0; i != piece.block_count(); ++i) {
+        auto r = piece.block_location(i);
+        assert(r.y - top < k_max_piece_span && r.x + k_column_bit >= 0);
+        rows[std::size_t(r.y - top)] |= RowMask(1) << (r.x + k_column_bit);
+    }
+    return rows;
+}
+
+/* private */ void TetrisAi::plan(const BlockGrid & blocks, const Polyomino & piece) {
+    load(blocks, piece);
+    search();
+    int target = k_no_state;
+    if (m_has_target) {
+        for (int state : m_landings) {
+            int top = 0;
+            auto rows = footprint(state, top);
+            if (top != m_target_top || rows != m_target_rows) continue;
+            target = state;
+            break;
+        }
+    }
+    if (target == k_no_state && !m_landings.empty()) {
+        double best_score = 0.;
+        for (int state : m_landings) {
+            auto state_score = score(state);
+            if (target != k_no_state && state_score <= best_score) continue;
+            target     = state;
+            best_score = state_score;
+        }
+        m_target_rows = footprint(target, m_target_top);
+        m_has_target  = true;
+    }
+
+    m_path.clear();
+    m_path_position = 0;
+    if (target == k_no_state) return;
+    for (int state = target; ; state = m_states[std::size_t(state)].parent) {
+        m_path.push_back(state);
+        if (m_states[std::size_t(state)].parent == state) break;
+    }
+    std::reverse(m_path.begin(), m_path.end());
+}
+
+/* private */ TetrisAi::Move TetrisAi::next_move
+    (const BlockGrid & blocks, const Polyomino & piece)
+{
+    // nowhere to go, searching again will not change that
+    if (m_path.empty()) return Move::none;
+    int top = 0;
+    auto rows = footprint_of(piece, top);
+    auto find_on_path = [this, &rows, top]() {
+        for (auto i = m_path_position; i != m_path.size(); ++i) {
+            int state_top = 0;
+            if (footprint(m_path[i], state_top) != rows || state_top != top) continue;
+            m_path_position = i;
+            return true;
+        }
+        return false;
+    };
+    if (!find_on_path()) {
+        plan(blocks, piece);
+        if (!find_on_path()) return Move::none;
+    }
+    if (m_path_position + 1 == m_path.size()) return Move::none;
+    return m_states[std::size_t(m_path[m_path_position + 1])].move;
+}
@@ -0,0 +1,175 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Polyomino.hpp"
+#include "PuyoAiScript.hpp"
+
+#include <array>
+#include <vector>
+
+#include <cstdint>
+
+/** Weights for the features a placement is scored on (Dellacherie's, with
+ *  El-Tetris' tuning), higher scores are better.
+ */
+struct TetrisAiWeights {
+    // of the piece's middle row, above the floor
+    double landing_height     = -4.500158825082766;
+    // rows cleared times the piece's blocks in them
+    double eroded_cells       =  3.4181268101392694;
+    double row_transitions    = -3.2178882868487753;
+    double column_transitions = -9.348695305445199;
+    double holes              = -7.899265427351652;
+    double well_sums          = -3.3855972247263626;
+    // blocks placed outside of the board are lost, and the game with them
+    double blocks_off_board   = -1000.;
+};
+
+/** Plays TetrisState's rules: finds every place the piece can come to rest,
+ *  scores each, and steers the piece to the best one a frame at a time.
+ *
+ *  The board is kept as one mask per row, so each test of a piece against it
+ *  takes a handful of ands (a row at a time) rather than a look up per block.
+ *  Boards that are too large for this (see can_represent) are not played.
+ */
+class TetrisAi final {
+public:
+    using StatesArray = ControllerState::StatesArray;
+
+    struct Placement {
+        // left turns from how the piece is facing now
+        int turns = 0;
+        VectorI location;
+        double score = 0.;
+    };
+
+    static bool can_represent(const BlockGrid &) noexcept;
+
+    void set_weights(const TetrisAiWeights & weights) { m_weights = weights; }
+
+    const TetrisAiWeights & weights() const noexcept { return m_weights; }
+
+    /** Every place the piece can come to rest from where it is now, moving
+     *  and turning as Polyomino does, each scored.
+     *  @throws if the board cannot be represented, or if the piece spans more
+     *          than k_max_piece_span rows or columns
+     */
+    const std::vector<Placement> & find_placements(const BlockGrid &, const Polyomino &);
+
+    /** @returns false if the piece cannot come to rest anywhere (it is
+     *           already stuck)
+     */
+    bool find_best_placement(const BlockGrid &, const Polyomino &, Placement &);
+
+    /** Sends one frame of input, for after the board's update for that
+     *  frame. The board is searched only when "piece_number" changes (see
+     *  TetrisEngine::piece_number), after that the path found is followed a
+     *  move at a time. The piece is searched for again only if it leaves the
+     *  path (falling during it, say), keeping its target if it can.
+     */
+    void play(const BlockGrid &, const Polyomino &, int piece_number,
+              PlayControlEventReceiver &);
+
+    static constexpr const int k_max_piece_span = 5;
+
+private:
+    using RowMask = uint64_t;
+    using ShapeRows = std::array<RowMask, k_max_piece_span>;
+    static constexpr const int k_turn_count = 4;
+    static constexpr const int k_no_state   = -1;
+
+    enum class Move : uint8_t { none, turn_left, turn_right, left, right, down };
+
+    // a piece facing one way, rows top to bottom
+    struct Shape {
+        int top = 0;
+        int row_count = 0;
+        ShapeRows rows = {};
+    };
+
+    struct SearchState {
+        int parent = k_no_state;
+        Move move = Move::none;
+    };
+
+    void load(const BlockGrid &, const Polyomino &);
+
+    void search();
+
+    int state_index(int turns, int x, int y) const noexcept;
+
+    static int turns_of(int state) noexcept { return state % k_turn_count; }
+
+    VectorI location_of(int state) const noexcept;
+
+    int inside_count(int turns, int x, int y) const noexcept;
+
+    bool overlaps(int turns, int x, int y) const noexcept;
+
+    bool fits_inside(int turns, int x, int y) const noexcept;
+
+    void visit(int state, int parent, Move, std::vector<int> & row_states);
+
+    double score(int state) const;
+
+    // cells the piece covers, to tell if a target is still the same one
+    ShapeRows footprint(int state, int & top) const;
+
+    static ShapeRows footprint_of(const Polyomino &, int & top);
+
+    // searches from where the piece is now, and sets the path to the target
+    void plan(const BlockGrid &, const Polyomino &);
+
+    // the move to take next, searching again if the piece is off the path
+    Move next_move(const BlockGrid &, const Polyomino &);
+
+    TetrisAiWeights m_weights;
+
+    std::array<RowMask, k_max_board_size> m_rows = {};
+    RowMask m_inside = 0;
+    int m_width  = 0;
+    int m_height = 0;
+
+    std::array<Shape, k_turn_count> m_shapes;
+    bool m_can_turn = false;
+
+    // states are indexed by location, over a box a little larger than the
+    // board, with the turns innermost
+    VectorI m_start;
+    int m_first_row = 0;
+    int m_row_count = 0;
+    int m_span_width = 0;
+    std::vector<SearchState> m_states;
+    std::vector<int> m_landings;
+    std::vector<int> m_row_states, m_next_row_states;
+    std::vector<Placement> m_placements;
+
+    // for play
+    ControllerState m_controller;
+    ShapeRows m_target_rows = {};
+    int m_target_top = 0;
+    bool m_has_target = false;
+    int m_piece_number = 0;
+    bool m_has_piece_number = false;
+    // states from the start of the last search to the target
+    std::vector<int> m_path;
+    std::size_t m_path_position = 0;
+};
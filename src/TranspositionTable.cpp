@@ -0,0 +1,55 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "TranspositionTable.hpp"
+
+#include <stdexcept>
+
+TranspositionTable::TranspositionTable(std::size_t entry_count) {
+    if (entry_count == 0) {
+        throw std::invalid_argument("TranspositionTable::TranspositionTable: entry count must be a positive integer.");
+    }
+    std::size_t size = 1;
+    while (size < entry_count) size *= 2;
+    m_entries = std::make_unique<Entry[]>(size);
+    m_mask = size - 1;
+}
+
+bool TranspositionTable::find(ZobristHash key, Value & value) const noexcept {
+    if (key == 0) return false;
+    const auto & entry = entry_for(key);
+    auto found = entry.value.load(std::memory_order_relaxed);
+    if ((entry.check.load(std::memory_order_relaxed) ^ found) != key) return false;
+    value = found;
+    return true;
+}
+
+void TranspositionTable::store(ZobristHash key, Value value) noexcept {
+    if (key == 0) return;
+    auto & entry = entry_for(key);
+    entry.check.store(key ^ value, std::memory_order_relaxed);
+    entry.value.store(value, std::memory_order_relaxed);
+}
+
+void TranspositionTable::clear() noexcept {
+    for (std::size_t i = 0; i != size(); ++i) {
+        m_entries[i].check.store(0, std::memory_order_relaxed);
+        m_entries[i].value.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,69 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "ZobristHash.hpp"
+
+#include <atomic>
+#include <memory>
+
+/** A fixed size table of values keyed by Zobrist hash, which many threads
+ *  may find in and store to at once without any locks.
+ *
+ *  Each entry keeps its key xor'ed with its value. Should two threads store
+ *  to the same entry at once, and the two halves come from different stores,
+ *  the entry fails to match either key rather than giving a wrong value.
+ *  Keys landing in the same entry replace each other.
+ */
+class TranspositionTable final {
+public:
+    using Value = uint64_t;
+
+    /** @param entry_count rounded up to a power of two
+     *  @throws if entry_count is zero
+     */
+    explicit TranspositionTable(std::size_t entry_count);
+
+    TranspositionTable(const TranspositionTable &) = delete;
+    TranspositionTable & operator = (const TranspositionTable &) = delete;
+
+    /** Key zero (the hash of an empty board) is never found.
+     *  @returns true if found, with "value" set to what was stored
+     */
+    bool find(ZobristHash, Value & value) const noexcept;
+
+    void store(ZobristHash, Value) noexcept;
+
+    void clear() noexcept;
+
+    std::size_t size() const noexcept { return m_mask + 1; }
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check { 0 };
+        std::atomic<Value> value { 0 };
+    };
+
+    Entry & entry_for(ZobristHash key) const noexcept
+        { return m_entries[key & m_mask]; }
+
+    std::unique_ptr<Entry[]> m_entries;
+    std::size_t m_mask = 0;
+};
@@ -0,0 +1,141 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cassert>
+
+/* static */ int WorkStealingPool::default_thread_count() {
+    // hardware_concurrency may not know, in which case it is zero
+    return std::max(1, int(std::thread::hardware_concurrency())) - 1;
+}
+
+WorkStealingPool::WorkStealingPool(int thread_count) {
+    if (thread_count < 0) {
+        throw std::invalid_argument("WorkStealingPool::WorkStealingPool: thread count must be a non-negative integer.");
+    }
+    m_queues.reserve(std::size_t(thread_count));
+    for (int i = 0; i != thread_count; ++i) {
+        m_queues.emplace_back(std::make_unique<TaskQueue>());
+    }
+    m_threads.reserve(std::size_t(thread_count));
+    for (int i = 0; i != thread_count; ++i) {
+        m_threads.emplace_back(&WorkStealingPool::run_worker, this, std::size_t(i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+    std::unique_lock lock(m_wake_mutex);
+    m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto & thread : m_threads) thread.join();
+}
+
+/* static */ WorkStealingPool & WorkStealingPool::shared_instance() {
+    static WorkStealingPool inst;
+    return inst;
+}
+
+/* private */ void WorkStealingPool::push(std::size_t queue_index, Task && task) {
+    assert(queue_index < m_queues.size());
+    auto & queue = *m_queues[queue_index];
+    // counted under the wake mutex, so no worker misses it going to sleep,
+    // and (held while it is queued) no thread takes it before it is counted
+    std::unique_lock wake_lock(m_wake_mutex);
+    {
+    std::unique_lock lock(queue.mutex);
+    queue.tasks.emplace_back(std::move(task));
+    }
+    ++m_queued;
+}
+
+/* private */ bool WorkStealingPool::try_run_one(std::size_t own_queue) {
+    const auto queue_count = m_queues.size();
+    for (std::size_t i = 0; i != queue_count; ++i) {
+        auto queue_index = (own_queue + i) % queue_count;
+        auto & queue = *m_queues[queue_index];
+        Task task;
+        {
+        std::unique_lock lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        if (queue_index == own_queue) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        }
+        {
+        std::unique_lock lock(m_wake_mutex);
+        --m_queued;
+        }
+        task();
+        return true;
+    }
+    return false;
+}
+
+/* private */ void WorkStealingPool::run_worker(std::size_t own_queue) {
+    while (true) {
+        if (try_run_one(own_queue)) continue;
+        std::unique_lock lock(m_wake_mutex);
+        m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+        if (m_stopping) return;
+    }
+}
+
+/* private */ void WorkStealingPool::run_batch
+    (int count, Batch & batch, const std::function<void(int)> & f)
+{
+    batch.remaining = count;
+    // contiguous runs of indices per queue, any imbalance is stolen away
+    const auto queue_count = m_queues.size();
+    for (std::size_t q = 0; q != queue_count; ++q) {
+        int beg = int(std::size_t(count)*q / queue_count);
+        int end = int(std::size_t(count)*(q + 1) / queue_count);
+        // owners run from the back, so push in reverse to start at beg
+        for (int i = end; i != beg; --i) {
+            push(q, [&batch, &f, i]() {
+                std::exception_ptr error;
+                try {
+                    f(i - 1);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                std::unique_lock lock(batch.mutex);
+                if (!batch.error) batch.error = error;
+                if (--batch.remaining == 0) batch.done.notify_one();
+            });
+        }
+    }
+    m_wake.notify_all();
+
+    // the caller owns no queue, so it only ever steals, once there is
+    // nothing left to steal what remains is already running
+    while (try_run_one(queue_count)) {}
+    std::unique_lock lock(batch.mutex);
+    batch.done.wait(lock, [&batch] { return batch.remaining == 0; });
+    if (batch.error) std::rethrow_exception(batch.error);
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A small pool of worker threads, each with its own queue of tasks. A
+ *  worker runs tasks from the back of its own queue, and when that runs dry
+ *  it steals from the front of the others'.
+ *
+ *  Meant for short, independent pieces of work, like evaluating candidate
+ *  boards for an AI. Work is handed out with for_each_index, which gives
+ *  each index its own result slot, so that reducing those slots in index
+ *  order gives the same answer whatever the thread count.
+ */
+class WorkStealingPool final {
+public:
+    /** One less than the hardware's threads, as the caller helps too. */
+    static int default_thread_count();
+
+    /** @param thread_count zero is fine, then all work runs on the calling
+     *         thread
+     */
+    explicit WorkStealingPool(int thread_count = default_thread_count());
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool & operator = (const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool();
+
+    int thread_count() const noexcept { return int(m_threads.size()); }
+
+    /** Calls f(i) for every i in [0 count), returning once all calls have.
+     *  The calling thread works through the indices too, then sleeps until
+     *  the last of them (taken by other threads) are done. f is called from
+     *  several threads at once, but never twice for the same index.
+     *  @throws the first exception thrown by f, after all calls finish
+     */
+    template <typename Func>
+    void for_each_index(int count, Func && f);
+
+    /** Pool shared by the AI scripts, started on first use. */
+    static WorkStealingPool & shared_instance();
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // tasks for one call to for_each_index
+    struct Batch {
+        std::mutex mutex;
+        // notified (under the mutex, as the batch goes once it is done)
+        // when nothing remains
+        std::condition_variable done;
+        int remaining = 0;
+        std::exception_ptr error;
+    };
+
+    void push(std::size_t queue_index, Task &&);
+
+    /** @param own_queue owner takes from the back, any other queue is
+     *         stolen from the front (the caller's thread owns none)
+     */
+    bool try_run_one(std::size_t own_queue);
+
+    void run_worker(std::size_t own_queue);
+
+    void run_batch(int count, Batch &, const std::function<void(int)> &);
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    // tasks pushed, but not yet taken by any thread (under the wake mutex,
+    // counted as they are pushed and taken)
+    int m_queued = 0;
+    bool m_stopping = false;
+};
+
+// ----------------------------------------------------------------------------
+
+template <typename Func>
+void WorkStealingPool::for_each_index(int count, Func && f) {
+    if (count < 1) return;
+    if (m_threads.empty() || count == 1) {
+        for (int i = 0; i != count; ++i) f(i);
+        return;
+    }
+    Batch batch;
+    // the caller blocks until the batch is done, so f is safe to refer to
+    run_batch(count, batch, [&f](int i) { f(i); });
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#include "ZobristHash.hpp"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr const int k_kind_count = static_cast<int>(BlockId::hard_glass) + 1;
+constexpr const int k_keys_per_table = k_max_board_size*k_max_board_size*k_kind_count;
+
+using KeyTable = std::array<ZobristHash, k_keys_per_table*2>;
+
+// splitmix64, from a fixed seed, so every build has the same keys
+constexpr KeyTable make_key_table() {
+    KeyTable keys {};
+    uint64_t state = 0x426C6F636B47616DULL;
+    for (auto & key : keys) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+        key = z ^ (z >> 31);
+    }
+    return keys;
+}
+
+constexpr const KeyTable k_keys = make_key_table();
+
+ZobristHash key_from(const char * caller, int table, VectorI r, BlockId bid);
+
+} // end of <anonymous> namespace
+
+ZobristHash zobrist_key(VectorI r, BlockId bid)
+    { return key_from("zobrist_key", 0, r, bid); }
+
+ZobristHash zobrist_falling_key(VectorI r, BlockId bid)
+    { return key_from("zobrist_falling_key", 1, r, bid); }
+
+ZobristHash zobrist_hash(const ConstBlockSubGrid & grid) {
+    ZobristHash rv = 0;
+    for (VectorI r; r != grid.end_position(); r = grid.next(r)) {
+        if (grid(r) == k_empty_block) continue;
+        rv ^= zobrist_key(r, grid(r));
+    }
+    return rv;
+}
+
+ZobristHash zobrist_hash
+    (const ConstBlockSubGrid & grid, VectorI location, BlockId color,
+     VectorI other_location, BlockId other_color)
+{
+    auto rv = zobrist_hash(grid);
+    if (grid.has_position(location)) {
+        rv ^= zobrist_falling_key(location, color);
+    }
+    if (grid.has_position(other_location)) {
+        rv ^= zobrist_falling_key(other_location, other_color);
+    }
+    return rv;
+}
+
+void ZobristTracker::post_pop_effect(VectorI r, BlockId bid) {
+    // (decay_block leaves colors as they are)
+    auto left_behind = is_block_color(bid) ? k_empty_block : decay_block(bid);
+    m_hash ^= zobrist_key(r, bid) ^ zobrist_key(r, left_behind);
+}
+
+namespace {
+
+ZobristHash key_from(const char * caller, int table, VectorI r, BlockId bid) {
+    if (bid == k_empty_block) return 0;
+    if (r.x < 0 || r.y < 0 || r.x >= k_max_board_size || r.y >= k_max_board_size) {
+        throw std::out_of_range(std::string(caller) + ": cell has no key (board is too large).");
+    }
+    auto idx =   table*k_keys_per_table
+               + ((r.y*k_max_board_size) + r.x)*k_kind_count
+               + static_cast<int>(bid);
+    return k_keys[std::size_t(idx)];
+}
+
+} // end of <anonymous> namespace
@@ -0,0 +1,96 @@
+/****************************************************************************
+
+    Copyright 2020 Aria Janke
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*****************************************************************************/
+
+#pragma once
+
+#include "Defs.hpp"
+
+#include <vector>
+
+#include <cstdint>
+
+using ZobristHash = uint64_t;
+
+/** Zobrist hashing: every (cell, block kind) has a random key, and a board
+ *  hashes to the xor of the keys of its blocks (empty cells have none). So
+ *  a change to one cell changes the hash by xoring out the old block's key
+ *  and xoring in the new one.
+ *
+ *  Keys are fixed, rather than seeded per run, so the same board hashes the
+ *  same between runs and between machines. Only cells within
+ *  k_max_board_size in both dimensions have keys.
+ *
+ *  @throws for a cell without a key
+ */
+ZobristHash zobrist_key(VectorI, BlockId);
+
+/** Keys for blocks of a falling pair, separate from those of blocks at rest
+ *  in the same cells.
+ */
+ZobristHash zobrist_falling_key(VectorI, BlockId);
+
+ZobristHash zobrist_hash(const ConstBlockSubGrid &);
+
+/** Hash of a board with a pair falling over it, blocks off the board are
+ *  ignored (as with a piece partly above the board).
+ */
+ZobristHash zobrist_hash(const ConstBlockSubGrid &,
+                         VectorI location, BlockId color,
+                         VectorI other_location, BlockId other_color);
+
+/** Keeps a board's hash up to date as blocks are placed, fall and pop. Is
+ *  both a fall and a pop effects sink, so it can be handed to the templated
+ *  algorithms (see BlockAlgorithm.hpp) to follow them.
+ */
+class ZobristTracker final {
+public:
+    ZobristTracker() {}
+
+    explicit ZobristTracker(ZobristHash hash_): m_hash(hash_) {}
+
+    explicit ZobristTracker(const ConstBlockSubGrid & grid):
+        m_hash(zobrist_hash(grid)) {}
+
+    ZobristHash hash() const noexcept { return m_hash; }
+
+    void place(VectorI r, BlockId bid) { m_hash ^= zobrist_key(r, bid); }
+
+    void remove(VectorI r, BlockId bid) { m_hash ^= zobrist_key(r, bid); }
+
+    // ------------------------------ effects sink ----------------------------
+
+    void start() {}
+
+    void finish() {}
+
+    void post_stationary_block(VectorI, BlockId) {}
+
+    void post_block_fall(VectorI from, VectorI to, BlockId bid)
+        { m_hash ^= zobrist_key(from, bid) ^ zobrist_key(to, bid); }
+
+    /** Popped blocks are emptied, glass is decayed a step (so hard glass
+     *  broken twice is posted twice, as the algorithms do).
+     */
+    void post_pop_effect(VectorI, BlockId);
+
+    void post_group(const std::vector<VectorI> &) {}
+
+private:
+    ZobristHash m_hash = 0;
+};
@@ -2,7 +2,11 @@
 #include "Graphics.hpp"
 #include "WakefullnessUpdater.hpp"
 #include "DialogState.hpp"
+#include "BoardStates.hpp"
 #include "Settings.hpp"
+#include "SameGameSolver.hpp"
+#include "PuyoAiTuner.hpp"
+#include "PuyoNetplay.hpp"
 // #include "discord.h"
 // test edit for wip
 
@@ -12,6 +16,11 @@
 #include <common/ParseOptions.hpp>
 
 #include <thread>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <array>
+#include <string>
 
 #include <cassert>
 
@@ -34,8 +43,19 @@ private:
 struct ProgramOptions {
 };
 
+void set_root_seed_option(ProgramOptions &, char ** beg, char ** end);
+void watch_replay(ProgramOptions &, char ** beg, char ** end);
+void fast_forward_replay(ProgramOptions &, char ** beg, char ** end);
 void parse_save_builtin_to_file_system(ProgramOptions &, char ** beg, char ** end);
 void save_icon_to_file(ProgramOptions &, char ** beg, char ** end);
+void rate_samegame_boards(ProgramOptions &, char ** beg, char ** end);
+void run_puyo_ai_tournament(ProgramOptions &, char ** beg, char ** end);
+void tune_puyo_ai_weights(ProgramOptions &, char ** beg, char ** end);
+void start_netplay(ProgramOptions &, char ** beg, char ** end);
+
+// a replay to watch (or netplay session) in place of starting at the menu,
+// if one was given
+std::unique_ptr<AppState> & first_state();
 
 } // end of <anonymous> namespace
 
@@ -45,15 +65,27 @@ void save_icon_to_file(ProgramOptions &, char ** beg, char ** end);
 
 int main(int argc, char ** argv) {
     parse_options<ProgramOptions>(argc, argv, {
+        { "seed"        , 's', set_root_seed_option              },
+        { "replay"      , 'p', watch_replay                      },
+        { "replay-fast" , 'f', fast_forward_replay               },
         { "save-builtin", 'b', parse_save_builtin_to_file_system },
-        { "save-icon"   , 'i', save_icon_to_file                 }
+        { "save-icon"   , 'i', save_icon_to_file                 },
+        { "rate-samegame", 'r', rate_samegame_boards             },
+        { "puyo-tournament", 't', run_puyo_ai_tournament         },
+        { "tune-puyo-ai" , 'u', tune_puyo_ai_weights             },
+        { "netplay"     , 'n', start_netplay                     }
     });
 
 #   ifdef MACRO_TEST_DRIVER_ENTRY_FUNCTION
     MACRO_TEST_DRIVER_ENTRY_FUNCTION();
 #   endif
 
-    std::unique_ptr<AppState> app_state = std::make_unique<DialogState>();
+    std::unique_ptr<AppState> app_state;
+    if (first_state()) {
+        app_state = std::move(first_state());
+    } else {
+        app_state = std::make_unique<DialogState>();
+    }
     SettingsPtr settings_ptr;
     app_state->setup(settings_ptr);
 
@@ -150,6 +182,67 @@ VectorI WindowAnchor::adjusted_position_for(const AppState & app_state) const {
 #   endif
 }
 
+// arguments: <seed>
+// every game and effect draws from this seed, so a run is repeatable
+void set_root_seed_option(ProgramOptions &, char ** beg, char ** end) {
+    try {
+        if (beg == end) throw std::invalid_argument("missing seed");
+        set_root_seed(uint64_t(std::stoull(*beg)));
+    } catch (std::exception &) {
+        std::cerr << "seed: seed must be a non-negative integer." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// arguments: <replay file>
+// watches the replay (at the usual frame rate) before going to the menu
+void watch_replay(ProgramOptions &, char ** beg, char ** end) {
+    try {
+        if (beg == end) throw std::invalid_argument("missing replay file.");
+        first_state() = std::make_unique<ReplayState>(ReplayLog::load(*beg));
+    } catch (std::exception & exp) {
+        std::cerr << "replay: " << exp.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// arguments: <replay file> [frame]
+// steps the replay's game as fast as it can, without a window or drawing,
+// prints how long it took and exits
+// with a frame, only seeks to it (from the nearest keyframe) instead
+void fast_forward_replay(ProgramOptions &, char ** beg, char ** end) {
+    using Clock = std::chrono::steady_clock;
+    try {
+        if (beg == end) throw std::invalid_argument("missing replay file.");
+        ReplayState state(ReplayLog::load(*beg));
+        // the state sets itself up from the replay's own settings
+        SettingsPtr unused = std::make_unique<Settings>(Settings::TransientTag());
+        state.setup(unused);
+        auto start_time = Clock::now();
+        auto seconds_since_start = [start_time]()
+            { return std::chrono::duration<double>(Clock::now() - start_time).count(); };
+        if (beg + 1 != end) {
+            state.seek(std::stoi(*(beg + 1)));
+            std::cout << "seeked to frame " << state.frame() << " of "
+                      << state.frame_count() << " in " << seconds_since_start()
+                      << "s" << std::endl;
+            std::exit(EXIT_SUCCESS);
+        }
+        while (!state.is_finished()) {
+            state.update(ReplayLog::k_frame_time);
+        }
+        double elapsed = seconds_since_start();
+        double played  = state.frame_count()*ReplayLog::k_frame_time;
+        std::cout << state.frame_count() << " frames (" << played << "s of play) in "
+                  << elapsed << "s (" << (state.frame_count() / elapsed) << " frames/s, "
+                  << (played / elapsed) << "x real time)" << std::endl;
+    } catch (std::exception & exp) {
+        std::cerr << "replay-fast: " << exp.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::exit(EXIT_SUCCESS);
+}
+
 void parse_save_builtin_to_file_system
     (ProgramOptions &, char ** beg, char ** end)
 {
@@ -176,4 +269,185 @@ void save_icon_to_file(ProgramOptions &, char ** beg, char ** end) {
     img.saveToFile(*beg);
 }
 
+// arguments: [board count] [width] [height] [colors] [seed]
+// solves that many random SameGame boards, prints how each went and exits
+void rate_samegame_boards(ProgramOptions &, char ** beg, char ** end) {
+    using Clock = std::chrono::steady_clock;
+    std::array<int, 5> args = { 10, 12, 12, 4, 0 };
+    try {
+        for (auto itr = args.begin(); itr != args.end() && beg != end; ++itr, ++beg) {
+            *itr = std::stoi(*beg);
+        }
+    } catch (std::exception &) {
+        std::cerr << "rate-samegame: arguments must be integers." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    const auto [count, width, height, colors, seed] = args;
+    if (count < 1) {
+        std::cerr << "rate-samegame: board count must be a positive integer." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (   width  < k_min_board_size || width  > k_max_board_size
+        || height < k_min_board_size || height > k_max_board_size
+        || colors < k_min_colors     || colors > k_max_colors)
+    {
+        std::cerr << "rate-samegame: board must be between " << k_min_board_size
+                  << " and " << k_max_board_size << " on each side, with "
+                  << k_min_colors << " to " << k_max_colors << " colors." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    Pcg32 rng { uint64_t(seed), uint64_t(RngStream::samegame_boards) };
+    SameGameSolver solver;
+    BlockGrid board;
+    board.set_size(width, height);
+    double total_score = 0., total_time = 0.;
+    int cleared = 0;
+    for (int i = 0; i < count; ++i) {
+        for (auto & block : board) {
+            block = ColorBlockDistri(colors)(rng);
+        }
+        auto start_time = Clock::now();
+        const auto & solution = solver.solve(board);
+        double elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+        std::cout << "board " << (i + 1) << ": score " << solution.score
+                  << ", blocks left " << solution.blocks_left
+                  << ", moves " << solution.selections.size()
+                  << ", " << elapsed << "s" << std::endl;
+        total_score += solution.score;
+        total_time  += elapsed;
+        if (solution.blocks_left == 0) ++cleared;
+    }
+    std::cout << "average score " << (total_score / count)
+              << ", cleared " << cleared << " of " << count
+              << ", average time " << (total_time / count) << "s" << std::endl;
+    std::exit(EXIT_SUCCESS);
+}
+
+// arguments: [match count] [seed] [first ai] [second ai]
+// where each ai is one of simple, beam or random; plays the matches
+// headless, prints how each player did and exits
+void run_puyo_ai_tournament(ProgramOptions &, char ** beg, char ** end) {
+    PuyoTournamentSettings settings;
+    std::array<std::string, 2> names = { "beam", "simple" };
+    try {
+        if (beg != end) settings.match_count = std::stoi(*beg++);
+        if (beg != end) settings.root_seed   = uint32_t(std::stoul(*beg++));
+    } catch (std::exception &) {
+        std::cerr << "puyo-tournament: match count and seed must be integers." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (settings.match_count < 1) {
+        std::cerr << "puyo-tournament: match count must be a positive integer." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    for (auto itr = names.begin(); itr != names.end() && beg != end; ++itr, ++beg) {
+        *itr = *beg;
+    }
+    PuyoTournamentReport report;
+    try {
+        for (const auto & name : names) make_puyo_ai_script(name, 0);
+        report = run_puyo_tournament(settings, [&names](int player, uint32_t seed)
+            { return make_puyo_ai_script(names[std::size_t(player)], seed); });
+    } catch (std::exception & exp) {
+        std::cerr << "puyo-tournament: " << exp.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::cout << report.matches << " matches in " << report.seconds << "s ("
+              << report.matches_per_second() << " matches/s, "
+              << report.turns_per_second() << " turns/s)" << std::endl;
+    for (int p = 0; p != 2; ++p) {
+        const auto & totals = report.totals[std::size_t(p)];
+        std::cout << "player " << (p + 1) << " (" << names[std::size_t(p)] << "): "
+                  << "win rate " << (report.win_rate(p)*100.) << "%, "
+                  << "average chain " << report.average_chain_length(p) << ", "
+                  << "longest chain " << totals.longest_chain << std::endl;
+    }
+    std::cout << "draws " << report.draws << std::endl;
+    std::exit(EXIT_SUCCESS);
+}
+
+// arguments: [generations] [population] [matches per candidate] [seed]
+// tunes from the weights the AI loads (against those same weights), saving
+// the mean to the weights file after every generation, then exits
+void tune_puyo_ai_weights(ProgramOptions &, char ** beg, char ** end) {
+    PuyoAiTuner::Settings settings;
+    int generations = 10;
+    try {
+        if (beg != end) generations                    = std::stoi(*beg++);
+        if (beg != end) settings.population            = std::stoi(*beg++);
+        if (beg != end) settings.matches_per_candidate = std::stoi(*beg++);
+        if (beg != end) settings.seed                  = uint32_t(std::stoul(*beg++));
+    } catch (std::exception &) {
+        std::cerr << "tune-puyo-ai: arguments must be integers." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    if (generations < 1 || settings.population < 1 || settings.matches_per_candidate < 1) {
+        std::cerr << "tune-puyo-ai: generations, population and matches per candidate "
+                     "must be positive integers." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    settings.elite_count = std::max(1, settings.population / 4);
+
+    auto print_weights = [](const PuyoAiWeights & weights) {
+        auto array = weights.to_array();
+        for (int i = 0; i != PuyoAiWeights::k_count; ++i) {
+            std::cout << " " << PuyoAiWeights::name_of(i) << " " << array[std::size_t(i)];
+        }
+        std::cout << std::endl;
+    };
+    try {
+        const auto & start = PuyoAiWeights::load_tuned();
+        PuyoAiTuner tuner(settings, start, start);
+        for (int i = 0; i < generations; ++i) {
+            const auto & best = tuner.run_generation();
+            std::cout << "generation " << tuner.generation() << ": best fitness "
+                      << best.fitness << "," << std::endl << " best:";
+            print_weights(best.weights);
+            std::cout << " mean:";
+            print_weights(tuner.mean());
+            if (!tuner.mean().save(k_puyo_ai_weights_filename)) {
+                std::cerr << "tune-puyo-ai: cannot write \"" << k_puyo_ai_weights_filename
+                          << "\"." << std::endl;
+            }
+        }
+    } catch (std::exception & exp) {
+        std::cerr << "tune-puyo-ai: " << exp.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::exit(EXIT_SUCCESS);
+}
+
+// arguments: <local port> <remote port> [latency ms] [loss percent]
+// plays Puyo VS against another instance on this machine, started with the
+// ports the other way around; latency and loss are added to what this end
+// sends, to try rollback over a worse network
+void start_netplay(ProgramOptions &, char ** beg, char ** end) {
+    static constexpr const int k_max_port = 65535;
+    try {
+        if (end - beg < 2) throw std::invalid_argument("missing ports.");
+        auto to_port = [](const char * str) {
+            int port = std::stoi(str);
+            if (port < 1 || port > k_max_port) {
+                throw std::invalid_argument("ports must be in [1 65535].");
+            }
+            return uint16_t(port);
+        };
+        ConditionedLink::Conditions conditions;
+        if (end - beg > 2) conditions.latency = std::stod(*(beg + 2)) / 1000.;
+        if (end - beg > 3) conditions.loss    = std::stod(*(beg + 3)) / 100.;
+        first_state() = std::make_unique<PuyoNetplayState>
+            (to_port(*beg), to_port(*(beg + 1)), conditions);
+    } catch (std::exception & exp) {
+        std::cerr << "netplay: " << exp.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+std::unique_ptr<AppState> & first_state() {
+    static std::unique_ptr<AppState> inst;
+    return inst;
+}
+
 } // end of <anonymous> namespace
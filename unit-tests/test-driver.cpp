@@ -19,15 +19,32 @@
 
 #include "../src/Defs.hpp"
 #include "../src/BlockAlgorithm.hpp"
+#include "../src/ChainResolver.hpp"
 #include "../src/EffectsFull.hpp"
 #include "../src/ColumnsClone.hpp"
 #include "../src/PlayControl.hpp"
 #include "../src/PuyoAiScript.hpp"
 #include "../src/PuyoState.hpp"
+#include "../src/WorkStealingPool.hpp"
+#include "../src/ZobristHash.hpp"
+#include "../src/TranspositionTable.hpp"
+#include "../src/TetrisAi.hpp"
+#include "../src/SameGameSolver.hpp"
+#include "../src/PuyoAiTuner.hpp"
+#include "../src/GameEngines.hpp"
+#include "../src/Replay.hpp"
+#include "../src/PuyoNetplay.hpp"
 
 #include <common/TestSuite.hpp>
 
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
 
 #include <cassert>
 
@@ -40,11 +57,27 @@ namespace {
 bool test_GetEdgeValue(ts::TestSuite &);
 bool test_select_connected_blocks(ts::TestSuite &);
 bool test_make_blocks_fall(ts::TestSuite &);
+bool test_BlockBitBoard(ts::TestSuite &);
+bool test_PackedBlockGrid(ts::TestSuite &);
+bool test_ConnectedGroups(ts::TestSuite &);
+bool test_tetris_rows(ts::TestSuite &);
+bool test_resolve_chain(ts::TestSuite &);
+bool test_ZobristHash(ts::TestSuite &);
+bool test_TranspositionTable(ts::TestSuite &);
 bool test_FallEffectsFull_do_fall_in(ts::TestSuite &);
 bool test_columns_algo(ts::TestSuite &);
 bool test_columns_rotate(ts::TestSuite &);
 bool test_play_control(ts::TestSuite &);
+bool test_WorkStealingPool(ts::TestSuite &);
 bool test_ai_script(ts::TestSuite &);
+bool test_TetrisAi(ts::TestSuite &);
+bool test_SameGameSolver(ts::TestSuite &);
+bool test_PuyoMatch(ts::TestSuite &);
+bool test_PuyoAiTuner(ts::TestSuite &);
+bool test_game_engines(ts::TestSuite &);
+bool test_random(ts::TestSuite &);
+bool test_replay(ts::TestSuite &);
+bool test_netplay(ts::TestSuite &);
 
 } // end of <anonymous> namespace
 
@@ -52,8 +85,12 @@ int MACRO_TEST_DRIVER_ENTRY_FUNCTION() {
     ts::TestSuite suite;
     static const auto k_test_fns = {
         test_GetEdgeValue, test_select_connected_blocks, test_make_blocks_fall,
+        test_BlockBitBoard, test_PackedBlockGrid, test_ConnectedGroups, test_tetris_rows,
+        test_resolve_chain, test_ZobristHash, test_TranspositionTable,
         test_FallEffectsFull_do_fall_in, test_columns_algo, test_columns_rotate,
-        test_play_control, test_ai_script
+        test_play_control, test_WorkStealingPool, test_ai_script, test_TetrisAi,
+        test_SameGameSolver, test_PuyoMatch, test_PuyoAiTuner, test_game_engines,
+        test_random, test_replay, test_netplay
     };
     bool all_good = true;
     for (auto f : k_test_fns) {
@@ -190,6 +227,544 @@ bool test_make_blocks_fall(ts::TestSuite & suite) {
             && g(0, 3) == r_
             && g(0, 4) == r_);
     });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { b_, e_ },
+            { e_, g_ },
+            { r_, e_ },
+            { e_, y_ },
+        });
+        std::vector<BlockFall> falls;
+        make_blocks_fall(g, falls);
+        // blocks fall bottom first, the yellow block does not move
+        return ts::test(falls.size() == 3
+            && falls[0].from == VectorI(0, 2) && falls[0].to == VectorI(0, 3)
+            && falls[1].from == VectorI(0, 0) && falls[1].to == VectorI(0, 2)
+            && falls[2].from == VectorI(1, 1) && falls[2].to == VectorI(1, 2)
+            && falls[2].color == g_
+            && is_grid_the_same(g, {
+                { e_, e_ },
+                { e_, e_ },
+                { b_, g_ },
+                { r_, y_ },
+            }));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { b_, BlockId::glass, e_ },
+            { e_, e_            , g_ },
+            { r_, m_            , e_ },
+            { e_, y_            , r_ },
+        });
+        BlockBitBoard board(g);
+        bool moved = make_blocks_fall(board);
+        board.store(g);
+        return ts::test(moved && is_grid_the_same(g, {
+            { e_, e_            , e_ },
+            { e_, BlockId::glass, e_ },
+            { b_, m_            , g_ },
+            { r_, y_            , r_ },
+        }) && !make_blocks_fall(board));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        struct CountingSink {
+            void start() {}
+            void post_stationary_block(VectorI, BlockId) { ++stationary; }
+            void post_block_fall(VectorI, VectorI, BlockId) { ++falls; }
+            void finish() {}
+
+            int stationary = 0, falls = 0;
+        };
+        BlockGrid g({
+            { b_, e_ },
+            { e_, g_ },
+            { r_, e_ },
+            { e_, y_ },
+        });
+        CountingSink sink;
+        make_blocks_fall(g, sink);
+        return ts::test(sink.stationary == 1 && sink.falls == 3);
+    });
+    // falls are posted a column at a time
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        class BatchRecorder final : public FallBlockEffects {
+        public:
+            std::vector<std::size_t> batch_sizes;
+        private:
+            void start() override {}
+            void post_stationary_block(VectorI, BlockId) override {}
+            void post_block_fall(VectorI, VectorI, BlockId) override
+                { batch_sizes.push_back(0); }
+            void post_block_falls(const BlockFall * beg, const BlockFall * end) override
+                { batch_sizes.push_back(std::size_t(end - beg)); }
+            void finish() override {}
+        };
+        BlockGrid g({
+            { b_, e_, r_ },
+            { e_, g_, e_ },
+            { r_, e_, e_ },
+            { e_, y_, e_ },
+        });
+        BatchRecorder recorder;
+        make_blocks_fall(g, recorder);
+        return ts::test(recorder.batch_sizes == std::vector<std::size_t> { 2, 1, 1 });
+    });
+    return suite.has_successes_only();
+}
+
+bool test_BlockBitBoard(ts::TestSuite & suite) {
+    suite.start_series("BlockBitBoard");
+    static const auto k_glass = BlockId::glass;
+    static const auto k_hard  = BlockId::hard_glass;
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { r_, e_, k_glass },
+            { b_, g_, k_hard  },
+            { m_, y_, e_      }
+        });
+        BlockGrid res;
+        res.set_size(g.width(), g.height());
+        BlockBitBoard(g).store(res);
+        return ts::test(std::equal(g.begin(), g.end(), res.begin(), res.end()));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockBitBoard board(BlockGrid({
+            { e_, r_, e_ },
+            { r_, r_, r_ },
+            { e_, r_, e_ }
+        }));
+        BlockBitBoard::ColumnMasks region = {};
+        region[1] = 1 << 1;
+        flood_fill(board.masks_for(r_), region, board.width());
+        return ts::test(count_cells(region, board.width()) == 5);
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        // hard glass touching two popped blocks is broken all the way
+        BlockGrid g({
+            { k_hard , r_, k_hard, e_ },
+            { r_     , r_, b_    , b_ },
+            { k_glass, r_, r_    , b_ },
+        });
+        BlockBitBoard board(g);
+        bool popped = pop_connected_blocks(board, 4);
+        board.store(g);
+        return ts::test(popped && is_grid_the_same(g, {
+            { e_, e_, k_glass, e_ },
+            { e_, e_, b_     , b_ },
+            { e_, e_, e_     , b_ },
+        }));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { r_, b_, r_ },
+            { b_, r_, b_ },
+            { r_, b_, r_ }
+        });
+        BlockBitBoard board(g);
+        return ts::test(!pop_connected_blocks(board, 2));
+    });
+    return suite.has_successes_only();
+}
+
+bool test_PackedBlockGrid(ts::TestSuite & suite) {
+    suite.start_series("PackedBlockGrid");
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { r_, e_, BlockId::glass      },
+            { b_, g_, BlockId::hard_glass },
+            { m_, y_, e_                  }
+        });
+        PackedBlockGrid packed(g);
+        BlockGrid res;
+        packed.unpack(res);
+        return ts::test(   packed.byte_size() == 5
+                        && packed.block_at(VectorI(2, 1)) == BlockId::hard_glass
+                        && std::equal(g.begin(), g.end(), res.begin(), res.end()));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        PackedBlockGrid packed(BlockGrid({
+            { r_, r_ },
+            { r_, r_ }
+        }));
+        packed.set_block(VectorI(1, 0), y_);
+        packed.set_block(VectorI(0, 1), e_);
+        return ts::test(   packed.block_at(VectorI(0, 0)) == r_
+                        && packed.block_at(VectorI(1, 0)) == y_
+                        && packed.block_at(VectorI(0, 1)) == e_
+                        && packed.block_at(VectorI(1, 1)) == r_);
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid start {
+            { e_, e_, e_ },
+            { g_, e_, r_ },
+            { r_, g_, b_ }
+        };
+        PuyoBoard board;
+        board.set_size(start.width(), start.height());
+        board.push_fall_in_blocks(start);
+        while (board.is_ready()) {
+            board.update(0.5);
+        }
+        PuyoBoard::Snapshot snapshot;
+        board.save_snapshot(snapshot);
+        board.edit_blocks()(VectorI(1, 1)) = y_;
+        board.restore_snapshot(snapshot);
+        // an idle board stays idle, rather than settling again
+        return ts::test(   !board.is_ready()
+                        && std::equal(board.blocks().begin(), board.blocks().end(),
+                                      start.begin(), start.end()));
+    });
+    return suite.has_successes_only();
+}
+
+bool test_ConnectedGroups(ts::TestSuite & suite) {
+    suite.start_series("ConnectedGroups");
+    // a "U" shape, only joined by its bottom row
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        ConnectedGroups groups(BlockGrid({
+            { r_, b_, r_ },
+            { r_, b_, r_ },
+            { r_, r_, r_ }
+        }));
+        return ts::test(   groups.group_count() == 2
+                        && groups.group_of(VectorI(0, 0)) == groups.group_of(VectorI(2, 0))
+                        && groups.group_size_at(VectorI(2, 0)) == 7
+                        && groups.group_size_at(VectorI(1, 0)) == 2);
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        ConnectedGroups groups(BlockGrid({
+            { BlockId::glass, BlockId::glass },
+            { e_            , g_             }
+        }));
+        return ts::test(   groups.group_count() == 3
+                        && groups.group_of(VectorI(0, 1)) == ConnectedGroups::k_no_group
+                        && groups.group_size_at(VectorI(0, 1)) == 0
+                        && groups.group_size_at(VectorI(1, 0)) == 1
+                        && groups.group_color(groups.group_of(VectorI(1, 1))) == g_);
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { r_, r_, BlockId::hard_glass },
+            { b_, r_, r_                  },
+            { b_, b_, y_                  }
+        });
+        ConnectedGroups groups;
+        bool popped = pop_connected_blocks(g, 4, groups);
+        return ts::test(popped && is_grid_the_same(g, {
+            { e_, e_, e_ },
+            { b_, e_, e_ },
+            { b_, b_, y_ }
+        }));
+    });
+    // only groups touching dirty cells pop
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { r_, b_, e_ },
+            { r_, b_, e_ },
+            { r_, b_, b_ }
+        });
+        GroupSearch search;
+        bool popped = pop_connected_blocks(g, 3, { VectorI(2, 2) }, search);
+        return ts::test(popped && is_grid_the_same(g, {
+            { r_, e_, e_ },
+            { r_, e_, e_ },
+            { r_, e_, e_ }
+        }));
+    });
+    // any type with the effects' member functions may be used as a sink
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        struct CountingSink {
+            void start() { ++starts; }
+            void finish() { ++finishes; }
+            void post_pop_effect(VectorI, BlockId) { ++pops; }
+            void post_group(const std::vector<VectorI> & group)
+                { groups.push_back(int(group.size())); }
+
+            int starts = 0, finishes = 0, pops = 0;
+            std::vector<int> groups;
+        };
+        BlockGrid g({
+            { r_, r_, BlockId::glass },
+            { b_, r_, r_             },
+            { b_, b_, b_             }
+        });
+        CountingSink sink;
+        bool popped = pop_connected_blocks(g, 3, sink);
+        // glass breaking is a pop effect, but not part of any group
+        return ts::test(   popped && sink.starts == 1 && sink.finishes == 1
+                        && sink.pops == 9 && sink.groups.size() == 2
+                        && sink.groups[0] + sink.groups[1] == 8
+                        && is_grid_the_same(g, {
+                            { e_, e_, e_ },
+                            { e_, e_, e_ },
+                            { e_, e_, e_ }
+                        }));
+    });
+    // each group's pops arrive as one batch, before the group itself
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        class BatchRecorder final : public PopEffects {
+        public:
+            std::vector<std::size_t> batch_sizes;
+            bool batch_before_each_group = true;
+        private:
+            void start() override {}
+            void finish() override {}
+            void post_pop_effect(VectorI, BlockId) override
+                { batch_sizes.push_back(0); }
+            void post_pop_effects(const BlockPop * beg, const BlockPop * end) override {
+                batch_sizes.push_back(std::size_t(end - beg));
+                m_has_pending_batch = true;
+            }
+            void post_group(const std::vector<VectorI> & group) override {
+                batch_before_each_group = batch_before_each_group && m_has_pending_batch
+                    && batch_sizes.back() == group.size();
+                m_has_pending_batch = false;
+            }
+            bool m_has_pending_batch = false;
+        };
+        BlockGrid g({
+            { r_, r_, e_ },
+            { b_, r_, e_ },
+            { b_, b_, y_ }
+        });
+        BatchRecorder recorder;
+        ConnectedGroups groups;
+        pop_connected_blocks(g, 3, groups, recorder);
+        return ts::test(   recorder.batch_before_each_group
+                        && recorder.batch_sizes == std::vector<std::size_t> { 3, 3 });
+    });
+    return suite.has_successes_only();
+}
+
+bool test_tetris_rows(ts::TestSuite & suite) {
+    suite.start_series("tetris rows with fill counts");
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { e_, b_, e_ },
+            { r_, r_, r_ },
+            { g_, e_, e_ },
+            { r_, r_, r_ }
+        });
+        std::vector<int> counts;
+        count_row_fills(g, counts);
+        return ts::test(counts == std::vector<int> { 1, 3, 1, 3 });
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g({
+            { e_, b_, e_ },
+            { r_, r_, r_ },
+            { g_, e_, e_ },
+            { r_, r_, r_ }
+        });
+        std::vector<int> counts;
+        count_row_fills(g, counts);
+        // the bottom row is outside of the rows checked
+        int cleared = clear_tetris_rows(g, counts, 0, 2);
+        make_tetris_rows_fall(g, counts);
+        return ts::test(cleared == 1 && counts == std::vector<int> { 0, 1, 1, 3 }
+            && is_grid_the_same(g, {
+                { e_, e_, e_ },
+                { e_, b_, e_ },
+                { g_, e_, e_ },
+                { r_, r_, r_ }
+            }));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        // like the sub grid version, only color blocks fall
+        const auto k_glass = BlockId::glass;
+        BlockGrid g({
+            { b_, e_, e_ },
+            { r_, k_glass, r_ },
+            { e_, e_, e_ },
+            { e_, e_, e_ }
+        });
+        BlockGrid h = g;
+        std::vector<int> counts;
+        count_row_fills(g, counts);
+        make_tetris_rows_fall(g, counts);
+        make_tetris_rows_fall(h);
+        return ts::test(counts == std::vector<int> { 0, 1, 1, 2 }
+            && std::equal(g.begin(), g.end(), h.begin(), h.end())
+            && is_grid_the_same(g, {
+                { e_, e_, e_ },
+                { e_, k_glass, e_ },
+                { b_, e_, e_ },
+                { r_, e_, r_ }
+            }));
+    });
+    return suite.has_successes_only();
+}
+
+bool test_resolve_chain(ts::TestSuite & suite) {
+    suite.start_series("resolve_chain");
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        // reds pop, then the blue block falls beside the other
+        auto trace = resolve_chain(BlockGrid({
+            { b_, e_ },
+            { r_, e_ },
+            { r_, b_ }
+        }), 2);
+        return ts::test(trace.waves.size() == 2 && trace.total_score == 6
+            && trace.waves[0].score == 2 && trace.waves[1].score == 4
+            && trace.groups[1].color == b_ && trace.groups[1].size == 2
+            && is_grid_the_same(trace.final_board, {
+                { e_, e_ },
+                { e_, e_ },
+                { e_, e_ }
+            }));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        auto trace = resolve_chain(BlockGrid({
+            { e_, e_ },
+            { e_, e_ },
+            { e_, e_ },
+            { r_, e_ }
+        }), 2, PlacedPair(VectorI(1, 1), r_, VectorI(1, 0), g_));
+        return ts::test(trace.waves.size() == 1 && trace.total_score == 2
+            && is_grid_the_same(trace.final_board, {
+                { e_, e_ },
+                { e_, e_ },
+                { e_, e_ },
+                { e_, g_ }
+            }));
+    });
+    // the final board's hash, as updated, is the same as hashed in full
+    suite.test([]() {
+        static const BlockId k_kinds[] = {
+            k_empty_block, k_empty_block, k_empty_block, BlockId::red,
+            BlockId::blue, BlockId::green, BlockId::glass, BlockId::hard_glass
+        };
+        std::default_random_engine rng { 0x5EEDu };
+        auto random_of = [&rng](int max)
+            { return std::uniform_int_distribution<int>(0, max)(rng); };
+        bool all_same = true;
+        for (int i = 0; i != 200; ++i) {
+            BlockGrid bg;
+            bg.set_size(6, 8, k_empty_block);
+            for (VectorI r; r != bg.end_position(); r = bg.next(r)) {
+                bg(r) = k_kinds[random_of(int(std::size(k_kinds)) - 1)];
+            }
+            make_blocks_fall(bg);
+            VectorI pivot(random_of(bg.width() - 1), 0);
+            auto adjacent = pivot + (pivot.x == 0 ? VectorI(1, 0) : VectorI(-1, 0));
+            bg(pivot) = bg(adjacent) = k_empty_block;
+            PlacedPair pair(pivot, BlockId::red, adjacent, BlockId::blue);
+            ChainTrace trace;
+            resolve_chain(bg, 3, i % 2 ? &pair : nullptr, trace);
+            all_same =    all_same
+                       &&    zobrist_hash_after_chain(zobrist_hash(bg), bg, i % 2 ? &pair : nullptr, trace)
+                          == zobrist_hash(trace.final_board);
+        }
+        return ts::test(all_same);
+    });
+    return suite.has_successes_only();
+}
+
+bool test_ZobristHash(ts::TestSuite & suite) {
+    suite.start_series("ZobristHash");
+    // follows falls and pops, including glass decaying
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g {
+            { e_, r_, e_                  },
+            { e_, e_, e_                  },
+            { r_, e_, BlockId::hard_glass },
+            { r_, r_, BlockId::glass      }
+        };
+        ZobristTracker tracker(g);
+        make_blocks_fall(g, tracker);
+        bool after_fall = tracker.hash() == zobrist_hash(g);
+        bool popped = pop_connected_blocks(g, 4, tracker);
+        return ts::test(   after_fall && popped
+                        && g(VectorI(2, 2)) == BlockId::glass
+                        && tracker.hash() == zobrist_hash(g));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g {
+            { e_, e_ },
+            { b_, e_ }
+        };
+        ZobristTracker tracker(g);
+        tracker.place(VectorI(1, 1), r_);
+        auto placed = tracker.hash();
+        g(VectorI(1, 1)) = r_;
+        tracker.remove(VectorI(1, 1), r_);
+        return ts::test(   placed == zobrist_hash(g)
+                        && tracker.hash() != placed
+                        && zobrist_hash(BlockGrid { { e_, e_ } }) == 0);
+    });
+    // a falling pair is not the same as those blocks at rest
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid g {
+            { e_, e_ },
+            { e_, e_ }
+        };
+        auto falling = zobrist_hash(g, VectorI(0, 0), r_, VectorI(0, -1), b_);
+        g(VectorI(0, 0)) = r_;
+        return ts::test(falling != zobrist_hash(g) && falling != 0);
+    });
+    suite.test([]() {
+        try {
+            zobrist_key(VectorI(k_max_board_size, 0), BlockId::red);
+        } catch (std::out_of_range &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
+bool test_TranspositionTable(ts::TestSuite & suite) {
+    suite.start_series("TranspositionTable");
+    suite.test([]() {
+        TranspositionTable table(1000);
+        table.store(0x1234, 42);
+        TranspositionTable::Value value = 0;
+        bool found = table.find(0x1234, value);
+        bool other_found = table.find(0x5678, value);
+        return ts::test(table.size() == 1024 && found && value == 42 && !other_found);
+    });
+    // same entry, the later key replaces the earlier
+    suite.test([]() {
+        TranspositionTable table(16);
+        table.store(0x11, 1);
+        table.store(0x21, 2);
+        TranspositionTable::Value value = 0;
+        bool first_found = table.find(0x11, value);
+        return ts::test(!first_found && table.find(0x21, value) && value == 2);
+    });
+    suite.test([]() {
+        TranspositionTable table(4);
+        table.store(0, 7);
+        table.store(3, 7);
+        table.clear();
+        TranspositionTable::Value value = 0;
+        return ts::test(!table.find(0, value) && !table.find(3, value));
+    });
     return suite.has_successes_only();
 }
 
@@ -374,6 +949,21 @@ bool test_columns_algo(ts::TestSuite & suite) {
         });
         return ts::test(compare_test_to_cor(g, cor));
     });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockBitBoard board(BlockGrid({
+            { e_, e_, e_, r_ },
+            { e_, e_, r_, e_ },
+            { e_, r_, e_, e_ },
+            { r_, e_, e_, r_ }
+        }));
+        BlockBitBoard::ColumnMasks matched;
+        bool found = find_columns_matches(board.masks_for(r_), board.width(),
+                                          board.height(), 4, matched);
+        // the lone block in the corner is not a part of the line
+        return ts::test(found && matched[0] == (1u << 3) && matched[1] == (1u << 2)
+                        && matched[2] == (1u << 1) && matched[3] == (1u << 0));
+    });
     return suite.has_successes_only();
 }
 
@@ -455,6 +1045,49 @@ bool test_play_control(ts::TestSuite & suite) {
     return suite.has_successes_only();
 }
 
+bool test_WorkStealingPool(ts::TestSuite & suite) {
+    suite.start_series("WorkStealingPool");
+    suite.test([]() {
+        WorkStealingPool pool(3);
+        std::vector<int> results(1000, 0);
+        pool.for_each_index(int(results.size()), [&results](int i) { results[i] += i*i; });
+        bool all_once = true;
+        for (int i = 0; i != int(results.size()); ++i) {
+            all_once = all_once && results[i] == i*i;
+        }
+        return ts::test(all_once);
+    });
+    suite.test([]() {
+        WorkStealingPool pool(0);
+        int sum = 0;
+        pool.for_each_index(10, [&sum](int i) { sum += i; });
+        return ts::test(pool.thread_count() == 0 && sum == 45);
+    });
+    suite.test([]() {
+        WorkStealingPool pool(2);
+        std::vector<int> results(100, 0);
+        try {
+            pool.for_each_index(int(results.size()), [&results](int i) {
+                if (i == 50) throw std::runtime_error("");
+                results[i] = 1;
+            });
+        } catch (std::runtime_error &) {
+            // every other index still ran
+            return ts::test(std::accumulate(results.begin(), results.end(), 0) == 99);
+        }
+        return ts::test(false);
+    });
+    suite.test([]() {
+        try {
+            WorkStealingPool pool(-1);
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
 bool test_ai_script(ts::TestSuite & suite) {
     suite.start_series("AI Script");
     suite.test([]() {
@@ -472,6 +1105,27 @@ bool test_ai_script(ts::TestSuite & suite) {
         return ts::test(   top_row_count   == 0 && pivot_row_count == 3
                         && below_row_count == 6);
     });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, e_, e_, e_ },
+            { e_, e_, r_, e_ },
+            { e_, e_, g_, e_ },
+            { b_, e_, g_, e_ }
+        };
+        auto reachables = SimpleMatcher::compute_reachable_blocks(VectorI(1, 0), bg);
+        ReachabilityCache cache;
+        bool first  = cache.update(VectorI(1, 0), bg, 1);
+        bool second = cache.update(VectorI(1, 0), bg, 1);
+        bool same = true;
+        for (VectorI r; r != bg.end_position(); r = bg.next(r)) {
+            same = same && reachables(r) == cache.is_reachable(r);
+        }
+        // ground cells are nearest to the pivot first
+        return ts::test(   first && !second && same
+                        && cache.ground_cells().front() == VectorI(2, 0)
+                        && cache.update(VectorI(1, 0), bg, 2));
+    });
     // test situations which need rotations
     static auto mk_board = [](const BlockGrid & grid) {
         PuyoBoard board;
@@ -572,6 +1226,1165 @@ bool test_ai_script(ts::TestSuite & suite) {
         return ts::test(    piece.other_location() - piece.location() == VectorI(1, 0)
                         && !simp.controller_state().is_pressed(PlayControlId::rotate_left));
     });
+    static auto mk_beam_board = []() {
+        using namespace BlockIdShorthand;
+        auto board = mk_board(BlockGrid {
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { r_, r_, r_, b_, g_, b_ }
+        });
+        board.push_falling_piece(r_, m_);
+        board.push_falling_piece(g_, b_);
+        return board;
+    };
+    // plays the obvious pop
+    suite.test([]() {
+        auto board = mk_beam_board();
+        BeamSearchMatcher::SearchSettings settings;
+        settings.time_budget = std::numeric_limits<double>::infinity();
+        BeamSearchMatcher beam(settings);
+        auto & as_script = static_cast<AiScript &>(beam);
+        for (int i = 0; i != 10000 && board.is_ready(); ++i) {
+            as_script.play_board(board);
+            board.update(1. / 60.);
+        }
+        const auto & blocks = board.blocks();
+        return ts::test(   !board.is_ready()
+                        && std::find(blocks.begin(), blocks.end(), BlockId::red) == blocks.end());
+    });
+    // the current pair is always searched, the next only with time to spare
+    suite.test([]() {
+        auto board = mk_beam_board();
+        BeamSearchMatcher::SearchSettings settings;
+        settings.time_budget = 0.;
+        BeamSearchMatcher hurried(settings);
+        settings.time_budget = std::numeric_limits<double>::infinity();
+        BeamSearchMatcher patient(settings);
+        static_cast<AiScript &>(hurried).play_board(board);
+        static_cast<AiScript &>(patient).play_board(board);
+        return ts::test(   hurried.pivot_target() != SimpleMatcher::k_no_location
+                        && hurried.boards_searched() < patient.boards_searched());
+    });
+    // same placement whatever the thread count
+    suite.test([]() {
+        auto board = mk_beam_board();
+        WorkStealingPool no_threads(0);
+        WorkStealingPool four_threads(4);
+        BeamSearchMatcher::SearchSettings settings;
+        settings.time_budget = std::numeric_limits<double>::infinity();
+        settings.pool = &no_threads;
+        BeamSearchMatcher alone(settings);
+        settings.pool = &four_threads;
+        BeamSearchMatcher together(settings);
+        static_cast<AiScript &>(alone   ).play_board(board);
+        static_cast<AiScript &>(together).play_board(board);
+        return ts::test(   alone.pivot_target()    == together.pivot_target()
+                        && alone.adjacent_target() == together.adjacent_target()
+                        && alone.boards_searched() == together.boards_searched());
+    });
+    // same pop, planned off the calling thread
+    suite.test([]() {
+        auto board = mk_beam_board();
+        BeamSearchMatcher::SearchSettings settings;
+        settings.time_budget = std::numeric_limits<double>::infinity();
+        AsyncAiScript async(std::make_unique<BeamSearchMatcher>(settings));
+        auto & as_script = static_cast<AiScript &>(async);
+        as_script.play_board(board);
+        bool was_waiting = async.is_waiting_on_plan();
+        async.wait_for_plan();
+        // waiting on the inputs each frame too, so they always come back
+        // within the idle frames they plan for
+        for (int i = 0; i != 10000 && board.is_ready(); ++i) {
+            as_script.play_board(board);
+            async.wait_for_plan();
+            board.update(1. / 60.);
+        }
+        const auto & blocks = board.blocks();
+        return ts::test(   was_waiting && !board.is_ready()
+                        && std::find(blocks.begin(), blocks.end(), BlockId::red) == blocks.end());
+    });
+    suite.test([]() {
+        TurnSnapshot snapshot;
+        snapshot.location       = VectorI(2, 1);
+        snapshot.other_location = VectorI(2, 0);
+        TurnPlan plan;
+        plan.pivot_target    = VectorI(0, 10);
+        plan.adjacent_target = VectorI(1, 10);
+        plan_tap_inputs(snapshot, plan);
+        // one right turn, two steps left, each pressed then released
+        auto is_tap = [&plan](std::size_t frame, PlayControlId id) {
+            auto pressed = plan.inputs[frame];
+            auto idx = static_cast<std::size_t>(id);
+            return    pressed[idx]
+                   && std::count(pressed.begin(), pressed.end(), true) == 1
+                   && std::count(plan.inputs[frame + 1].begin(), plan.inputs[frame + 1].end(), true) == 0;
+        };
+        return ts::test(   plan.inputs.size() == 6
+                        && is_tap(0, PlayControlId::rotate_right)
+                        && is_tap(2, PlayControlId::left)
+                        && is_tap(4, PlayControlId::left));
+    });
+    // lands where planned, and sooner than tapping there then holding down
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        auto board = mk_beam_board();
+        TurnPlan plan;
+        plan.pivot_target    = VectorI(5, 10);
+        plan.adjacent_target = VectorI(4, 10);
+        TurnPlan taps = plan, lead = plan;
+        plan_tap_inputs(TurnSnapshot(board), taps);
+        bool found = plan_frame_inputs(TurnSnapshot(board), plan);
+        // as AsyncAiScript plans them, idle while the search runs
+        static constexpr const int k_lead = AsyncAiScript::k_input_lead_frames;
+        bool found_lead = plan_frame_inputs(TurnSnapshot(board), lead, 1. / 60., k_lead);
+        bool lead_is_idle = found_lead && std::all_of(lead.inputs.begin(), lead.inputs.begin() + k_lead,
+            [](const ControllerState::StatesArray & states)
+            { return std::none_of(states.begin(), states.end(), [](bool b) { return b; }); });
+
+        // -1 if the pair comes to rest anywhere else
+        auto frames_to_land = [](PuyoBoard board, const TurnPlan & plan) {
+            ControllerState controller;
+            ControllerState::StatesArray down {};
+            down[static_cast<std::size_t>(PlayControlId::down)] = true;
+            auto version = board.blocks_version();
+            std::size_t frames = 0;
+            for (; frames != 10000 && board.blocks_version() == version; ++frames) {
+                controller.update(frames < plan.inputs.size() ? plan.inputs[frames] : down, board);
+                board.update(1. / 60.);
+            }
+            while (board.is_ready()) board.update(1. / 60.);
+            if (   board.blocks()(plan.pivot_target   ) != r_
+                || board.blocks()(plan.adjacent_target) != m_)
+            { return -1; }
+            return int(frames);
+        };
+        int planned = frames_to_land(board, plan);
+        int tapped  = frames_to_land(board, taps);
+        return ts::test(   found && planned == int(plan.inputs.size())
+                        && tapped != -1 && planned < tapped
+                        && lead_is_idle && frames_to_land(board, lead) == int(lead.inputs.size()));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        // a full column stands between the pair and its target
+        BlockGrid blocks;
+        blocks.set_size(6, 12, k_empty_block);
+        for (int y = 0; y != blocks.height(); ++y) {
+            blocks(3, y) = y % 2 ? r_ : b_;
+        }
+        auto board = mk_board(blocks);
+        board.push_falling_piece(g_, y_);
+        board.push_falling_piece(g_, y_);
+        TurnPlan plan;
+        plan.pivot_target    = VectorI(5, 11);
+        plan.adjacent_target = VectorI(5, 10);
+        return ts::test(   !plan_frame_inputs(TurnSnapshot(board), plan)
+                        && plan.inputs.empty());
+    });
+    suite.test([]() {
+        BeamSearchMatcher::SearchSettings settings;
+        settings.beam_width = 0;
+        try {
+            BeamSearchMatcher beam(settings);
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
+bool test_TetrisAi(ts::TestSuite & suite) {
+    suite.start_series("TetrisAi");
+    using Tetromino = Polyomino::Tetromino;
+    static auto get_tetromino = [](Tetromino t) {
+        auto piece = Polyomino::default_tetrominos()[static_cast<std::size_t>(t)];
+        piece.set_colors(BlockId::red);
+        return piece;
+    };
+    suite.test([]() {
+        BlockGrid bg;
+        bg.set_size(10, 20, k_empty_block);
+        auto piece = get_tetromino(Tetromino::o);
+        piece.set_location(5, 0);
+        TetrisAi ai;
+        const auto & placements = ai.find_placements(bg, piece);
+        bool all_on_floor = std::all_of(placements.begin(), placements.end(),
+            [](const TetrisAi::Placement & placement)
+            { return placement.turns == 0 && placement.location.y == 18; });
+        return ts::test(placements.size() == 9 && all_on_floor);
+    });
+    // the long piece goes straight into the well, clearing every row
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_ },
+            { r_, r_, r_, r_, e_ },
+            { r_, b_, r_, r_, e_ },
+            { r_, r_, g_, r_, e_ },
+            { r_, r_, r_, b_, e_ }
+        };
+        auto piece = get_tetromino(Tetromino::i);
+        piece.set_location(2, 0);
+        TetrisAi ai;
+        TetrisAi::Placement best;
+        bool found = ai.find_best_placement(bg, piece, best);
+        return ts::test(   found && best.turns % 2 == 0
+                        && best.location == VectorI(4, 5));
+    });
+    // sliding under a ledge, after having fallen past it
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, e_, e_, e_ },
+            { e_, e_, e_, e_ },
+            { r_, r_, r_, e_ },
+            { e_, e_, e_, e_ }
+        };
+        auto piece = Polyomino::default_domino().front();
+        piece.set_colors(BlockId::red);
+        piece.set_location(2, 0);
+        TetrisAi ai;
+        const auto & placements = ai.find_placements(bg, piece);
+        return ts::test(std::any_of(placements.begin(), placements.end(),
+            [](const TetrisAi::Placement & placement)
+            { return placement.location == VectorI(1, 3) && placement.turns % 2 == 1; }));
+    });
+    // every placement found is one Polyomino itself allows to rest there
+    suite.test([]() {
+        std::default_random_engine rng { 0x5EEDu };
+        BlockGrid bg;
+        bg.set_size(10, 20, k_empty_block);
+        for (int y = 10; y != bg.height(); ++y) {
+        for (int x = 0; x != bg.width(); ++x) {
+            if (std::uniform_int_distribution<int>(0, 2)(rng) == 0) continue;
+            bg(x, y) = BlockId::blue;
+        }}
+        TetrisAi ai;
+        BlockGrid open_space;
+        open_space.set_size(11, 11, k_empty_block);
+        bool all_rest = true;
+        std::size_t placement_count = 0;
+        for (auto piece : Polyomino::all_polyminos()) {
+            piece.set_colors(BlockId::red);
+            piece.set_location(bg.width() / 2, 0);
+            for (const auto & placement : ai.find_placements(bg, piece)) {
+                auto turned = piece;
+                turned.set_location(5, 5);
+                for (int i = 0; i != placement.turns; ++i) {
+                    turned.rotate_left(open_space);
+                }
+                turned.set_location(placement.location.x, placement.location.y);
+                all_rest =    all_rest && !turned.obstructed_by(bg)
+                           && !turned.move_down(bg);
+                ++placement_count;
+            }
+        }
+        return ts::test(all_rest && placement_count > 0);
+    });
+    // played a frame at a time, falling all the while, the piece still
+    // comes to rest where the search says it is best
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { r_, r_, r_, r_, r_, e_ },
+            { r_, b_, r_, r_, r_, e_ }
+        };
+        auto piece = get_tetromino(Tetromino::l);
+        piece.set_location(2, 1);
+        TetrisAi::Placement best;
+        if (!TetrisAi().find_best_placement(bg, piece, best)) return ts::test(false);
+
+        struct Mover final : public PlayControlEventReceiver {
+            Mover(const BlockGrid & blocks_, Polyomino & piece_):
+                blocks(blocks_), piece(piece_) {}
+            void handle_event(PlayControlEvent event) override {
+                using Pid = PlayControlId;
+                if (event.id == Pid::down && is_pressed(event)) {
+                    landed = landed || !piece.move_down(blocks);
+                }
+                if (event.state != PlayControlState::just_pressed) return;
+                switch (event.id) {
+                case Pid::left        : piece.move_left   (blocks); break;
+                case Pid::right       : piece.move_right  (blocks); break;
+                case Pid::rotate_left : piece.rotate_left (blocks); break;
+                case Pid::rotate_right: piece.rotate_right(blocks); break;
+                default: break;
+                }
+            }
+            const BlockGrid & blocks;
+            Polyomino & piece;
+            bool landed = false;
+        };
+        auto expected = piece;
+        for (int i = 0; i != best.turns; ++i) expected.hard_rotate_left();
+        expected.set_location(best.location.x, best.location.y);
+
+        TetrisAi ai;
+        Mover mover(bg, piece);
+        for (int frame = 0; frame != 200 && !mover.landed; ++frame) {
+            if (frame % 3 == 2) mover.landed = !piece.move_down(bg);
+            if (!mover.landed) ai.play(bg, piece, 1, mover);
+        }
+        bool same_blocks = mover.landed;
+        for (int i = 0; i != piece.block_count(); ++i) {
+            same_blocks = same_blocks && piece.block_location(i) == expected.block_location(i);
+        }
+        return ts::test(same_blocks);
+    });
+    return suite.has_successes_only();
+}
+
+
+bool test_SameGameSolver(ts::TestSuite & suite) {
+    suite.start_series("SameGameSolver");
+    // the emptied column is closed up from the left
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, r_, e_ },
+            { b_, r_, b_ }
+        };
+        BlockGrid expected {
+            { e_, e_, e_ },
+            { e_, b_, b_ }
+        };
+        int removed = SameGameSolver::apply_selection(bg, VectorI(1, 1), false);
+        return ts::test(   removed == 2
+                        && std::equal(bg.begin(), bg.end(), expected.begin(), expected.end()));
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, r_, e_ },
+            { b_, r_, b_ }
+        };
+        auto unchanged = bg;
+        bool single_refused = SameGameSolver::apply_selection(bg, VectorI(0, 1), false) == 0;
+        single_refused =    single_refused
+                         && std::equal(bg.begin(), bg.end(), unchanged.begin(), unchanged.end());
+        return ts::test(   single_refused
+                        && SameGameSolver::apply_selection(bg, VectorI(0, 1), true) == 1);
+    });
+    // removing the middle first joins the sides into one large group
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { r_, b_, r_ },
+            { r_, b_, r_ }
+        };
+        SameGameSolver solver;
+        const auto & solution = solver.solve(bg);
+        return ts::test(   solution.blocks_left == 0 && solution.selections.size() == 2
+                        && solution.score == SameGameSolver::k_clear_bonus + 4);
+    });
+    // replaying a solution reaches the same score
+    suite.test([]() {
+        std::default_random_engine rng { 0x5A3Eu };
+        BlockGrid bg;
+        bg.set_size(10, 10);
+        for (auto & block : bg) {
+            block = ColorBlockDistri(3)(rng);
+        }
+        SameGameSolver solver;
+        auto solution = solver.solve(bg);
+        int score = 0;
+        bool all_removed = true;
+        for (auto selection : solution.selections) {
+            int removed = SameGameSolver::apply_selection(bg, selection, false);
+            all_removed = all_removed && removed != 0;
+            score += SameGameSolver::score_for_group(removed);
+        }
+        int blocks_left = int(std::count_if(bg.begin(), bg.end(),
+            [](BlockId block) { return block != k_empty_block; }));
+        if (blocks_left == 0) score += SameGameSolver::k_clear_bonus;
+        return ts::test(   all_removed && score == solution.score
+                        && blocks_left == solution.blocks_left);
+    });
+    // both boards of the narrow beam reach the same last board, so one
+    // has its only child pruned and ends its line early; that line is kept
+    // but the one played out to the same score wins
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { r_, r_, b_, r_, r_ }
+        };
+        SameGameSolver::SearchSettings settings;
+        settings.beam_width = 2;
+        SameGameSolver solver(settings);
+        const auto & solution = solver.solve(bg);
+        return ts::test(   solution.selections.size() == 2 && solution.blocks_left == 1
+                        && solution.score == 0);
+    });
+    suite.test([]() {
+        SameGameSolver::SearchSettings settings;
+        settings.time_budget = 0.;
+        try {
+            SameGameSolver solver(settings);
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
+bool test_PuyoMatch(ts::TestSuite & suite) {
+    suite.start_series("PuyoMatch");
+    static auto count_refuges = [](const BlockGrid & fallins) {
+        return int(std::count_if(fallins.begin(), fallins.end(),
+            [](BlockId block) { return block != k_empty_block; }));
+    };
+    // less than a row's worth is scattered
+    suite.test([]() {
+        Pcg32 rng { 0x6A4Bu };
+        BlockGrid fallins;
+        fallins.set_size(6, 12);
+        // 8*(1 + 8 / 8) / 4
+        PuyoStateVS::make_refuge_fall_ins(8, fallins, rng);
+        return ts::test(count_refuges(fallins) == 4);
+    });
+    suite.test([]() {
+        Pcg32 rng { 0x6A4Bu };
+        BlockGrid fallins;
+        fallins.set_size(6, 12);
+        // 16*(1 + 16 / 8) / 4
+        PuyoStateVS::make_refuge_fall_ins(16, fallins, rng);
+        bool row_full = true;
+        for (int x = 0; x != fallins.width(); ++x) {
+            row_full = row_full && fallins(x, 0) != k_empty_block;
+        }
+        return ts::test(row_full && count_refuges(fallins) == 12);
+    });
+    // the same seed plays out the same match
+    suite.test([]() {
+        static constexpr const int k_max_frames = 60*60*2;
+        PuyoMatch a(0xC0FFEEu, make_puyo_ai_script("simple", 1), make_puyo_ai_script("random", 2));
+        PuyoMatch b(0xC0FFEEu, make_puyo_ai_script("simple", 1), make_puyo_ai_script("random", 2));
+        const auto & ares = a.run(k_max_frames);
+        const auto & bres = b.run(k_max_frames);
+        bool same = ares.winner == bres.winner && ares.frames == bres.frames;
+        for (std::size_t p = 0; p != 2; ++p) {
+            same =    same && ares.players[p].turns == bres.players[p].turns
+                   && ares.players[p].score == bres.players[p].score;
+        }
+        return ts::test(same && ares.players[0].turns > 2);
+    });
+    // results do not depend on how many threads play the matches
+    suite.test([]() {
+        PuyoTournamentSettings settings;
+        settings.match_count = 4;
+        settings.root_seed   = 0x70u;
+        settings.max_frames  = 60*60;
+        auto make_script = [](int player, uint32_t seed)
+            { return make_puyo_ai_script(player == 0 ? "simple" : "random", seed); };
+        WorkStealingPool no_threads(0), two_threads(2);
+        settings.pool = &no_threads;
+        auto serial = run_puyo_tournament(settings, make_script);
+        settings.pool = &two_threads;
+        auto parallel = run_puyo_tournament(settings, make_script);
+        bool same =    serial.wins == parallel.wins && serial.draws == parallel.draws
+                    && serial.frames == parallel.frames;
+        for (std::size_t p = 0; p != 2; ++p) {
+            same =    same && serial.totals[p].turns == parallel.totals[p].turns
+                   && serial.totals[p].score == parallel.totals[p].score;
+        }
+        return ts::test(same);
+    });
+    suite.test([]() {
+        try {
+            make_puyo_ai_script("nobody", 0);
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
+bool test_PuyoAiTuner(ts::TestSuite & suite) {
+    suite.start_series("PuyoAiTuner");
+    static constexpr const char * const k_test_filename = "puyoaiweights-test.txt";
+    suite.test([]() {
+        PuyoAiWeights weights;
+        weights.chain_score = 3.25;
+        weights.bumpiness   = -0.1;
+        PuyoAiWeights loaded;
+        bool saved = weights.save(k_test_filename);
+        bool read  = loaded.load(k_test_filename);
+        std::remove(k_test_filename);
+        return ts::test(saved && read && loaded.to_array() == weights.to_array());
+    });
+    // anything but weights leaves them as they were
+    suite.test([]() {
+        {
+        std::ofstream fout(k_test_filename);
+        fout << "chain_score 2\nnot_a_weight 1\n";
+        }
+        PuyoAiWeights weights;
+        bool read = weights.load(k_test_filename);
+        std::remove(k_test_filename);
+        return ts::test(!read && weights.to_array() == PuyoAiWeights().to_array());
+    });
+    // the same seed tunes to the same weights
+    suite.test([]() {
+        PuyoAiTuner::Settings settings;
+        settings.population = 3;
+        settings.elite_count = 1;
+        settings.matches_per_candidate = 1;
+        settings.max_frames = 60*20;
+        settings.seed = 0x7E57u;
+        WorkStealingPool no_threads(0), two_threads(2);
+        settings.pool = &no_threads;
+        PuyoAiTuner a(settings, PuyoAiWeights(), PuyoAiWeights());
+        settings.pool = &two_threads;
+        PuyoAiTuner b(settings, PuyoAiWeights(), PuyoAiWeights());
+        const auto & abest = a.run_generation();
+        const auto & bbest = b.run_generation();
+        return ts::test(   abest.fitness == bbest.fitness
+                        && a.mean().to_array() == b.mean().to_array()
+                        && a.mean().to_array() == abest.weights.to_array());
+    });
+    suite.test([]() {
+        PuyoAiTuner::Settings settings;
+        settings.population  = 4;
+        settings.elite_count = 5;
+        try {
+            PuyoAiTuner tuner(settings, PuyoAiWeights(), PuyoAiWeights());
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
+bool test_game_engines(ts::TestSuite & suite) {
+    suite.start_series("game engines");
+    auto same_board = [](const BlockGrid & lhs, const BlockGrid & rhs) {
+        return    lhs.width() == rhs.width() && lhs.height() == rhs.height()
+               && std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    };
+    // a whole turn scores as resolve_chain does
+    suite.test([&same_board]() {
+        using namespace BlockIdShorthand;
+        PuyoEngine engine(6, 4, 4);
+        engine.edit_blocks()(0, 3) = r_;
+        engine.edit_blocks()(1, 3) = r_;
+        engine.edit_blocks()(2, 3) = r_;
+        engine.push_fall_in_blocks(BlockGrid(), FallBlockEffects::default_instance());
+        engine.push_pair(r_, b_);
+        auto result = engine.step_turn(PuyoEngine::Action(3, VectorI(0, -1)));
+        BlockGrid expected {
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, e_, e_, e_ },
+            { e_, e_, e_, b_, e_, e_ }
+        };
+        return ts::test(   result.chain_length == 1
+                        && result.score == puyo_group_score(4, 1, 4, 0)
+                        && engine.queued_pairs() == 0
+                        && same_board(engine.blocks(), expected));
+    });
+    // a lowered requirement, or an edit, has the next pop search the whole
+    // board, rather than only the cells moved since the last
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        auto & pops = PopEffects::default_instance();
+        PuyoEngine engine(4, 2, 4);
+        engine.restore(PackedBlockGrid(BlockGrid({
+            { e_, e_, e_, e_ },
+            { r_, r_, r_, b_ }
+        })));
+        bool popped_at_four = engine.pop_wave(pops);
+        engine.set_pop_requirement(3);
+        bool popped_at_three = engine.pop_wave(pops);
+        engine.edit_blocks()(3, 0) = b_;
+        engine.edit_blocks()(2, 1) = b_;
+        bool popped_edit = engine.pop_wave(pops);
+        return ts::test(!popped_at_four && popped_at_three && popped_edit);
+    });
+    // a step at a time scores the same as a whole turn
+    suite.test([&same_board]() {
+        using namespace BlockIdShorthand;
+        BlockGrid start {
+            { e_, e_, e_, e_ },
+            { g_, g_, e_, e_ },
+            { g_, r_, e_, e_ },
+            { r_, r_, e_, e_ }
+        };
+        PuyoEngine whole(4, 4, 4), stepped(4, 4, 4);
+        for (auto * engine : { &whole, &stepped }) {
+            auto blocks = engine->edit_blocks();
+            for (int y = 0; y != start.height(); ++y) {
+            for (int x = 0; x != start.width (); ++x) {
+                blocks(x, y) = start(x, y);
+            }}
+            engine->push_fall_in_blocks(BlockGrid(), FallBlockEffects::default_instance());
+            (void)engine->finish_turn();
+        }
+        whole.push_pair(r_, g_);
+        auto whole_result = whole.step_turn(PuyoEngine::Action(2, VectorI(0, -1)));
+
+        stepped.place_pair(PlacedPair(VectorI(2, 3), r_, VectorI(2, 2), g_));
+        stepped.settle(FallBlockEffects::default_instance());
+        while (stepped.pop_wave(PopEffects::default_instance())) {
+            stepped.settle(FallBlockEffects::default_instance());
+        }
+        auto stepped_result = stepped.finish_turn();
+        return ts::test(   whole_result.chain_length == 2
+                        && whole_result.chain_length == stepped_result.chain_length
+                        && whole_result.score == stepped_result.score
+                        && same_board(whole.blocks(), stepped.blocks()));
+    });
+    suite.test([]() {
+        PuyoEngine engine(6, 12, 4);
+        try {
+            (void)engine.step_turn(PuyoEngine::Action());
+        } catch (std::runtime_error &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    // every legal placement rests on something, and the same seed plays out
+    // the same
+    suite.test([&same_board]() {
+        PolyominoEnabledSet enabled;
+        enabled.set();
+        TetrisEngine a, b;
+        a.setup(10, 20, enabled, 0x7E57u);
+        b.setup(10, 20, enabled, 0x7E57u);
+        std::vector<TetrisEngine::Action> actions;
+        bool all_legal = true;
+        for (int i = 0; i != 40; ++i) {
+            a.legal_actions(actions);
+            if (actions.empty()) break;
+            for (const auto & action : actions) {
+                all_legal = all_legal && a.is_legal(action);
+            }
+            const auto & action = actions[std::size_t(i) % actions.size()];
+            (void)a.step_turn(action);
+            (void)b.step_turn(action);
+        }
+        return ts::test(all_legal && same_board(a.blocks(), b.blocks()));
+    });
+    // a domino dropped into the gap fills both of the bottom rows
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        PolyominoEnabledSet enabled;
+        enabled.set();
+        TetrisEngine engine;
+        engine.setup(4, 4, enabled, 0x7E57u);
+        auto domino = Polyomino::default_domino().front();
+        domino.set_colors(b_);
+        engine.restore(PackedBlockGrid(BlockGrid({
+            { e_, e_, e_, e_ },
+            { g_, e_, e_, e_ },
+            { r_, r_, r_, e_ },
+            { r_, r_, r_, e_ }
+        })), domino);
+        auto result = engine.step_turn(TetrisEngine::Action(0, VectorI(3, 3)));
+        return ts::test(result.rows_cleared == 2 && !result.topped_out
+            && is_grid_the_same(engine.blocks(), {
+                { e_, e_, e_, e_ },
+                { e_, e_, e_, e_ },
+                { e_, e_, e_, e_ },
+                { g_, e_, e_, e_ }
+            }));
+    });
+    // removing a group matches the solver's rules
+    suite.test([&same_board]() {
+        using namespace BlockIdShorthand;
+        BlockGrid bg {
+            { e_, r_, e_ },
+            { b_, r_, b_ }
+        };
+        SameGameEngine engine;
+        engine.set_blocks(bg);
+        auto result = engine.step_turn(VectorI(1, 1));
+        (void)SameGameSolver::apply_selection(bg, VectorI(1, 1), false);
+        std::vector<VectorI> actions;
+        engine.legal_actions(actions);
+        return ts::test(   result.blocks_removed == 2 && result.score == 0
+                        && same_board(engine.blocks(), bg)
+                        && actions.size() == 1 && !engine.is_gameover());
+    });
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        SameGameEngine engine;
+        engine.set_blocks(BlockGrid { { r_, r_, r_, r_ } });
+        auto result = engine.step_turn(VectorI(0, 0));
+        return ts::test(   result.score == SameGameEngine::score_for_group(4)
+                                           + SameGameEngine::k_clear_bonus
+                        && engine.is_gameover());
+    });
+    suite.test([&same_board]() {
+        ColumnsEngine a, b;
+        a.setup(6, 12, 5, 0x7E57u);
+        b.setup(6, 12, 5, 0x7E57u);
+        std::vector<ColumnsEngine::Action> actions;
+        a.legal_actions(actions);
+        bool all_columns = int(actions.size()) == 6*ColumnsPiece::k_piece_size;
+        for (int i = 0; i != 30; ++i) {
+            const auto & action = actions[std::size_t(i*7) % actions.size()];
+            (void)a.step_turn(action);
+            (void)b.step_turn(action);
+        }
+        return ts::test(all_columns && same_board(a.blocks(), b.blocks()));
+    });
+    return suite.has_successes_only();
+}
+
+
+bool test_random(ts::TestSuite & suite) {
+    suite.start_series("random");
+    // the same seed and stream is the same sequence, another stream isn't
+    suite.test([]() {
+        Pcg32 a { 0x5EEDu, 3 }, b { 0x5EEDu, 3 }, c { 0x5EEDu, 4 };
+        bool same = true, all_same_as_other = true;
+        for (int i = 0; i != 100; ++i) {
+            auto n = a();
+            same = same && n == b();
+            all_same_as_other = all_same_as_other && n == c();
+        }
+        return ts::test(same && !all_same_as_other);
+    });
+    suite.test([]() {
+        Pcg32 rng { 0x5EEDu };
+        auto split = rng.split();
+        return ts::test(split != rng);
+    });
+    suite.test([]() {
+        Pcg32 rng { 0x5EEDu };
+        std::array<int, 6> counts = {};
+        bool in_bounds = true;
+        for (int i = 0; i != 6000; ++i) {
+            int n = random_int(rng, 1, 6);
+            in_bounds = in_bounds && n >= 1 && n <= 6;
+            if (in_bounds) ++counts[std::size_t(n - 1)];
+        }
+        bool all_drawn = std::all_of(counts.begin(), counts.end(),
+                                     [](int count) { return count > 800; });
+        return ts::test(in_bounds && all_drawn);
+    });
+    suite.test([]() {
+        using IntLims = std::numeric_limits<int>;
+        Pcg32 rng { 0x5EEDu };
+        bool in_bounds = true;
+        // the full range takes the generator's draw as is, which should land
+        // on both sides of zero
+        int negatives = 0;
+        for (int i = 0; i != 1000; ++i) {
+            auto x = random_real(rng, 0.75, 1.2);
+            auto n = random_int(rng, IntLims::min(), IntLims::max());
+            in_bounds = in_bounds && x >= 0.75 && x < 1.2
+                        && n >= IntLims::min() && n <= IntLims::max();
+            if (n < 0) ++negatives;
+        }
+        return ts::test(in_bounds && negatives > 400 && negatives < 600);
+    });
+    // pairs are the same however far ahead they're asked for
+    suite.test([]() {
+        ColorPairQueue a { 0x5EEDu, 4 }, b { 0x5EEDu, 4 };
+        auto far = a.pair_at(200);
+        bool same = true;
+        for (std::size_t i = 0; i != 201; ++i) {
+            auto [first, second] = b.pair_at(i);
+            same = same && is_block_color(first) && is_block_color(second)
+                   && a.pair_at(i) == std::make_pair(first, second);
+        }
+        return ts::test(same && far == b.pair_at(200));
+    });
+    suite.test([]() {
+        try {
+            ColorPairQueue queue { 0x5EEDu, k_max_colors + 1 };
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    return suite.has_successes_only();
+}
+
+
+bool test_replay(ts::TestSuite & suite) {
+    suite.start_series("replay");
+    using PlayControlArray = ReplayLog::PlayControlArray;
+    using Pcs = PlayControlState;
+    struct EventRecorder final : public PlayControlEventReceiver {
+        void handle_event(PlayControlEvent event) override
+            { events.push_back(event); }
+        std::vector<PlayControlEvent> events;
+    };
+    // states as a handler would hold them over some frames, including a
+    // press and release inside of one frame
+    static const auto make_frames = []() {
+        std::vector<PlayControlArray> rv;
+        PlayControlArray states;
+        std::fill(states.begin(), states.end(), Pcs::still_released);
+        auto set = [&states](PlayControlId id, Pcs state)
+            { states[std::size_t(id)] = state; };
+        for (int i = 0; i != 300; ++i) {
+            if (i == 10) set(PlayControlId::left, Pcs::just_pressed);
+            if (i == 40) set(PlayControlId::left, Pcs::just_released);
+            if (i == 41) set(PlayControlId::rotate_left, Pcs::just_released);
+            if (i == 42) set(PlayControlId::down, Pcs::still_pressed);
+            if (i == 200) set(PlayControlId::down, Pcs::just_released);
+            rv.push_back(states);
+            PlayControlEventHandler::degrade_states(states);
+        }
+        return rv;
+    };
+    static const auto record = [](const std::vector<PlayControlArray> & frames) {
+        ReplayHeader header;
+        header.game = ReplayGame::tetris;
+        header.seeds.root = 0x5EEDu;
+        header.seeds.counts[1] = 3;
+        header.tetris.width = 8;
+        ReplayLog log(header);
+        for (const auto & states : frames) log.push_frame(states);
+        return log;
+    };
+    static const auto play = [](const ReplayLog & log) {
+        EventRecorder recorder;
+        ReplayPlayer player(log);
+        while (!player.is_finished()) player.send_frame(recorder);
+        return recorder.events;
+    };
+    auto frames = make_frames();
+    EventRecorder expected;
+    for (auto states : frames) {
+        PlayControlEventHandler::send_events(states, expected);
+    }
+
+    suite.test([&frames, &expected]() {
+        auto log = record(frames);
+        return ts::test(   log.frame_count() == int(frames.size())
+                        && play(log) == expected.events);
+    });
+    // idle frames cost nothing
+    suite.test([&frames]() {
+        return ts::test(record(frames).frame_data().size() <= 16);
+    });
+    suite.test([&frames, &expected]() {
+        auto log = record(frames);
+        std::stringstream sstrm;
+        log.save(sstrm);
+        auto loaded = ReplayLog::load(sstrm);
+        const auto & header = loaded.header();
+        return ts::test(   header.game == ReplayGame::tetris
+                        && header.seeds.root == 0x5EEDu && header.seeds.counts[1] == 3
+                        && header.tetris.width == 8
+                        && header.tetris.enabled_polyominos == log.header().tetris.enabled_polyominos
+                        && loaded.frame_count() == log.frame_count()
+                        && play(loaded) == expected.events);
+    });
+    suite.test([&frames]() {
+        std::stringstream sstrm;
+        record(frames).save(sstrm);
+        auto bytes = sstrm.str();
+        bytes.pop_back();
+        std::stringstream truncated { bytes };
+        try {
+            (void)ReplayLog::load(truncated);
+        } catch (std::runtime_error &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    // keyed every fifty frames, each holding its own number
+    static const auto make_header = []() {
+        ReplayHeader header;
+        header.game = ReplayGame::puyo_scenario;
+        return header;
+    };
+    static const auto record_keyed = [](const std::vector<PlayControlArray> & frames) {
+        ReplayLog log { make_header() };
+        for (const auto & states : frames) {
+            if (log.frame_count() % 50 == 0) {
+                std::vector<uint8_t> state { uint8_t(log.frame_count() / 50) };
+                log.push_keyframe(ByteView(state));
+            }
+            log.push_frame(states);
+        }
+        std::stringstream sstrm;
+        log.save(sstrm);
+        return ReplayLog::load(sstrm);
+    };
+    // events from the frame on
+    static const auto play_from = [](ReplayPlayer & player, int frame) {
+        EventRecorder recorder;
+        while (!player.is_finished()) {
+            if (player.frame() < frame) {
+                EventRecorder skipped;
+                player.send_frame(skipped);
+            } else {
+                player.send_frame(recorder);
+            }
+        }
+        return recorder.events;
+    };
+    suite.test([&frames]() {
+        auto log = record_keyed(frames);
+        ReplayKeyframe keyframe;
+        bool found = log.find_keyframe(120, keyframe);
+        return ts::test(   log.keyframe_count() == 6 && found && keyframe.frame == 100
+                        && keyframe.board_state == std::vector<uint8_t> { 2 });
+    });
+    // resuming from any keyframe sends what playing up to it would have
+    suite.test([&frames]() {
+        auto log = record_keyed(frames);
+        bool all_match = true;
+        for (int frame : { 0, 40, 50, 199, 250, 299 }) {
+            ReplayKeyframe keyframe;
+            if (!log.find_keyframe(frame, keyframe)) return ts::test(false);
+            ReplayPlayer from_start(log), from_keyframe(log);
+            from_keyframe.seek(keyframe);
+            all_match =    all_match
+                        && play_from(from_start, keyframe.frame) == play_from(from_keyframe, 0);
+        }
+        return ts::test(all_match);
+    });
+    suite.test([]() {
+        std::stringstream sstrm;
+        ReplayLog(make_header()).save(sstrm);
+        auto loaded = ReplayLog::load(sstrm);
+        ReplayKeyframe keyframe;
+        return ts::test(   loaded.keyframe_count() == 0
+                        && !loaded.find_keyframe(0, keyframe));
+    });
+    // a keyed puyo board carries on as the one it was taken from
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        BlockGrid start {
+            { e_, e_, e_, e_ },
+            { e_, e_, e_, e_ },
+            { e_, e_, e_, e_ },
+            { g_, e_, r_, e_ },
+            { r_, g_, b_, y_ }
+        };
+        PuyoBoard board, restored;
+        for (auto * board_ptr : { &board, &restored }) {
+            board_ptr->set_size(start.width(), start.height(), 0x5EEDu);
+        }
+        board.push_fall_in_blocks(start);
+        while (board.is_ready()) board.update(0.5);
+        board.push_falling_piece(r_, b_);
+        board.push_falling_piece(g_, y_);
+        board.update(0.1);
+
+        PuyoBoard::Snapshot snapshot, decoded;
+        board.save_snapshot(snapshot);
+        std::vector<uint8_t> bytes;
+        ReplayEncoder encoder(bytes);
+        PuyoBoard::encode_snapshot(snapshot, encoder);
+        ReplayDecoder decoder { ByteView(bytes) };
+        PuyoBoard::decode_snapshot(decoder, decoded);
+        restored.restore_snapshot(decoded);
+        // until the piece lands and everything settles
+        bool both_ready = true;
+        while (both_ready && board.is_ready()) {
+            board   .update(0.25);
+            restored.update(0.25);
+            both_ready = board.is_ready() == restored.is_ready();
+        }
+        return ts::test(   decoder.at_end() && both_ready
+                        && std::equal(board.blocks().begin(), board.blocks().end(),
+                                      restored.blocks().begin(), restored.blocks().end())
+                        && board.current_piece().location() == restored.current_piece().location()
+                        && board.next_piece() == restored.next_piece());
+    });
+    // seeking while pops are playing leaves none of them behind
+    suite.test([]() {
+        using namespace BlockIdShorthand;
+        PuyoBoard board, seeking;
+        for (auto * board_ptr : { &board, &seeking }) {
+            board_ptr->set_size(4, 3, 0x5EEDu);
+        }
+        BlockGrid empty;
+        empty.set_size(4, 3);
+        board.push_fall_in_blocks(empty);
+        while (board.is_ready()) board.update(0.5);
+        board.push_falling_piece(r_, b_);
+        board.push_falling_piece(g_, y_);
+        board.update(0.1);
+        PuyoBoard::Snapshot snapshot;
+        board.save_snapshot(snapshot);
+
+        seeking.push_fall_in_blocks(BlockGrid({
+            { e_, e_, e_, e_ },
+            { e_, e_, e_, e_ },
+            { r_, r_, r_, r_ }
+        }));
+        // the row falls in, then pops (its effects play on after it is gone)
+        auto has_blocks = [&seeking]() {
+            return std::any_of(seeking.blocks().begin(), seeking.blocks().end(),
+                               [](BlockId block) { return block != k_empty_block; });
+        };
+        while (seeking.is_ready() && has_blocks()) seeking.update(0.05);
+        seeking.update(0.05);
+        bool was_popping = seeking.is_ready() && !seeking.has_only_piece_in_play();
+        seeking.restore_snapshot(snapshot);
+        return ts::test(   was_popping && seeking.has_only_piece_in_play()
+                        && std::equal(board.blocks().begin(), board.blocks().end(),
+                                      seeking.blocks().begin(), seeking.blocks().end()));
+    });
+    return suite.has_successes_only();
+}
+
+bool test_netplay(ts::TestSuite & suite) {
+    suite.start_series("netplay");
+    using PlayControlArray = PuyoRollbackSession::PlayControlArray;
+    using Pcs = PlayControlState;
+    static constexpr const uint64_t k_seed = 0xC0FFEEu;
+    static const auto make_released = []() {
+        PlayControlArray states;
+        std::fill(states.begin(), states.end(), Pcs::still_released);
+        return states;
+    };
+    // a player mashing movement and rotation
+    struct ScriptedPlayer {
+        explicit ScriptedPlayer(uint64_t seed): rng(seed) {}
+        PlayControlArray next() {
+            PlayControlEventHandler::degrade_states(states);
+            static const std::array<PlayControlId, 5> k_ids = {
+                PlayControlId::left, PlayControlId::right, PlayControlId::down,
+                PlayControlId::rotate_left, PlayControlId::rotate_right
+            };
+            if (rng() % 6 == 0) {
+                auto & state = states[std::size_t(k_ids[rng() % k_ids.size()])];
+                state = is_pressed(state) ? Pcs::just_released : Pcs::just_pressed;
+            }
+            return states;
+        }
+        Pcg32 rng;
+        PlayControlArray states = make_released();
+    };
+    // both ends of a session over a slow, lossy link
+    struct Match {
+        Match() {
+            ConditionedLink::Conditions conditions;
+            conditions.latency = 0.06;
+            conditions.jitter  = 0.03;
+            conditions.loss    = 0.25;
+            auto links = PacketLink::make_loopback_pair();
+            ends[0] = std::make_unique<PuyoRollbackSession>
+                (0, k_seed, std::make_unique<ConditionedLink>(std::move(links.first ), conditions, 1));
+            ends[1] = std::make_unique<PuyoRollbackSession>
+                (1, 0, std::make_unique<ConditionedLink>(std::move(links.second), conditions, 2));
+            for (auto & sent : controls_sent) {
+                sent.assign(std::size_t(NetplaySettings().input_delay), make_released());
+            }
+        }
+        void advance(const std::array<PlayControlArray, 2> & controls) {
+            for (int i = 0; i != 2; ++i) {
+                if (ends[i]->advance(controls[i])) controls_sent[i].push_back(controls[i]);
+            }
+        }
+        std::array<std::unique_ptr<PuyoRollbackSession>, 2> ends;
+        // local controls of each stepped frame, including those delayed
+        std::array<std::vector<PlayControlArray>, 2> controls_sent;
+    };
+    // steps a simulation of its own with what each end actually sent, so
+    // frames with nothing from the other end yet are played as released
+    // (which is also what the end predicts, after a long enough idle)
+    static const auto replay_to = [](const Match & match, int frame) {
+        PuyoVsSimulation simulation { k_seed };
+        while (simulation.frame() != frame) {
+            PuyoVsSimulation::PlayerControls controls;
+            for (int i = 0; i != 2; ++i) {
+                const auto & sent = match.controls_sent[i];
+                auto f = std::size_t(simulation.frame());
+                controls[i] = f < sent.size() ? sent[f] : make_released();
+            }
+            simulation.step(controls);
+        }
+        return simulation.checksum();
+    };
+    static const auto play = [](Match & match, int frames, int idle_frames) {
+        ScriptedPlayer players[2] = { ScriptedPlayer(3), ScriptedPlayer(4) };
+        for (int i = 0; i != frames; ++i) {
+            match.advance({ players[0].next(), players[1].next() });
+        }
+        for (int i = 0; i != idle_frames; ++i) {
+            match.advance({ make_released(), make_released() });
+        }
+    };
+
+    // neither end steps until it hears from the other
+    suite.test([]() {
+        Match match;
+        match.advance({ make_released(), make_released() });
+        bool waited =    !match.ends[0]->is_connected() && !match.ends[1]->is_connected()
+                      && match.controls_sent[0].size() == match.controls_sent[1].size();
+        play(match, 0, 60);
+        return ts::test(   waited
+                        && match.ends[0]->is_connected() && match.ends[1]->is_connected());
+    });
+    // despite mispredictions and losses, each end ends up where playing
+    // every control as it was sent would have
+    suite.test([]() {
+        Match match;
+        play(match, 900, 300);
+        const auto & a = *match.ends[0];
+        const auto & b = *match.ends[1];
+        return ts::test(   a.rollbacks() > 0 && b.rollbacks() > 0
+                        && a.frame() > 900 && b.frame() > 900
+                        && a.simulation().checksum() == replay_to(match, a.frame())
+                        && b.simulation().checksum() == replay_to(match, b.frame()));
+    });
+    suite.test([]() {
+        Match match;
+        play(match, 300, 0);
+        auto & a = *match.ends[0];
+        auto before = a.simulation().checksum();
+        a.roll_back_to(a.frame() - NetplaySettings().max_rollback);
+        return ts::test(before == a.simulation().checksum());
+    });
+    suite.test([]() {
+        Match match;
+        play(match, 60, 0);
+        auto & a = *match.ends[0];
+        try {
+            a.roll_back_to(a.frame() - NetplaySettings().max_rollback - 1);
+        } catch (std::invalid_argument &) {
+            return ts::test(true);
+        }
+        return ts::test(false);
+    });
+    // going back as far as allowed fits well inside of a frame
+    suite.test([]() {
+        using Clock = std::chrono::steady_clock;
+        static constexpr const int k_rollbacks = 100;
+        Match match;
+        play(match, 300, 0);
+        auto & a = *match.ends[0];
+        auto start = Clock::now();
+        for (int i = 0; i != k_rollbacks; ++i) {
+            a.roll_back_to(a.frame() - NetplaySettings().max_rollback);
+        }
+        double per_rollback = std::chrono::duration<double>(Clock::now() - start).count()
+            / k_rollbacks;
+        return ts::test(per_rollback < PuyoVsSimulation::k_frame_time);
+    });
     return suite.has_successes_only();
 }
 